@@ -0,0 +1,237 @@
+/*
+ * BackgroundTaskScheduler.cpp
+ *
+ * Copyright (C) 2009-11 by RStudio, Inc.
+ *
+ * This program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <core/BackgroundTaskScheduler.hpp>
+
+#include <algorithm>
+
+#include <boost/bind.hpp>
+#include <boost/foreach.hpp>
+
+#include <core/Error.hpp>
+#include <core/Log.hpp>
+#include <core/Thread.hpp>
+
+namespace core {
+namespace thread {
+
+BackgroundTaskScheduler::BackgroundTaskScheduler(std::size_t maxThreads)
+   : maxThreads_(std::max(maxThreads, std::size_t(1))),
+     pMutex_(new boost::mutex()),
+     pWaitCondition_(new boost::condition()),
+     nextId_(1),
+     idleThreads_(0),
+     stopped_(false)
+{
+}
+
+BackgroundTaskScheduler::~BackgroundTaskScheduler()
+{
+   try
+   {
+      stop();
+   }
+   catch(...)
+   {
+   }
+}
+
+BackgroundTaskScheduler::TaskId BackgroundTaskScheduler::schedule(
+                                             const Task& task,
+                                             Priority priority,
+                                             const Completion& onCompleted)
+{
+   TaskId id = 0;
+
+   LOCK_MUTEX(*pMutex_)
+   {
+      if (stopped_)
+         return id;
+
+      QueuedTask queuedTask;
+      queuedTask.id = id = nextId_++;
+      queuedTask.task = task;
+      queuedTask.onCompleted = onCompleted;
+      queues_[priority].push_back(queuedTask);
+      pending_.insert(id);
+
+      ensureThread();
+   }
+   END_LOCK_MUTEX
+
+   pWaitCondition_->notify_one();
+   return id;
+}
+
+void BackgroundTaskScheduler::cancel(TaskId id)
+{
+   // (queued tasks are discarded when they reach the front of the queue)
+   LOCK_MUTEX(*pMutex_)
+   {
+      pending_.erase(id);
+   }
+   END_LOCK_MUTEX
+}
+
+std::size_t BackgroundTaskScheduler::processCompletions()
+{
+   std::deque<std::pair<TaskId,Completion> > completions;
+   LOCK_MUTEX(*pMutex_)
+   {
+      completions.swap(completions_);
+   }
+   END_LOCK_MUTEX
+
+   std::size_t processed = 0;
+   typedef std::pair<TaskId,Completion> TaskCompletion;
+   BOOST_FOREACH(const TaskCompletion& completion, completions)
+   {
+      // skip tasks cancelled since they completed
+      bool cancelled = true;
+      LOCK_MUTEX(*pMutex_)
+      {
+         cancelled = pending_.erase(completion.first) == 0;
+      }
+      END_LOCK_MUTEX
+      if (cancelled)
+         continue;
+
+      try
+      {
+         completion.second();
+      }
+      CATCH_UNEXPECTED_EXCEPTION
+
+      processed++;
+   }
+
+   return processed;
+}
+
+std::size_t BackgroundTaskScheduler::pendingTasks()
+{
+   LOCK_MUTEX(*pMutex_)
+   {
+      return pending_.size();
+   }
+   END_LOCK_MUTEX
+
+   // keep compiler happy
+   return 0;
+}
+
+void BackgroundTaskScheduler::stop()
+{
+   std::vector<boost::shared_ptr<boost::thread> > threads;
+   LOCK_MUTEX(*pMutex_)
+   {
+      stopped_ = true;
+      for (int i = PriorityLow; i <= PriorityHigh; i++)
+         queues_[i].clear();
+      pending_.clear();
+      completions_.clear();
+      threads.swap(threads_);
+   }
+   END_LOCK_MUTEX
+
+   pWaitCondition_->notify_all();
+
+   BOOST_FOREACH(boost::shared_ptr<boost::thread> pThread, threads)
+   {
+      if (!pThread->timed_join(boost::posix_time::seconds(3)))
+      {
+         LOG_WARNING_MESSAGE("Background task didn't stop within 3 sec");
+         pThread->detach();
+      }
+   }
+}
+
+// NOTE: called with the mutex held
+void BackgroundTaskScheduler::ensureThread()
+{
+   if (idleThreads_ > 0 || threads_.size() >= maxThreads_)
+      return;
+
+   boost::shared_ptr<boost::thread> pThread(new boost::thread());
+   safeLaunchThread(boost::bind(&BackgroundTaskScheduler::workerMain, this),
+                    pThread.get());
+   if (pThread->joinable())
+      threads_.push_back(pThread);
+}
+
+void BackgroundTaskScheduler::workerMain()
+{
+   QueuedTask task;
+   while (nextTask(&task))
+   {
+      try
+      {
+         task.task();
+      }
+      CATCH_UNEXPECTED_EXCEPTION
+
+      taskCompleted(task);
+   }
+}
+
+bool BackgroundTaskScheduler::nextTask(QueuedTask* pTask)
+{
+   try
+   {
+      boost::unique_lock<boost::mutex> lock(*pMutex_);
+      while (!stopped_)
+      {
+         // highest priority task which hasn't been cancelled
+         for (int i = PriorityHigh; i >= PriorityLow; i--)
+         {
+            while (!queues_[i].empty())
+            {
+               *pTask = queues_[i].front();
+               queues_[i].pop_front();
+               if (pending_.find(pTask->id) != pending_.end())
+                  return true;
+            }
+         }
+
+         idleThreads_++;
+         pWaitCondition_->wait(lock);
+         idleThreads_--;
+      }
+   }
+   catch(const boost::thread_resource_error& e)
+   {
+      Error waitError(boost::thread_error::ec_from_exception(e),
+                      ERROR_LOCATION);
+      LOG_ERROR(waitError);
+   }
+
+   return false;
+}
+
+void BackgroundTaskScheduler::taskCompleted(const QueuedTask& task)
+{
+   LOCK_MUTEX(*pMutex_)
+   {
+      if (pending_.find(task.id) == pending_.end())
+         return;
+
+      if (task.onCompleted)
+         completions_.push_back(std::make_pair(task.id, task.onCompleted));
+      else
+         pending_.erase(task.id);
+   }
+   END_LOCK_MUTEX
+}
+
+} // namespace thread
+} // namespace core
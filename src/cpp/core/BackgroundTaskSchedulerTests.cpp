@@ -0,0 +1,155 @@
+/*
+ * BackgroundTaskSchedulerTests.cpp
+ *
+ * Copyright (C) 2009-11 by RStudio, Inc.
+ *
+ * This program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <core/BackgroundTaskScheduler.hpp>
+
+#include <vector>
+
+#include <boost/assert.hpp>
+#include <boost/bind.hpp>
+
+#include <core/BoostThread.hpp>
+
+namespace core {
+namespace thread {
+
+namespace {
+
+typedef BackgroundTaskScheduler Scheduler;
+
+void sleepMs(int ms)
+{
+   boost::this_thread::sleep(boost::posix_time::milliseconds(ms));
+}
+
+void appendValue(boost::mutex* pMutex, std::vector<int>* pValues, int value)
+{
+   boost::lock_guard<boost::mutex> lock(*pMutex);
+   pValues->push_back(value);
+}
+
+std::size_t countValues(boost::mutex* pMutex, const std::vector<int>& values)
+{
+   boost::lock_guard<boost::mutex> lock(*pMutex);
+   return values.size();
+}
+
+void waitFor(const volatile bool* pReleased)
+{
+   while (!*pReleased)
+      sleepMs(1);
+}
+
+void runCompletions(Scheduler* pScheduler)
+{
+   while (pScheduler->pendingTasks() > 0)
+   {
+      pScheduler->processCompletions();
+      sleepMs(1);
+   }
+}
+
+// with a single thread queued tasks start in priority order
+void testPriorities()
+{
+   Scheduler scheduler(1);
+   boost::mutex mutex;
+   std::vector<int> started;
+   volatile bool released = false;
+
+   scheduler.schedule(boost::bind(waitFor, &released));
+   scheduler.schedule(boost::bind(appendValue, &mutex, &started, 1),
+                      Scheduler::PriorityLow);
+   scheduler.schedule(boost::bind(appendValue, &mutex, &started, 2),
+                      Scheduler::PriorityNormal);
+   scheduler.schedule(boost::bind(appendValue, &mutex, &started, 3),
+                      Scheduler::PriorityHigh);
+   scheduler.schedule(boost::bind(appendValue, &mutex, &started, 4),
+                      Scheduler::PriorityHigh);
+   released = true;
+   runCompletions(&scheduler);
+
+   BOOST_ASSERT(started.size() == 4);
+   BOOST_ASSERT(started[0] == 3 && started[1] == 4);
+   BOOST_ASSERT(started[2] == 2 && started[3] == 1);
+}
+
+// completions run on the calling thread (and not at all once cancelled)
+void testCompletions()
+{
+   Scheduler scheduler(4);
+   boost::mutex mutex;
+   std::vector<int> ran, completed;
+
+   std::vector<Scheduler::TaskId> ids;
+   for (int i = 0; i < 20; i++)
+   {
+      ids.push_back(scheduler.schedule(
+                  boost::bind(appendValue, &mutex, &ran, i),
+                  Scheduler::PriorityNormal,
+                  boost::bind(appendValue, &mutex, &completed, i)));
+   }
+   runCompletions(&scheduler);
+   BOOST_ASSERT(ran.size() == 20);
+   BOOST_ASSERT(completed.size() == 20);
+
+   // cancel a task which has run but whose completion hasn't
+   ran.clear();
+   completed.clear();
+   Scheduler::TaskId id = scheduler.schedule(
+                  boost::bind(appendValue, &mutex, &ran, 0),
+                  Scheduler::PriorityNormal,
+                  boost::bind(appendValue, &mutex, &completed, 0));
+   while (countValues(&mutex, ran) == 0)
+      sleepMs(1);
+   scheduler.cancel(id);
+   BOOST_ASSERT(scheduler.pendingTasks() == 0);
+   BOOST_ASSERT(scheduler.processCompletions() == 0);
+   BOOST_ASSERT(completed.empty());
+}
+
+// cancelled tasks which haven't started are never run
+void testCancel()
+{
+   Scheduler scheduler(1);
+   boost::mutex mutex;
+   std::vector<int> ran;
+   volatile bool released = false;
+
+   scheduler.schedule(boost::bind(waitFor, &released));
+   Scheduler::TaskId id = scheduler.schedule(
+                                 boost::bind(appendValue, &mutex, &ran, 1));
+   scheduler.schedule(boost::bind(appendValue, &mutex, &ran, 2));
+   scheduler.cancel(id);
+   released = true;
+   runCompletions(&scheduler);
+
+   BOOST_ASSERT(ran.size() == 1 && ran[0] == 2);
+
+   // nothing is scheduled once stopped
+   scheduler.stop();
+   BOOST_ASSERT(scheduler.schedule(
+                  boost::bind(appendValue, &mutex, &ran, 3)) == 0);
+}
+
+} // anonymous namespace
+
+void runBackgroundTaskSchedulerTests()
+{
+   testPriorities();
+   testCompletions();
+   testCancel();
+}
+
+} // namespace thread
+} // namespace core
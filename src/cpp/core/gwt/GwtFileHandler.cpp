@@ -13,9 +13,15 @@
 
 #include <core/gwt/GwtFileHandler.hpp>
 
+#include <map>
+#include <list>
+#include <sstream>
+
 #include <boost/regex.hpp>
+#include <boost/iostreams/copy.hpp>
 
 #include <core/FilePath.hpp>
+#include <core/Thread.hpp>
 #include <core/system/System.hpp>
 #include <core/http/Request.hpp>
 #include <core/http/Response.hpp>
@@ -85,6 +91,234 @@ FilePath requestedFile(const std::string& wwwLocalPath,
 
 }
 
+#ifndef _WIN32
+
+Error gzipFile(const FilePath& filePath, std::string* pCompressed)
+{
+   boost::shared_ptr<std::istream> pIfs;
+   Error error = filePath.open_r(&pIfs);
+   if (error)
+      return error;
+
+   try
+   {
+      // NOTE: copy closes the stream (writing the gzip trailer)
+      boost::iostreams::filtering_ostream filteringStream;
+      filteringStream.push(boost::iostreams::gzip_compressor());
+      filteringStream.push(boost::iostreams::back_inserter(*pCompressed));
+      boost::iostreams::copy(*pIfs, filteringStream);
+      return Success();
+   }
+   catch(const std::exception& e)
+   {
+      Error error = systemError(boost::system::errc::io_error,
+                                ERROR_LOCATION);
+      error.addProperty("what", e.what());
+      error.addProperty("path", filePath.absolutePath());
+      return error;
+   }
+}
+
+// LRU cache of the gzipped contents of static files (so that large GWT
+// bundles aren't compressed again for every request). entries are keyed
+// by path and are discarded if the file's size or write time changes
+class CompressedFileCache : boost::noncopyable
+{
+public:
+   CompressedFileCache(std::size_t maxBytes, std::size_t maxFileBytes)
+      : maxBytes_(maxBytes), maxFileBytes_(maxFileBytes), bytes_(0)
+   {
+   }
+
+   // get the compressed contents of a file (pCompressed is left empty if
+   // the file is too large to be cached)
+   Error get(const FilePath& filePath,
+             boost::shared_ptr<const std::string>* pCompressed)
+   {
+      std::string path = filePath.absolutePath();
+      std::time_t lastWriteTime = filePath.lastWriteTime();
+      uintmax_t size = filePath.size();
+      if (size > maxFileBytes_)
+         return Success();
+
+      LOCK_MUTEX(mutex_)
+      {
+         Entries::iterator it = entries_.find(path);
+         if (it != entries_.end() &&
+             it->second.lastWriteTime == lastWriteTime &&
+             it->second.size == size)
+         {
+            // move to the front of the lru list
+            lru_.splice(lru_.begin(), lru_, it->second.lruIt);
+            *pCompressed = it->second.pCompressed;
+            return Success();
+         }
+      }
+      END_LOCK_MUTEX
+
+      // compress outside of the lock (concurrent misses for the same
+      // file just do some redundant work)
+      boost::shared_ptr<std::string> pNewCompressed(new std::string());
+      Error error = gzipFile(filePath, pNewCompressed.get());
+      if (error)
+         return error;
+
+      LOCK_MUTEX(mutex_)
+      {
+         remove(path);
+
+         lru_.push_front(path);
+         Entry entry;
+         entry.lastWriteTime = lastWriteTime;
+         entry.size = size;
+         entry.pCompressed = pNewCompressed;
+         entry.lruIt = lru_.begin();
+         entries_[path] = entry;
+         bytes_ += pNewCompressed->size();
+
+         // evict least recently used entries
+         while (bytes_ > maxBytes_ && lru_.size() > 1)
+            remove(lru_.back());
+      }
+      END_LOCK_MUTEX
+
+      *pCompressed = pNewCompressed;
+      return Success();
+   }
+
+private:
+   // requires mutex_ to be held
+   void remove(const std::string& path)
+   {
+      Entries::iterator it = entries_.find(path);
+      if (it != entries_.end())
+      {
+         bytes_ -= it->second.pCompressed->size();
+         lru_.erase(it->second.lruIt);
+         entries_.erase(it);
+      }
+   }
+
+private:
+   struct Entry
+   {
+      std::time_t lastWriteTime;
+      uintmax_t size;
+      boost::shared_ptr<const std::string> pCompressed;
+      std::list<std::string>::iterator lruIt;
+   };
+   typedef std::map<std::string, Entry> Entries;
+
+   boost::mutex mutex_;
+   std::size_t maxBytes_;
+   std::size_t maxFileBytes_;
+   std::size_t bytes_;
+   Entries entries_;
+   std::list<std::string> lru_;
+};
+
+CompressedFileCache s_compressedFileCache(64 * 1024 * 1024,
+                                          16 * 1024 * 1024);
+
+#endif
+
+// strong validator for a file (the compressed representation has its
+// own tag since its bytes differ)
+std::string fileETag(const FilePath& filePath, bool gzip)
+{
+   std::ostringstream ostr;
+   ostr << "\"" << std::hex << filePath.lastWriteTime() << "-"
+        << filePath.size() << (gzip ? "-gz" : "") << "\"";
+   return ostr.str();
+}
+
+void setFileResponse(const FilePath& filePath,
+                     const http::Request& request,
+                     bool validate,
+                     http::Response* pResponse)
+{
+   // ensure that the file exists
+   if (!filePath.exists())
+   {
+      pResponse->setError(http::status::NotFound,
+                          request.uri() + " not found");
+      return;
+   }
+
+#ifndef _WIN32
+   bool gzip = request.acceptsEncoding(http::kGzipEncoding);
+#else
+   bool gzip = false;
+#endif
+
+   // set validators and check them against the request
+   if (validate)
+   {
+      using namespace boost::posix_time;
+      ptime lastModifiedDate = from_time_t(filePath.lastWriteTime());
+      pResponse->setHeader("Last-Modified",
+                           http::util::httpDate(lastModifiedDate));
+
+      std::string eTag = fileETag(filePath, gzip);
+      pResponse->setHeader("ETag", eTag);
+
+      if (eTag == request.headerValue("If-None-Match") ||
+          lastModifiedDate == request.ifModifiedSince())
+      {
+         pResponse->removeHeader("Content-Type");
+         pResponse->setStatusCode(http::status::NotModified);
+         return;
+      }
+   }
+
+   pResponse->setContentType(filePath.mimeContentType());
+   pResponse->setHeader("Vary", "Accept-Encoding");
+
+   Error error;
+   if (!gzip)
+   {
+      error = pResponse->setStreamBody(filePath);
+   }
+#ifndef _WIN32
+   else
+   {
+      // use a precompressed sibling if there is an up to date one (note
+      // that the encoding is set after the body so it isn't re-gzipped)
+      FilePath gzPath(filePath.absolutePath() + ".gz");
+      boost::shared_ptr<const std::string> pCompressed;
+      if (gzPath.exists() &&
+          gzPath.lastWriteTime() >= filePath.lastWriteTime())
+      {
+         error = pResponse->setStreamBody(gzPath);
+      }
+
+      // otherwise use the compressed file cache
+      else
+      {
+         error = s_compressedFileCache.get(filePath, &pCompressed);
+         if (!error && pCompressed)
+            pResponse->setBodyUnencoded(*pCompressed);
+
+         // too large to cache, compress as it is streamed
+         else if (!error)
+         {
+            pResponse->setContentEncoding(http::kGzipEncoding);
+            error = pResponse->setStreamBody(filePath);
+         }
+      }
+
+      pResponse->setContentEncoding(http::kGzipEncoding);
+   }
+#endif
+
+   if (error)
+   {
+      LOG_ERROR(error);
+      pResponse->setError(http::status::InternalServerError,
+                          error.code().message());
+   }
+}
+
 void handleFileRequest(const std::string& wwwLocalPath,
                        const std::string& baseUri,
                        core::http::UriFilterFunction mainPageFilter,
@@ -148,14 +382,14 @@ void handleFileRequest(const std::string& wwwLocalPath,
    if (regex_match(uri, boost::regex(".*\\.cache\\..*")))
    {
       pResponse->setCacheForeverHeaders();
-      pResponse->setFile(filePath, request);
+      setFileResponse(filePath, request, true, pResponse);
    }
    
    // case: files designated to never be cached 
    else if (regex_match(uri, boost::regex(".*\\.nocache\\..*")))
    {
       pResponse->setNoCacheHeaders();
-      pResponse->setFile(filePath, request);
+      setFileResponse(filePath, request, false, pResponse);
    }
    
    // case: normal cacheable file
@@ -163,7 +397,7 @@ void handleFileRequest(const std::string& wwwLocalPath,
    {
       // since these are application components we force revalidation
       pResponse->setCacheWithRevalidationHeaders();
-      pResponse->setCacheableFile(filePath, request);
+      setFileResponse(filePath, request, true, pResponse);
    }
   
 }
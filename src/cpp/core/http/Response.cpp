@@ -133,11 +133,24 @@ void Response::setDynamicHtml(const std::string& html,
    setBody(html);
 }
    
+void Response::setStreamBody(const boost::shared_ptr<StreamBody>& pBody)
+{
+   body_.clear();
+   streamBody_ = pBody;
+
+   boost::int64_t length = pBody->length();
+   if (length >= 0)
+      setHeader("Content-Length", boost::lexical_cast<std::string>(length));
+   else
+      removeHeader("Content-Length");
+}
+
 void Response::setBodyUnencoded(const std::string& body)
 {
    removeHeader("Content-Encoding");
    body_ = body;
    setContentLength(body_.length());
+   streamBody_.reset();
 }
    
    
@@ -173,6 +186,7 @@ void Response::resetMembers()
 	statusCode_ = status::Ok ;
 	statusCodeStr_.clear() ;
 	statusMessage_.clear() ;
+	streamBody_.reset();
 }
    
 void Response::removeCachingHeaders()
@@ -0,0 +1,158 @@
+/*
+ * StreamBody.cpp
+ *
+ * Copyright (C) 2009-11 by RStudio, Inc.
+ *
+ * This program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <core/http/StreamBody.hpp>
+
+#include <sstream>
+#include <algorithm>
+
+#ifdef __linux__
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/sendfile.h>
+#endif
+
+#include <core/Log.hpp>
+
+namespace core {
+namespace http {
+
+const std::size_t StreamBody::kBlockSize;
+
+const std::string kChunkTrailer = "\r\n";
+const std::string kLastChunk = "0\r\n\r\n";
+
+std::string chunkHeader(std::size_t size)
+{
+   std::ostringstream ostr;
+   ostr << std::hex << size << "\r\n";
+   return ostr.str();
+}
+
+Error FileStreamBody::create(const FilePath& filePath,
+                             boost::shared_ptr<StreamBody>* pBody)
+{
+   boost::shared_ptr<std::istream> pStream;
+   Error error = filePath.open_r(&pStream);
+   if (error)
+      return error;
+
+   boost::int64_t length = filePath.size();
+   pBody->reset(new FileStreamBody(filePath, pStream, length));
+   return Success();
+}
+
+Error FileStreamBody::nextBlock(std::string* pBlock)
+{
+   pBlock->resize(kBlockSize);
+   pStream_->read(&((*pBlock)[0]), kBlockSize);
+   if (pStream_->bad())
+   {
+      Error error = systemError(boost::system::errc::io_error,
+                                ERROR_LOCATION);
+      error.addProperty("path", filePath_.absolutePath());
+      return error;
+   }
+
+   pBlock->resize(pStream_->gcount());
+   return Success();
+}
+
+#ifdef __linux__
+
+Error sendFile(int socket,
+               int fileDescriptor,
+               boost::int64_t* pOffset,
+               boost::int64_t count,
+               bool* pWouldBlock)
+{
+   *pWouldBlock = false;
+
+   // limit the size of any one call so other connections get a turn
+   const boost::int64_t kMaxSend = 1024 * 1024;
+
+   off_t offset = *pOffset;
+   ssize_t sent = -1;
+   do
+   {
+      sent = ::sendfile(socket,
+                        fileDescriptor,
+                        &offset,
+                        std::min(count, kMaxSend));
+   }
+   while (sent == -1 && errno == EINTR);
+
+   if (sent == -1)
+   {
+      if (errno == EAGAIN || errno == EWOULDBLOCK)
+      {
+         *pWouldBlock = true;
+         return Success();
+      }
+      else
+      {
+         return systemError(errno, ERROR_LOCATION);
+      }
+   }
+
+   // the file was truncated after the length was sent
+   if (sent == 0 && count > 0)
+      return systemError(boost::system::errc::io_error, ERROR_LOCATION);
+
+   *pOffset = offset;
+   return Success();
+}
+
+Error sendFile(int socket,
+               const boost::shared_ptr<StreamBody>& pBody,
+               bool* pSent)
+{
+   *pSent = false;
+
+   int fd = ::open(pBody->file().absolutePath().c_str(), O_RDONLY);
+   if (fd == -1)
+      return Success();
+
+   Error error;
+   boost::int64_t offset = 0;
+   while (offset < pBody->length())
+   {
+      bool wouldBlock;
+      error = sendFile(socket, fd, &offset, pBody->length() - offset,
+                       &wouldBlock);
+      if (error)
+         break;
+
+      // shouldn't happen for a blocking socket
+      if (wouldBlock)
+      {
+         error = systemError(
+                     boost::system::errc::resource_unavailable_try_again,
+                     ERROR_LOCATION);
+         break;
+      }
+   }
+
+   ::close(fd);
+
+   if (!error)
+      *pSent = true;
+   return error;
+}
+
+#endif
+
+} // namespace http
+} // namespace core
+
@@ -0,0 +1,114 @@
+/*
+ * BackgroundTaskScheduler.hpp
+ *
+ * Copyright (C) 2009-11 by RStudio, Inc.
+ *
+ * This program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef CORE_BACKGROUND_TASK_SCHEDULER_HPP
+#define CORE_BACKGROUND_TASK_SCHEDULER_HPP
+
+#include <set>
+#include <deque>
+#include <vector>
+
+#include <boost/utility.hpp>
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/cstdint.hpp>
+
+#include <core/BoostThread.hpp>
+
+namespace core {
+namespace thread {
+
+// Runs tasks on a bounded pool of worker threads (created as they are
+// needed). Queued tasks are started in priority order and then in the
+// order they were scheduled.
+//
+// A task may have a completion handler. Completion handlers are queued
+// as tasks finish and run by the thread which owns the scheduler when it
+// calls processCompletions. Tasks can therefore compute results without
+// touching shared state, while completion handlers apply those results
+// without locking.
+//
+// A cancelled task isn't started if it is still queued. If it is already
+// running then its completion handler isn't run.
+class BackgroundTaskScheduler : boost::noncopyable
+{
+public:
+   enum Priority
+   {
+      PriorityLow = 0,
+      PriorityNormal = 1,
+      PriorityHigh = 2
+   };
+
+   typedef boost::function<void()> Task;
+   typedef boost::function<void()> Completion;
+   typedef boost::uint64_t TaskId;
+
+   explicit BackgroundTaskScheduler(std::size_t maxThreads);
+   virtual ~BackgroundTaskScheduler();
+
+   // COPYING: boost::noncopyable
+
+public:
+   TaskId schedule(const Task& task,
+                   Priority priority = PriorityNormal,
+                   const Completion& onCompleted = Completion());
+
+   void cancel(TaskId id);
+
+   // run the completion handlers of finished tasks (returns the number
+   // of handlers run)
+   std::size_t processCompletions();
+
+   // tasks which have been scheduled but not yet completed or cancelled
+   std::size_t pendingTasks();
+
+   // stop the worker threads (queued tasks are discarded and running
+   // tasks are waited for briefly)
+   void stop();
+
+private:
+   struct QueuedTask
+   {
+      TaskId id;
+      Task task;
+      Completion onCompleted;
+   };
+
+   void ensureThread();
+   void workerMain();
+   bool nextTask(QueuedTask* pTask);
+   void taskCompleted(const QueuedTask& task);
+
+private:
+   const std::size_t maxThreads_;
+
+   // synchronization objects (heap based and never freed for the same
+   // reasons as ThreadsafeQueue)
+   boost::mutex* pMutex_;
+   boost::condition* pWaitCondition_;
+
+   // instance data (guarded by the mutex)
+   TaskId nextId_;
+   std::deque<QueuedTask> queues_[PriorityHigh + 1];
+   std::set<TaskId> pending_;
+   std::deque<std::pair<TaskId,Completion> > completions_;
+   std::size_t idleThreads_;
+   bool stopped_;
+   std::vector<boost::shared_ptr<boost::thread> > threads_;
+};
+
+} // namespace thread
+} // namespace core
+
+#endif // CORE_BACKGROUND_TASK_SCHEDULER_HPP
@@ -14,6 +14,8 @@
 #ifndef CORE_HTTP_ASYNC_CLIENT_HPP
 #define CORE_HTTP_ASYNC_CLIENT_HPP
 
+#include <algorithm>
+
 #include <boost/shared_ptr.hpp>
 #include <boost/function.hpp>
 #include <boost/enable_shared_from_this.hpp>
@@ -22,12 +24,15 @@
 #include <boost/asio/io_service.hpp>
 #include <boost/asio/placeholders.hpp>
 #include <boost/asio/streambuf.hpp>
+#include <boost/asio/buffers_iterator.hpp>
 #include <boost/asio/read.hpp>
 #include <boost/asio/read_until.hpp>
 #include <boost/asio/deadline_timer.hpp>
+#include <boost/algorithm/string/predicate.hpp>
 
 #include <core/Error.hpp>
 #include <core/Log.hpp>
+#include <core/SafeConvert.hpp>
 
 #include <core/http/Request.hpp>
 #include <core/http/Response.hpp>
@@ -54,6 +59,19 @@ namespace http {
 typedef boost::function<void(const http::Response&)> ResponseHandler;
 typedef boost::function<void(const core::Error&)> ErrorHandler;
 
+// handlers for streamed responses. the headers handler is called once the
+// headers have been read and then the block handler is called with each
+// block of the body (as it was read, i.e. without removing any chunked
+// encoding). an empty block indicates the end of the body. the handlers
+// call the passed function when they are ready for the next block
+typedef boost::function<void()> ReadNextBlockFunction;
+typedef boost::function<void(const http::Response&,
+                             const ReadNextBlockFunction&)>
+                                                   StreamHeadersHandler;
+typedef boost::function<void(const std::string&,
+                             const ReadNextBlockFunction&)>
+                                                   StreamBlockHandler;
+
 
 template <typename SocketService>
 class AsyncClient :
@@ -63,7 +81,11 @@ class AsyncClient :
 public:
    AsyncClient(boost::asio::io_service& ioService)
       : ioService_(ioService),
-        connectionRetryContext_(ioService)
+        connectionRetryContext_(ioService),
+        keepAlive_(false),
+        contentLength_(-1),
+        streamedLength_(0),
+        streaming_(false)
    {
    }
 
@@ -95,6 +117,22 @@ public:
       connectAndWriteRequest();
    }
 
+   // execute the async client, passing the body of the response on as it
+   // is read rather than waiting for all of it (the connection is closed
+   // after a streamed response unless keep-alive was requested and the
+   // response gives its length)
+   void executeStreaming(const StreamHeadersHandler& headersHandler,
+                         const StreamBlockHandler& blockHandler,
+                         const ErrorHandler& errorHandler)
+   {
+      streaming_ = true;
+      streamHeadersHandler_ = headersHandler;
+      streamBlockHandler_ = blockHandler;
+      errorHandler_ = errorHandler;
+
+      connectAndWriteRequest();
+   }
+
    void close()
    {
       Error error = closeSocket(socket().lowest_layer());
@@ -108,6 +146,31 @@ protected:
 
    virtual SocketService& socket() = 0;
 
+   // request that the server keep the connection open after the response
+   // (subclasses which pool connections call this before writing)
+   void setKeepAlive(bool keepAlive)
+   {
+      keepAlive_ = keepAlive;
+   }
+
+   // called once the full response has been read. reusable indicates that
+   // the server agreed to keep the connection open and the end of the
+   // response was determined without reading to eof (subclasses which
+   // pool connections can then keep the socket rather than closing it)
+   virtual void onResponseComplete(bool reusable)
+   {
+      close();
+   }
+
+   // called if the connection fails before any of the response is read.
+   // subclasses return true if they are retrying the request on a fresh
+   // connection (e.g. because the failed one had been idle in a pool and
+   // was closed by the server in the meantime)
+   virtual bool retryOnNewConnection()
+   {
+      return false;
+   }
+
    void handleConnectionError(const Error& connectionError)
    {
       // retry if necessary, otherwise just forward the error to
@@ -121,10 +184,17 @@ protected:
    // they finish connecting)
    void writeRequest()
    {
+      // reset any state from a previous attempt
+      responseBuffer_.consume(responseBuffer_.size());
+      contentLength_ = -1;
+      streamedLength_ = 0;
+
       // write
       boost::asio::async_write(
           socket(),
-          request_.toBuffers(Header::connectionClose()),
+          request_.toBuffers(keepAlive_ ?
+                                Header("Connection", "keep-alive") :
+                                Header::connectionClose()),
           boost::bind(
                &AsyncClient<SocketService>::handleWrite,
                AsyncClient<SocketService>::shared_from_this(),
@@ -259,7 +329,7 @@ private:
                           AsyncClient<SocketService>::shared_from_this(),
                           boost::asio::placeholders::error));
          }
-         else
+         else if (!retryOnNewConnection())
          {
             handleErrorCode(ec, ERROR_LOCATION);
          }
@@ -292,7 +362,7 @@ private:
                              boost::asio::placeholders::error));
             }
          }
-         else
+         else if (!retryOnNewConnection())
          {
             handleErrorCode(ec, ERROR_LOCATION);
          }
@@ -320,12 +390,31 @@ private:
             // parse headers
             ResponseParser::parseHeaders(&responseBuffer_, &response_);
 
+            // if we asked for keep-alive and know the length then we can
+            // tell when the body is complete (otherwise read until eof)
+            if (keepAlive_)
+            {
+               contentLength_ = safe_convert::stringTo<int>(
+                        response_.headerValue("Content-Length"), -1);
+            }
+
+            // streamed responses pass on the headers and then the body
+            if (streaming_)
+            {
+               if (streamedContentComplete())
+                  onResponseComplete(isReusable());
+
+               streamHeadersHandler_(response_, readNextBlockFunction());
+               return;
+            }
+
             // append any lefover buffer contents to the body
             if (responseBuffer_.size() > 0)
                ResponseParser::appendToBody(&responseBuffer_, &response_);
 
             // start reading content
-            readSomeContent();
+            if (!checkContentComplete())
+               readSomeContent();
          }
          else
          {
@@ -335,21 +424,87 @@ private:
       CATCH_UNEXPECTED_ASYNC_CLIENT_EXCEPTION
    }
 
+   ReadNextBlockFunction readNextBlockFunction()
+   {
+      return boost::bind(&AsyncClient<SocketService>::readNextBlock,
+                         AsyncClient<SocketService>::shared_from_this());
+   }
+
+   void readNextBlock()
+   {
+      try
+      {
+         // end of a response of known length, otherwise pass on anything
+         // left over from reading the headers or read some more
+         if (streamedContentComplete())
+            streamBlockHandler_(std::string(), ReadNextBlockFunction());
+         else if (responseBuffer_.size() > 0)
+            passOnStreamedContent();
+         else
+            readSomeContent();
+      }
+      CATCH_UNEXPECTED_ASYNC_CLIENT_EXCEPTION
+   }
+
+   void passOnStreamedContent()
+   {
+      std::size_t size = responseBuffer_.size();
+      if (contentLength_ >= 0)
+      {
+         size = std::min(size, static_cast<std::size_t>(
+                                       contentLength_ - streamedLength_));
+      }
+
+      std::string block(
+         boost::asio::buffers_begin(responseBuffer_.data()),
+         boost::asio::buffers_begin(responseBuffer_.data()) + size);
+      responseBuffer_.consume(size);
+      streamedLength_ += static_cast<int>(size);
+
+      // the connection can be reused (or closed) as soon as all of the
+      // response has been read
+      if (streamedContentComplete())
+         onResponseComplete(isReusable());
+
+      streamBlockHandler_(block, readNextBlockFunction());
+   }
+
+   bool streamedContentComplete() const
+   {
+      return contentLength_ >= 0 && streamedLength_ >= contentLength_;
+   }
+
+   bool isReusable() const
+   {
+      return !boost::algorithm::iequals(response_.headerValue("Connection"),
+                                        "close");
+   }
+
    void handleReadContent(const boost::system::error_code& ec)
    {
       try
       {
-         if (!ec)
+         if (!ec && streaming_)
+         {
+            passOnStreamedContent();
+         }
+         else if (ec == boost::asio::error::eof && streaming_)
+         {
+            close();
+            streamBlockHandler_(std::string(), ReadNextBlockFunction());
+         }
+         else if (!ec)
          {
             // copy content
             ResponseParser::appendToBody(&responseBuffer_, &response_);
 
             // continue reading content
-            readSomeContent();
+            if (!checkContentComplete())
+               readSomeContent();
          }
          else if (ec == boost::asio::error::eof)
          {
-            close();
+            onResponseComplete(false);
 
             if (responseHandler_)
                responseHandler_(response_);
@@ -362,6 +517,22 @@ private:
       CATCH_UNEXPECTED_ASYNC_CLIENT_EXCEPTION
   }
 
+   bool checkContentComplete()
+   {
+      if (contentLength_ < 0 ||
+          response_.body().size() < static_cast<std::size_t>(contentLength_))
+      {
+         return false;
+      }
+
+      onResponseComplete(isReusable());
+
+      if (responseHandler_)
+         responseHandler_(response_);
+
+      return true;
+   }
+
 // struct and instance variable to track connection retry state
 private:
    struct ConnectionRetryContext
@@ -385,6 +556,12 @@ private:
    http::Request request_;
    boost::asio::streambuf responseBuffer_;
    http::Response response_;
+   bool keepAlive_;
+   int contentLength_;
+   int streamedLength_;
+   bool streaming_;
+   StreamHeadersHandler streamHeadersHandler_;
+   StreamBlockHandler streamBlockHandler_;
 };
    
 
@@ -14,6 +14,9 @@
 #ifndef CORE_HTTP_ASYNC_CONNECTION_HPP
 #define CORE_HTTP_ASYNC_CONNECTION_HPP
 
+#include <string>
+
+#include <boost/function.hpp>
 #include <boost/shared_ptr.hpp>
 #include <boost/asio/io_service.hpp>
 
@@ -45,6 +48,18 @@ public:
    // simple wrappers for writing an existing response or error
    virtual void writeResponse(const http::Response& response) = 0;
    virtual void writeError(const Error& error) = 0;
+
+   // write the response headers and then each block of the body as it
+   // becomes available (e.g. when proxying a streamed response). the body
+   // is written as-is (so it must already be chunk encoded if the response
+   // specifies that). the end of the response is marked by closing the
+   // connection unless the response gives its Content-Length (in which
+   // case the connection may be kept open). the handler is called once
+   // each write completes and an empty block ends the response
+   typedef boost::function<void(const Error&)> WriteHandler;
+   virtual void writeResponseHeaders(const WriteHandler& handler) = 0;
+   virtual void writeResponseBlock(const std::string& block,
+                                   const WriteHandler& handler) = 0;
 };
 
 } // namespace http
@@ -22,12 +22,23 @@
 #include <boost/asio/write.hpp>
 #include <boost/asio/io_service.hpp>
 #include <boost/asio/placeholders.hpp>
+#include <boost/asio/socket_base.hpp>
+#include <boost/asio/deadline_timer.hpp>
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+
+#ifdef __linux__
+#include <unistd.h>
+#include <fcntl.h>
+#endif
 
 #include <core/Error.hpp>
 #include <core/Log.hpp>
+#include <core/SafeConvert.hpp>
 
 #include <core/http/Request.hpp>
 #include <core/http/Response.hpp>
+#include <core/http/StreamBody.hpp>
 #include <core/http/SocketUtils.hpp>
 #include <core/http/RequestParser.hpp>
 #include <core/http/AsyncConnection.hpp>
@@ -49,15 +60,36 @@ public:
    typedef boost::function<void(http::Response*)> ResponseFilter;
 
 public:
+   // connections are kept open after a response (for up to maxRequests
+   // requests) if the client asks for this. the connection is closed if
+   // the next request doesn't begin to arrive within idleTimeout
    AsyncConnectionImpl(boost::asio::io_service& ioService,
                        const Handler& handler,
-                       const ResponseFilter& responseFilter =ResponseFilter())
+                       const ResponseFilter& responseFilter =ResponseFilter(),
+                       const boost::posix_time::time_duration& idleTimeout =
+                                             boost::posix_time::seconds(60),
+                       std::size_t maxRequests = 100)
       : ioService_(ioService),
         socket_(ioService),
         handler_(handler),
-        responseFilter_(responseFilter)
-        
+        responseFilter_(responseFilter),
+        idleTimeout_(idleTimeout),
+        maxRequests_(maxRequests),
+        requestCount_(0),
+        badRequest_(false),
+        keepAlive_(false),
+        idleTimer_(ioService),
+        idle_(false),
+        chunked_(false),
+        blockLength_(0),
+        sendFileDescriptor_(-1),
+        sendFileOffset_(0)
+   {
+   }
+
+   virtual ~AsyncConnectionImpl()
    {
+      closeSendFile();
    }
    
    typename ProtocolType::socket& socket() 
@@ -89,18 +121,36 @@ public:
    {
       // add extra response headers
       response_.setHeader("Date", util::httpDate());
-      response_.setHeader("Connection", "close");
 
       // call the response filter if we have one
       if (responseFilter_)
          responseFilter_(&response_);
 
-      // write
+      // streamed bodies of unknown length are chunked for HTTP/1.1 clients
+      // (for HTTP/1.0 clients closing the connection marks the end)
+      pStreamBody_ = response_.streamBody();
+      chunked_ = pStreamBody_ &&
+                 pStreamBody_->length() < 0 &&
+                 !request_.isHttp10();
+      if (chunked_)
+         response_.setHeader("Transfer-Encoding", "chunked");
+
+      // in-memory bodies always have a known length
+      if (!pStreamBody_ && !response_.containsHeader("Content-Length"))
+         response_.setContentLength(response_.body().length());
+
+      // determine whether we'll keep the connection open
+      keepAlive_ = isKeepAlive();
+      response_.setHeader("Connection", keepAlive_ ? "keep-alive" : "close");
+
+      // write (streamed bodies are written after the headers)
       boost::asio::async_write(
           socket_,
           response_.toBuffers(),
           boost::bind(
-               &AsyncConnectionImpl<ProtocolType>::handleWrite,
+               pStreamBody_ ?
+                  &AsyncConnectionImpl<ProtocolType>::handleWriteHeaders :
+                  &AsyncConnectionImpl<ProtocolType>::handleWrite,
                AsyncConnectionImpl<ProtocolType>::shared_from_this(),
                boost::asio::placeholders::error)
       );
@@ -117,48 +167,214 @@ public:
       response_.setError(error);
       writeResponse();
    }
+
+   virtual void writeResponseHeaders(const WriteHandler& handler)
+   {
+      // add extra response headers
+      response_.setHeader("Date", util::httpDate());
+
+      // call the response filter if we have one
+      if (responseFilter_)
+         responseFilter_(&response_);
+
+      // the end of the body is marked by closing the connection unless
+      // the response gives its length
+      blockLength_ = 0;
+      if (response_.containsHeader("Content-Length") &&
+          !response_.containsHeader("Transfer-Encoding"))
+      {
+         keepAlive_ = isKeepAlive();
+      }
+      else
+      {
+         keepAlive_ = false;
+         response_.removeHeader("Content-Length");
+      }
+      response_.setHeader("Connection", keepAlive_ ? "keep-alive" : "close");
+
+      boost::asio::async_write(
+          socket_,
+          response_.toBuffers(),
+          boost::bind(
+               &AsyncConnectionImpl<ProtocolType>::handleWriteBlock,
+               AsyncConnectionImpl<ProtocolType>::shared_from_this(),
+               handler,
+               boost::asio::placeholders::error)
+      );
+   }
+
+   virtual void writeResponseBlock(const std::string& block,
+                                   const WriteHandler& handler)
+   {
+      // empty block -- end of the response (if the body was cut short then
+      // the connection must be closed to mark its end)
+      if (block.empty())
+      {
+         if (keepAlive_ &&
+             safe_convert::stringTo<boost::int64_t>(
+                  response_.headerValue("Content-Length"), -1) != blockLength_)
+         {
+            keepAlive_ = false;
+         }
+         handleWrite(boost::system::error_code());
+         return;
+      }
+
+      blockLength_ += block.size();
+      block_ = block;
+      boost::asio::async_write(
+          socket_,
+          boost::asio::buffer(block_),
+          boost::bind(
+               &AsyncConnectionImpl<ProtocolType>::handleWriteBlock,
+               AsyncConnectionImpl<ProtocolType>::shared_from_this(),
+               handler,
+               boost::asio::placeholders::error)
+      );
+   }
    
 private:
    
+   // keep the connection open if the client asked for it, the end of the
+   // response doesn't need to be marked by closing, and the client
+   // hasn't reached the maximum number of requests
+   bool isKeepAlive() const
+   {
+      if (badRequest_ || (requestCount_ + 1) >= maxRequests_)
+         return false;
+
+      std::string connection = request_.headerValue("Connection");
+      if (boost::algorithm::iequals(connection, "close"))
+         return false;
+      if (request_.isHttp10() &&
+          !boost::algorithm::iequals(connection, "keep-alive"))
+      {
+         return false;
+      }
+
+      return !pStreamBody_ || chunked_ || pStreamBody_->length() >= 0;
+   }
+
+   // parse request input (the remaining input after a complete request
+   // is kept for when the next request is read)
+   void parseInput(const char* begin, const char* end)
+   {
+      RequestParser::status status = requestParser_.parse(request_,
+                                                          &begin,
+                                                          end);
+      pipelinedInput_.assign(begin, end);
+
+      // error - return bad request
+      if (status == RequestParser::error)
+      {
+         badRequest_ = true;
+         response_.setStatusCode(http::status::BadRequest);
+         writeResponse();
+      }
+
+      // incomplete -- keep reading
+      else if (status == RequestParser::incomplete)
+      {
+         readSome();
+      }
+
+      // got valid request -- handle it
+      else
+      {
+         handler_(AsyncConnectionImpl<ProtocolType>::shared_from_this(),
+                  &request_);
+      }
+   }
+
+   // reset for the next request on a persistent connection
+   void readNextRequest()
+   {
+      requestCount_++;
+      requestParser_.reset();
+      request_.reset();
+      response_.reset();
+      pStreamBody_.reset();
+      chunked_ = false;
+      keepAlive_ = false;
+
+      // the client may have already sent the next request
+      if (!pipelinedInput_.empty())
+      {
+         std::string input;
+         input.swap(pipelinedInput_);
+         parseInput(input.data(), input.data() + input.size());
+         return;
+      }
+
+      // otherwise wait for it (closing the connection if it doesn't
+      // arrive within the idle timeout)
+      boost::system::error_code ec;
+      idleTimer_.expires_from_now(idleTimeout_, ec);
+      if (ec)
+      {
+         LOG_ERROR(Error(ec, ERROR_LOCATION));
+         closeConnection();
+         return;
+      }
+
+      idle_ = true;
+      idleTimer_.async_wait(boost::bind(
+               &AsyncConnectionImpl<ProtocolType>::handleIdleTimeout,
+               AsyncConnectionImpl<ProtocolType>::shared_from_this(),
+               boost::asio::placeholders::error));
+
+      readSome();
+   }
+
+   void handleIdleTimeout(const boost::system::error_code& e)
+   {
+      try
+      {
+         // close the connection if we are still waiting (this will cause
+         // the pending read to complete with an error)
+         if (e != boost::asio::error::operation_aborted && idle_)
+            closeConnection();
+      }
+      CATCH_UNEXPECTED_EXCEPTION
+   }
+
+   void closeConnection()
+   {
+      Error error = closeSocket(socket_);
+      if (error)
+         LOG_ERROR(error);
+   }
+
    void handleRead(const boost::system::error_code& e,
                    std::size_t bytesTransferred)
    {
       try
       {
+         // no longer idle once the client sends something
+         bool wasIdle = idle_;
+         if (idle_)
+         {
+            idle_ = false;
+            boost::system::error_code ec;
+            idleTimer_.cancel(ec);
+         }
+
          if (!e)
          {
             // parse next chunk
-            RequestParser::status status = requestParser_.parse(
-                                             request_,
-                                             buffer_.data(), 
-                                             buffer_.data() + bytesTransferred);
-            
-            // error - return bad request
-            if (status == RequestParser::error)
-            {
-               response_.setStatusCode(http::status::BadRequest);
-               writeResponse();
-            }
-            
-            // incomplete -- keep reading
-            else if (status == RequestParser::incomplete)
-            {
-               readSome();
-            }
-            
-            // got valid request -- handle it 
-            else
-            {
-               handler_(AsyncConnectionImpl<ProtocolType>::shared_from_this(),
-                        &request_);
-            }
+            parseInput(buffer_.data(), buffer_.data() + bytesTransferred);
          }
          else // error reading
          {
-            // log the error if it wasn't connection terminated
+            // log the error if it wasn't connection terminated (or the
+            // client closing or timing out an idle persistent connection)
             Error error(e, ERROR_LOCATION);
-            if (!isConnectionTerminatedError(error))
+            if (!isConnectionTerminatedError(error) &&
+                !(requestCount_ > 0 &&
+                  (wasIdle || e == boost::asio::error::operation_aborted)))
+            {
                LOG_ERROR(error);
+            }
             
             // close the socket
             error = closeSocket(socket_);
@@ -175,6 +391,30 @@ private:
    }
    
 
+   void handleWriteBlock(const WriteHandler& handler,
+                         const boost::system::error_code& e)
+   {
+      try
+      {
+         if (e)
+         {
+            // the response can't be completed so close the connection
+            // (logging the error if it wasn't connection terminated)
+            Error error(e, ERROR_LOCATION);
+            if (!http::isConnectionTerminatedError(error))
+               LOG_ERROR(error);
+            closeConnection();
+
+            handler(error);
+         }
+         else
+         {
+            handler(Success());
+         }
+      }
+      CATCH_UNEXPECTED_EXCEPTION
+   }
+
    void handleWrite(const boost::system::error_code& e)
    {
       try
@@ -186,11 +426,14 @@ private:
             if (!http::isConnectionTerminatedError(error))
                LOG_ERROR(error);
          }
+         else if (keepAlive_)
+         {
+            readNextRequest();
+            return;
+         }
          
          // close the socket
-         Error error = closeSocket(socket_);
-         if (error)
-            LOG_ERROR(error);
+         closeConnection();
          
          //
          // no more async operations are initiated here so the shared_ptr to 
@@ -200,6 +443,180 @@ private:
       CATCH_UNEXPECTED_EXCEPTION
    }
    
+   void handleWriteHeaders(const boost::system::error_code& e)
+   {
+      try
+      {
+         if (e)
+         {
+            handleWrite(e);
+            return;
+         }
+
+#ifdef __linux__
+         // send unfiltered files directly from the file to the socket
+         if (!chunked_ && !pStreamBody_->file().empty() && beginSendFile())
+            return;
+#endif
+
+         writeNextBlock();
+      }
+      CATCH_UNEXPECTED_EXCEPTION
+   }
+
+   void handleWriteBlock(const boost::system::error_code& e)
+   {
+      try
+      {
+         if (e)
+            handleWrite(e);
+         else
+            writeNextBlock();
+      }
+      CATCH_UNEXPECTED_EXCEPTION
+   }
+
+   // write the next block of a streamed body (or the final chunk if the
+   // body is complete)
+   void writeNextBlock()
+   {
+      Error error = pStreamBody_->nextBlock(&block_);
+      if (error)
+      {
+         // the headers are already written so all we can do is close
+         LOG_ERROR(error);
+         keepAlive_ = false;
+         handleWrite(boost::system::error_code());
+         return;
+      }
+
+      if (block_.empty())
+      {
+         pStreamBody_.reset();
+         if (chunked_)
+         {
+            boost::asio::async_write(
+               socket_,
+               boost::asio::buffer(kLastChunk),
+               boost::bind(
+                  &AsyncConnectionImpl<ProtocolType>::handleWrite,
+                  AsyncConnectionImpl<ProtocolType>::shared_from_this(),
+                  boost::asio::placeholders::error)
+            );
+         }
+         else
+         {
+            handleWrite(boost::system::error_code());
+         }
+         return;
+      }
+
+      std::vector<boost::asio::const_buffer> buffers;
+      if (chunked_)
+      {
+         chunkHeader_ = chunkHeader(block_.size());
+         buffers.push_back(boost::asio::buffer(chunkHeader_));
+      }
+      buffers.push_back(boost::asio::buffer(block_));
+      if (chunked_)
+         buffers.push_back(boost::asio::buffer(kChunkTrailer));
+
+      boost::asio::async_write(
+         socket_,
+         buffers,
+         boost::bind(
+            &AsyncConnectionImpl<ProtocolType>::handleWriteBlock,
+            AsyncConnectionImpl<ProtocolType>::shared_from_this(),
+            boost::asio::placeholders::error)
+      );
+   }
+
+#ifdef __linux__
+   // returns false if the file couldn't be opened (in which case the body
+   // is read from its stream instead)
+   bool beginSendFile()
+   {
+      sendFileDescriptor_ = ::open(
+                  pStreamBody_->file().absolutePath().c_str(), O_RDONLY);
+      if (sendFileDescriptor_ == -1)
+         return false;
+
+      // sendfile needs to return rather than block when the socket is full
+      // (we then wait for it to become writeable again)
+      boost::system::error_code ec;
+      boost::asio::socket_base::non_blocking_io nonBlocking(true);
+      socket_.io_control(nonBlocking, ec);
+      if (ec)
+      {
+         closeSendFile();
+         return false;
+      }
+
+      sendFileOffset_ = 0;
+      sendNextFileBlock(boost::system::error_code());
+      return true;
+   }
+
+   void sendNextFileBlock(const boost::system::error_code& e)
+   {
+      try
+      {
+         if (e)
+         {
+            closeSendFile();
+            handleWrite(e);
+            return;
+         }
+
+         boost::int64_t length = pStreamBody_->length();
+         while (sendFileOffset_ < length)
+         {
+            bool wouldBlock;
+            Error error = sendFile(socket_.native(),
+                                   sendFileDescriptor_,
+                                   &sendFileOffset_,
+                                   length - sendFileOffset_,
+                                   &wouldBlock);
+            if (error)
+            {
+               // the body is incomplete so we need to close
+               LOG_ERROR(error);
+               keepAlive_ = false;
+               break;
+            }
+
+            if (wouldBlock)
+            {
+               socket_.async_write_some(
+                  boost::asio::null_buffers(),
+                  boost::bind(
+                     &AsyncConnectionImpl<ProtocolType>::sendNextFileBlock,
+                     AsyncConnectionImpl<ProtocolType>::shared_from_this(),
+                     boost::asio::placeholders::error)
+               );
+               return;
+            }
+         }
+
+         closeSendFile();
+         pStreamBody_.reset();
+         handleWrite(boost::system::error_code());
+      }
+      CATCH_UNEXPECTED_EXCEPTION
+   }
+#endif
+
+   void closeSendFile()
+   {
+#ifdef __linux__
+      if (sendFileDescriptor_ != -1)
+      {
+         ::close(sendFileDescriptor_);
+         sendFileDescriptor_ = -1;
+      }
+#endif
+   }
+
    void readSome()
    {
       socket_.async_read_some(
@@ -221,6 +638,25 @@ private:
    RequestParser requestParser_ ;
    http::Request request_;
    http::Response response_;
+
+   // state for persistent connections
+   boost::posix_time::time_duration idleTimeout_;
+   std::size_t maxRequests_;
+   std::size_t requestCount_;
+   bool badRequest_;
+   bool keepAlive_;
+   std::string pipelinedInput_;
+   boost::asio::deadline_timer idleTimer_;
+   bool idle_;
+
+   // state for writing streamed bodies
+   boost::shared_ptr<StreamBody> pStreamBody_;
+   bool chunked_;
+   std::string block_;
+   boost::int64_t blockLength_;
+   std::string chunkHeader_;
+   int sendFileDescriptor_;
+   boost::int64_t sendFileOffset_;
 };
    
 
@@ -50,7 +50,9 @@ public:
                const std::string& baseUri = std::string())
       : abortOnResourceError_(false),
         serverName_(serverName),
-        baseUri_(baseUri)
+        baseUri_(baseUri),
+        ioServicePerThread_(false),
+        nextIoService_(0)
    {
    }
    
@@ -63,6 +65,17 @@ public:
       abortOnResourceError_ = abortOnResourceError;
    }
    
+   // give each thread in the pool its own io_service rather than having
+   // all of the threads share one. connections are still accepted on a
+   // single io_service (with its own thread) and are then assigned to the
+   // per-thread io_services round robin, so the handlers for a given
+   // connection always run on the same thread and threads don't contend
+   // on a shared io_service queue. must be called prior to run
+   void setIoServicePerThread(bool ioServicePerThread)
+   {
+      ioServicePerThread_ = ioServicePerThread;
+   }
+
    void addHandler(const std::string& prefix,
                    const AsyncUriHandlerFunction& handler)
    {
@@ -103,16 +116,30 @@ public:
          if (error)
             return error ;
       
+         // create the per-thread io services (each has work associated
+         // with it so that it keeps running when it has no connections)
+         if (ioServicePerThread_)
+         {
+            for (std::size_t i=0; i < threadPoolSize; ++i)
+            {
+               boost::shared_ptr<boost::asio::io_service> pIoService(
+                                             new boost::asio::io_service());
+               ioServices_.push_back(pIoService);
+               ioServiceWork_.push_back(
+                  boost::shared_ptr<boost::asio::io_service::work>(
+                        new boost::asio::io_service::work(*pIoService)));
+            }
+
+            // dedicated thread for accepting connections
+            addServiceThread(&acceptorService_.ioService());
+         }
+
          // create the threads
          for (std::size_t i=0; i < threadPoolSize; ++i)
          {
-            // run the thread
-            boost::shared_ptr<boost::thread> pThread(new boost::thread(
-                              &AsyncServer<ProtocolType>::runServiceThread,
-                              this));
-            
-            // add to list of threads
-            threads_.push_back(pThread);            
+            addServiceThread(ioServicePerThread_ ?
+                                 ioServices_[i].get() :
+                                 &acceptorService_.ioService());
          }
       }
       catch(const boost::thread_resource_error& e)
@@ -134,6 +161,8 @@ public:
       
       // stop the server 
       acceptorService_.ioService().stop();
+      for (std::size_t i=0; i < ioServices_.size(); ++i)
+         ioServices_[i]->stop();
    }
    
    void waitUntilStopped()
@@ -146,25 +175,45 @@ public:
    
 private:
 
-   void runServiceThread()
+   void addServiceThread(boost::asio::io_service* pIoService)
+   {
+      boost::shared_ptr<boost::thread> pThread(new boost::thread(
+                        &AsyncServer<ProtocolType>::runServiceThread,
+                        this,
+                        pIoService));
+      threads_.push_back(pThread);
+   }
+
+   void runServiceThread(boost::asio::io_service* pIoService)
    {
       try
       {
          boost::system::error_code ec;
-         acceptorService_.ioService().run(ec);
+         pIoService->run(ec);
          if (ec)
             LOG_ERROR(Error(ec, ERROR_LOCATION));
       }
       CATCH_UNEXPECTED_EXCEPTION
    }
 
+   // io service for the next connection (only called from the acceptor's
+   // io service so needs no synchronization)
+   boost::asio::io_service& connectionIoService()
+   {
+      if (ioServices_.empty())
+         return acceptorService_.ioService();
+
+      nextIoService_ = (nextIoService_ + 1) % ioServices_.size();
+      return *ioServices_[nextIoService_];
+   }
+
    void acceptNextConnection()
    {
       // create a new connection 
       ptrNextConnection_.reset(new AsyncConnectionImpl<ProtocolType>(
                                                                  
          // controlling io_service
-         acceptorService_.ioService(),
+         connectionIoService(),
 
          // connection handler
          boost::bind(&AsyncServer<ProtocolType>::handleConnection,
@@ -340,6 +389,11 @@ private:
    AsyncUriHandlers uriHandlers_ ;
    AsyncUriHandlerFunction defaultHandler_;
    std::vector<boost::shared_ptr<boost::thread> > threads_;
+   bool ioServicePerThread_;
+   std::vector<boost::shared_ptr<boost::asio::io_service> > ioServices_;
+   std::vector<boost::shared_ptr<boost::asio::io_service::work> >
+                                                            ioServiceWork_;
+   std::size_t nextIoService_;
    SocketAcceptorService<ProtocolType> acceptorService_;
 };
 
@@ -23,6 +23,7 @@
 
 #include <core/http/AsyncClient.hpp>
 #include <core/http/LocalStreamSocketUtils.hpp>
+#include <core/http/LocalStreamConnectionPool.hpp>
 
 namespace core {
 namespace http {  
@@ -31,25 +32,47 @@ class LocalStreamAsyncClient
    : public AsyncClient<boost::asio::local::stream_protocol::socket>
 {
 public:
+   // if a connection pool is provided then idle connections from it are
+   // used when available (and connections are returned to it after the
+   // response is read)
    LocalStreamAsyncClient(boost::asio::io_service& ioService,
-                          const FilePath localStreamPath)
+                          const FilePath localStreamPath,
+                          LocalStreamConnectionPool* pConnectionPool = NULL)
      : AsyncClient<boost::asio::local::stream_protocol::socket>(ioService),
-       socket_(ioService),
-       localStreamPath_(localStreamPath)
+       pSocket_(new boost::asio::local::stream_protocol::socket(ioService)),
+       localStreamPath_(localStreamPath),
+       pConnectionPool_(pConnectionPool),
+       pooledSocket_(false)
    {
+      setKeepAlive(pConnectionPool_ != NULL);
    }
 
 protected:
 
    virtual boost::asio::local::stream_protocol::socket& socket()
    {
-      return socket_;
+      return *pSocket_;
    }
 
 private:
 
    virtual void connectAndWriteRequest()
    {
+      // use an idle connection if we have one
+      if (pConnectionPool_ != NULL)
+      {
+         boost::shared_ptr<boost::asio::local::stream_protocol::socket>
+            pSocket = pConnectionPool_->acquire(ioService(),
+                                                localStreamPath_);
+         if (pSocket)
+         {
+            pSocket_ = pSocket;
+            pooledSocket_ = true;
+            writeRequest();
+            return;
+         }
+      }
+
       // establish endpoint
       using boost::asio::local::stream_protocol;
       stream_protocol::endpoint endpoint(localStreamPath_.absolutePath());
@@ -62,6 +85,37 @@ private:
                      boost::asio::placeholders::error));
    }
 
+   virtual void onResponseComplete(bool reusable)
+   {
+      if (reusable && pConnectionPool_ != NULL)
+         pConnectionPool_->release(ioService(), localStreamPath_, pSocket_);
+      else
+         close();
+   }
+
+   virtual bool retryOnNewConnection()
+   {
+      // a pooled connection may have been closed by the server while it was
+      // idle -- discard it and try again on a new connection
+      if (pooledSocket_)
+      {
+         close();
+         pSocket_.reset(
+               new boost::asio::local::stream_protocol::socket(ioService()));
+         pooledSocket_ = false;
+
+         // don't use the pool for the retry (its other connections are
+         // likely also stale)
+         pConnectionPool_->clear(localStreamPath_);
+         connectAndWriteRequest();
+         return true;
+      }
+      else
+      {
+         return false;
+      }
+   }
+
    void handleConnect(const boost::system::error_code& ec)
    {
       try
@@ -89,8 +143,10 @@ private:
    }
 
 private:
-   boost::asio::local::stream_protocol::socket socket_;
+   boost::shared_ptr<boost::asio::local::stream_protocol::socket> pSocket_;
    core::FilePath localStreamPath_;
+   LocalStreamConnectionPool* pConnectionPool_;
+   bool pooledSocket_;
 };
    
    
@@ -0,0 +1,231 @@
+/*
+ * LocalStreamConnectionPool.hpp
+ *
+ * Copyright (C) 2009-11 by RStudio, Inc.
+ *
+ * This program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef CORE_HTTP_LOCAL_STREAM_CONNECTION_POOL_HPP
+#define CORE_HTTP_LOCAL_STREAM_CONNECTION_POOL_HPP
+
+#include <map>
+#include <deque>
+#include <vector>
+#include <string>
+
+#include <boost/utility.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/asio/io_service.hpp>
+#include <boost/asio/local/stream_protocol.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include <core/Thread.hpp>
+#include <core/FilePath.hpp>
+#include <core/http/SocketUtils.hpp>
+
+namespace core {
+namespace http {
+
+// Idle keep-alive connections to local stream servers. Connections are
+// keyed by stream path and io_service (a socket can only be used by
+// clients on the io_service it was created with). Connections which have
+// been idle for longer than the idle timeout are closed rather than
+// reused (connections to all streams are checked for expiry as others are
+// acquired and released), and clients retry on a new connection if a
+// pooled one turns out to have been closed by the server
+class LocalStreamConnectionPool : boost::noncopyable
+{
+public:
+   typedef boost::asio::local::stream_protocol::socket Socket;
+
+public:
+   LocalStreamConnectionPool(
+         std::size_t maxIdlePerStream = 8,
+         boost::posix_time::time_duration idleTimeout =
+                                       boost::posix_time::seconds(60))
+      : maxIdlePerStream_(maxIdlePerStream), idleTimeout_(idleTimeout)
+   {
+   }
+
+   // COPYING: boost::noncopyable
+
+public:
+   // get an idle connection (returns an empty pointer if there are none)
+   boost::shared_ptr<Socket> acquire(boost::asio::io_service& ioService,
+                                     const FilePath& streamPath)
+   {
+      using namespace boost::posix_time;
+      ptime now = microsec_clock::universal_time();
+
+      std::vector<boost::shared_ptr<Socket> > expired;
+      boost::shared_ptr<Socket> pSocket;
+
+      LOCK_MUTEX(mutex_)
+      {
+         Connections::iterator it = connections_.find(
+                                       key(ioService, streamPath));
+         if (it != connections_.end())
+         {
+            // most recently used connections are at the back
+            std::deque<IdleConnection>& idle = it->second;
+            while (!idle.empty())
+            {
+               IdleConnection connection = idle.back();
+               idle.pop_back();
+               if (now - connection.idleSince < idleTimeout_)
+               {
+                  pSocket = connection.pSocket;
+                  break;
+               }
+               expired.push_back(connection.pSocket);
+            }
+
+            if (idle.empty())
+               connections_.erase(it);
+         }
+
+         reapExpired(now, &expired);
+      }
+      END_LOCK_MUTEX
+
+      closeAll(expired);
+      return pSocket;
+   }
+
+   // return a connection to the pool once a response has been read
+   void release(boost::asio::io_service& ioService,
+                const FilePath& streamPath,
+                boost::shared_ptr<Socket> pSocket)
+   {
+      using namespace boost::posix_time;
+      ptime now = microsec_clock::universal_time();
+      IdleConnection connection;
+      connection.pSocket = pSocket;
+      connection.idleSince = now;
+
+      std::vector<boost::shared_ptr<Socket> > evicted;
+
+      LOCK_MUTEX(mutex_)
+      {
+         std::deque<IdleConnection>& idle =
+                              connections_[key(ioService, streamPath)];
+         idle.push_back(connection);
+
+         // discard the least recently used connections
+         while (idle.size() > maxIdlePerStream_)
+         {
+            evicted.push_back(idle.front().pSocket);
+            idle.pop_front();
+         }
+
+         reapExpired(now, &evicted);
+      }
+      END_LOCK_MUTEX
+
+      closeAll(evicted);
+   }
+
+   // close all of the idle connections to a stream (e.g. because the
+   // server at the other end has exited)
+   void clear(const FilePath& streamPath)
+   {
+      std::vector<boost::shared_ptr<Socket> > sockets;
+
+      LOCK_MUTEX(mutex_)
+      {
+         Connections::iterator it = connections_.begin();
+         while (it != connections_.end())
+         {
+            if (it->first.second == streamPath.absolutePath())
+            {
+               for (std::size_t i = 0; i < it->second.size(); i++)
+                  sockets.push_back(it->second[i].pSocket);
+               connections_.erase(it++);
+            }
+            else
+            {
+               ++it;
+            }
+         }
+      }
+      END_LOCK_MUTEX
+
+      closeAll(sockets);
+   }
+
+private:
+   typedef std::pair<boost::asio::io_service*, std::string> Key;
+
+   static Key key(boost::asio::io_service& ioService,
+                  const FilePath& streamPath)
+   {
+      return std::make_pair(&ioService, streamPath.absolutePath());
+   }
+
+   // remove expired connections to any stream (at most once a second)
+   // NOTE: called with the mutex held
+   void reapExpired(const boost::posix_time::ptime& now,
+                    std::vector<boost::shared_ptr<Socket> >* pExpired)
+   {
+      if (!lastReaped_.is_not_a_date_time() &&
+          now - lastReaped_ < boost::posix_time::seconds(1))
+      {
+         return;
+      }
+      lastReaped_ = now;
+
+      Connections::iterator it = connections_.begin();
+      while (it != connections_.end())
+      {
+         // least recently used connections are at the front
+         std::deque<IdleConnection>& idle = it->second;
+         while (!idle.empty() &&
+                now - idle.front().idleSince >= idleTimeout_)
+         {
+            pExpired->push_back(idle.front().pSocket);
+            idle.pop_front();
+         }
+
+         if (idle.empty())
+            connections_.erase(it++);
+         else
+            ++it;
+      }
+   }
+
+   static void closeAll(const std::vector<boost::shared_ptr<Socket> >& sockets)
+   {
+      for (std::size_t i = 0; i < sockets.size(); i++)
+      {
+         Error error = closeSocket(*sockets[i]);
+         if (error)
+            LOG_ERROR(error);
+      }
+   }
+
+   struct IdleConnection
+   {
+      boost::shared_ptr<Socket> pSocket;
+      boost::posix_time::ptime idleSince;
+   };
+
+   typedef std::map<Key, std::deque<IdleConnection> > Connections;
+
+private:
+   boost::mutex mutex_;
+   std::size_t maxIdlePerStream_;
+   boost::posix_time::time_duration idleTimeout_;
+   boost::posix_time::ptime lastReaped_;
+   Connections connections_;
+};
+
+} // namespace http
+} // namespace core
+
+#endif // CORE_HTTP_LOCAL_STREAM_CONNECTION_POOL_HPP
@@ -41,6 +41,16 @@ public:
   template <typename InputIterator>
   status parse(Request& req, InputIterator begin, InputIterator end)
   {
+    return parse(req, &begin, end);
+  }
+
+  // parse input up to the end of the request, leaving *pBegin positioned
+  // after the input consumed (any remaining input is the start of the next
+  // request on the connection if the client is pipelining requests)
+  template <typename InputIterator>
+  status parse(Request& req, InputIterator* pBegin, InputIterator end)
+  {
+    InputIterator& begin = *pBegin;
     while (begin != end)
     {
        // header parsing
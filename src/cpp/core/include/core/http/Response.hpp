@@ -29,6 +29,7 @@
 #include <core/FilePath.hpp>
 
 #include "Message.hpp"
+#include "StreamBody.hpp"
 #include "Request.hpp"
 #include "Util.hpp"
 
@@ -61,19 +62,6 @@ enum Code {
 };
 } 
     
-class NullOutputFilter : public boost::iostreams::multichar_output_filter 
-{   
-public:
-   template<typename Sink>
-   std::streamsize write(Sink& dest, const char* s, std::streamsize n)
-   {
-      // this class exists only as a "null" tag for the setBody Filter
-      // argument -- it should never actually be used as a filter!
-      BOOST_ASSERT(false); 
-      return boost::iostreams::write(dest, s, n);
-   }   
-};     
-   
 class Response : public Message
 {
 public:
@@ -88,6 +76,7 @@ public:
       statusCode_ = response.statusCode_;
       statusCodeStr_ = response.statusCodeStr_;
       statusMessage_ = response.statusMessage_;
+      streamBody_ = response.streamBody_;
    }
 
 public:   
@@ -191,6 +180,7 @@ public:
          // set body 
          body_ = bodyStream.str();
          setContentLength(body_.length());
+         streamBody_.reset();
          
          // return success
          return Success();
@@ -236,6 +226,55 @@ public:
       }
    }
 
+   // set a body which is written to the connection a block at a time
+   // (rather than being held in memory). the Content-Length is set if the
+   // length of the body is known in advance
+   void setStreamBody(const boost::shared_ptr<StreamBody>& pBody);
+
+   const boost::shared_ptr<StreamBody>& streamBody() const
+   {
+      return streamBody_;
+   }
+
+   Error setStreamBody(const FilePath& filePath)
+   {
+      NullOutputFilter nullFilter;
+      return setStreamBody(filePath, nullFilter);
+   }
+
+   template <typename Filter>
+   Error setStreamBody(const FilePath& filePath, const Filter& filter)
+   {
+      // never gzip on win32
+#ifdef _WIN32
+      if (contentEncoding() == kGzipEncoding)
+         removeHeader("Content-Encoding");
+#endif
+      bool gzip = contentEncoding() == kGzipEncoding;
+
+      boost::shared_ptr<StreamBody> pBody;
+
+      // unfiltered files are sent as-is (with a known length)
+      if (boost::is_same<Filter, NullOutputFilter>::value && !gzip)
+      {
+         Error error = FileStreamBody::create(filePath, &pBody);
+         if (error)
+            return error;
+      }
+      else
+      {
+         boost::shared_ptr<std::istream> pIfs;
+         Error error = filePath.open_r(&pIfs);
+         if (error)
+            return error;
+
+         pBody.reset(new FilteredStreamBody<Filter>(pIfs, filter, gzip));
+      }
+
+      setStreamBody(pBody);
+      return Success();
+   }
+
    void setDynamicHtml(const std::string& html, const Request& request);
    
    void setFile(const FilePath& filePath, const Request& request)
@@ -263,8 +302,8 @@ public:
       if (request.acceptsEncoding(kGzipEncoding))
          setContentEncoding(kGzipEncoding);
       
-      // set body from file
-      Error error = setBody(filePath, filter);
+      // stream body from file
+      Error error = setStreamBody(filePath, filter);
       if (error)
          setError(status::InternalServerError, error.code().message());
    }
@@ -336,6 +375,9 @@ private:
 
    // string storage for integer members (need for toBuffers)
    mutable std::string statusCodeStr_ ;
+
+   // body which is streamed rather than held in body_
+   boost::shared_ptr<StreamBody> streamBody_;
 };
 
 std::ostream& operator << (std::ostream& stream, const Response& r) ;
@@ -0,0 +1,256 @@
+/*
+ * StreamBody.hpp
+ *
+ * Copyright (C) 2009-11 by RStudio, Inc.
+ *
+ * This program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef CORE_HTTP_STREAM_BODY_HPP
+#define CORE_HTTP_STREAM_BODY_HPP
+
+#include <string>
+#include <vector>
+#include <iostream>
+
+#include <boost/utility.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/asio/write.hpp>
+#include <boost/asio/buffer.hpp>
+#include <boost/type_traits/is_same.hpp>
+#include <boost/iostreams/concepts.hpp>
+#include <boost/iostreams/device/back_inserter.hpp>
+#include <boost/iostreams/filtering_stream.hpp>
+
+#ifndef _WIN32
+#include <boost/iostreams/filter/gzip.hpp>
+#endif
+
+#include <core/Error.hpp>
+#include <core/FilePath.hpp>
+
+namespace core {
+namespace http {
+
+class NullOutputFilter : public boost::iostreams::multichar_output_filter
+{
+public:
+   template<typename Sink>
+   std::streamsize write(Sink& dest, const char* s, std::streamsize n)
+   {
+      // this class exists only as a "null" tag for the setBody Filter
+      // argument -- it should never actually be used as a filter!
+      BOOST_ASSERT(false);
+      return boost::iostreams::write(dest, s, n);
+   }
+};
+
+// Response body which is produced a block at a time as it is written to
+// the connection (so that memory use doesn't depend on the size of the
+// body). Bodies of unknown length are written using chunked transfer
+// encoding (or terminated by closing the connection for HTTP/1.0)
+class StreamBody : boost::noncopyable
+{
+public:
+   static const std::size_t kBlockSize = 65536;
+
+public:
+   virtual ~StreamBody() {}
+
+   // length of the body (-1 if it isn't known in advance)
+   virtual boost::int64_t length() const = 0;
+
+   // read the next block of the body (an empty block indicates the end)
+   virtual Error nextBlock(std::string* pBlock) = 0;
+
+   // file whose contents are exactly the body (allows connections to send
+   // it using sendfile). returns an empty path if there is no such file
+   virtual FilePath file() const { return FilePath(); }
+};
+
+// body read unchanged from a file
+class FileStreamBody : public StreamBody
+{
+public:
+   static Error create(const FilePath& filePath,
+                       boost::shared_ptr<StreamBody>* pBody);
+
+   virtual boost::int64_t length() const { return length_; }
+   virtual Error nextBlock(std::string* pBlock);
+   virtual FilePath file() const { return filePath_; }
+
+private:
+   FileStreamBody(const FilePath& filePath,
+                  boost::shared_ptr<std::istream> pStream,
+                  boost::int64_t length)
+      : filePath_(filePath), pStream_(pStream), length_(length)
+   {
+   }
+
+private:
+   FilePath filePath_;
+   boost::shared_ptr<std::istream> pStream_;
+   boost::int64_t length_;
+};
+
+// body read from a stream and passed through a filter and/or gzip
+// compressor (the filters are flushed once the end of the input is read)
+template <typename Filter>
+class FilteredStreamBody : public StreamBody
+{
+public:
+   FilteredStreamBody(boost::shared_ptr<std::istream> pStream,
+                      const Filter& filter,
+                      bool gzip)
+      : pStream_(pStream), finished_(false)
+   {
+      // don't bother adding the filter if it is the NullOutputFilter
+      if ( !boost::is_same<Filter, NullOutputFilter>::value )
+         filteringStream_.push(filter, kBlockSize);
+
+#ifndef _WIN32
+      if (gzip)
+         filteringStream_.push(boost::iostreams::gzip_compressor(),
+                               kBlockSize);
+#endif
+
+      filteringStream_.push(boost::iostreams::back_inserter(pending_),
+                            kBlockSize);
+   }
+
+   virtual boost::int64_t length() const { return -1; }
+
+   virtual Error nextBlock(std::string* pBlock)
+   {
+      try
+      {
+         // keep reading until the filters produce some output
+         while (pending_.empty() && !finished_)
+         {
+            pStream_->read(buffer_, kBlockSize);
+            std::streamsize read = pStream_->gcount();
+            if (read > 0)
+               filteringStream_.write(buffer_, read);
+
+            if (pStream_->bad())
+            {
+               return systemError(boost::system::errc::io_error,
+                                  ERROR_LOCATION);
+            }
+            else if (!pStream_->good())
+            {
+               // end of input -- popping the chain closes the filters
+               // (writing any remaining output e.g. the gzip trailer)
+               filteringStream_.reset();
+               finished_ = true;
+            }
+         }
+
+         pBlock->clear();
+         pBlock->swap(pending_);
+         return Success();
+      }
+      catch(const std::exception& e)
+      {
+         Error error = systemError(boost::system::errc::io_error,
+                                   ERROR_LOCATION);
+         error.addProperty("what", e.what());
+         return error;
+      }
+   }
+
+private:
+   boost::shared_ptr<std::istream> pStream_;
+   boost::iostreams::filtering_ostream filteringStream_;
+   std::string pending_;
+   bool finished_;
+   char buffer_[kBlockSize];
+};
+
+#ifdef __linux__
+// send up to count bytes of a file to a socket starting from *pOffset
+// (which is advanced past the bytes sent). if the socket is non-blocking
+// and can't accept any more data then pWouldBlock is set to true
+Error sendFile(int socket,
+               int fileDescriptor,
+               boost::int64_t* pOffset,
+               boost::int64_t count,
+               bool* pWouldBlock);
+
+// send the whole of a file body to a blocking socket. pSent is set to false
+// (with no error) if the file couldn't be opened so that the caller can
+// fall back to reading the body in blocks
+Error sendFile(int socket,
+               const boost::shared_ptr<StreamBody>& pBody,
+               bool* pSent);
+#endif
+
+// framing for chunked transfer encoding
+std::string chunkHeader(std::size_t size);
+extern const std::string kChunkTrailer;
+extern const std::string kLastChunk;
+
+// write the remainder of a streamed body to a blocking socket (the headers
+// must already have been written). chunked bodies are terminated with the
+// last chunk, and bodies read from files are sent using sendfile on linux
+template <typename SocketType>
+Error writeStreamBody(SocketType& socket,
+                      const boost::shared_ptr<StreamBody>& pBody,
+                      bool chunked)
+{
+   try
+   {
+#ifdef __linux__
+      if (!chunked && !pBody->file().empty())
+      {
+         bool sent = false;
+         Error error = sendFile(socket.native(), pBody, &sent);
+         if (error || sent)
+            return error;
+      }
+#endif
+
+      std::string block;
+      while (true)
+      {
+         Error error = pBody->nextBlock(&block);
+         if (error)
+            return error;
+
+         if (block.empty())
+            break;
+
+         std::vector<boost::asio::const_buffer> buffers;
+         std::string header;
+         if (chunked)
+         {
+            header = chunkHeader(block.size());
+            buffers.push_back(boost::asio::buffer(header));
+         }
+         buffers.push_back(boost::asio::buffer(block));
+         if (chunked)
+            buffers.push_back(boost::asio::buffer(kChunkTrailer));
+         boost::asio::write(socket, buffers);
+      }
+
+      if (chunked)
+         boost::asio::write(socket, boost::asio::buffer(kLastChunk));
+
+      return Success();
+   }
+   catch(const boost::system::system_error& e)
+   {
+      return Error(e.code(), ERROR_LOCATION);
+   }
+}
+
+} // namespace http
+} // namespace core
+
+#endif // CORE_HTTP_STREAM_BODY_HPP
@@ -15,8 +15,10 @@
 #define CORE_JSON_HPP
 
 #include <string>
-#include <iosfwd>
+#include <sstream>
 
+#include <boost/utility.hpp>
+#include <boost/cstdint.hpp>
 #include <boost/type_traits/is_same.hpp>
 
 #include <core/json/spirit/json_spirit_value.h>
@@ -70,7 +72,49 @@ json::Value toJsonString(const std::string& val);
 
 bool parse(const std::string& input, Value* pValue);
 
+// Appends json to a string (and optionally flushes it to a stream as it
+// grows). Values can be written whole or piece by piece (the latter allows
+// json to be written from other representations without building values)
+class Writer : boost::noncopyable
+{
+public:
+   explicit Writer(std::string* pOutput, std::ostream* pStream = NULL);
+   virtual ~Writer();
+
+   void write(const Value& value);
+
+   void writeString(const std::string& str)
+   {
+      writeString(str.data(), str.size());
+   }
+   void writeString(const char* str, std::size_t length);
+   void writeInteger(boost::int64_t value);
+   void writeInteger(boost::uint64_t magnitude, bool negative);
+   void writeReal(double value);
+   void writeBool(bool value) { output_.append(value ? "true" : "false"); }
+   void writeNull() { output_.append("null"); }
+
+   // write punctuation (or other pre-formatted json)
+   void writeRaw(char ch) { output_.push_back(ch); }
+   void writeRaw(const char* json) { output_.append(json); }
+
+   void flush();
+
+private:
+   void writeObject(const Object& object);
+   void writeArray(const Array& array);
+   void checkFlush();
+
+private:
+   std::string& output_;
+   std::ostream* pStream_;
+   std::ostringstream realStream_;
+};
+
+
 void write(const Value& value, std::ostream& os);
+// (appends to the output)
+void write(const Value& value, std::string* pOutput);
 void writeFormatted(const Value& value, std::ostream& os);
    
 } // namespace json
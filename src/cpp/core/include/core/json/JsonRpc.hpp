@@ -607,8 +607,14 @@ public:
 
    void setAsyncHandle(const std::string& handle);
 
+   // set a result which has already been written as json (it is written
+   // into the response as is)
+   void setResultJson(const std::string& resultJson);
+
    void setField(const std::string& name, const json::Value& value) 
    { 
+      if (name == kRpcResult)
+         resultJson_.clear();
       response_[name] = value;
    }             
                 
@@ -622,6 +628,7 @@ public:
    void setResponse(const json::Object& response)
    {
       response_ = response;
+      resultJson_.clear();
    }
    
    // specify a function to run after the response
@@ -638,9 +645,11 @@ public:
    json::Object getRawResponse();
    
    void write(std::ostream& os) const;
+   void write(std::string* pOutput) const;
    
 private:
    json::Object response_;
+   std::string resultJson_;
    boost::function<void()> afterResponse_ ;
    bool suppressDetectChanges_;
 };
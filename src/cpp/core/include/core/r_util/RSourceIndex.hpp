@@ -129,7 +129,16 @@ public:
    RSourceIndex(const std::string& context,
                 const std::string& code);
 
+   // Create an index from previously computed items (e.g. items read
+   // back from an on-disk cache of an earlier index)
+   RSourceIndex(const std::string& context,
+                const std::vector<RSourceItem>& items)
+      : context_(context), items_(items)
+   {
+   }
+
    const std::string& context() const { return context_; }
+   const std::vector<RSourceItem>& items() const { return items_; }
 
    template <typename OutputIterator>
    OutputIterator search(const std::string& term,
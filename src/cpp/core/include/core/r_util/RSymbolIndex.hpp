@@ -0,0 +1,106 @@
+/*
+ * RSymbolIndex.hpp
+ *
+ * Copyright (C) 2009-11 by RStudio, Inc.
+ *
+ * This program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef CORE_R_UTIL_R_SYMBOL_INDEX_HPP
+#define CORE_R_UTIL_R_SYMBOL_INDEX_HPP
+
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+
+#include <boost/utility.hpp>
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <core/r_util/RSourceIndex.hpp>
+
+namespace core {
+namespace r_util {
+
+// Symbol index spanning many RSourceIndex instances (e.g. all of the source
+// files within a project). Names are case-folded once when an index is
+// added and kept in sorted order (for prefix searches) along with a
+// trigram index over the distinct names (for substring and wildcard
+// searches). Searches visit names in sorted order and stop as soon as
+// maxResults items have been collected.
+class RSymbolIndex : boost::noncopyable
+{
+public:
+   RSymbolIndex() {}
+   virtual ~RSymbolIndex() {}
+
+   // add the items in the index (replaces any existing index which has
+   // the same context)
+   void add(const boost::shared_ptr<RSourceIndex>& pIndex);
+
+   // remove the index with the specified context
+   void remove(const std::string& context);
+
+   // remove all indexes
+   void clear();
+
+   std::size_t size() const { return names_.size(); }
+
+   // search for items whose name matches the term (which may include '*'
+   // wildcards). items from the contexts in excludeContexts are skipped
+   void search(const std::string& term,
+               bool prefixOnly,
+               bool caseSensitive,
+               const std::set<std::string>& excludeContexts,
+               std::size_t maxResults,
+               std::vector<RSourceItem>* pItems) const;
+
+private:
+   struct SymbolRef
+   {
+      SymbolRef(const RSourceIndex* pIndex, std::size_t item)
+         : pIndex(pIndex), item(item)
+      {
+      }
+      const RSourceIndex* pIndex;
+      std::size_t item;
+   };
+
+   // case-folded name => all of the items with that name
+   typedef std::map<std::string, std::vector<SymbolRef> > NameMap;
+
+   // trigram => case-folded names which contain the trigram
+   typedef std::map<std::string, std::set<std::string> > TrigramMap;
+
+   // contexts => indexes
+   typedef std::map<std::string, boost::shared_ptr<RSourceIndex> > IndexMap;
+
+   typedef boost::function<bool(const RSourceItem&)> ItemPredicate;
+
+   bool collectMatches(NameMap::const_iterator nameIt,
+                       const ItemPredicate& itemPredicate,
+                       const std::set<std::string>& excludeContexts,
+                       std::size_t maxResults,
+                       std::vector<RSourceItem>* pItems) const;
+
+   const std::set<std::string>* candidateNames(
+                                       const std::string& literal) const;
+
+private:
+   IndexMap indexes_;
+   NameMap names_;
+   TrigramMap trigrams_;
+};
+
+} // namespace r_util
+} // namespace core
+
+
+#endif // CORE_R_UTIL_R_SYMBOL_INDEX_HPP
+
@@ -20,7 +20,6 @@
 
 #include <boost/utility.hpp>
 #include <boost/shared_ptr.hpp>
-#include <boost/regex_fwd.hpp>
 
 // On Linux confirm that wchar_t is Unicode
 #if !defined(_WIN32) && !defined(__APPLE__) && !defined(__STDC_ISO_10646__)
@@ -33,24 +32,10 @@ class Error;
 
 namespace r_util {
 
-// Make RToken non-subclassable (since it has copy/byval semantics any
-// subclass would be sliced
-class RToken_lock
-{
-   friend class RToken ;
-private:
-   RToken_lock() {}
-   RToken_lock(const RToken_lock&) {}
-};
-
-// RToken. Note that RToken instances are only valid as long as the class
-// which yielded them (RTokenizer or RTokens) is alive. This is because
-// they contain iterators into the original source data rather than their
-// own copy of their contents.
-class RToken : public virtual RToken_lock
+// Token types (shared by the wide and UTF-8 flavors of RToken)
+class RTokenTypes
 {
 public:
-
    static const wchar_t LPAREN;
    static const wchar_t RPAREN;
    static const wchar_t LBRACKET;
@@ -70,16 +55,46 @@ public:
    static const wchar_t RDBRACKET;
    static const wchar_t COMMENT;
 
+protected:
+   RTokenTypes() {}
+};
+
+template <typename StringType> class BasicRToken;
+
+// Make RToken non-subclassable (since it has copy/byval semantics any
+// subclass would be sliced
+class RToken_lock
+{
+   template <typename StringType> friend class BasicRToken;
+private:
+   RToken_lock() {}
+   RToken_lock(const RToken_lock&) {}
+};
+
+// RToken. Note that RToken instances are only valid as long as the class
+// which yielded them (RTokenizer or RTokens) is alive. This is because
+// they contain iterators into the original source data rather than their
+// own copy of their contents.
+//
+// The StringType is either std::wstring (offsets and lengths are in
+// characters) or std::string containing UTF-8 (offsets and lengths are
+// in bytes).
+template <typename StringType>
+class BasicRToken : public RTokenTypes, public virtual RToken_lock
+{
+public:
+   typedef typename StringType::const_iterator const_iterator;
+
 public:
-   RToken()
+   BasicRToken()
       : offset_(-1)
    {
    }
 
-   RToken(wchar_t type,
-          std::wstring::const_iterator begin,
-          std::wstring::const_iterator end,
-          std::size_t offset)
+   BasicRToken(wchar_t type,
+               const_iterator begin,
+               const_iterator end,
+               std::size_t offset)
       : type_(type), begin_(begin), end_(end), offset_(offset)
    {
    }
@@ -88,24 +103,25 @@ public:
 
    // accessors
    wchar_t type() const { return type_; }
-   std::wstring content() const { return std::wstring(begin_, end_); }
+   StringType content() const { return StringType(begin_, end_); }
    std::size_t offset() const { return offset_; }
    std::size_t length() const { return end_ - begin_; }
 
    // efficient comparison operations
-   bool contentEquals(const std::wstring& text) const
+   bool contentEquals(const StringType& text) const
    {
-      return std::equal(begin_, end_, text.begin());
+      return (length() == text.length()) &&
+             std::equal(begin_, end_, text.begin());
    }
 
-   bool contentStartsWith(const std::wstring& text) const
+   bool contentStartsWith(const StringType& text) const
    {
       return std::search(begin_, end_, text.begin(), text.end()) == begin_;
    }
 
-   bool isOperator(const std::wstring& op) const
+   bool isOperator(const StringType& op) const
    {
-      return (type_ == RToken::OPER) &&
+      return (type_ == RTokenTypes::OPER) &&
               std::equal(begin_, end_, op.begin());
    }
 
@@ -125,8 +141,8 @@ public:
 
 private:
    wchar_t type_;
-   std::wstring::const_iterator begin_;
-   std::wstring::const_iterator end_;
+   const_iterator begin_;
+   const_iterator end_;
    std::size_t offset_;
 };
 
@@ -134,47 +150,56 @@ private:
 // valid only during the lifetime of the RTokenizer which yielded them
 // (because they store iterators into their content rather than making a copy
 // of the content)
-class RTokenizer : boost::noncopyable
+//
+// The tokenizer is a hand-written scanner driven by a character class
+// table for ASCII; non-ASCII characters are only decoded when they need to
+// be classified (identifiers and whitespace) so UTF-8 input can be scanned
+// directly without first converting it to a wide string.
+template <typename StringType>
+class BasicRTokenizer : boost::noncopyable
 {
 public:
-   explicit RTokenizer(const std::wstring& data)
+   typedef BasicRToken<StringType> Token;
+
+public:
+   explicit BasicRTokenizer(const StringType& data)
       : data_(data), pos_(data_.begin())
    {
    }
 
-   virtual ~RTokenizer() {}
+   virtual ~BasicRTokenizer() {}
 
    // COPYING: boost::noncopyable
 
-   RToken nextToken();
+   Token nextToken();
 
 private:
-   RToken matchWhitespace();
-   RToken matchStringLiteral();
-   RToken matchNumber();
-   RToken matchIdentifier();
-   RToken matchQuotedIdentifier();
-   RToken matchComment();
-   RToken matchUserOperator();
-   RToken matchOperator();
+   Token matchWhitespace();
+   Token matchStringLiteral();
+   Token matchNumber();
+   Token matchIdentifier();
+   Token matchQuotedIdentifier();
+   Token matchComment();
+   Token matchUserOperator();
+   Token matchOperator();
    bool eol();
    wchar_t peek();
    wchar_t peek(std::size_t lookahead);
    wchar_t eat();
-   std::wstring peek(const boost::wregex& regex);
-   void eatUntil(const boost::wregex& regex);
-   RToken consumeToken(wchar_t tokenType, std::size_t length);
+   Token consumeToken(wchar_t tokenType, std::size_t length);
 
 private:
-   std::wstring data_;
-   std::wstring::const_iterator pos_;
+   const StringType data_;
+   typename StringType::const_iterator pos_;
 };
 
 
 // Set of RTokens. Note that the RTokens returned from the set
 // are conceptually iterators so are only valid for the lifetime of
 // the RTokens object which yielded them.
-class RTokens : public std::deque<RToken>, boost::noncopyable
+template <typename StringType>
+class BasicRTokens : public std::deque<BasicRToken<StringType> >,
+                     boost::noncopyable
 {
 public:
    enum Flags
@@ -185,26 +210,38 @@ public:
    };
 
 public:
-   explicit RTokens(const std::wstring& code, int flags = None)
+   explicit BasicRTokens(const StringType& code, int flags = None)
       : tokenizer_(code)
    {
-      RToken token;
+      BasicRToken<StringType> token;
       while (token = tokenizer_.nextToken())
       {
-         if ((flags & StripWhitespace) && token.type() == RToken::WHITESPACE)
+         if ((flags & StripWhitespace) &&
+             token.type() == RTokenTypes::WHITESPACE)
             continue;
 
-         if ((flags & StripComments) && token.type() == RToken::COMMENT)
+         if ((flags & StripComments) &&
+             token.type() == RTokenTypes::COMMENT)
             continue;
 
-         push_back(token);
+         this->push_back(token);
       }
    }
 
 private:
-    RTokenizer tokenizer_;
+    BasicRTokenizer<StringType> tokenizer_;
 };
 
+// wide string tokens (offsets are in characters)
+typedef BasicRToken<std::wstring> RToken;
+typedef BasicRTokenizer<std::wstring> RTokenizer;
+typedef BasicRTokens<std::wstring> RTokens;
+
+// UTF-8 tokens (offsets are in bytes)
+typedef BasicRToken<std::string> RUtf8Token;
+typedef BasicRTokenizer<std::string> RUtf8Tokenizer;
+typedef BasicRTokens<std::string> RUtf8Tokens;
+
 
 } // namespace r_util
 } // namespace core 
@@ -15,6 +15,9 @@
 #ifndef CORE_SYSTEM_FILE_SCANNER_HPP
 #define CORE_SYSTEM_FILE_SCANNER_HPP
 
+#include <vector>
+#include <string>
+
 #include <boost/function.hpp>
 
 #include <core/FileInfo.hpp>
@@ -25,9 +28,34 @@
 namespace core {
 
 class Error;
+class FilePath;
 
 namespace system {
 
+// List the entries of a directory (other than . and ..) in no particular
+// order. Entries are read in a single pass and each is stat'ed at most
+// once (relative to the directory, so its path isn't resolved again).
+// If followLinks is true then symbolic links are reported as the file or
+// directory they point to (as FileInfo(FilePath) does), otherwise they
+// are reported as files. Entries which can't be stat'ed are skipped.
+Error listDirectory(const FilePath& dirPath,
+                    bool followLinks,
+                    std::vector<FileInfo>* pFiles);
+
+// Stat a single file the way listDirectory stats its entries (returns
+// false if it doesn't exist or can't be stat'ed)
+bool statFile(const std::string& path, bool followLinks, FileInfo* pFileInfo);
+
+// Same as listDirectory but the names and types of the entries of a
+// listing made within the last second are reused if the directory hasn't
+// been modified since (as of the file system's timestamp resolution).
+// Entries other than directories are stat'ed again so their size and
+// modification time are current. For listings requested repeatedly by
+// the Files pane (scans for changes should always use listDirectory)
+Error listDirectoryCached(const FilePath& dirPath,
+                          bool followLinks,
+                          std::vector<FileInfo>* pFiles);
+
 Error scanFiles(const FileInfo& fromRoot,
                 bool recursive,
                 const boost::function<bool(const FileInfo&)>& filter,
@@ -197,7 +197,8 @@ public:
    // are still children being supervised after the poll
    bool poll();
 
-   // Wait for all children to exit
+   // Wait for all children to exit (children are polled as soon as they
+   // have output or exit, and at least every pollingIntervalMs)
    void wait(int pollingIntervalMs = 100);
 
 private:
@@ -46,14 +46,32 @@ class TemplateFilter : public boost::iostreams::regex_filter
 public:
    TemplateFilter(const std::map<std::string, std::string>& variables)
       : boost::iostreams::regex_filter(
-            boost::regex("#([!\\']?)([A-Za-z0-9_-]+)#"),
+            templateRegex(),
             boost::bind(&TemplateFilter::substitute, this, _1)),
    
         variables_(variables)
    {
    }
+
+   // the substitution callback is bound to this instance so copies need
+   // their own (the filter is copied into streamed response bodies which
+   // outlive the original)
+   TemplateFilter(const TemplateFilter& other)
+      : boost::iostreams::regex_filter(
+            templateRegex(),
+            boost::bind(&TemplateFilter::substitute, this, _1)),
+
+        variables_(other.variables_)
+   {
+   }
    
 private:
+   static boost::regex templateRegex()
+   {
+      return boost::regex("#([!\\']?)([A-Za-z0-9_-]+)#");
+   }
+
+
    std::string substitute(const boost::cmatch& match)
    {
       std::map<std::string, std::string>::const_iterator valPos = 
@@ -11,16 +11,25 @@
  *
  */
 
+// NOTE: json values are parsed and written by hand rather than by
+// json_spirit (its Boost.Spirit based reader and stream based writer were
+// the bulk of the cost of handling large rpc requests and responses). The
+// json_spirit value types are still used and its writer is still used for
+// formatted output (which is only used for diagnostics)
+
 #include <core/json/Json.hpp>
 
+#include <cmath>
 #include <cstdlib>
+#include <cstring>
+#include <locale>
 #include <sstream>
+#include <iomanip>
 
-#include <boost/format.hpp>
-#include <boost/scoped_array.hpp>
+#include <boost/utility.hpp>
+#include <boost/cstdint.hpp>
 
 #include <core/Log.hpp>
-#include <core/Thread.hpp>
 
 #include "spirit/json_spirit.h"
 
@@ -28,13 +37,588 @@ namespace core {
 namespace json {
 
 json_spirit::Value_type ObjectType = json_spirit::obj_type;
-json_spirit::Value_type ArrayType = json_spirit::array_type; 
+json_spirit::Value_type ArrayType = json_spirit::array_type;
 json_spirit::Value_type StringType = json_spirit::str_type;
 json_spirit::Value_type BooleanType = json_spirit::bool_type;
 json_spirit::Value_type IntegerType = json_spirit::int_type;
 json_spirit::Value_type RealType = json_spirit::real_type;
 json_spirit::Value_type NullType = json_spirit::null_type;
 
+namespace {
+
+// maximum nesting of arrays and objects (so that malformed input can't
+// exhaust the stack)
+const int kMaxParseDepth = 512;
+
+// output is written to streams in chunks of this size
+const std::size_t kStreamChunkSize = 64 * 1024;
+
+inline bool isSpace(char ch)
+{
+   return ch == ' ' || ch == '\n' || ch == '\r' || ch == '\t' ||
+          ch == '\f' || ch == '\v';
+}
+
+inline bool isDigit(char ch)
+{
+   return ch >= '0' && ch <= '9';
+}
+
+inline int hexDigitValue(char ch)
+{
+   if (ch >= '0' && ch <= '9')
+      return ch - '0';
+   else if (ch >= 'a' && ch <= 'f')
+      return ch - 'a' + 10;
+   else if (ch >= 'A' && ch <= 'F')
+      return ch - 'A' + 10;
+   else
+      return -1;
+}
+
+void appendUtf8(boost::uint32_t codePoint, std::string* pOutput)
+{
+   if (codePoint < 0x80)
+   {
+      pOutput->push_back(static_cast<char>(codePoint));
+   }
+   else if (codePoint < 0x800)
+   {
+      pOutput->push_back(static_cast<char>(0xC0 | (codePoint >> 6)));
+      pOutput->push_back(static_cast<char>(0x80 | (codePoint & 0x3F)));
+   }
+   else if (codePoint < 0x10000)
+   {
+      pOutput->push_back(static_cast<char>(0xE0 | (codePoint >> 12)));
+      pOutput->push_back(static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F)));
+      pOutput->push_back(static_cast<char>(0x80 | (codePoint & 0x3F)));
+   }
+   else
+   {
+      pOutput->push_back(static_cast<char>(0xF0 | (codePoint >> 18)));
+      pOutput->push_back(static_cast<char>(0x80 | ((codePoint >> 12) & 0x3F)));
+      pOutput->push_back(static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F)));
+      pOutput->push_back(static_cast<char>(0x80 | (codePoint & 0x3F)));
+   }
+}
+
+// Single pass recursive descent parser. Values are built in place within
+// their parent (rather than being built and then copied in) and the
+// buffers used for strings and member names are reused throughout.
+class Parser : boost::noncopyable
+{
+public:
+   explicit Parser(const std::string& input)
+      : pos_(input.data()), end_(input.data() + input.size()), depth_(0)
+   {
+   }
+
+   bool parse(Value* pValue)
+   {
+      if (!parseValue(pValue))
+         return false;
+
+      // allow trailing whitespace only
+      skipWhitespace();
+      return pos_ == end_;
+   }
+
+private:
+   void skipWhitespace()
+   {
+      while (pos_ < end_ && isSpace(*pos_))
+         ++pos_;
+   }
+
+   bool consume(char ch)
+   {
+      skipWhitespace();
+      if (pos_ < end_ && *pos_ == ch)
+      {
+         ++pos_;
+         return true;
+      }
+      else
+      {
+         return false;
+      }
+   }
+
+   bool consumeLiteral(const char* literal, std::size_t length)
+   {
+      if (static_cast<std::size_t>(end_ - pos_) < length ||
+          std::memcmp(pos_, literal, length) != 0)
+      {
+         return false;
+      }
+
+      pos_ += length;
+      return true;
+   }
+
+   bool parseValue(Value* pValue)
+   {
+      skipWhitespace();
+      if (pos_ == end_)
+         return false;
+
+      switch (*pos_)
+      {
+         case '{':
+            return parseObject(pValue);
+
+         case '[':
+            return parseArray(pValue);
+
+         case '"':
+         {
+            if (!parseString(&string_))
+               return false;
+            *pValue = string_;
+            return true;
+         }
+
+         case 't':
+         {
+            if (!consumeLiteral("true", 4))
+               return false;
+            *pValue = true;
+            return true;
+         }
+
+         case 'f':
+         {
+            if (!consumeLiteral("false", 5))
+               return false;
+            *pValue = false;
+            return true;
+         }
+
+         case 'n':
+         {
+            if (!consumeLiteral("null", 4))
+               return false;
+            *pValue = Value();
+            return true;
+         }
+
+         default:
+            return parseNumber(pValue);
+      }
+   }
+
+   bool parseObject(Value* pValue)
+   {
+      if (++depth_ > kMaxParseDepth)
+         return false;
+
+      ++pos_; // '{'
+      *pValue = Object();
+      Object& object = pValue->get_obj();
+
+      if (!consume('}'))
+      {
+         do
+         {
+            skipWhitespace();
+            if (pos_ == end_ || *pos_ != '"' || !parseString(&name_))
+               return false;
+
+            if (!consume(':'))
+               return false;
+
+            // (as with json_spirit the last of any duplicate names wins)
+            Value& member = object[name_];
+            member = Value();
+            if (!parseValue(&member))
+               return false;
+         }
+         while (consume(','));
+
+         if (!consume('}'))
+            return false;
+      }
+
+      --depth_;
+      return true;
+   }
+
+   bool parseArray(Value* pValue)
+   {
+      if (++depth_ > kMaxParseDepth)
+         return false;
+
+      ++pos_; // '['
+      *pValue = Array();
+      Array& array = pValue->get_array();
+
+      if (!consume(']'))
+      {
+         do
+         {
+            array.push_back(Value());
+            if (!parseValue(&array.back()))
+               return false;
+         }
+         while (consume(','));
+
+         if (!consume(']'))
+            return false;
+      }
+
+      --depth_;
+      return true;
+   }
+
+   bool parseHex4(boost::uint32_t* pValue)
+   {
+      if (end_ - pos_ < 4)
+         return false;
+
+      boost::uint32_t value = 0;
+      for (int i = 0; i < 4; i++)
+      {
+         int digit = hexDigitValue(*pos_++);
+         if (digit < 0)
+            return false;
+         value = (value << 4) | digit;
+      }
+
+      *pValue = value;
+      return true;
+   }
+
+   bool parseString(std::string* pString)
+   {
+      ++pos_; // '"'
+      pString->clear();
+
+      while (true)
+      {
+         // copy everything up to the next quote or escape at once
+         const char* run = pos_;
+         while (pos_ < end_ && *pos_ != '"' && *pos_ != '\\')
+            ++pos_;
+         pString->append(run, pos_);
+
+         if (pos_ == end_)
+            return false;
+
+         if (*pos_++ == '"')
+            return true;
+
+         // escape
+         if (pos_ == end_)
+            return false;
+         switch (*pos_++)
+         {
+            case '"':  pString->push_back('"');  break;
+            case '\\': pString->push_back('\\'); break;
+            case '/':  pString->push_back('/');  break;
+            case 'b':  pString->push_back('\b'); break;
+            case 'f':  pString->push_back('\f'); break;
+            case 'n':  pString->push_back('\n'); break;
+            case 'r':  pString->push_back('\r'); break;
+            case 't':  pString->push_back('\t'); break;
+            case 'u':
+            {
+               boost::uint32_t codePoint;
+               if (!parseHex4(&codePoint))
+                  return false;
+
+               // combine surrogate pairs
+               if (codePoint >= 0xD800 && codePoint <= 0xDBFF &&
+                   end_ - pos_ >= 6 && pos_[0] == '\\' && pos_[1] == 'u')
+               {
+                  const char* lowPos = pos_;
+                  pos_ += 2;
+                  boost::uint32_t low;
+                  if (parseHex4(&low) && low >= 0xDC00 && low <= 0xDFFF)
+                     codePoint = 0x10000 + ((codePoint - 0xD800) << 10) +
+                                 (low - 0xDC00);
+                  else
+                     pos_ = lowPos;
+               }
+
+               appendUtf8(codePoint, pString);
+               break;
+            }
+            default:
+               return false;
+         }
+      }
+   }
+
+   bool parseNumber(Value* pValue)
+   {
+      const char* start = pos_;
+      bool negative = false;
+      if (pos_ < end_ && *pos_ == '-')
+      {
+         negative = true;
+         ++pos_;
+      }
+
+      // integer part (accumulated as we go in case there is nothing else)
+      if (pos_ == end_ || !isDigit(*pos_))
+         return false;
+      boost::uint64_t magnitude = 0;
+      bool overflow = false;
+      while (pos_ < end_ && isDigit(*pos_))
+      {
+         boost::uint64_t digit = *pos_++ - '0';
+         if (magnitude > (~boost::uint64_t(0) - digit) / 10)
+            overflow = true;
+         magnitude = (magnitude * 10) + digit;
+      }
+
+      bool isReal = false;
+      if (pos_ < end_ && *pos_ == '.')
+      {
+         // (digits after the point are optional as json_spirit writes
+         // reals with 16 integer digits without them)
+         isReal = true;
+         ++pos_;
+         while (pos_ < end_ && isDigit(*pos_))
+            ++pos_;
+      }
+      if (pos_ < end_ && (*pos_ == 'e' || *pos_ == 'E'))
+      {
+         isReal = true;
+         ++pos_;
+         if (pos_ < end_ && (*pos_ == '+' || *pos_ == '-'))
+            ++pos_;
+         if (pos_ == end_ || !isDigit(*pos_))
+            return false;
+         while (pos_ < end_ && isDigit(*pos_))
+            ++pos_;
+      }
+
+      if (isReal)
+      {
+         // (strtod needs a terminated string)
+         std::string number(start, pos_);
+         *pValue = std::strtod(number.c_str(), NULL);
+         return true;
+      }
+
+      // integers are signed 64 bit if they fit, otherwise unsigned
+      const boost::uint64_t maxInt64 = 0x7FFFFFFFFFFFFFFFULL;
+      if (overflow)
+      {
+         return false;
+      }
+      else if (negative)
+      {
+         if (magnitude > maxInt64 + 1)
+            return false;
+         *pValue = static_cast<boost::int64_t>(0 - magnitude);
+      }
+      else if (magnitude > maxInt64)
+      {
+         *pValue = magnitude;
+      }
+      else
+      {
+         *pValue = static_cast<boost::int64_t>(magnitude);
+      }
+      return true;
+   }
+
+private:
+   const char* pos_;
+   const char* end_;
+   int depth_;
+   std::string string_;
+   std::string name_;
+};
+
+} // anonymous namespace
+
+Writer::Writer(std::string* pOutput, std::ostream* pStream)
+   : output_(*pOutput), pStream_(pStream)
+{
+   realStream_.imbue(std::locale::classic());
+   realStream_ << std::showpoint << std::setprecision(16);
+}
+
+Writer::~Writer()
+{
+   try
+   {
+      flush();
+   }
+   catch(...)
+   {
+   }
+}
+
+void Writer::write(const Value& value)
+{
+   switch (value.type())
+   {
+      case json_spirit::obj_type:
+         writeObject(value.get_obj());
+         break;
+      case json_spirit::array_type:
+         writeArray(value.get_array());
+         break;
+      case json_spirit::str_type:
+         writeString(value.get_str());
+         break;
+      case json_spirit::bool_type:
+         writeBool(value.get_bool());
+         break;
+      case json_spirit::int_type:
+         if (value.is_uint64())
+            writeInteger(value.get_uint64(), false);
+         else
+            writeInteger(value.get_int64());
+         break;
+      case json_spirit::real_type:
+         writeReal(value.get_real());
+         break;
+      case json_spirit::null_type:
+      default:
+         writeNull();
+         break;
+   }
+}
+
+void Writer::writeObject(const Object& object)
+{
+   output_.push_back('{');
+   for (Object::const_iterator it = object.begin(); it != object.end(); ++it)
+   {
+      if (it != object.begin())
+         output_.push_back(',');
+      writeString(it->first);
+      output_.push_back(':');
+      write(it->second);
+   }
+   output_.push_back('}');
+   checkFlush();
+}
+
+void Writer::writeArray(const Array& array)
+{
+   output_.push_back('[');
+   for (Array::const_iterator it = array.begin(); it != array.end(); ++it)
+   {
+      if (it != array.begin())
+         output_.push_back(',');
+      write(*it);
+   }
+   output_.push_back(']');
+   checkFlush();
+}
+
+void Writer::writeString(const char* str, std::size_t length)
+{
+   output_.push_back('"');
+
+   // copy runs of characters which don't need escaping at once
+   const char* pos = str;
+   const char* end = str + length;
+   const char* run = pos;
+   for ( ; pos < end; ++pos)
+   {
+      unsigned char ch = static_cast<unsigned char>(*pos);
+      if (ch >= 0x20 && ch != '"' && ch != '\\')
+         continue;
+
+      output_.append(run, pos);
+      run = pos + 1;
+
+      switch (ch)
+      {
+         case '"':  output_.append("\\\""); break;
+         case '\\': output_.append("\\\\"); break;
+         case '\b': output_.append("\\b");  break;
+         case '\f': output_.append("\\f");  break;
+         case '\n': output_.append("\\n");  break;
+         case '\r': output_.append("\\r");  break;
+         case '\t': output_.append("\\t");  break;
+         default:
+         {
+            const char* const hex = "0123456789ABCDEF";
+            output_.append("\\u00");
+            output_.push_back(hex[ch >> 4]);
+            output_.push_back(hex[ch & 0xF]);
+            break;
+         }
+      }
+   }
+   output_.append(run, end);
+
+   output_.push_back('"');
+   checkFlush();
+}
+
+void Writer::writeInteger(boost::uint64_t magnitude, bool negative)
+{
+   char buffer[24];
+   char* pos = buffer + sizeof(buffer);
+   do
+   {
+      *--pos = static_cast<char>('0' + (magnitude % 10));
+      magnitude /= 10;
+   }
+   while (magnitude != 0);
+
+   if (negative)
+      *--pos = '-';
+
+   output_.append(pos, buffer + sizeof(buffer));
+}
+
+void Writer::writeInteger(boost::int64_t value)
+{
+   if (value < 0)
+      writeInteger(0 - static_cast<boost::uint64_t>(value), true);
+   else
+      writeInteger(static_cast<boost::uint64_t>(value), false);
+}
+
+void Writer::writeReal(double value)
+{
+   // same representation as json_spirit (std::showpoint with a precision
+   // of 16). integral values (e.g. times) are common so are formatted
+   // directly (as their digits padded with zeros after the point)
+   if ((value > 0 || value < 0) && std::fabs(value) < 1e15 &&
+       std::floor(value) == value)
+   {
+      boost::uint64_t magnitude =
+                  static_cast<boost::uint64_t>(std::fabs(value));
+      std::size_t start = output_.size();
+      writeInteger(magnitude, value < 0);
+      std::size_t digits = output_.size() - start - (value < 0 ? 1 : 0);
+      output_.push_back('.');
+      output_.append(16 - digits, '0');
+      return;
+   }
+
+   realStream_.str(std::string());
+   realStream_ << value;
+   output_.append(realStream_.str());
+}
+
+void Writer::flush()
+{
+   if (pStream_ != NULL && !output_.empty())
+   {
+      pStream_->write(output_.data(), output_.size());
+      output_.clear();
+   }
+}
+
+void Writer::checkFlush()
+{
+   if (pStream_ != NULL && output_.size() >= kStreamChunkSize)
+      flush();
+}
+
+
 json::Value toJsonString(const std::string& val)
 {
    return json::Value(val);
@@ -42,34 +626,30 @@ json::Value toJsonString(const std::string& val)
 
 bool parse(const std::string& input, Value* pValue)
 {
-   // two threads simultaneously using the json parser has been observed
-   // to crash the process. protect it globally with a mutex. note this was
-   // probably a result of not defining BOOST_SPIRIT_THREADSAFE (which we
-   // have subsequently defined) however since there isn't much documentation 
-   // on the behavior of boost spirit w/ threads and the specific behavior
-   // of this constant we leave in mutex just to be sure   
-      
-   static boost::mutex s_spiritMutex ;
-   LOCK_MUTEX(s_spiritMutex)
-   {
-      return json_spirit::read(input, *pValue);
-   }
-   END_LOCK_MUTEX
-   
-   // mutex related error
-   return false;
+   Parser parser(input);
+   return parser.parse(pValue);
 }
 
 void write(const Value& value, std::ostream& os)
 {
-   json_spirit::write(value, os);
+   std::string buffer;
+   buffer.reserve(kStreamChunkSize * 2);
+   Writer writer(&buffer, &os);
+   writer.write(value);
+   writer.flush();
+}
+
+void write(const Value& value, std::string* pOutput)
+{
+   Writer writer(pOutput);
+   writer.write(value);
 }
 
 void writeFormatted(const Value& value, std::ostream& os)
 {
    json_spirit::write_formatted(value, os);
-}   
-   
+}
+
 } // namespace json
 } // namespace core
 
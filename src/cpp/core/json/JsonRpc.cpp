@@ -41,13 +41,14 @@ Error parseJsonRpcRequest(const std::string& input, JsonRpcRequest* pRequest)
          return Error(errc::InvalidRequest, ERROR_LOCATION) ;
       }
 
-      // extract the fields
+      // extract the fields (params are swapped out of the parsed request
+      // rather than copied as they can be large)
       json::Object& requestObject = var.get_obj();
-      for (json::Object::const_iterator it = 
+      for (json::Object::iterator it = 
             requestObject.begin(); it != requestObject.end(); ++it)
       {
-         std::string fieldName = it->first ;
-         json::Value fieldValue = it->second ;
+         const std::string& fieldName = it->first ;
+         json::Value& fieldValue = it->second ;
 
          if ( fieldName == "method" )
          {
@@ -61,14 +62,14 @@ Error parseJsonRpcRequest(const std::string& input, JsonRpcRequest* pRequest)
             if (fieldValue.type() != json::ArrayType)
                return Error(errc::ParamTypeMismatch, ERROR_LOCATION) ;
 
-            pRequest->params = fieldValue.get_array();
+            pRequest->params.swap(fieldValue.get_array());
          }
          else if ( fieldName == "kwparams" )
          {
             if (fieldValue.type() != json::ObjectType)
                return Error(errc::ParamTypeMismatch, ERROR_LOCATION) ;
 
-            pRequest->kwparams = fieldValue.get_obj();
+            pRequest->kwparams.swap(fieldValue.get_obj());
          }
          else if (fieldName == "clientId" )
          {
@@ -157,14 +158,65 @@ void JsonRpcResponse::runAfterResponse()
       afterResponse_();
 }
    
+void JsonRpcResponse::setResultJson(const std::string& resultJson)
+{
+   response_.erase(kRpcResult);
+   response_.erase(kRpcAsyncHandle);
+   response_.erase(kRpcError);
+
+   resultJson_ = resultJson;
+}
+
 json::Object JsonRpcResponse::getRawResponse()
 {
-   return response_;
+   json::Object response = response_;
+   if (!resultJson_.empty())
+   {
+      json::Value result;
+      if (!json::parse(resultJson_, &result))
+         LOG_ERROR_MESSAGE("Invalid json result: " + resultJson_);
+      response[kRpcResult] = result;
+   }
+   return response;
 }
    
 void JsonRpcResponse::write(std::ostream& os) const
 {
-   json::write(response_, os);
+   if (resultJson_.empty())
+   {
+      json::write(response_, os);
+   }
+   else
+   {
+      std::string output;
+      write(&output);
+      os << output;
+   }
+}
+
+void JsonRpcResponse::write(std::string* pOutput) const
+{
+   if (resultJson_.empty())
+   {
+      json::write(response_, pOutput);
+      return;
+   }
+
+   // write the result followed by the other fields
+   pOutput->append("{\"");
+   pOutput->append(kRpcResult);
+   pOutput->append("\":");
+   pOutput->append(resultJson_);
+   for (json::Object::const_iterator it = response_.begin();
+        it != response_.end();
+        ++it)
+   {
+      pOutput->push_back(',');
+      json::write(json::Value(it->first), pOutput);
+      pOutput->push_back(':');
+      json::write(it->second, pOutput);
+   }
+   pOutput->push_back('}');
 }
    
    
@@ -172,6 +224,7 @@ void JsonRpcResponse::setError(const Error& error)
 {   
    // remove result
    response_.erase(kRpcResult);
+   resultJson_.clear();
    response_.erase(kRpcAsyncHandle);
 
    const boost::system::error_code& ec = error.code();
@@ -204,6 +257,7 @@ void JsonRpcResponse::setError(const boost::system::error_code& ec)
 {
    // remove result
    response_.erase(kRpcResult);
+   resultJson_.clear();
    response_.erase(kRpcAsyncHandle);
 
    // error from error code
@@ -220,6 +274,7 @@ void JsonRpcResponse::setError(const boost::system::error_code& ec)
 void JsonRpcResponse::setAsyncHandle(const std::string& handle)
 {
    response_.erase(kRpcResult);
+   resultJson_.clear();
    response_.erase(kRpcError);
 
    setField(kRpcAsyncHandle, handle);
@@ -238,17 +293,24 @@ void setJsonRpcResponse(const core::json::JsonRpcResponse& jsonRpcResponse,
    if (pResponse->contentType().empty())
        pResponse->setContentType(kJsonContentType) ; 
    
-   // set body 
-   std::stringstream responseStream ;
-   jsonRpcResponse.write(responseStream);
-   Error error = pResponse->setBody(responseStream);
-   
-   // report error to client if one occurred
-   if (error)
+   // set body (written directly to the body if there is no encoding)
+   std::string body;
+   jsonRpcResponse.write(&body);
+   if (pResponse->contentEncoding().empty())
+   {
+      pResponse->setBodyUnencoded(body);
+   }
+   else
    {
-      LOG_ERROR(error);
-      pResponse->setError(http::status::InternalServerError,
-                          error.code().message());
+      Error error = pResponse->setBody(body);
+
+      // report error to client if one occurred
+      if (error)
+      {
+         LOG_ERROR(error);
+         pResponse->setError(http::status::InternalServerError,
+                             error.code().message());
+      }
    }
 }     
    
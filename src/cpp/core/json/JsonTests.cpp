@@ -0,0 +1,344 @@
+/*
+ * JsonTests.cpp
+ *
+ * Copyright (C) 2009-11 by RStudio, Inc.
+ *
+ * This program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <core/json/Json.hpp>
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <boost/assert.hpp>
+#include <boost/foreach.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include "spirit/json_spirit.h"
+
+namespace core {
+namespace json {
+
+namespace {
+
+// Payloads representative of those exchanged with the client
+
+std::string sourceCode(std::size_t lines)
+{
+   std::ostringstream ostr;
+   for (std::size_t i = 0; i < lines; i++)
+   {
+      ostr << "result" << i << " <- sapply(data$\"column\", function(x) {\n"
+           << "\tpaste(\"value:\", x, sep = '\\t')  # caf\xC3\xA9\n"
+           << "})\n";
+   }
+   return ostr.str();
+}
+
+// client init documents (the source documents open in the editor)
+Value documentsPayload()
+{
+   Array documents;
+   for (int i = 0; i < 20; i++)
+   {
+      Object properties;
+      properties["cursorPosition"] = "12,4";
+      properties["scrollLine"] = "40";
+
+      Object document;
+      document["id"] = "C3E2B7A1" + boost::lexical_cast<std::string>(i);
+      document["path"] = "~/projects/analysis/R/script" +
+                         boost::lexical_cast<std::string>(i) + ".R";
+      document["type"] = "r_source";
+      document["contents"] = sourceCode(500);
+      document["dirty"] = (i % 3) == 0;
+      document["created"] = 1318534112877.0 + i;
+      document["source_on_save"] = false;
+      document["properties"] = properties;
+      documents.push_back(document);
+   }
+   return documents;
+}
+
+// a large directory listing
+Value fileListingPayload()
+{
+   Array files;
+   for (int i = 0; i < 2000; i++)
+   {
+      Object file;
+      file["path"] = "~/projects/analysis/data/observations-" +
+                     boost::lexical_cast<std::string>(i) + ".csv";
+      file["is_directory"] = false;
+      file["length"] = 1024 * i;
+      file["exists"] = true;
+      file["lastModified"] = 1318534112877.0 + (i * 1000);
+      files.push_back(file);
+   }
+   return files;
+}
+
+// a workspace refresh (columns of object descriptions)
+Value workspacePayload()
+{
+   Array names, types, lengths, values, extra;
+   for (int i = 0; i < 1000; i++)
+   {
+      std::string index = boost::lexical_cast<std::string>(i);
+      names.push_back("object" + index);
+      types.push_back(i % 2 ? "data.frame" : "numeric");
+      lengths.push_back(i * 10);
+      values.push_back(i % 2 ? "NO_VALUE" : "c(1.5, 2.25, " + index + ")");
+      extra.push_back(i % 2 ? index + " obs. of 12 variables" : "");
+   }
+
+   Object workspace;
+   workspace["name"] = names;
+   workspace["type"] = types;
+   workspace["len"] = lengths;
+   workspace["value"] = values;
+   workspace["extra"] = extra;
+   return workspace;
+}
+
+// an rpc request saving a document
+Value saveDocumentPayload()
+{
+   Array params;
+   params.push_back("C3E2B7A1");
+   params.push_back("~/projects/analysis/R/script.R");
+   params.push_back("r_source");
+   params.push_back(sourceCode(2000));
+   params.push_back(true);
+
+   Object request;
+   request["method"] = "save_document";
+   request["params"] = params;
+   request["clientId"] = "33e600bb-c1b1-46bf-b562-ab5cba070b0e";
+   request["version"] = 1318534112877.0;
+   return request;
+}
+
+std::string spiritWrite(const Value& value)
+{
+   std::ostringstream ostr;
+   json_spirit::write(value, ostr);
+   return ostr.str();
+}
+
+std::string fastWrite(const Value& value)
+{
+   std::string output;
+   write(value, &output);
+   return output;
+}
+
+void verifyParse(const std::string& input, const Value& expected)
+{
+   Value value;
+   bool parsed = parse(input, &value);
+   if (!parsed || !(value == expected))
+      std::cout << "Unexpected parse: " << input << std::endl;
+   BOOST_ASSERT(parsed);
+   BOOST_ASSERT(value == expected);
+}
+
+void verifyInvalid(const std::string& input)
+{
+   Value value;
+   bool parsed = parse(input, &value);
+   if (parsed)
+      std::cout << "Invalid input parsed: " << input << std::endl;
+   BOOST_ASSERT(!parsed);
+}
+
+// values written and read by both json_spirit and our parser and writer
+// are identical
+void verifyRoundTrip(const Value& value)
+{
+   std::string output = fastWrite(value);
+   BOOST_ASSERT(output == spiritWrite(value));
+
+   Value spiritValue;
+   bool parsed = json_spirit::read(output, spiritValue);
+   BOOST_ASSERT(parsed);
+   verifyParse(output, spiritValue);
+   verifyParse(output, value);
+}
+
+void testScalars()
+{
+   verifyParse("true", Value(true));
+   verifyParse("false", Value(false));
+   verifyParse("null", Value());
+   verifyParse(" \n\t42 \r\n", Value(boost::int64_t(42)));
+   verifyParse("-17", Value(boost::int64_t(-17)));
+   verifyParse("-9223372036854775808",
+               Value(boost::int64_t(-9223372036854775807LL - 1)));
+   verifyParse("18446744073709551615",
+               Value(boost::uint64_t(18446744073709551615ULL)));
+   verifyParse("1.5", Value(1.5));
+   verifyParse("-2.5e3", Value(-2500.0));
+   verifyParse("1E-2", Value(0.01));
+
+   // reals are written as json_spirit writes them
+   const double reals[] = { 0.0, -0.0, 1.0, -1.0, 0.5, 1e-7, 123456789.0,
+                            1318534112877.0, -1318534112877.0, 1e14, 1e15,
+                            1e16, 3.141592653589793, 1.0/3.0, 2.5e300 };
+   BOOST_FOREACH(double real, reals)
+   {
+      BOOST_ASSERT(fastWrite(Value(real)) == spiritWrite(Value(real)));
+      verifyParse(fastWrite(Value(real)), Value(real));
+   }
+
+   verifyInvalid("");
+   verifyInvalid("tru");
+   verifyInvalid("nul");
+   verifyInvalid("01x");
+   verifyInvalid("1e");
+   verifyInvalid("-");
+   verifyInvalid("18446744073709551616");
+   verifyInvalid("true false");
+}
+
+void testStrings()
+{
+   verifyParse("\"\"", Value(std::string()));
+   verifyParse("\"a \\\"quoted\\\" \\\\ \\/ string\"",
+               Value(std::string("a \"quoted\" \\ / string")));
+   verifyParse("\"\\b\\f\\n\\r\\t\"", Value(std::string("\b\f\n\r\t")));
+   verifyParse("\"caf\\u00e9\"", Value(std::string("caf\xC3\xA9")));
+   verifyParse("\"\\u20AC\"", Value(std::string("\xE2\x82\xAC")));
+   verifyParse("\"\\ud83d\\ude00\"", Value(std::string("\xF0\x9F\x98\x80")));
+   verifyParse("\"caf\xC3\xA9\"", Value(std::string("caf\xC3\xA9")));
+
+   verifyInvalid("\"unterminated");
+   verifyInvalid("\"bad \\q escape\"");
+   verifyInvalid("\"short \\u12\"");
+
+   // control characters are escaped when written
+   BOOST_ASSERT(fastWrite(Value(std::string("a\x01""b"))) == "\"a\\u0001b\"");
+   verifyParse(fastWrite(Value(std::string("a\x01""b"))),
+               Value(std::string("a\x01""b")));
+}
+
+void testCompounds()
+{
+   Object object;
+   object["a"] = Array();
+   object["b"] = Object();
+   object["c"] = 3;
+   verifyParse(" { \"c\" : 3 , \"b\" : { } , \"a\" : [ ] } ", object);
+
+   // the last of any duplicate names wins
+   Object duplicate;
+   duplicate["a"] = 2;
+   verifyParse("{\"a\":1,\"a\":2}", duplicate);
+
+   verifyInvalid("{");
+   verifyInvalid("{\"a\"}");
+   verifyInvalid("{\"a\":1,}");
+   verifyInvalid("{a:1}");
+   verifyInvalid("[1,2");
+   verifyInvalid("[1,,2]");
+   verifyInvalid("[1 2]");
+
+   // nesting is limited
+   Value nested = Array();
+   for (int i = 1; i < 100; i++)
+   {
+      Array array;
+      array.push_back(nested);
+      nested = array;
+   }
+   verifyParse(std::string(100, '[') + std::string(100, ']'), nested);
+   verifyInvalid(std::string(10000, '[') + std::string(10000, ']'));
+}
+
+void testPayloads()
+{
+   verifyRoundTrip(documentsPayload());
+   verifyRoundTrip(fileListingPayload());
+   verifyRoundTrip(workspacePayload());
+   verifyRoundTrip(saveDocumentPayload());
+}
+
+void printThroughput(const std::string& name,
+                     double megabytes,
+                     const boost::posix_time::ptime& start)
+{
+   using namespace boost::posix_time;
+   time_duration elapsed = microsec_clock::universal_time() - start;
+   double seconds = static_cast<double>(elapsed.total_microseconds()) / 1e6;
+   std::cout << name << ": " << (megabytes / seconds) << " MB/s" << std::endl;
+}
+
+void benchmarkPayload(const std::string& name,
+                      const Value& payload,
+                      int iterations)
+{
+   using namespace boost::posix_time;
+
+   std::string json = fastWrite(payload);
+   double megabytes = static_cast<double>(json.size() * iterations) /
+                      (1024 * 1024);
+   std::cout << name << " (" << json.size() << " bytes)" << std::endl;
+
+   ptime start = microsec_clock::universal_time();
+   for (int i = 0; i < iterations; i++)
+      spiritWrite(payload);
+   printThroughput("   write (json_spirit)", megabytes, start);
+
+   start = microsec_clock::universal_time();
+   for (int i = 0; i < iterations; i++)
+      fastWrite(payload);
+   printThroughput("   write", megabytes, start);
+
+   start = microsec_clock::universal_time();
+   for (int i = 0; i < iterations; i++)
+   {
+      Value value;
+      json_spirit::read(json, value);
+   }
+   printThroughput("   parse (json_spirit)", megabytes, start);
+
+   start = microsec_clock::universal_time();
+   for (int i = 0; i < iterations; i++)
+   {
+      Value value;
+      parse(json, &value);
+   }
+   printThroughput("   parse", megabytes, start);
+}
+
+} // anonymous namespace
+
+void runJsonTests()
+{
+   testScalars();
+   testStrings();
+   testCompounds();
+   testPayloads();
+}
+
+// Benchmark json_spirit and our parser and writer on representative
+// payloads (each is parsed and written the specified number of times)
+void runJsonBenchmark(int iterations)
+{
+   benchmarkPayload("client init documents", documentsPayload(), iterations);
+   benchmarkPayload("file listing", fileListingPayload(), iterations);
+   benchmarkPayload("workspace", workspacePayload(), iterations);
+   benchmarkPayload("save document request", saveDocumentPayload(), iterations);
+}
+
+} // namespace json
+} // namespace core
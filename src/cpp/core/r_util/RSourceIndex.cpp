@@ -13,6 +13,8 @@
 
 #include <core/r_util/RSourceIndex.hpp>
 
+#include <algorithm>
+
 #include <boost/algorithm/string.hpp>
 
 #include <core/StringUtils.hpp>
@@ -24,14 +26,34 @@ namespace r_util {
 
 namespace {
 
-std::wstring removeQuoteDelims(const std::wstring& input)
+bool isUtf8Continuation(char c)
+{
+   return (static_cast<unsigned char>(c) & 0xC0) == 0x80;
+}
+
+std::string removeQuoteDelims(const std::string& input)
 {
    // since we know this was parsed as a quoted string we can just remove
-   // the first and last characters
+   // the first and last characters (note that the last character of an
+   // unterminated string may be a multi-byte UTF-8 sequence)
    if (input.size() >= 2)
-      return std::wstring(input, 1, input.size() - 2);
+   {
+      std::size_t last = input.size() - 1;
+      while (last > 1 && isUtf8Continuation(input[last]))
+         last--;
+      return std::string(input, 1, last - 1);
+   }
    else
-      return std::wstring();
+   {
+      return std::string();
+   }
+}
+
+// number of characters in a range of UTF-8 text
+std::size_t utf8Length(std::string::const_iterator begin,
+                       std::string::const_iterator end)
+{
+   return (end - begin) - std::count_if(begin, end, isUtf8Continuation);
 }
 
 }  // anonymous namespace
@@ -40,44 +62,42 @@ RSourceIndex::RSourceIndex(const std::string& context,
                            const std::string& code)
    : context_(context)
 {
-   // convert code to wide
-   std::wstring wCode = string_utils::utf8ToWide(code);
-
    // determine where the linebreaks are and initialize an iterator
    // used for scanning them
    std::vector<std::size_t> newlineLocs;
    std::size_t nextNL = 0;
-   while ( (nextNL = wCode.find(L'\n', nextNL)) != std::string::npos )
+   while ( (nextNL = code.find('\n', nextNL)) != std::string::npos )
       newlineLocs.push_back(nextNL++);
    std::vector<std::size_t>::const_iterator newlineIter = newlineLocs.begin();
    std::vector<std::size_t>::const_iterator endNewlines = newlineLocs.end();
 
-   // tokenize
-   RTokens rTokens(wCode, RTokens::StripWhitespace | RTokens::StripComments);
+   // tokenize (token offsets are byte offsets into the UTF-8 code)
+   RUtf8Tokens rTokens(code, RUtf8Tokens::StripWhitespace |
+                             RUtf8Tokens::StripComments);
 
    // scan for function, method, and class definitions
-   std::wstring function(L"function");
-   std::wstring set(L"set");
-   std::wstring setGeneric(L"setGeneric");
-   std::wstring setGroupGeneric(L"setGroupGeneric");
-   std::wstring setMethod(L"setMethod");
-   std::wstring setClass(L"setClass");
-   std::wstring setClassUnion(L"setClassUnion");
-   std::wstring eqOp(L"=");
-   std::wstring assignOp(L"<-");
-   std::wstring parentAssignOp(L"<<-");
+   std::string function("function");
+   std::string set("set");
+   std::string setGeneric("setGeneric");
+   std::string setGroupGeneric("setGroupGeneric");
+   std::string setMethod("setMethod");
+   std::string setClass("setClass");
+   std::string setClassUnion("setClassUnion");
+   std::string eqOp("=");
+   std::string assignOp("<-");
+   std::string parentAssignOp("<<-");
    for (std::size_t i=0; i<rTokens.size(); i++)
    {
       // initial name and type are nil
       RSourceItem::Type type = RSourceItem::None;
-      std::wstring name;
+      std::string name;
       std::size_t tokenOffset = -1;
 
       // alias the token
-      const RToken& token = rTokens.at(i);
+      const RUtf8Token& token = rTokens.at(i);
 
       // bail if this isn't an identifier
-      if (token.type() != RToken::ID)
+      if (token.type() != RUtf8Token::ID)
          continue;
 
       // is this a potential method or class definition?
@@ -106,8 +126,8 @@ RSourceIndex::RSourceIndex(const std::string& context,
             continue;
 
          // there needs to be two more tokens, one an lparen and one a string
-         if ( (rTokens.at(i+1).type() != RToken::LPAREN) ||
-              (rTokens.at(i+2).type() != RToken::STRING))
+         if ( (rTokens.at(i+1).type() != RUtf8Token::LPAREN) ||
+              (rTokens.at(i+2).type() != RUtf8Token::STRING))
             continue;
 
          // found a class or method definition (will find location below)
@@ -125,8 +145,8 @@ RSourceIndex::RSourceIndex(const std::string& context,
             continue;
 
          // check for an assignment operator
-         const RToken& opToken = rTokens.at(i-1);
-         if ( opToken.type() != RToken::OPER)
+         const RUtf8Token& opToken = rTokens.at(i-1);
+         if ( opToken.type() != RUtf8Token::OPER)
             continue;
          if (!opToken.isOperator(eqOp) &&
              !opToken.isOperator(assignOp) &&
@@ -134,17 +154,17 @@ RSourceIndex::RSourceIndex(const std::string& context,
             continue;
 
          // check for an identifier
-         const RToken& idToken = rTokens.at(i-2);
-         if ( idToken.type() != RToken::ID )
+         const RUtf8Token& idToken = rTokens.at(i-2);
+         if ( idToken.type() != RUtf8Token::ID )
             continue;
 
          // if there is another previous token make sure it isn't a
          // comma or an open paren
          if ( i > 2 )
          {
-            const RToken& prevToken = rTokens.at(i-3);
-            if (prevToken.type() == RToken::LPAREN ||
-                prevToken.type() == RToken::COMMA)
+            const RUtf8Token& prevToken = rTokens.at(i-3);
+            if (prevToken.type() == RUtf8Token::LPAREN ||
+                prevToken.type() == RUtf8Token::COMMA)
                continue;
          }
 
@@ -165,17 +185,18 @@ RSourceIndex::RSourceIndex(const std::string& context,
                                      tokenOffset);
       std::size_t line = newlineIter - newlineLocs.begin() + 1;
 
-      // compute column by comparing the offset to the PREVIOUS newline
-      // (guard against no previous newline)
+      // compute column by counting the characters from the PREVIOUS
+      // newline (guard against no previous newline)
       std::size_t column;
       if (line > 1)
-         column = tokenOffset - *(newlineIter - 1);
+         column = utf8Length(code.begin() + *(newlineIter - 1),
+                             code.begin() + tokenOffset);
       else
-         column = tokenOffset;
+         column = utf8Length(code.begin(), code.begin() + tokenOffset);
 
       // add to index
       items_.push_back(RSourceItem(type,
-                                   string_utils::wideToUtf8(name),
+                                   name,
                                    line,
                                    column));
    }
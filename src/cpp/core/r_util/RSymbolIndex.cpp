@@ -0,0 +1,309 @@
+/*
+ * RSymbolIndex.cpp
+ *
+ * Copyright (C) 2009-11 by RStudio, Inc.
+ *
+ * This program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <core/r_util/RSymbolIndex.hpp>
+
+#include <algorithm>
+
+#include <boost/bind.hpp>
+#include <boost/foreach.hpp>
+#include <boost/regex.hpp>
+#include <boost/algorithm/string.hpp>
+
+#include <core/StringUtils.hpp>
+#include <core/RegexUtils.hpp>
+
+namespace core {
+namespace r_util {
+
+namespace {
+
+const std::size_t kTrigramLength = 3;
+
+void trigramsOf(const std::string& str, std::set<std::string>* pTrigrams)
+{
+   for (std::size_t i = 0; i + kTrigramLength <= str.length(); i++)
+      pTrigrams->insert(str.substr(i, kTrigramLength));
+}
+
+bool refersToIndex(const RSourceIndex* pIndex, const RSourceIndex* pRefIndex)
+{
+   return pIndex == pRefIndex;
+}
+
+bool keyMatches(const std::string& key,
+                const std::string& lowerTerm,
+                bool prefixOnly)
+{
+   if (prefixOnly)
+      return boost::algorithm::starts_with(key, lowerTerm);
+   else
+      return boost::algorithm::contains(key, lowerTerm);
+}
+
+bool keyMatchesRegex(const std::string& key,
+                     const boost::regex& regex,
+                     bool prefixOnly)
+{
+   // the key is already case-folded so match it case-sensitively
+   return regex_utils::textMatches(key, regex, prefixOnly, true);
+}
+
+} // anonymous namespace
+
+void RSymbolIndex::add(const boost::shared_ptr<RSourceIndex>& pIndex)
+{
+   // replace any existing index for this context
+   remove(pIndex->context());
+   indexes_[pIndex->context()] = pIndex;
+
+   const std::vector<RSourceItem>& items = pIndex->items();
+   for (std::size_t i = 0; i<items.size(); i++)
+   {
+      std::string key = string_utils::toLower(items[i].name());
+      std::vector<SymbolRef>& refs = names_[key];
+
+      // first time we've seen this name, add it to the trigram index
+      if (refs.empty())
+      {
+         std::set<std::string> trigrams;
+         trigramsOf(key, &trigrams);
+         BOOST_FOREACH(const std::string& trigram, trigrams)
+         {
+            trigrams_[trigram].insert(key);
+         }
+      }
+
+      refs.push_back(SymbolRef(pIndex.get(), i));
+   }
+}
+
+void RSymbolIndex::remove(const std::string& context)
+{
+   IndexMap::iterator indexIt = indexes_.find(context);
+   if (indexIt == indexes_.end())
+      return;
+
+   const RSourceIndex* pIndex = indexIt->second.get();
+   BOOST_FOREACH(const RSourceItem& item, pIndex->items())
+   {
+      std::string key = string_utils::toLower(item.name());
+      NameMap::iterator nameIt = names_.find(key);
+      if (nameIt == names_.end())
+         continue;
+
+      // remove all references to this index
+      std::vector<SymbolRef>& refs = nameIt->second;
+      refs.erase(std::remove_if(refs.begin(),
+                                refs.end(),
+                                boost::bind(refersToIndex,
+                                            boost::bind(&SymbolRef::pIndex, _1),
+                                            pIndex)),
+                 refs.end());
+
+      // if there are no more references then remove the name entirely
+      if (refs.empty())
+      {
+         std::set<std::string> trigrams;
+         trigramsOf(key, &trigrams);
+         BOOST_FOREACH(const std::string& trigram, trigrams)
+         {
+            TrigramMap::iterator trigramIt = trigrams_.find(trigram);
+            if (trigramIt != trigrams_.end())
+            {
+               trigramIt->second.erase(key);
+               if (trigramIt->second.empty())
+                  trigrams_.erase(trigramIt);
+            }
+         }
+
+         names_.erase(nameIt);
+      }
+   }
+
+   indexes_.erase(indexIt);
+}
+
+void RSymbolIndex::clear()
+{
+   indexes_.clear();
+   names_.clear();
+   trigrams_.clear();
+}
+
+void RSymbolIndex::search(const std::string& term,
+                          bool prefixOnly,
+                          bool caseSensitive,
+                          const std::set<std::string>& excludeContexts,
+                          std::size_t maxResults,
+                          std::vector<RSourceItem>* pItems) const
+{
+   // all matching is done against the case-folded keys (case sensitive
+   // searches additionally filter each item using the original name)
+   std::string lowerTerm = string_utils::toLower(term);
+
+   // determine the key predicate along with the longest literal fragment
+   // of the term (used to narrow the candidates via the trigram index)
+   boost::function<bool(const std::string&)> keyPredicate;
+   ItemPredicate itemPredicate;
+   std::string prefix, literal;
+   if (lowerTerm.find('*') != std::string::npos)
+   {
+      keyPredicate = boost::bind(keyMatchesRegex,
+                                 _1,
+                                 regex_utils::wildcardPatternToRegex(lowerTerm),
+                                 prefixOnly);
+      if (caseSensitive)
+      {
+         itemPredicate = boost::bind(&RSourceItem::nameMatches,
+                                     _1,
+                                     regex_utils::wildcardPatternToRegex(term),
+                                     prefixOnly,
+                                     true);
+      }
+
+      std::vector<std::string> fragments;
+      boost::algorithm::split(fragments,
+                              lowerTerm,
+                              boost::algorithm::is_any_of("*"));
+      if (prefixOnly)
+         prefix = fragments.front();
+      BOOST_FOREACH(const std::string& fragment, fragments)
+      {
+         if (fragment.length() > literal.length())
+            literal = fragment;
+      }
+   }
+   else
+   {
+      keyPredicate = boost::bind(keyMatches, _1, lowerTerm, prefixOnly);
+      if (caseSensitive)
+      {
+         if (prefixOnly)
+            itemPredicate = boost::bind(&RSourceItem::nameStartsWith,
+                                        _1, term, true);
+         else
+            itemPredicate = boost::bind(&RSourceItem::nameContains,
+                                        _1, term, true);
+      }
+      if (prefixOnly)
+         prefix = lowerTerm;
+      literal = lowerTerm;
+   }
+
+   // prefix searches: walk the sorted range of names with the prefix
+   if (!prefix.empty())
+   {
+      for (NameMap::const_iterator it = names_.lower_bound(prefix);
+           it != names_.end() &&
+           boost::algorithm::starts_with(it->first, prefix);
+           ++it)
+      {
+         if (keyPredicate(it->first) &&
+             !collectMatches(it, itemPredicate, excludeContexts,
+                             maxResults, pItems))
+         {
+            return;
+         }
+      }
+   }
+
+   // substring searches: visit only names which share a trigram with
+   // the longest literal fragment of the term
+   else if (literal.length() >= kTrigramLength)
+   {
+      const std::set<std::string>* pCandidates = candidateNames(literal);
+      if (pCandidates == NULL)
+         return;
+
+      BOOST_FOREACH(const std::string& name, *pCandidates)
+      {
+         NameMap::const_iterator it = names_.find(name);
+         if (it != names_.end() &&
+             keyPredicate(it->first) &&
+             !collectMatches(it, itemPredicate, excludeContexts,
+                             maxResults, pItems))
+         {
+            return;
+         }
+      }
+   }
+
+   // terms which are too short to narrow by trigram: scan all names
+   else
+   {
+      for (NameMap::const_iterator it = names_.begin(); it != names_.end(); ++it)
+      {
+         if (keyPredicate(it->first) &&
+             !collectMatches(it, itemPredicate, excludeContexts,
+                             maxResults, pItems))
+         {
+            return;
+         }
+      }
+   }
+}
+
+// add the items for a matching name (returns false once maxResults is hit)
+bool RSymbolIndex::collectMatches(NameMap::const_iterator nameIt,
+                                  const ItemPredicate& itemPredicate,
+                                  const std::set<std::string>& excludeContexts,
+                                  std::size_t maxResults,
+                                  std::vector<RSourceItem>* pItems) const
+{
+   BOOST_FOREACH(const SymbolRef& ref, nameIt->second)
+   {
+      const std::string& context = ref.pIndex->context();
+      if (excludeContexts.find(context) != excludeContexts.end())
+         continue;
+
+      const RSourceItem& item = ref.pIndex->items().at(ref.item);
+
+      // case sensitive searches need to check the original name
+      if (itemPredicate && !itemPredicate(item))
+         continue;
+
+      pItems->push_back(item.withContext(context));
+      if (pItems->size() >= maxResults)
+         return false;
+   }
+
+   return true;
+}
+
+// get the candidate names for a literal fragment (the names associated
+// with the literal's least common trigram) or NULL if there are none
+const std::set<std::string>* RSymbolIndex::candidateNames(
+                                          const std::string& literal) const
+{
+   std::set<std::string> trigrams;
+   trigramsOf(literal, &trigrams);
+
+   const std::set<std::string>* pCandidates = NULL;
+   BOOST_FOREACH(const std::string& trigram, trigrams)
+   {
+      TrigramMap::const_iterator it = trigrams_.find(trigram);
+      if (it == trigrams_.end())
+         return NULL;
+
+      if (pCandidates == NULL || it->second.size() < pCandidates->size())
+         pCandidates = &(it->second);
+   }
+
+   return pCandidates;
+}
+
+} // namespace r_util
+} // namespace core
+
+
@@ -13,17 +13,11 @@
 
 #include <core/r_util/RTokenizer.hpp>
 
-#include <boost/regex.hpp>
-
-#include <iostream>
-
 #include <core/Error.hpp>
 #include <core/Log.hpp>
 #include <core/StringUtils.hpp>
 
 
-// TODO: implement file monitoring
-
 // TODO: some type of cap on number of files or directories? (or just
 // have searches be really slow for that case?)
 
@@ -39,64 +33,316 @@ namespace r_util {
 
 namespace {
 
-class TokenPatterns
+// character classes for ASCII characters
+enum CharClass
+{
+   kSpace      = 0x01,   // \s (whitespace continuation)
+   kLineEnd    = 0x02,   // terminates a comment
+   kDigit      = 0x04,
+   kHexDigit   = 0x08,
+   kAlnum      = 0x10,
+   kEndQuote   = 0x20    // \ ' and " (ends a run of string literal text)
+};
+
+class CharClassTable
 {
 private:
-   friend TokenPatterns& tokenPatterns();
-   TokenPatterns()
-      : NUMBER(L"[0-9]*(\\.[0-9]*)?([eE][+-]?[0-9]*)?[Li]?"),
-        HEX_NUMBER(L"0x[0-9a-fA-F]*L?"),
-        USER_OPERATOR(L"%[^%]*%"),
-        QUOTED_IDENTIFIER(L"`[^`]*`"),
-        UNTIL_END_QUOTE(L"[\\\\\'\"]"),
-        WHITESPACE(L"[\\s\x00A0\x3000]+"),
-        COMMENT(L"#.*?$")
+   friend const CharClassTable& charClassTable();
+   CharClassTable()
    {
+      std::fill(classes_, classes_ + 128, 0);
+
+      const char* space = "\t\n\v\f\r ";
+      for (const char* c = space; *c; c++)
+         classes_[static_cast<int>(*c)] |= kSpace;
+
+      const char* lineEnd = "\n\f\r";
+      for (const char* c = lineEnd; *c; c++)
+         classes_[static_cast<int>(*c)] |= kLineEnd;
+
+      for (int c = '0'; c <= '9'; c++)
+         classes_[c] |= kDigit | kHexDigit | kAlnum;
+      for (int c = 'a'; c <= 'z'; c++)
+         classes_[c] |= kAlnum;
+      for (int c = 'A'; c <= 'Z'; c++)
+         classes_[c] |= kAlnum;
+      for (int c = 'a'; c <= 'f'; c++)
+         classes_[c] |= kHexDigit;
+      for (int c = 'A'; c <= 'F'; c++)
+         classes_[c] |= kHexDigit;
+
+      classes_[static_cast<int>('\\')] |= kEndQuote;
+      classes_[static_cast<int>('\'')] |= kEndQuote;
+      classes_[static_cast<int>('"')] |= kEndQuote;
    }
 
 public:
-   const boost::wregex NUMBER;
-   const boost::wregex HEX_NUMBER;
-   const boost::wregex USER_OPERATOR;
-   const boost::wregex QUOTED_IDENTIFIER;
-   const boost::wregex UNTIL_END_QUOTE;
-   const boost::wregex WHITESPACE;
-   const boost::wregex COMMENT;
+   bool is(unsigned long c, unsigned char charClass) const
+   {
+      return c < 128 && (classes_[c] & charClass);
+   }
+
+private:
+   unsigned char classes_[128];
 };
 
-TokenPatterns& tokenPatterns()
+const CharClassTable& charClassTable()
 {
-   static TokenPatterns instance;
+   static CharClassTable instance;
    return instance;
 }
 
+// code unit as an unsigned value (so that bytes >= 0x80 aren't negative)
+inline unsigned long codeUnit(char c)
+{
+   return static_cast<unsigned char>(c);
+}
+
+inline unsigned long codeUnit(wchar_t c)
+{
+   return static_cast<unsigned long>(c);
+}
+
+// decode the character at pos (wide strings hold one character per unit)
+inline wchar_t decodeChar(std::wstring::const_iterator pos,
+                          std::wstring::const_iterator,
+                          std::size_t* pLength)
+{
+   *pLength = 1;
+   return *pos;
+}
+
+// decode the UTF-8 sequence at pos (invalid or truncated sequences are
+// consumed one byte at a time and yield the replacement character)
+inline wchar_t decodeChar(std::string::const_iterator pos,
+                          std::string::const_iterator end,
+                          std::size_t* pLength)
+{
+   unsigned long lead = codeUnit(*pos);
+   *pLength = 1;
+   if (lead < 0x80)
+      return static_cast<wchar_t>(lead);
+
+   std::size_t length;
+   unsigned long c;
+   if ((lead & 0xE0) == 0xC0)
+   {
+      length = 2;
+      c = lead & 0x1F;
+   }
+   else if ((lead & 0xF0) == 0xE0)
+   {
+      length = 3;
+      c = lead & 0x0F;
+   }
+   else if ((lead & 0xF8) == 0xF0)
+   {
+      length = 4;
+      c = lead & 0x07;
+   }
+   else
+   {
+      return 0xFFFD;
+   }
+
+   if (static_cast<std::size_t>(end - pos) < length)
+      return 0xFFFD;
+
+   for (std::size_t i = 1; i < length; i++)
+   {
+      unsigned long next = codeUnit(*(pos + i));
+      if ((next & 0xC0) != 0x80)
+         return 0xFFFD;
+      c = (c << 6) | (next & 0x3F);
+   }
+
+   *pLength = length;
+   return static_cast<wchar_t>(c);
+}
+
+inline bool isWhitespace(wchar_t c)
+{
+   return charClassTable().is(codeUnit(c), kSpace) ||
+          c == 0x00A0 || c == 0x3000;
+}
+
+inline bool isLineEnd(wchar_t c)
+{
+   return charClassTable().is(codeUnit(c), kLineEnd) ||
+          c == 0x0085 || c == 0x2028 || c == 0x2029;
+}
+
+// the scan functions below take the current position and return the
+// position just beyond the text they match (or the current position if
+// there is no match)
+
+// [\s\x00A0\x3000]*
+template <typename Iterator>
+Iterator scanWhitespace(Iterator pos, Iterator end)
+{
+   const CharClassTable& table = charClassTable();
+   while (pos < end)
+   {
+      if (table.is(codeUnit(*pos), kSpace))
+      {
+         ++pos;
+      }
+      else if (codeUnit(*pos) >= 128)
+      {
+         std::size_t length;
+         if (!isWhitespace(decodeChar(pos, end, &length)))
+            break;
+         pos += length;
+      }
+      else
+      {
+         break;
+      }
+   }
+   return pos;
+}
+
+// #.*?$
+template <typename Iterator>
+Iterator scanComment(Iterator pos, Iterator end)
+{
+   const CharClassTable& table = charClassTable();
+   while (pos < end)
+   {
+      unsigned long c = codeUnit(*pos);
+      if (c < 128)
+      {
+         if (table.is(c, kLineEnd))
+            break;
+         ++pos;
+      }
+      else
+      {
+         std::size_t length;
+         if (isLineEnd(decodeChar(pos, end, &length)))
+            break;
+         pos += length;
+      }
+   }
+   return pos;
+}
+
+// 0x[0-9a-fA-F]*L? or [0-9]*(\.[0-9]*)?([eE][+-]?[0-9]*)?[Li]?
+template <typename Iterator>
+Iterator scanNumber(Iterator pos, Iterator end)
+{
+   const CharClassTable& table = charClassTable();
+
+   if ((end - pos) >= 2 && *pos == '0' && *(pos + 1) == 'x')
+   {
+      pos += 2;
+      while (pos < end && table.is(codeUnit(*pos), kHexDigit))
+         ++pos;
+      if (pos < end && *pos == 'L')
+         ++pos;
+      return pos;
+   }
+
+   while (pos < end && table.is(codeUnit(*pos), kDigit))
+      ++pos;
+
+   if (pos < end && *pos == '.')
+   {
+      ++pos;
+      while (pos < end && table.is(codeUnit(*pos), kDigit))
+         ++pos;
+   }
+
+   if (pos < end && (*pos == 'e' || *pos == 'E'))
+   {
+      ++pos;
+      if (pos < end && (*pos == '+' || *pos == '-'))
+         ++pos;
+      while (pos < end && table.is(codeUnit(*pos), kDigit))
+         ++pos;
+   }
+
+   if (pos < end && (*pos == 'L' || *pos == 'i'))
+      ++pos;
+
+   return pos;
+}
+
+// continuation of an identifier ([alnum._]*)
+template <typename Iterator>
+Iterator scanIdentifier(Iterator pos, Iterator end)
+{
+   const CharClassTable& table = charClassTable();
+   while (pos < end)
+   {
+      unsigned long c = codeUnit(*pos);
+      if (c < 128)
+      {
+         if (!table.is(c, kAlnum) && c != '.' && c != '_')
+            break;
+         ++pos;
+      }
+      else
+      {
+         std::size_t length;
+         if (!string_utils::isalnum(decodeChar(pos, end, &length)))
+            break;
+         pos += length;
+      }
+   }
+   return pos;
+}
+
+// <delim>[^<delim>]*<delim> (used for `quoted identifiers` and %operators%)
+template <typename Iterator>
+Iterator scanDelimited(Iterator pos, Iterator end)
+{
+   Iterator closing = std::find(pos + 1, end, *pos);
+   if (closing == end)
+      return pos;
+   else
+      return closing + 1;
+}
+
+// advance to the next \ ' or " (or the end of the input)
+template <typename Iterator>
+Iterator scanUntilEndQuote(Iterator pos, Iterator end)
+{
+   const CharClassTable& table = charClassTable();
+   while (pos < end && !table.is(codeUnit(*pos), kEndQuote))
+      ++pos;
+   return pos;
+}
+
 } // anonymous namespace
 
 
-const wchar_t RToken::LPAREN         = L'(';
-const wchar_t RToken::RPAREN         = L')';
-const wchar_t RToken::LBRACKET       = L'[';
-const wchar_t RToken::RBRACKET       = L']';
-const wchar_t RToken::LBRACE         = L'{';
-const wchar_t RToken::RBRACE         = L'}';
-const wchar_t RToken::COMMA          = L',';
-const wchar_t RToken::SEMI           = L';';
-const wchar_t RToken::WHITESPACE     = 0x1001;
-const wchar_t RToken::STRING         = 0x1002;
-const wchar_t RToken::NUMBER         = 0x1003;
-const wchar_t RToken::ID             = 0x1004;
-const wchar_t RToken::OPER           = 0x1005;
-const wchar_t RToken::UOPER          = 0x1006;
-const wchar_t RToken::ERR            = 0x1007;
-const wchar_t RToken::LDBRACKET      = 0x1008;
-const wchar_t RToken::RDBRACKET      = 0x1009;
-const wchar_t RToken::COMMENT        = 0x100A;
-
-
-RToken RTokenizer::nextToken()
+const wchar_t RTokenTypes::LPAREN         = L'(';
+const wchar_t RTokenTypes::RPAREN         = L')';
+const wchar_t RTokenTypes::LBRACKET       = L'[';
+const wchar_t RTokenTypes::RBRACKET       = L']';
+const wchar_t RTokenTypes::LBRACE         = L'{';
+const wchar_t RTokenTypes::RBRACE         = L'}';
+const wchar_t RTokenTypes::COMMA          = L',';
+const wchar_t RTokenTypes::SEMI           = L';';
+const wchar_t RTokenTypes::WHITESPACE     = 0x1001;
+const wchar_t RTokenTypes::STRING         = 0x1002;
+const wchar_t RTokenTypes::NUMBER         = 0x1003;
+const wchar_t RTokenTypes::ID             = 0x1004;
+const wchar_t RTokenTypes::OPER           = 0x1005;
+const wchar_t RTokenTypes::UOPER          = 0x1006;
+const wchar_t RTokenTypes::ERR            = 0x1007;
+const wchar_t RTokenTypes::LDBRACKET      = 0x1008;
+const wchar_t RTokenTypes::RDBRACKET      = 0x1009;
+const wchar_t RTokenTypes::COMMENT        = 0x100A;
+
+
+template <typename StringType>
+typename BasicRTokenizer<StringType>::Token
+BasicRTokenizer<StringType>::nextToken()
 {
   if (eol())
-     return RToken() ;
+     return Token() ;
 
   wchar_t c = peek() ;
 
@@ -108,12 +354,12 @@ RToken RTokenizer::nextToken()
      return consumeToken(c, 1) ;
   case L'[':
      if (peek(1) == L'[')
-        return consumeToken(RToken::LDBRACKET, 2) ;
+        return consumeToken(Token::LDBRACKET, 2) ;
      else
         return consumeToken(c, 1) ;
   case L']':
      if (peek(1) == L']')
-        return consumeToken(RToken::RDBRACKET, 2) ;
+        return consumeToken(Token::RDBRACKET, 2) ;
      else
         return consumeToken(c, 1) ;
   case L'"':
@@ -135,7 +381,7 @@ RToken RTokenizer::nextToken()
   if ((c >= L'0' && c <= L'9')
         || (c == L'.' && cNext >= L'0' && cNext <= L'9'))
   {
-     RToken numberToken = matchNumber() ;
+     Token numberToken = matchNumber() ;
      if (numberToken.length() > 0)
         return numberToken ;
   }
@@ -152,32 +398,38 @@ RToken RTokenizer::nextToken()
      return matchIdentifier() ;
   }
 
-  RToken oper = matchOperator() ;
+  Token oper = matchOperator() ;
   if (oper)
      return oper ;
 
-  // Error!!
-  return consumeToken(RToken::ERR, 1) ;
+  // Error!! (consume the whole of a multi-byte character)
+  std::size_t length;
+  decodeChar(pos_, data_.end(), &length);
+  return consumeToken(Token::ERR, length) ;
 }
 
 
 
-RToken RTokenizer::matchWhitespace()
+template <typename StringType>
+typename BasicRTokenizer<StringType>::Token
+BasicRTokenizer<StringType>::matchWhitespace()
 {
-   std::wstring whitespace = peek(tokenPatterns().WHITESPACE) ;
-   return consumeToken(RToken::WHITESPACE, whitespace.length()) ;
+   return consumeToken(Token::WHITESPACE,
+                       scanWhitespace(pos_, data_.end()) - pos_) ;
 }
 
-RToken RTokenizer::matchStringLiteral()
+template <typename StringType>
+typename BasicRTokenizer<StringType>::Token
+BasicRTokenizer<StringType>::matchStringLiteral()
 {
-   std::wstring::const_iterator start = pos_ ;
+   typename StringType::const_iterator start = pos_ ;
    wchar_t quot = eat() ;
 
    bool wellFormed = false ;
 
    while (!eol())
    {
-      eatUntil(tokenPatterns().UNTIL_END_QUOTE);
+      pos_ = scanUntilEndQuote(pos_, data_.end());
 
       if (eol())
          break ;
@@ -207,59 +459,65 @@ RToken RTokenizer::matchStringLiteral()
    // implementation of RToken is stack based so doesn't support subclasses
    // (because they will be sliced when copied). If we need the well
    // formed flag we can just add it onto RToken.
-   return RToken(RToken::STRING,
-                 start,
-                 pos_,
-                 start - data_.begin());
+   return Token(Token::STRING,
+                start,
+                pos_,
+                start - data_.begin());
 }
 
-RToken RTokenizer::matchNumber()
+template <typename StringType>
+typename BasicRTokenizer<StringType>::Token
+BasicRTokenizer<StringType>::matchNumber()
 {
-   std::wstring num = peek(tokenPatterns().HEX_NUMBER) ;
-   if (num.empty())
-      num = peek(tokenPatterns().NUMBER) ;
-
-   return consumeToken(RToken::NUMBER, num.length());
+   return consumeToken(Token::NUMBER, scanNumber(pos_, data_.end()) - pos_);
 }
 
-RToken RTokenizer::matchIdentifier()
+template <typename StringType>
+typename BasicRTokenizer<StringType>::Token
+BasicRTokenizer<StringType>::matchIdentifier()
 {
-   std::wstring::const_iterator start = pos_ ;
+   typename StringType::const_iterator start = pos_ ;
    eat();
-   while (string_utils::isalnum(peek()) || peek() == L'.' || peek() == L'_')
-      eat();
-   return RToken(RToken::ID,
-                 start,
-                 pos_,
-                 start - data_.begin()) ;
+   pos_ = scanIdentifier(pos_, data_.end());
+   return Token(Token::ID,
+                start,
+                pos_,
+                start - data_.begin()) ;
 }
 
-RToken RTokenizer::matchQuotedIdentifier()
+template <typename StringType>
+typename BasicRTokenizer<StringType>::Token
+BasicRTokenizer<StringType>::matchQuotedIdentifier()
 {
-   std::wstring iden = peek(tokenPatterns().QUOTED_IDENTIFIER) ;
-   if (iden.empty())
-      return consumeToken(RToken::ERR, 1);
+   std::size_t length = scanDelimited(pos_, data_.end()) - pos_;
+   if (length == 0)
+      return consumeToken(Token::ERR, 1);
    else
-      return consumeToken(RToken::ID, iden.length());
+      return consumeToken(Token::ID, length);
 }
 
-RToken RTokenizer::matchComment()
+template <typename StringType>
+typename BasicRTokenizer<StringType>::Token
+BasicRTokenizer<StringType>::matchComment()
 {
-   std::wstring comment = peek(tokenPatterns().COMMENT);
-   return consumeToken(RToken::COMMENT, comment.length());
+   return consumeToken(Token::COMMENT, scanComment(pos_, data_.end()) - pos_);
 }
 
-RToken RTokenizer::matchUserOperator()
+template <typename StringType>
+typename BasicRTokenizer<StringType>::Token
+BasicRTokenizer<StringType>::matchUserOperator()
 {
-   std::wstring oper = peek(tokenPatterns().USER_OPERATOR) ;
-   if (oper.empty())
-      return consumeToken(RToken::ERR, 1) ;
+   std::size_t length = scanDelimited(pos_, data_.end()) - pos_;
+   if (length == 0)
+      return consumeToken(Token::ERR, 1) ;
    else
-      return consumeToken(RToken::UOPER, oper.length()) ;
+      return consumeToken(Token::UOPER, length) ;
 }
 
 
-RToken RTokenizer::matchOperator()
+template <typename StringType>
+typename BasicRTokenizer<StringType>::Token
+BasicRTokenizer<StringType>::matchOperator()
 {
    wchar_t cNext = peek(1) ;
 
@@ -269,101 +527,91 @@ RToken RTokenizer::matchOperator()
    case L'^': case L'&': case L'|':
    case L'~': case L'$': case L':':
       // single-character operators
-      return consumeToken(RToken::OPER, 1) ;
+      return consumeToken(Token::OPER, 1) ;
    case L'-': // also ->
-      return consumeToken(RToken::OPER, cNext == L'>' ? 2 : 1) ;
+      return consumeToken(Token::OPER, cNext == L'>' ? 2 : 1) ;
    case L'>': // also >=
-      return consumeToken(RToken::OPER, cNext == L'=' ? 2 : 1) ;
+      return consumeToken(Token::OPER, cNext == L'=' ? 2 : 1) ;
    case L'<': // also <- and <=
-      return consumeToken(RToken::OPER, cNext == L'=' ? 2 :
+      return consumeToken(Token::OPER, cNext == L'=' ? 2 :
                                        cNext == L'-' ? 2 :
                                        1) ;
    case L'=': // also ==
-      return consumeToken(RToken::OPER, cNext == L'=' ? 2 : 1) ;
+      return consumeToken(Token::OPER, cNext == L'=' ? 2 : 1) ;
    case L'!': // also !=
-      return consumeToken(RToken::OPER, cNext == L'=' ? 2 : 1) ;
+      return consumeToken(Token::OPER, cNext == L'=' ? 2 : 1) ;
    default:
-      return RToken() ;
+      return Token() ;
    }
 }
 
-bool RTokenizer::eol()
+template <typename StringType>
+bool BasicRTokenizer<StringType>::eol()
 {
    return pos_ >= data_.end();
 }
 
-wchar_t RTokenizer::peek()
+template <typename StringType>
+wchar_t BasicRTokenizer<StringType>::peek()
 {
    return peek(0) ;
 }
 
-wchar_t RTokenizer::peek(std::size_t lookahead)
+template <typename StringType>
+wchar_t BasicRTokenizer<StringType>::peek(std::size_t lookahead)
 {
-   if ((pos_ + lookahead) >= data_.end())
-      return 0 ;
-   else
-      return *(pos_ + lookahead) ;
-}
-
-wchar_t RTokenizer::eat()
-{
-   wchar_t result = *pos_;
-   pos_++ ;
-   return result ;
-}
-
-std::wstring RTokenizer::peek(const boost::wregex& regex)
-{
-   boost::wsmatch match;
-   std::wstring::const_iterator end = data_.end();
-   boost::match_flag_type flg = boost::match_default | boost::match_continuous;
-   if (boost::regex_search(pos_, end, match, regex, flg))
+   typename StringType::const_iterator pos = pos_;
+   std::size_t length;
+   for (std::size_t i = 0; i < lookahead && pos < data_.end(); i++)
    {
-      return match[0];
+      decodeChar(pos, data_.end(), &length);
+      pos += length;
    }
+
+   if (pos >= data_.end())
+      return 0 ;
    else
-   {
-      return std::wstring();
-   }
+      return decodeChar(pos, data_.end(), &length) ;
 }
 
-void RTokenizer::eatUntil(const boost::wregex& regex)
+template <typename StringType>
+wchar_t BasicRTokenizer<StringType>::eat()
 {
-   boost::wsmatch match;
-   std::wstring::const_iterator end = data_.end();
-   if (boost::regex_search(pos_, end, match, regex))
-   {
-      pos_ = match[0].first;
-   }
-   else
-   {
-      // eat all on failure to match
-      pos_ = data_.end();
-   }
+   std::size_t length;
+   wchar_t result = decodeChar(pos_, data_.end(), &length);
+   pos_ += length ;
+   return result ;
 }
 
 
-RToken RTokenizer::consumeToken(wchar_t tokenType, std::size_t length)
+template <typename StringType>
+typename BasicRTokenizer<StringType>::Token
+BasicRTokenizer<StringType>::consumeToken(wchar_t tokenType,
+                                          std::size_t length)
 {
    if (length == 0)
    {
       LOG_WARNING_MESSAGE("Can't create zero-length token");
-      return RToken();
+      return Token();
    }
-   else if ((pos_ + length) > data_.end())
+   else if (length > static_cast<std::size_t>(data_.end() - pos_))
    {
       LOG_WARNING_MESSAGE("Premature EOF");
-      return RToken();
+      return Token();
    }
 
-   std::wstring::const_iterator start = pos_ ;
+   typename StringType::const_iterator start = pos_ ;
    pos_ += length ;
-   return RToken(tokenType,
-                 start,
-                 pos_,
-                 start - data_.begin()) ;
+   return Token(tokenType,
+                start,
+                pos_,
+                start - data_.begin()) ;
 }
 
+// wide string and UTF-8 tokenizers
+template class BasicRTokenizer<std::wstring>;
+template class BasicRTokenizer<std::string>;
+
 
 } // namespace r_util
 } // namespace core 
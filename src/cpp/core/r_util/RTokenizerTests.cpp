@@ -14,15 +14,336 @@
 #include <core/r_util/RTokenizer.hpp>
 
 #include <iostream>
+#include <vector>
 
 #include <boost/assert.hpp>
+#include <boost/bind.hpp>
 #include <boost/foreach.hpp>
+#include <boost/regex.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include <core/Error.hpp>
+#include <core/Log.hpp>
+#include <core/FilePath.hpp>
+#include <core/FileSerializer.hpp>
+#include <core/StringUtils.hpp>
 
 namespace core {
 namespace r_util {
 
 namespace {
 
+// Reference implementation of the tokenizer (the original regex based
+// version) which the table driven tokenizer is verified against
+class RegexTokenPatterns
+{
+private:
+   friend RegexTokenPatterns& regexTokenPatterns();
+   RegexTokenPatterns()
+      : NUMBER(L"[0-9]*(\\.[0-9]*)?([eE][+-]?[0-9]*)?[Li]?"),
+        HEX_NUMBER(L"0x[0-9a-fA-F]*L?"),
+        USER_OPERATOR(L"%[^%]*%"),
+        QUOTED_IDENTIFIER(L"`[^`]*`"),
+        UNTIL_END_QUOTE(L"[\\\\\'\"]"),
+        WHITESPACE(L"[\\s\x00A0\x3000]+"),
+        COMMENT(L"#.*?$")
+   {
+   }
+
+public:
+   const boost::wregex NUMBER;
+   const boost::wregex HEX_NUMBER;
+   const boost::wregex USER_OPERATOR;
+   const boost::wregex QUOTED_IDENTIFIER;
+   const boost::wregex UNTIL_END_QUOTE;
+   const boost::wregex WHITESPACE;
+   const boost::wregex COMMENT;
+};
+
+RegexTokenPatterns& regexTokenPatterns()
+{
+   static RegexTokenPatterns instance;
+   return instance;
+}
+
+class RegexTokenizer : boost::noncopyable
+{
+public:
+   explicit RegexTokenizer(const std::wstring& data)
+      : data_(data), pos_(data_.begin())
+   {
+   }
+
+   RToken nextToken()
+   {
+      if (eol())
+         return RToken() ;
+
+      wchar_t c = peek() ;
+
+      switch (c)
+      {
+      case L'(': case L')':
+      case L'{': case L'}':
+      case L';': case L',':
+         return consumeToken(c, 1) ;
+      case L'[':
+         if (peek(1) == L'[')
+            return consumeToken(RToken::LDBRACKET, 2) ;
+         else
+            return consumeToken(c, 1) ;
+      case L']':
+         if (peek(1) == L']')
+            return consumeToken(RToken::RDBRACKET, 2) ;
+         else
+            return consumeToken(c, 1) ;
+      case L'"':
+      case L'\'':
+         return matchStringLiteral() ;
+      case L'`':
+         return matchRegex(regexTokenPatterns().QUOTED_IDENTIFIER,
+                           RToken::ID);
+      case L'#':
+         return consumeToken(RToken::COMMENT,
+                             peek(regexTokenPatterns().COMMENT).length());
+      case L'%':
+         return matchRegex(regexTokenPatterns().USER_OPERATOR,
+                           RToken::UOPER);
+      case L' ': case L'\t': case L'\r': case L'\n':
+      case L'\x00A0': case L'\x3000':
+         return consumeToken(RToken::WHITESPACE,
+                             peek(regexTokenPatterns().WHITESPACE).length());
+      }
+
+      wchar_t cNext = peek(1) ;
+
+      if ((c >= L'0' && c <= L'9')
+            || (c == L'.' && cNext >= L'0' && cNext <= L'9'))
+      {
+         std::wstring num = peek(regexTokenPatterns().HEX_NUMBER) ;
+         if (num.empty())
+            num = peek(regexTokenPatterns().NUMBER) ;
+         if (num.length() > 0)
+            return consumeToken(RToken::NUMBER, num.length());
+      }
+
+      if (string_utils::isalnum(c) || c == L'.')
+      {
+         std::wstring::const_iterator start = pos_ ;
+         pos_++;
+         while (string_utils::isalnum(peek()) ||
+                peek() == L'.' ||
+                peek() == L'_')
+         {
+            pos_++;
+         }
+         return RToken(RToken::ID, start, pos_, start - data_.begin()) ;
+      }
+
+      RToken oper = matchOperator() ;
+      if (oper)
+         return oper ;
+
+      return consumeToken(RToken::ERR, 1) ;
+   }
+
+private:
+   RToken matchStringLiteral()
+   {
+      std::wstring::const_iterator start = pos_ ;
+      wchar_t quot = *pos_++ ;
+      while (!eol())
+      {
+         boost::wsmatch match;
+         std::wstring::const_iterator end = data_.end();
+         if (boost::regex_search(pos_, end, match,
+                                 regexTokenPatterns().UNTIL_END_QUOTE))
+            pos_ = match[0].first;
+         else
+            pos_ = data_.end();
+
+         if (eol())
+            break ;
+
+         wchar_t c = *pos_++ ;
+         if (c == quot)
+            break ;
+
+         if (c == L'\\' && !eol())
+            pos_++ ;
+      }
+
+      return RToken(RToken::STRING, start, pos_, start - data_.begin());
+   }
+
+   RToken matchRegex(const boost::wregex& regex, wchar_t tokenType)
+   {
+      std::wstring value = peek(regex) ;
+      if (value.empty())
+         return consumeToken(RToken::ERR, 1);
+      else
+         return consumeToken(tokenType, value.length());
+   }
+
+   RToken matchOperator()
+   {
+      wchar_t cNext = peek(1) ;
+
+      switch (peek())
+      {
+      case L'+': case L'*': case L'/':
+      case L'^': case L'&': case L'|':
+      case L'~': case L'$': case L':':
+         return consumeToken(RToken::OPER, 1) ;
+      case L'-':
+         return consumeToken(RToken::OPER, cNext == L'>' ? 2 : 1) ;
+      case L'>':
+         return consumeToken(RToken::OPER, cNext == L'=' ? 2 : 1) ;
+      case L'<':
+         return consumeToken(RToken::OPER, cNext == L'=' ? 2 :
+                                          cNext == L'-' ? 2 :
+                                          1) ;
+      case L'=':
+         return consumeToken(RToken::OPER, cNext == L'=' ? 2 : 1) ;
+      case L'!':
+         return consumeToken(RToken::OPER, cNext == L'=' ? 2 : 1) ;
+      default:
+         return RToken() ;
+      }
+   }
+
+   bool eol()
+   {
+      return pos_ >= data_.end();
+   }
+
+   wchar_t peek(std::size_t lookahead = 0)
+   {
+      if ((pos_ + lookahead) >= data_.end())
+         return 0 ;
+      else
+         return *(pos_ + lookahead) ;
+   }
+
+   std::wstring peek(const boost::wregex& regex)
+   {
+      boost::wsmatch match;
+      std::wstring::const_iterator end = data_.end();
+      boost::match_flag_type flg = boost::match_default |
+                                   boost::match_continuous;
+      if (boost::regex_search(pos_, end, match, regex, flg))
+         return match[0];
+      else
+         return std::wstring();
+   }
+
+   RToken consumeToken(wchar_t tokenType, std::size_t length)
+   {
+      if (length == 0 || (pos_ + length) > data_.end())
+         return RToken();
+
+      std::wstring::const_iterator start = pos_ ;
+      pos_ += length ;
+      return RToken(tokenType, start, pos_, start - data_.begin()) ;
+   }
+
+private:
+   const std::wstring data_;
+   std::wstring::const_iterator pos_;
+};
+
+// token summary which is comparable across tokenizers (offsets and lengths
+// are always in characters)
+struct TokenInfo
+{
+   TokenInfo(wchar_t type, std::size_t offset, std::size_t length)
+      : type(type), offset(offset), length(length)
+   {
+   }
+
+   bool operator==(const TokenInfo& other) const
+   {
+      return type == other.type &&
+             offset == other.offset &&
+             length == other.length;
+   }
+
+   wchar_t type;
+   std::size_t offset;
+   std::size_t length;
+};
+
+template <typename Tokenizer>
+void wideTokens(const std::wstring& code, std::vector<TokenInfo>* pTokens)
+{
+   Tokenizer tokenizer(code);
+   RToken t;
+   while (t = tokenizer.nextToken())
+      pTokens->push_back(TokenInfo(t.type(), t.offset(), t.length()));
+}
+
+std::size_t utf8Length(const std::string& code,
+                       std::size_t offset,
+                       std::size_t length)
+{
+   std::size_t chars = 0;
+   for (std::size_t i = offset; i < offset + length; i++)
+   {
+      if ((static_cast<unsigned char>(code[i]) & 0xC0) != 0x80)
+         chars++;
+   }
+   return chars;
+}
+
+void utf8Tokens(const std::string& code, std::vector<TokenInfo>* pTokens)
+{
+   RUtf8Tokenizer tokenizer(code);
+   RUtf8Token t;
+   std::size_t chars = 0, bytes = 0;
+   while (t = tokenizer.nextToken())
+   {
+      chars += utf8Length(code, bytes, t.offset() - bytes);
+      bytes = t.offset();
+      pTokens->push_back(TokenInfo(t.type(),
+                                   chars,
+                                   utf8Length(code, t.offset(), t.length())));
+   }
+}
+
+// verify that the regex, wide, and UTF-8 tokenizers all yield the same
+// tokens for the passed code
+bool verifyIdenticalTokens(const std::wstring& code)
+{
+   std::vector<TokenInfo> regexTokens, tokens, utf8TokenInfos;
+   wideTokens<RegexTokenizer>(code, &regexTokens);
+   wideTokens<RTokenizer>(code, &tokens);
+   utf8Tokens(string_utils::wideToUtf8(code), &utf8TokenInfos);
+
+   bool identical = (regexTokens == tokens) && (regexTokens == utf8TokenInfos);
+   if (!identical)
+      std::wcout << L"Tokens differ: " << code << std::endl;
+   BOOST_ASSERT(identical);
+   return identical;
+}
+
+void collectRSourceFiles(const FilePath& filePath,
+                         std::vector<FilePath>* pFiles)
+{
+   if (!filePath.isDirectory() && filePath.extensionLowerCase() == ".r")
+      pFiles->push_back(filePath);
+}
+
+void printThroughput(const std::wstring& name,
+                     double megabytes,
+                     const boost::posix_time::ptime& start)
+{
+   using namespace boost::posix_time;
+   time_duration elapsed = microsec_clock::universal_time() - start;
+   double seconds = static_cast<double>(elapsed.total_microseconds()) / 1e6;
+   std::wcout << name << L": " << (megabytes / seconds) << L" MB/s"
+              << std::endl;
+}
+
 class Verifier
 {
 public:
@@ -42,6 +363,7 @@ public:
 
    void verify(wchar_t tokenType, const std::wstring& value)
    {
+      verifyIdenticalTokens(prefix_ + value + suffix_);
 
       RTokenizer rt(prefix_ + value + suffix_) ;
       RToken t ;
@@ -217,6 +539,47 @@ void testWhitespace()
    v.verify(L" \x00A0\t\x3000\r  ") ;
 }
 
+void testDifferential()
+{
+   const wchar_t* snippets[] = {
+      L"foo <- function(x, y = 2L) { x[[y]] %in% c(0x1F, 1e-3i) }",
+      L"setMethod(\"show\", \"Foo\", function(object) cat('\\'', \"\\\\\"))",
+      L"x <- 'unterminated",
+      L"x <- \"unterminated \x00E9",
+      L"`unterminated quoted identifier",
+      L"a %unterminated user operator",
+      L"# comment\r\n# comment\x2028x # comment\x0085y # comment\fz",
+      L"# comment\vstill comment\n",
+      L"\x00C1" L"bc.d_e <- 1; \x00E9t\x00E9 = \x4E2D\x6587",
+      L"a\x3000" L"b\x00A0" L"c\x2003" L"d\x0085" L"e",
+      L"\x20AC \x00D7 \x00B6 @ ? \\",
+      L"..1 .2 . .a 1..2 0xL 0X1 1e 1e+ 1.e5 1Li",
+      L"x<-y<=z->w>=v==u!=t!s&r|q~p$o:n^m",
+      L"[[ ]] [ ] { } ( ) ; ,",
+      L"\x0001\x007F\xFFFD",
+      L""
+   };
+   for (std::size_t i = 0; i < sizeof(snippets) / sizeof(snippets[0]); i++)
+      verifyIdenticalTokens(snippets[i]);
+
+   // random sequences of characters which are significant to the tokenizer
+   const wchar_t alphabet[] = L"aZ_.09xeELi+-<>=!%`'\"\\#()[]{};, \t\r\n\f\v"
+                              L"\x00A0\x3000\x0085\x2028"
+                              L"\x00C1\x00E9\x20AC\x1F600";
+   const std::size_t alphabetSize = sizeof(alphabet) / sizeof(wchar_t) - 1;
+   unsigned long seed = 12345;
+   for (int i = 0; i < 2000; i++)
+   {
+      std::wstring code;
+      for (int j = 0; j < 24; j++)
+      {
+         seed = seed * 1103515245 + 12345;
+         code.push_back(alphabet[(seed >> 16) % alphabetSize]);
+      }
+      verifyIdenticalTokens(code);
+   }
+}
+
 
 } // anonymous namespace
 
@@ -233,6 +596,73 @@ void runTokenizerTests()
    testStrings();
    testIdentifiers();
    testWhitespace();
+   testDifferential();
+}
+
+// Benchmark the regex, wide, and UTF-8 tokenizers on all of the R source
+// files within sourceDir (also verifies that they all yield the same tokens)
+void runTokenizerBenchmark(const FilePath& sourceDir)
+{
+   std::vector<FilePath> children;
+   Error error = sourceDir.childrenRecursive(
+      boost::bind(collectRSourceFiles, _2, &children));
+   if (error)
+   {
+      LOG_ERROR(error);
+      return;
+   }
+
+   std::vector<std::string> sources;
+   std::vector<std::wstring> wideSources;
+   std::size_t bytes = 0;
+   BOOST_FOREACH(const FilePath& filePath, children)
+   {
+      std::string code;
+      error = readStringFromFile(filePath, &code);
+      if (error)
+      {
+         LOG_ERROR(error);
+         continue;
+      }
+      bytes += code.size();
+      sources.push_back(code);
+      wideSources.push_back(string_utils::utf8ToWide(code));
+      verifyIdenticalTokens(wideSources.back());
+   }
+
+   using namespace boost::posix_time;
+   double megabytes = static_cast<double>(bytes) / (1024 * 1024);
+   std::size_t tokens = 0;
+
+   ptime start = microsec_clock::universal_time();
+   BOOST_FOREACH(const std::wstring& code, wideSources)
+   {
+      RegexTokenizer tokenizer(code);
+      while (tokenizer.nextToken())
+         tokens++;
+   }
+   printThroughput(L"regex (wide)", megabytes, start);
+
+   start = microsec_clock::universal_time();
+   BOOST_FOREACH(const std::wstring& code, wideSources)
+   {
+      RTokenizer tokenizer(code);
+      while (tokenizer.nextToken())
+         tokens++;
+   }
+   printThroughput(L"table (wide)", megabytes, start);
+
+   start = microsec_clock::universal_time();
+   BOOST_FOREACH(const std::string& code, sources)
+   {
+      RUtf8Tokenizer tokenizer(code);
+      while (tokenizer.nextToken())
+         tokens++;
+   }
+   printThroughput(L"table (UTF-8)", megabytes, start);
+
+   std::wcout << sources.size() << L" files, " << megabytes << L" MB, "
+              << tokens / 3 << L" tokens" << std::endl;
 }
 
 
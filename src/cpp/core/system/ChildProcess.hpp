@@ -14,6 +14,8 @@
 #ifndef CORE_SYSTEM_CHILD_PROCESS_HPP
 #define CORE_SYSTEM_CHILD_PROCESS_HPP
 
+#include <set>
+
 #include <core/system/Process.hpp>
 
 #include <core/Error.hpp>
@@ -142,6 +144,7 @@ public:
       if (!error)
       {
          callbacks_ = callbacks;
+         initAsync();
          return Success();
       }
       else
@@ -150,13 +153,22 @@ public:
       }
    }
 
-   // poll for input and exit status
-   void poll();
+   // poll for input and exit status. activity indicates whether a
+   // ChildProcessMonitor reported output or exit for the child (if it
+   // didn't then reading output can be skipped)
+   void poll(bool activity = true);
 
    // has it exited?
    bool exited();
 
 private:
+   friend class ChildProcessMonitor;
+
+   // platform specific setup once the process is running
+   void initAsync();
+
+   // read available output from stdout or stderr (posix)
+   void readOutput(bool stdErr);
 
    void reportError(const Error& error)
    {
@@ -190,6 +202,34 @@ private:
    boost::scoped_ptr<AsyncImpl> pAsyncImpl_;
 };
 
+
+// Waits for activity (output or exit) from asynchronous children so that
+// they can be polled as soon as something happens rather than at a fixed
+// interval. On linux this uses epoll (along with a pidfd for each child
+// where the kernel supports them). On other platforms activity can't be
+// determined so all children are treated as active.
+class ChildProcessMonitor : boost::noncopyable
+{
+public:
+   ChildProcessMonitor();
+   virtual ~ChildProcessMonitor();
+
+   // start monitoring a child which is running (the child stops being
+   // monitored when it exits or is destroyed)
+   void add(AsyncChildProcess* pChild);
+
+   // wait for up to timeoutMs for activity from any of the children
+   void waitForActivity(int timeoutMs);
+
+   // get the children which currently have activity. returns false if
+   // this can't be determined (in which case all should be polled)
+   bool activeChildren(std::set<AsyncChildProcess*>* pActive);
+
+private:
+   struct Impl;
+   boost::scoped_ptr<Impl> pImpl_;
+};
+
 } // namespace system
 } // namespace core
 
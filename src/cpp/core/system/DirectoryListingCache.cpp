@@ -0,0 +1,174 @@
+/*
+ * DirectoryListingCache.cpp
+ *
+ * Copyright (C) 2009-11 by RStudio, Inc.
+ *
+ * This program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <core/system/FileScanner.hpp>
+
+#include <ctime>
+#include <map>
+
+#include <sys/stat.h>
+
+#include <boost/foreach.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include <core/Error.hpp>
+#include <core/Thread.hpp>
+#include <core/FilePath.hpp>
+
+using namespace boost::posix_time;
+
+namespace core {
+namespace system {
+
+namespace {
+
+const time_duration kMaxListingAge = seconds(1);
+
+// modification time of a directory (seconds and nanoseconds)
+typedef std::pair<std::time_t, long> WriteTime;
+
+// only the names and types of entries are cached (the size and
+// modification time of a file can change without its directory changing)
+struct Entry
+{
+   std::string path;
+   bool isDirectory;
+};
+
+struct Listing
+{
+   ptime listedAt;
+   WriteTime directoryWriteTime;
+   std::vector<Entry> entries;
+};
+
+// listings are keyed by directory and whether links were followed
+typedef std::map<std::pair<std::string, bool>, Listing> Listings;
+
+// (listings may be requested from any thread)
+boost::mutex s_mutex;
+Listings s_listings;
+ptime s_lastPruned;
+
+// read the modification time of a directory to the resolution the file
+// system records (returns false if listings of it can't be cached)
+bool directoryWriteTime(const FilePath& dirPath, WriteTime* pWriteTime)
+{
+#ifndef _WIN32
+   struct stat st;
+   if (::stat(dirPath.absolutePath().c_str(), &st) != 0)
+      return false;
+
+#ifdef __APPLE__
+   *pWriteTime = WriteTime(st.st_mtimespec.tv_sec, st.st_mtimespec.tv_nsec);
+#else
+   *pWriteTime = WriteTime(st.st_mtim.tv_sec, st.st_mtim.tv_nsec);
+#endif
+
+   // a directory modified within the current second could be modified
+   // again without its time changing (where only seconds are recorded)
+   return pWriteTime->first < std::time(NULL);
+#else
+   // (only seconds are available)
+   return false;
+#endif
+}
+
+} // anonymous namespace
+
+Error listDirectoryCached(const FilePath& dirPath,
+                          bool followLinks,
+                          std::vector<FileInfo>* pFiles)
+{
+   ptime now = microsec_clock::universal_time();
+   WriteTime writeTime;
+   if (!directoryWriteTime(dirPath, &writeTime))
+      return listDirectory(dirPath, followLinks, pFiles);
+
+   std::pair<std::string, bool> key(dirPath.absolutePath(), followLinks);
+
+   // use the entries of a recent listing if there is one
+   std::vector<Entry> entries;
+   bool found = false;
+   LOCK_MUTEX(s_mutex)
+   {
+      Listings::const_iterator it = s_listings.find(key);
+      if (it != s_listings.end() &&
+          now - it->second.listedAt < kMaxListingAge &&
+          it->second.directoryWriteTime == writeTime)
+      {
+         entries = it->second.entries;
+         found = true;
+      }
+   }
+   END_LOCK_MUTEX
+
+   if (found)
+   {
+      pFiles->clear();
+      BOOST_FOREACH(const Entry& entry, entries)
+      {
+         FileInfo fileInfo;
+         if (entry.isDirectory)
+            pFiles->push_back(FileInfo(entry.path, true));
+         else if (statFile(entry.path, followLinks, &fileInfo))
+            pFiles->push_back(fileInfo);
+      }
+      return Success();
+   }
+
+   // list the directory (without holding the lock)
+   Error error = listDirectory(dirPath, followLinks, pFiles);
+   if (error)
+      return error;
+
+   entries.reserve(pFiles->size());
+   BOOST_FOREACH(const FileInfo& fileInfo, *pFiles)
+   {
+      Entry entry;
+      entry.path = fileInfo.absolutePath();
+      entry.isDirectory = fileInfo.isDirectory();
+      entries.push_back(entry);
+   }
+
+   LOCK_MUTEX(s_mutex)
+   {
+      Listing& listing = s_listings[key];
+      listing.listedAt = now;
+      listing.directoryWriteTime = writeTime;
+      listing.entries.swap(entries);
+
+      // discard expired listings (at most once per expiry interval so
+      // that listing many directories doesn't repeatedly walk the map)
+      if (s_lastPruned.is_not_a_date_time() ||
+          now - s_lastPruned > kMaxListingAge)
+      {
+         for (Listings::iterator it = s_listings.begin();
+              it != s_listings.end(); )
+         {
+            if (now - it->second.listedAt >= kMaxListingAge)
+               s_listings.erase(it++);
+            else
+               ++it;
+         }
+         s_lastPruned = now;
+      }
+   }
+   END_LOCK_MUTEX
+
+   return Success();
+}
+
+} // namespace system
+} // namespace core
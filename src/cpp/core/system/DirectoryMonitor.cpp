@@ -21,6 +21,7 @@
 #include <core/Error.hpp>
 #include <core/FilePath.hpp>
 #include <core/FileInfo.hpp>
+#include <core/system/FileScanner.hpp>
     
 namespace core {
 namespace system {
@@ -30,19 +31,9 @@ namespace {
 Error fileListing(const FilePath& filePath, std::vector<FileInfo>* pFiles)
 {
    // get the children
-   std::vector<FilePath> children ;
-   Error error = filePath.children(&children);
+   Error error = listDirectory(filePath, true, pFiles);
    if (error)
       return error;
-  
-   // add to listing
-   pFiles->clear();
-   for (std::vector<FilePath>::const_iterator it = children.begin();
-        it != children.end();
-        ++it)
-   {
-      pFiles->push_back(FileInfo(*it));
-   }
    
    // sort the listing
    std::sort(pFiles->begin(), pFiles->end(), fileInfoPathLessThan);
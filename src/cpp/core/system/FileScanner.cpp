@@ -31,6 +31,33 @@ inline FileInfo toFileInfo(const FilePath& filePath)
 
 } // anonymous namespace
 
+bool statFile(const std::string& path, bool followLinks, FileInfo* pFileInfo)
+{
+   FilePath filePath(path);
+   if (!filePath.exists())
+      return false;
+
+   *pFileInfo = FileInfo(filePath);
+   return true;
+}
+
+Error listDirectory(const FilePath& dirPath,
+                    bool followLinks,
+                    std::vector<FileInfo>* pFiles)
+{
+   std::vector<FilePath> children;
+   Error error = dirPath.children(&children);
+   if (error)
+      return error;
+
+   pFiles->clear();
+   std::transform(children.begin(),
+                  children.end(),
+                  std::back_inserter(*pFiles),
+                  toFileInfo);
+   return Success();
+}
+
 Error scanFiles(const FileInfo& fromRoot,
                 bool recursive,
                 const boost::function<bool(const FileInfo&)>& filter,
@@ -55,23 +82,16 @@ Error scanFiles(const tree<FileInfo>::iterator_base& fromNode,
    // clear all existing
    pTree->erase_children(fromNode);
 
-   // create FilePath for root
-   FilePath rootPath(fromNode->absolutePath());
-
    // read directory entries
-   std::vector<FilePath> children;
-   Error error = rootPath.children(&children);
+   std::vector<FileInfo> childrenFileInfo;
+   Error error = listDirectory(FilePath(fromNode->absolutePath()),
+                               false,
+                               &childrenFileInfo);
    if (error)
       return error;
 
-   // convert to FileInfo and sort using alphasort equivilant (for
-   // compatability with scandir, which is what is used in our
-   // posix-specific implementation
-   std::vector<FileInfo> childrenFileInfo;
-   std::transform(children.begin(),
-                  children.end(),
-                  std::back_inserter(childrenFileInfo),
-                  toFileInfo);
+   // sort using alphasort equivilant (for compatability with scandir,
+   // which is what is used in our posix-specific implementation
    std::sort(childrenFileInfo.begin(),
              childrenFileInfo.end(),
              fileInfoPathLessThan);
@@ -27,10 +27,20 @@
 #include <iostream>
 #include <sstream>
 
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/syscall.h>
+#endif
+
 #include <boost/iostreams/copy.hpp>
 
 #include <core/Error.hpp>
 #include <core/Log.hpp>
+#include <core/BoostThread.hpp>
 
 #include "ChildProcess.hpp"
 
@@ -67,36 +77,47 @@ Error readStream(redi::basic_pstream<char>& stream, std::string* pStr)
    }
 }
 
-void asyncReadStream(redi::basic_pstream<char>& stream, std::string* pOutput)
+Error setNonBlocking(int fd)
 {
-   char ch;
-   while (stream.readsome(&ch, 1) > 0)
-      pOutput->append(1, ch);
+   int flags = ::fcntl(fd, F_GETFL);
+   if (flags == -1 || ::fcntl(fd, F_SETFL, flags | O_NONBLOCK) == -1)
+      return systemError(errno, ERROR_LOCATION);
+   else
+      return Success();
 }
 
-Error checkStreamState(redi::basic_pstream<char>& stream,
-                       bool *pFinished,
-                       bool otherFinished)
+// read the output which is currently available from a non-blocking pipe
+// (limiting the amount read at once so other children get a turn). sets
+// pEof when the write end of the pipe has been closed
+Error readPipe(int fd, std::string* pOutput, bool* pEof)
 {
-   // defualt to no error
-   Error error;
+   const std::size_t kMaxRead = 1024 * 1024;
+   char buffer[65536];
 
-   // check for eof or error
-   if (stream.eof())
+   *pEof = false;
+   while (pOutput->size() < kMaxRead)
    {
-      *pFinished = true;
-   }
-   else if (stream.fail())
-   {
-      error = systemError(boost::system::errc::io_error, ERROR_LOCATION);
+      ssize_t bytesRead = ::read(fd, buffer, sizeof(buffer));
+      if (bytesRead > 0)
+      {
+         pOutput->append(buffer, bytesRead);
+      }
+      else if (bytesRead == 0)
+      {
+         *pEof = true;
+         break;
+      }
+      else if (errno == EAGAIN || errno == EWOULDBLOCK)
+      {
+         break;
+      }
+      else if (errno != EINTR)
+      {
+         return systemError(errno, ERROR_LOCATION);
+      }
    }
 
-   // clear any error bit if the other stream isn't finished yet
-   if (!stream.good() && !otherFinished)
-      stream.clear();
-
-   // return error status
-   return error;
+   return Success();
 }
 
 
@@ -232,14 +253,49 @@ struct AsyncChildProcess::AsyncImpl
       : calledOnStarted_(false),
         finishedStdout_(false),
         finishedStderr_(false),
-        exited_(false)
+        exited_(false),
+        epollFd_(-1),
+        pidFd_(-1)
    {
    }
 
+   // stop waiting on a descriptor (we do this explicitly rather than
+   // relying on close since other children may have inherited it)
+   void unmonitor(int fd)
+   {
+#ifdef __linux__
+      if (epollFd_ != -1 && fd != -1)
+      {
+         struct epoll_event event;
+         if (::epoll_ctl(epollFd_, EPOLL_CTL_DEL, fd, &event) == -1 &&
+             errno != ENOENT && errno != EBADF)
+         {
+            LOG_ERROR(systemError(errno, ERROR_LOCATION));
+         }
+      }
+#endif
+   }
+
+   void closePidFd()
+   {
+      if (pidFd_ != -1)
+      {
+         unmonitor(pidFd_);
+         ::close(pidFd_);
+         pidFd_ = -1;
+      }
+   }
+
    bool calledOnStarted_;
    bool finishedStdout_;
    bool finishedStderr_;
    bool exited_;
+
+   // epoll instance of the ChildProcessMonitor (-1 if not monitored)
+   int epollFd_;
+
+   // pidfd for the child (-1 if not monitored or unsupported)
+   int pidFd_;
 };
 
 AsyncChildProcess::AsyncChildProcess(const std::string& exe,
@@ -257,9 +313,63 @@ AsyncChildProcess::AsyncChildProcess(const std::string& command)
 
 AsyncChildProcess::~AsyncChildProcess()
 {
+   try
+   {
+      if (!pAsyncImpl_->finishedStdout_)
+         pAsyncImpl_->unmonitor(pImpl_->rdbuf().out_fd(false));
+      if (!pAsyncImpl_->finishedStderr_)
+         pAsyncImpl_->unmonitor(pImpl_->rdbuf().out_fd(true));
+      pAsyncImpl_->closePidFd();
+   }
+   catch(...)
+   {
+   }
+}
+
+void AsyncChildProcess::initAsync()
+{
+   // we read output directly from the pipes as it becomes available
+   for (int i = 0; i < 2; i++)
+   {
+      Error error = setNonBlocking(pImpl_->rdbuf().out_fd(i == 1));
+      if (error)
+         LOG_ERROR(error);
+   }
 }
 
-void AsyncChildProcess::poll()
+void AsyncChildProcess::readOutput(bool stdErr)
+{
+   bool& finished = stdErr ? pAsyncImpl_->finishedStderr_ :
+                             pAsyncImpl_->finishedStdout_;
+   if (finished)
+      return;
+
+   int fd = pImpl_->rdbuf().out_fd(stdErr);
+   std::string output;
+   bool eof = false;
+   Error error = readPipe(fd, &output, &eof);
+
+   // fire event if we got output
+   if (!output.empty())
+   {
+      if (stdErr && callbacks_.onStderr)
+         callbacks_.onStderr(*this, output);
+      else if (!stdErr && callbacks_.onStdout)
+         callbacks_.onStdout(*this, output);
+   }
+
+   if (error)
+      reportError(error);
+
+   // stop waiting on the pipe once it is finished
+   if (eof || error)
+   {
+      finished = true;
+      pAsyncImpl_->unmonitor(fd);
+   }
+}
+
+void AsyncChildProcess::poll(bool activity)
 {
    // check for output
    try
@@ -284,37 +394,10 @@ void AsyncChildProcess::poll()
          }
       }
 
-      // check stdout and fire event if we got output
-      if (!pAsyncImpl_->finishedStdout_)
-      {
-         std::string out;
-         asyncReadStream(pImpl_->pstream_.out(), &out);
-         if (!out.empty() && callbacks_.onStdout)
-            callbacks_.onStdout(*this, out);
-
-         // check stream state
-         Error error = checkStreamState(pImpl_->pstream_,
-                                        &(pAsyncImpl_->finishedStdout_),
-                                        pAsyncImpl_->finishedStderr_);
-         if (error)
-            reportError(error);
-      }
-
-      // check stderr and fire event if we got output
-      if (!pAsyncImpl_->finishedStderr_)
-      {
-         std::string err;
-         asyncReadStream(pImpl_->pstream_.err(), &err);
-         if (!err.empty() && callbacks_.onStderr)
-            callbacks_.onStderr(*this, err);
-
-         // check stream state
-         Error error = checkStreamState(pImpl_->pstream_,
-                                        &(pAsyncImpl_->finishedStderr_),
-                                        pAsyncImpl_->finishedStdout_);
-         if (error)
-            reportError(error);
-      }
+      // if we have a pidfd then its activity tells us whether the child
+      // has exited -- otherwise we need to check every time
+      if (!activity && pAsyncImpl_->pidFd_ != -1)
+         return;
 
       // Check for exited. Note that this method specifies WNOHANG
       // so we don't block forever waiting for a process the exit. We may
@@ -328,8 +411,28 @@ void AsyncChildProcess::poll()
       // calling exited in every polling interval (and this leak this
       // object). Note that we don't anticipate this ever occuring based
       // on our understanding of waitpid, PStreams, etc.
-      if (pImpl_->rdbuf().exited() || (pImpl_->rdbuf().error() == ECHILD))
+      bool exited = pImpl_->rdbuf().exited() ||
+                    (pImpl_->rdbuf().error() == ECHILD);
+
+      // read output (we always read after an exit so we get everything
+      // that was written before it)
+      if (activity || exited)
+      {
+         readOutput(false);
+         readOutput(true);
+      }
+
+      if (exited)
       {
+         // stop waiting on the child
+         pAsyncImpl_->closePidFd();
+         if (!pAsyncImpl_->finishedStdout_)
+            pAsyncImpl_->unmonitor(pImpl_->rdbuf().out_fd(false));
+         if (!pAsyncImpl_->finishedStderr_)
+            pAsyncImpl_->unmonitor(pImpl_->rdbuf().out_fd(true));
+         pAsyncImpl_->finishedStdout_ = true;
+         pAsyncImpl_->finishedStderr_ = true;
+
          // close the stream (this won't block because we have
          // already established that the child is not running)
          pImpl_->pstream_.close();
@@ -363,6 +466,125 @@ bool AsyncChildProcess::exited()
    return pAsyncImpl_->exited_;
 }
 
+struct ChildProcessMonitor::Impl
+{
+   Impl() : epollFd(-1) {}
+
+#ifdef __linux__
+   bool wait(int timeoutMs, std::set<AsyncChildProcess*>* pActive)
+   {
+      if (epollFd == -1)
+         return false;
+
+      const int kMaxEvents = 64;
+      struct epoll_event events[kMaxEvents];
+      int count;
+      do
+      {
+         count = ::epoll_wait(epollFd, events, kMaxEvents, timeoutMs);
+      }
+      while (count == -1 && errno == EINTR);
+
+      if (count == -1)
+      {
+         LOG_ERROR(systemError(errno, ERROR_LOCATION));
+         return false;
+      }
+
+      if (pActive != NULL)
+      {
+         for (int i = 0; i < count; i++)
+         {
+            pActive->insert(
+                  static_cast<AsyncChildProcess*>(events[i].data.ptr));
+         }
+      }
+
+      return true;
+   }
+
+   void monitor(int fd, AsyncChildProcess* pChild)
+   {
+      struct epoll_event event;
+      event.events = EPOLLIN;
+      event.data.ptr = pChild;
+      if (::epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event) == -1)
+         LOG_ERROR(systemError(errno, ERROR_LOCATION));
+   }
+#endif
+
+   int epollFd;
+};
+
+ChildProcessMonitor::ChildProcessMonitor()
+   : pImpl_(new Impl())
+{
+#ifdef __linux__
+   pImpl_->epollFd = ::epoll_create(64);
+   if (pImpl_->epollFd == -1)
+      LOG_ERROR(systemError(errno, ERROR_LOCATION));
+   else
+      ::fcntl(pImpl_->epollFd, F_SETFD, FD_CLOEXEC);
+#endif
+}
+
+ChildProcessMonitor::~ChildProcessMonitor()
+{
+   if (pImpl_->epollFd != -1)
+      ::close(pImpl_->epollFd);
+}
+
+void ChildProcessMonitor::add(AsyncChildProcess* pChild)
+{
+#ifdef __linux__
+   if (pImpl_->epollFd == -1)
+      return;
+
+   AsyncChildProcess::AsyncImpl& asyncImpl = *(pChild->pAsyncImpl_);
+   redi::basic_pstreambuf<char>& rdbuf = pChild->pImpl_->rdbuf();
+
+   asyncImpl.epollFd_ = pImpl_->epollFd;
+   pImpl_->monitor(rdbuf.out_fd(false), pChild);
+   pImpl_->monitor(rdbuf.out_fd(true), pChild);
+
+   // a pidfd becomes readable when the child exits (without one we need
+   // to check for exit every time the child is polled)
+#ifdef SYS_pidfd_open
+   pid_t pid = rdbuf.pid();
+   if (pid > 0)
+   {
+      int pidFd = ::syscall(SYS_pidfd_open, pid, 0);
+      if (pidFd != -1)
+      {
+         ::fcntl(pidFd, F_SETFD, FD_CLOEXEC);
+         asyncImpl.pidFd_ = pidFd;
+         pImpl_->monitor(pidFd, pChild);
+      }
+   }
+#endif
+#endif
+}
+
+void ChildProcessMonitor::waitForActivity(int timeoutMs)
+{
+#ifdef __linux__
+   if (pImpl_->wait(timeoutMs, NULL))
+      return;
+#endif
+
+   boost::this_thread::sleep(boost::posix_time::milliseconds(timeoutMs));
+}
+
+bool ChildProcessMonitor::activeChildren(
+                                 std::set<AsyncChildProcess*>* pActive)
+{
+#ifdef __linux__
+   return pImpl_->wait(0, pActive);
+#else
+   return false;
+#endif
+}
+
 
 
 } // namespace system
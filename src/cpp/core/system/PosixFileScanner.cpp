@@ -13,9 +13,14 @@
 
 #include <core/system/FileScanner.hpp>
 
+#include <errno.h>
+#include <fcntl.h>
 #include <dirent.h>
+#include <string.h>
 #include <sys/stat.h>
 
+#include <algorithm>
+
 #include <core/Error.hpp>
 #include <core/Log.hpp>
 #include <core/FilePath.hpp>
@@ -24,20 +29,129 @@ namespace core {
 namespace system {
 
 namespace {
+
+// stat a directory entry (returns false if it has since been removed or
+// can't be stat'ed)
+bool statEntry(int dirFd,
+               const char* name,
+               const std::string& path,
+               bool followLinks,
+               FileInfo* pFileInfo)
+{
+#ifdef STATX_BASIC_STATS
+   // request only what we need and don't force attribute synchronization
+   // (which costs a round-trip to the server on network file systems)
+   struct statx stx;
+   int flags = AT_STATX_DONT_SYNC | (followLinks ? 0 : AT_SYMLINK_NOFOLLOW);
+   int res = ::statx(dirFd,
+                     name,
+                     flags,
+                     STATX_TYPE | STATX_SIZE | STATX_MTIME,
+                     &stx);
+#else
+   struct stat st;
+   int res = ::fstatat(dirFd, name, &st, followLinks ? 0 : AT_SYMLINK_NOFOLLOW);
+#endif
+
+   if (res == -1)
+   {
+      // removed since the directory was read (or a dangling link)
+      if (errno != ENOENT)
+      {
+         Error error = systemError(errno, ERROR_LOCATION);
+         error.addProperty("path", path);
+         LOG_ERROR(error);
+      }
+      return false;
+   }
+
+#ifdef STATX_BASIC_STATS
+   bool isDirectory = S_ISDIR(stx.stx_mode);
+   uintmax_t size = stx.stx_size;
+   std::time_t lastWriteTime = stx.stx_mtime.tv_sec;
+#else
+   bool isDirectory = S_ISDIR(st.st_mode);
+   uintmax_t size = st.st_size;
 #ifdef __APPLE__
-int entryFilter(struct dirent *entry)
+   std::time_t lastWriteTime = st.st_mtimespec.tv_sec;
 #else
-int entryFilter(const struct dirent *entry)
+   std::time_t lastWriteTime = st.st_mtime;
 #endif
-{
-   if (::strcmp(entry->d_name, ".") == 0 || ::strcmp(entry->d_name, "..") == 0)
-      return 0;
+#endif
+
+   if (isDirectory)
+      *pFileInfo = FileInfo(path, true);
    else
-      return 1;
+      *pFileInfo = FileInfo(path, false, size, lastWriteTime);
+   return true;
 }
 
 } // anonymous namespace
 
+bool statFile(const std::string& path, bool followLinks, FileInfo* pFileInfo)
+{
+   return statEntry(AT_FDCWD, path.c_str(), path, followLinks, pFileInfo);
+}
+
+Error listDirectory(const FilePath& dirPath,
+                    bool followLinks,
+                    std::vector<FileInfo>* pFiles)
+{
+   pFiles->clear();
+
+   std::string dir = dirPath.absolutePath();
+   DIR* pDir = ::opendir(dir.c_str());
+   if (pDir == NULL)
+   {
+      Error error = systemError(errno, ERROR_LOCATION);
+      error.addProperty("path", dir);
+      return error;
+   }
+
+   std::string prefix = dir;
+   if (prefix.empty() || prefix[prefix.length() - 1] != '/')
+      prefix.append("/");
+
+   // readdir reads entries from the kernel in large batches
+   Error error;
+   int dirFd = ::dirfd(pDir);
+   while (true)
+   {
+      errno = 0;
+      struct dirent* pEntry = ::readdir(pDir);
+      if (pEntry == NULL)
+      {
+         if (errno != 0)
+         {
+            error = systemError(errno, ERROR_LOCATION);
+            error.addProperty("path", dir);
+         }
+         break;
+      }
+
+      const char* name = pEntry->d_name;
+      if (::strcmp(name, ".") == 0 || ::strcmp(name, "..") == 0)
+         continue;
+
+      // directories don't need to be stat'ed (we don't report their size
+      // or modification time) if the file system reports entry types
+#ifdef DT_DIR
+      if (pEntry->d_type == DT_DIR)
+      {
+         pFiles->push_back(FileInfo(prefix + name, true));
+         continue;
+      }
+#endif
+
+      FileInfo fileInfo;
+      if (statEntry(dirFd, name, prefix + name, followLinks, &fileInfo))
+         pFiles->push_back(fileInfo);
+   }
+
+   ::closedir(pDir);
+   return error;
+}
+
 Error scanFiles(const FileInfo& fromRoot,
                 bool recursive,
                 const boost::function<bool(const FileInfo&)>& filter,
@@ -54,63 +168,24 @@ Error scanFiles(const tree<FileInfo>::iterator_base& fromNode,
    // clear all existing
    pTree->erase_children(fromNode);
 
-   // create FilePath for root
-   FilePath rootPath(fromNode->absolutePath());
-
-   // read directory contents
-   struct dirent **namelist;
-   int entries = ::scandir(fromNode->absolutePath().c_str(),
-                           &namelist,
-                           entryFilter,
-                           ::alphasort);
-   if (entries == -1)
-   {
-      Error error = systemError(boost::system::errc::no_such_file_or_directory,
-                                ERROR_LOCATION);
-      error.addProperty("path", fromNode->absolutePath());
+   // read directory contents (links aren't followed so that we don't
+   // recurse into linked directories)
+   std::vector<FileInfo> entries;
+   Error error = listDirectory(FilePath(fromNode->absolutePath()),
+                               false,
+                               &entries);
+   if (error)
       return error;
-   }
+
+   // sort in the same order as alphasort
+   std::sort(entries.begin(), entries.end(), fileInfoPathLessThan);
 
    // iterate over entries
-   for(int i=0; i<entries; i++)
+   for (std::vector<FileInfo>::const_iterator it = entries.begin();
+        it != entries.end();
+        ++it)
    {
-      // get the entry (then free it) and compute the path
-      dirent entry = *namelist[i];
-      ::free(namelist[i]);
-      std::string name(entry.d_name,
-#ifdef __APPLE__
-                       entry.d_namlen);
-#else
-                       entry.d_reclen);
-#endif
-      std::string path = rootPath.childPath(name).absolutePath();
-
-      // get the attributes
-      struct stat st;
-      int res = ::lstat(path.c_str(), &st);
-      if (res == -1)
-      {
-         LOG_ERROR(systemError(errno, ERROR_LOCATION));
-         continue;
-      }
-
-      // create the FileInfo
-      FileInfo fileInfo;
-      if (S_ISDIR(st.st_mode))
-      {
-         fileInfo = FileInfo(path, true);
-      }
-      else
-      {
-         fileInfo = FileInfo(path,
-                             false,
-                             st.st_size,
-#ifdef __APPLE__
-                             st.st_mtimespec.tv_sec);
-#else
-                             st.st_mtime);
-#endif
-      }
+      const FileInfo& fileInfo = *it;
 
       // apply the filter (if any)
       if (!filter || filter(fileInfo))
@@ -120,8 +195,8 @@ Error scanFiles(const tree<FileInfo>::iterator_base& fromNode,
          {
             tree<FileInfo>::iterator_base child = pTree->append_child(fromNode,
                                                                       fileInfo);
-            // recurse if requested and this isn't a link
-            if (recursive && !S_ISLNK(st.st_mode))
+            // recurse if requested
+            if (recursive)
             {
                Error error = scanFiles(child, true, filter, pTree);
                if (error)
@@ -138,9 +213,6 @@ Error scanFiles(const tree<FileInfo>::iterator_base& fromNode,
       }
    }
 
-   // free the namelist
-   ::free(namelist);
-
    // return success
    return Success();
 }
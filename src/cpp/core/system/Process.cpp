@@ -13,6 +13,7 @@
 
 #include <core/system/Process.hpp>
 
+#include <set>
 #include <iostream>
 
 #include <boost/bind.hpp>
@@ -54,6 +55,8 @@ Error runCommand(const std::string& command,
 
 struct ProcessSupervisor::Impl
 {
+   // (declared first so that the children are destroyed before it)
+   ChildProcessMonitor monitor;
    std::vector<boost::shared_ptr<AsyncChildProcess> > children;
 };
 
@@ -70,6 +73,7 @@ namespace {
 
 Error runChild(boost::shared_ptr<AsyncChildProcess> pChild,
                std::vector<boost::shared_ptr<AsyncChildProcess> >* pChildren,
+               ChildProcessMonitor* pMonitor,
                const ProcessCallbacks& callbacks)
 {
    // run the child
@@ -77,8 +81,9 @@ Error runChild(boost::shared_ptr<AsyncChildProcess> pChild,
    if (error)
       return error;
 
-   // add to the list of children
+   // add to the list of children (and wait for its activity)
    pChildren->push_back(pChild);
+   pMonitor->add(pChild.get());
 
    // success
    return Success();
@@ -95,7 +100,10 @@ Error ProcessSupervisor::runProgram(const std::string& executable,
                                  new AsyncChildProcess(executable, args));
 
    // run the child
-   return runChild(pChild, &(pImpl_->children), callbacks);
+   return runChild(pChild,
+                   &(pImpl_->children),
+                   &(pImpl_->monitor),
+                   callbacks);
 }
 
 Error ProcessSupervisor::runCommand(const std::string& command,
@@ -106,7 +114,10 @@ Error ProcessSupervisor::runCommand(const std::string& command,
                                  new AsyncChildProcess(command));
 
    // run the child
-   return runChild(pChild, &(pImpl_->children), callbacks);
+   return runChild(pChild,
+                   &(pImpl_->children),
+                   &(pImpl_->monitor),
+                   callbacks);
 }
 
 namespace {
@@ -231,10 +242,18 @@ bool ProcessSupervisor::poll()
    if (!hasRunningChildren())
       return false;
 
-   // call poll on all of our children
-   std::for_each(pImpl_->children.begin(),
-                 pImpl_->children.end(),
-                 boost::bind(&AsyncChildProcess::poll, _1));
+   // find out which children have output or have exited (if we can't
+   // tell then we poll all of them for output)
+   std::set<AsyncChildProcess*> active;
+   bool haveActive = pImpl_->monitor.activeChildren(&active);
+
+   // call poll on all of our children (so they all get onContinue)
+   for (std::vector<boost::shared_ptr<AsyncChildProcess> >::const_iterator
+        it = pImpl_->children.begin(); it != pImpl_->children.end(); ++it)
+   {
+      AsyncChildProcess* pChild = it->get();
+      pChild->poll(!haveActive || active.count(pChild) > 0);
+   }
 
    // remove any children who have exited from our list
    pImpl_->children.erase(std::remove_if(
@@ -251,9 +270,10 @@ void ProcessSupervisor::wait(int pollingIntervalMs)
 {
    while (poll())
    {
-      boost::this_thread::sleep(
-           boost::posix_time::milliseconds(pollingIntervalMs));
-  }
+      // wait for output or exit (polling at least every interval so
+      // that onContinue is still called)
+      pImpl_->monitor.waitForActivity(pollingIntervalMs);
+   }
 }
 
 } // namespace system
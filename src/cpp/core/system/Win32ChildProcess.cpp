@@ -441,7 +441,11 @@ AsyncChildProcess::~AsyncChildProcess()
 {
 }
 
-void AsyncChildProcess::poll()
+void AsyncChildProcess::initAsync()
+{
+}
+
+void AsyncChildProcess::poll(bool activity)
 {
    // call onStarted if we haven't yet
    if (!(pAsyncImpl_->calledOnStarted_))
@@ -533,6 +537,36 @@ bool AsyncChildProcess::exited()
    return pImpl_->hProcess == NULL;
 }
 
+// activity isn't tracked on win32 (the pipes are anonymous so they can't
+// be waited on) so we simply wait for the timeout
+struct ChildProcessMonitor::Impl
+{
+};
+
+ChildProcessMonitor::ChildProcessMonitor()
+   : pImpl_(new Impl())
+{
+}
+
+ChildProcessMonitor::~ChildProcessMonitor()
+{
+}
+
+void ChildProcessMonitor::add(AsyncChildProcess* pChild)
+{
+}
+
+void ChildProcessMonitor::waitForActivity(int timeoutMs)
+{
+   ::Sleep(timeoutMs);
+}
+
+bool ChildProcessMonitor::activeChildren(
+                                 std::set<AsyncChildProcess*>* pActive)
+{
+   return false;
+}
+
 } // namespace system
 } // namespace core
 
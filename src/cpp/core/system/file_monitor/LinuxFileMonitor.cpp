@@ -13,6 +13,18 @@
 
 #include <core/system/FileMonitor.hpp>
 
+#include <errno.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+
+#include <map>
+#include <list>
+#include <memory>
+
+#include <boost/foreach.hpp>
+#include <boost/utility.hpp>
+#include <boost/algorithm/string/predicate.hpp>
+
 #include <core/Log.hpp>
 #include <core/Error.hpp>
 #include <core/FileInfo.hpp>
@@ -22,23 +34,424 @@
 
 #include "FileMonitorImpl.hpp"
 
-// TODO: replace pstreams with native implementation
+// inotify faq: http://inotify.aiken.cz/?section=inotify&page=faq&lang=en
+
+// NOTE: inotify is not recursive so we maintain one watch descriptor for
+// each directory within the monitored tree (adding and removing watches as
+// directories are created and removed). the number of watches available
+// per-user is governed by /proc/sys/fs/inotify/max_user_watches
 
 // TODO: investigate parallel package (multicore) interactions with file monitor
 
 // TODO: should we be using lstat64?
 
-// TODO: investigate use of IN_DONT_FOLLOW to prevent following links
-//       (also add documentation to the API and comment in generic
-//        FileScanner.cpp)
-
 namespace core {
 namespace system {
 namespace file_monitor {
 
 namespace {
 
+// mask for all of the watches we create
+const uint32_t kWatchMask = IN_CREATE |
+                            IN_DELETE |
+                            IN_MODIFY |
+                            IN_MOVED_TO |
+                            IN_MOVED_FROM |
+                            IN_DELETE_SELF |
+                            IN_MOVE_SELF |
+                            IN_DONT_FOLLOW |
+                            IN_ONLYDIR;
+
+class FileEventContext : boost::noncopyable
+{
+public:
+   FileEventContext()
+      : fd(-1), recursive(false), terminated(false)
+   {
+      handle = Handle((void*)this);
+   }
+   virtual ~FileEventContext() {}
+
+   // handle
+   Handle handle;
+
+   // inotify file descriptor (one per monitor so that a queue overflow
+   // only ever affects the tree of a single monitor)
+   int fd;
+
+   // path we are monitoring and recursive flag
+   FilePath rootPath;
+   bool recursive;
+
+   // watch descriptors for each directory in the tree (indexed both ways
+   // so we can map events back to paths and drop all of the watches
+   // beneath a directory which has been removed)
+   std::map<int,std::string> watchPaths;
+   std::map<std::string,int> pathWatches;
+
+   // our own snapshot of the file tree
+   tree<FileInfo> fileTree;
+
+   // set once a monitoring error has been reported (no further events
+   // are delivered while the unregistration is pending)
+   bool terminated;
+
+   // filter/callbacks
+   boost::function<bool(const FileInfo&)> filter;
+   Callbacks callbacks;
+};
+
+// active contexts (accessed only from the file monitor thread)
+std::list<FileEventContext*> s_activeContexts;
+
+Error addWatch(const std::string& path, FileEventContext* pContext)
+{
+   int wd = ::inotify_add_watch(pContext->fd, path.c_str(), kWatchMask);
+   if (wd < 0)
+   {
+      Error error = systemError(errno, ERROR_LOCATION);
+      error.addProperty("path", path);
+      return error;
+   }
+
+   // note that inotify returns the existing watch descriptor if the
+   // path is already being watched so this is safe to call repeatedly
+   pContext->watchPaths[wd] = path;
+   pContext->pathWatches[path] = wd;
+
+   return Success();
+}
+
+Error addWatches(const tree<FileInfo>& fileTree, FileEventContext* pContext)
+{
+   for (tree<FileInfo>::iterator it = fileTree.begin();
+        it != fileTree.end();
+        ++it)
+   {
+      if (it->isDirectory())
+      {
+         Error error = addWatch(it->absolutePath(), pContext);
+         if (error)
+            return error;
+      }
+   }
+
+   return Success();
+}
+
+void removeWatches(const std::string& path, FileEventContext* pContext)
+{
+   // remove watches for the directory and all of its descendents (the
+   // pathWatches map is sorted so these are all in a contiguous range)
+   std::string childPrefix = path + "/";
+   std::map<std::string,int>::iterator it =
+                                       pContext->pathWatches.lower_bound(path);
+   while (it != pContext->pathWatches.end() &&
+          (it->first == path ||
+           boost::algorithm::starts_with(it->first, childPrefix)))
+   {
+      // remove the watch (EINVAL is expected if the kernel has already
+      // removed the watch because the directory was deleted)
+      if (::inotify_rm_watch(pContext->fd, it->second) < 0 && errno != EINVAL)
+         LOG_ERROR(systemError(errno, ERROR_LOCATION));
+
+      pContext->watchPaths.erase(it->second);
+      pContext->pathWatches.erase(it++);
+   }
+}
+
+void forgetWatch(int wd, FileEventContext* pContext)
+{
+   std::map<int,std::string>::iterator it = pContext->watchPaths.find(wd);
+   if (it != pContext->watchPaths.end())
+   {
+      pContext->pathWatches.erase(it->second);
+      pContext->watchPaths.erase(it);
+   }
+}
+
+void closeContext(FileEventContext* pContext)
+{
+   // closing the inotify descriptor frees all of its watches
+   if (pContext->fd >= 0)
+   {
+      if (::close(pContext->fd) < 0)
+         LOG_ERROR(systemError(errno, ERROR_LOCATION));
+      pContext->fd = -1;
+   }
+
+   pContext->watchPaths.clear();
+   pContext->pathWatches.clear();
+}
+
+void terminateWithMonitoringError(FileEventContext* pContext,
+                                  const Error& error)
+{
+   pContext->terminated = true;
+   pContext->callbacks.onMonitoringError(error);
+
+   // unregister this monitor (this is done via postback from the
+   // main file_monitor loop so that the monitor Handle can be tracked)
+   file_monitor::unregisterMonitor(pContext->handle);
+}
+
+void processFileChange(const struct inotify_event& event,
+                       const FilePath& filePath,
+                       FileEventContext* pContext,
+                       std::vector<FileChangeEvent>* pFileChanges)
+{
+   // get an iterator to this file's parent
+   FileInfo parentFileInfo(filePath.parent().absolutePath(), true);
+   tree<FileInfo>::iterator parentIt = impl::findFile(
+                                                pContext->fileTree.begin(),
+                                                pContext->fileTree.end(),
+                                                parentFileInfo);
+
+   // if we can't find a parent then return (this directory may have
+   // been excluded from scanning due to a filter)
+   if (parentIt == pContext->fileTree.end())
+      return;
 
+   bool isDirectory = (event.mask & IN_ISDIR) != 0;
+
+   if (event.mask & (IN_CREATE | IN_MOVED_TO))
+   {
+      // the file may have already been removed (in which case we will
+      // get a subsequent remove event and can simply ignore this one)
+      if (!filePath.exists())
+         return;
+
+      // if this is a directory then start watching it before we scan it
+      // so that we don't miss changes which occur during the scan
+      FileInfo fileInfo(filePath);
+      if (isDirectory && pContext->recursive)
+      {
+         Error error = addWatch(filePath.absolutePath(), pContext);
+         if (error)
+         {
+            terminateWithMonitoringError(pContext, error);
+            return;
+         }
+      }
+
+      FileChangeEvent fileChange(FileChangeEvent::FileAdded, fileInfo);
+      std::size_t prevChanges = pFileChanges->size();
+      Error error = impl::processFileAdded(parentIt,
+                                           fileChange,
+                                           pContext->recursive,
+                                           pContext->filter,
+                                           &(pContext->fileTree),
+                                           pFileChanges);
+      if (error)
+      {
+         LOG_ERROR(error);
+         return;
+      }
+
+      // add watches for any sub-directories discovered by the scan
+      if (isDirectory && pContext->recursive)
+      {
+         for (std::size_t i = prevChanges; i<pFileChanges->size(); i++)
+         {
+            const FileInfo& addedInfo = pFileChanges->at(i).fileInfo();
+            if (addedInfo.isDirectory())
+            {
+               Error error = addWatch(addedInfo.absolutePath(), pContext);
+               if (error)
+               {
+                  terminateWithMonitoringError(pContext, error);
+                  return;
+               }
+            }
+         }
+      }
+   }
+   else if (event.mask & (IN_DELETE | IN_MOVED_FROM))
+   {
+      FileInfo fileInfo(filePath.absolutePath(), isDirectory);
+      FileChangeEvent fileChange(FileChangeEvent::FileRemoved, fileInfo);
+      impl::processFileRemoved(parentIt,
+                               fileChange,
+                               pContext->recursive,
+                               &(pContext->fileTree),
+                               pFileChanges);
+
+      if (isDirectory)
+         removeWatches(filePath.absolutePath(), pContext);
+   }
+   else if ((event.mask & IN_MODIFY) && !isDirectory)
+   {
+      // ignore directory modified actions (we rely instead on the
+      // actions which occur inside the directory)
+      if (!filePath.exists())
+         return;
+
+      FileChangeEvent fileChange(FileChangeEvent::FileModified,
+                                 FileInfo(filePath));
+      impl::processFileModified(parentIt,
+                                fileChange,
+                                &(pContext->fileTree),
+                                pFileChanges);
+   }
+}
+
+Error rescanAfterOverflow(FileEventContext* pContext)
+{
+   // the kernel dropped events for this monitor. we don't know which
+   // directories were affected so we diff the monitor's tree against
+   // the filesystem (this fires the appropriate events)
+   Error error = impl::discoverAndProcessFileChanges(
+                                       *(pContext->fileTree.begin()),
+                                       pContext->recursive,
+                                       pContext->filter,
+                                       &(pContext->fileTree),
+                                       pContext->callbacks.onFilesChanged);
+   if (error)
+      return error;
+
+   // re-synchronize watches with the refreshed tree
+   if (pContext->recursive)
+   {
+      // drop watches for directories no longer in the tree
+      std::vector<std::string> stalePaths;
+      typedef std::map<std::string,int>::value_type PathWatch;
+      BOOST_FOREACH(const PathWatch& pathWatch, pContext->pathWatches)
+      {
+         FileInfo dirInfo(pathWatch.first, true);
+         if (impl::findFile(pContext->fileTree.begin(),
+                            pContext->fileTree.end(),
+                            dirInfo) == pContext->fileTree.end())
+         {
+            stalePaths.push_back(pathWatch.first);
+         }
+      }
+      BOOST_FOREACH(const std::string& path, stalePaths)
+      {
+         removeWatches(path, pContext);
+      }
+
+      // add watches for new directories
+      return addWatches(pContext->fileTree, pContext);
+   }
+   else
+   {
+      return Success();
+   }
+}
+
+void processFileChanges(FileEventContext* pContext)
+{
+   // bail if we don't have callbacks installed yet (could have occurred
+   // if we encountered an error during file scanning) or monitoring has
+   // been terminated
+   if (!pContext->callbacks.onFilesChanged || pContext->terminated)
+      return;
+
+   // buffer for reading events (aligned for struct inotify_event)
+   const std::size_t kBuffSize = 16384;
+   char buffer[kBuffSize]
+               __attribute__ ((aligned(__alignof__(struct inotify_event))));
+
+   // accumulate file changes across all of the events we read
+   std::vector<FileChangeEvent> fileChanges;
+
+   // loop until we hit EAGAIN or EWOULDBLOCK
+   while (true)
+   {
+      ssize_t len = ::read(pContext->fd, buffer, kBuffSize);
+      if (len < 0)
+      {
+         // break on errors which indicate there are no events to read
+         if (errno == EAGAIN || errno == EWOULDBLOCK)
+            break;
+
+         if (errno == EINTR)
+            continue;
+
+         // otherwise this is a fatal error
+         terminateWithMonitoringError(pContext,
+                                      systemError(errno, ERROR_LOCATION));
+         return;
+      }
+
+      // iterate through the events
+      const struct inotify_event* pEvent;
+      for (char* ptr = buffer;
+           ptr < buffer + len;
+           ptr += sizeof(struct inotify_event) + pEvent->len)
+      {
+         pEvent = (const struct inotify_event*)ptr;
+
+         // check for queue overflow (we need to rescan the tree)
+         if (pEvent->mask & IN_Q_OVERFLOW)
+         {
+            // deliver changes accumulated so far first so that the
+            // ordering of events is preserved
+            if (!fileChanges.empty())
+            {
+               pContext->callbacks.onFilesChanged(fileChanges);
+               fileChanges.clear();
+            }
+
+            Error error = rescanAfterOverflow(pContext);
+            if (error)
+            {
+               terminateWithMonitoringError(pContext, error);
+               return;
+            }
+            continue;
+         }
+
+         // the kernel removed this watch (directory deleted or unmounted)
+         if (pEvent->mask & IN_IGNORED)
+         {
+            forgetWatch(pEvent->wd, pContext);
+            continue;
+         }
+
+         // find the directory associated with this watch (if we can't
+         // then it's a watch we've already removed)
+         std::map<int,std::string>::const_iterator watchIt =
+                                       pContext->watchPaths.find(pEvent->wd);
+         if (watchIt == pContext->watchPaths.end())
+            continue;
+         FilePath dirPath(watchIt->second);
+
+         // root deleted or moved (terminate monitoring)
+         if ((pEvent->mask & (IN_DELETE_SELF | IN_MOVE_SELF)) &&
+             (dirPath == pContext->rootPath))
+         {
+            Error error = fileNotFoundError(pContext->rootPath.absolutePath(),
+                                            ERROR_LOCATION);
+            terminateWithMonitoringError(pContext, error);
+            return;
+         }
+
+         // self events for sub-directories are handled via the
+         // corresponding delete/move event on their parent
+         if (pEvent->len == 0)
+            continue;
+
+         // get the path and apply the filter
+         FilePath filePath = dirPath.childPath(pEvent->name);
+         FileInfo fileInfo(filePath.absolutePath(),
+                           (pEvent->mask & IN_ISDIR) != 0);
+         if (!pContext->filter || pContext->filter(fileInfo))
+         {
+            processFileChange(*pEvent, filePath, pContext, &fileChanges);
+
+            // stop reading (and discard changes) if the change terminated
+            // monitoring
+            if (pContext->terminated)
+               return;
+         }
+      }
+   }
+
+   // notify client of file changes
+   if (!fileChanges.empty())
+      pContext->callbacks.onFilesChanged(fileChanges);
+}
 
 } // anonymous namespace
 
@@ -47,33 +460,121 @@ namespace detail {
 // register a new file monitor
 Handle registerMonitor(const core::FilePath& filePath,
                        bool recursive,
+                       const boost::function<bool(const FileInfo&)>& filter,
                        const Callbacks& callbacks)
 {
-   return Handle();
+   // create and allocate FileEventContext (create auto-ptr in case we
+   // return early, we'll call release later before returning)
+   FileEventContext* pContext = new FileEventContext();
+   std::auto_ptr<FileEventContext> autoPtrContext(pContext);
+   pContext->rootPath = filePath;
+   pContext->recursive = recursive;
+   pContext->filter = filter;
+
+   // init file descriptor
+   pContext->fd = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+   if (pContext->fd < 0)
+   {
+      callbacks.onRegistrationError(systemError(errno, ERROR_LOCATION));
+      return Handle();
+   }
+
+   // watch the root (always do this before the scan so we don't
+   // miss any events which occur while we are scanning)
+   Error error = addWatch(filePath.absolutePath(), pContext);
+   if (error)
+   {
+      closeContext(pContext);
+      callbacks.onRegistrationError(error);
+      return Handle();
+   }
+
+   // scan the files
+   error = scanFiles(FileInfo(filePath),
+                     recursive,
+                     filter,
+                     &pContext->fileTree);
+   if (error)
+   {
+      closeContext(pContext);
+      callbacks.onRegistrationError(error);
+      return Handle();
+   }
+
+   // watch all of the sub-directories (this will fail with ENOSPC if
+   // the user is out of watches -- report that as a registration error)
+   if (recursive)
+   {
+      error = addWatches(pContext->fileTree, pContext);
+      if (error)
+      {
+         closeContext(pContext);
+         callbacks.onRegistrationError(error);
+         return Handle();
+      }
+   }
+
+   // now that we have finished the file listing we know we have a valid
+   // file-monitor so set the callbacks
+   pContext->callbacks = callbacks;
+
+   // we are going to pass the context pointer to the client (as the Handle)
+   // so we release it here to relinquish ownership
+   autoPtrContext.release();
+   s_activeContexts.push_back(pContext);
+
+   // notify the caller that we have successfully registered
+   callbacks.onRegistered(pContext->handle, pContext->fileTree);
+
+   // return the handle
+   return pContext->handle;
 }
 
 // unregister a file monitor
 void unregisterMonitor(Handle handle)
 {
+   // cast to context
+   FileEventContext* pContext = (FileEventContext*)(handle.pData);
+
+   // stop monitoring
+   closeContext(pContext);
+   s_activeContexts.remove(pContext);
+
+   // let the client know we are unregistered (note this call should always
+   // be prior to delete pContext below!)
+   pContext->callbacks.onUnregistered();
 
+   // delete the context
+   delete pContext;
 }
 
 void run(const boost::function<void()>& checkForInput)
 {
+   // loop processing:
+   //   - file change events (read from each monitor's inotify descriptor)
+   //   - inbound commands (occur during checkForInput)
+   while (true)
+   {
+      std::for_each(s_activeContexts.begin(),
+                    s_activeContexts.end(),
+                    processFileChanges);
 
+      checkForInput();
+   }
 }
 
 void stop()
 {
-
+   // all contexts are unregistered (and their descriptors closed) prior
+   // to this call so there is nothing more to do
 }
 
 } // namespace detail
 } // namespace file_monitor
 } // namespace system
-} // namespace core 
+} // namespace core
+
 
-   
 
 
 
@@ -169,6 +169,15 @@ namespace redi
       int
       error() const;
 
+      /// Return the process id of the child (RStudio addition).
+      pid_t
+      pid() const;
+
+      /// Return the file descriptor for the process' stdout or stderr
+      /// (RStudio addition).
+      pstreams::fd_type
+      out_fd(bool err = false) const;
+
     protected:
       /// Transfer characters to the pipe when character buffer overflows.
       int_type
@@ -1525,6 +1534,27 @@ namespace redi
       return error_;
     }
 
+  /**
+   *  @return  The process id of the child, or -1/0 if there is no child.
+   */
+  template <typename C, typename T>
+    inline pid_t
+    basic_pstreambuf<C,T>::pid() const
+    {
+      return ppid_;
+    }
+
+  /**
+   *  @param   err  true for the stderr pipe, false for the stdout pipe.
+   *  @return  The file descriptor of the pipe, or -1 if it is closed.
+   */
+  template <typename C, typename T>
+    inline pstreams::fd_type
+    basic_pstreambuf<C,T>::out_fd(bool err) const
+    {
+      return rpipe_[err ? rsrc_err : rsrc_out];
+    }
+
   /**
    *  Closes the output pipe, causing the child process to receive the
    *  end-of-file indicator on subsequent reads from its @c stdin stream.
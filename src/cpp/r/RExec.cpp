@@ -14,6 +14,10 @@
 #define R_INTERNAL_FUNCTIONS
 #include <r/RExec.hpp>
 
+#include <map>
+
+#include <boost/algorithm/string/predicate.hpp>
+
 #include <core/FilePath.hpp>
 #include <core/Log.hpp>
 
@@ -175,6 +179,95 @@ void SEXPTopLevelExec(void *data)
    SEXPTopLevelExecContext* pContext = (SEXPTopLevelExecContext*)data;
    *(pContext->pReturnSEXP) = pContext->function();
 }
+
+// Functions in tools:rstudio (.rs.*) are called from C++ constantly so
+// rather than searching for them on every call they are cached (and
+// preserved). A cached function is only used while it is still bound
+// within its environment and isn't masked by the global environment, and
+// the cache is discarded whenever the source manager sources R code (which
+// may re-create the tools:rstudio environment)
+class ToolsFunctionCache : boost::noncopyable
+{
+public:
+   ToolsFunctionCache() : generation_(0) {}
+
+   // COPYING: boost::noncopyable
+
+   SEXP find(const std::string& name)
+   {
+      int generation = r::sourceManager().generation();
+      if (generation != generation_)
+      {
+         clear();
+         generation_ = generation;
+      }
+
+      // check for a cached function
+      Functions::iterator it = functions_.find(name);
+      if (it != functions_.end())
+      {
+         if (isCurrent(it->second))
+            return it->second.functionSEXP;
+
+         ::R_ReleaseObject(it->second.functionSEXP);
+         functions_.erase(it);
+      }
+
+      // look it up and cache it if it is bound within its own environment
+      SEXP functionSEXP = sexp::findFunction(name, std::string());
+      if (TYPEOF(functionSEXP) == CLOSXP)
+      {
+         Function function;
+         function.symbolSEXP = Rf_install(name.c_str());
+         function.functionSEXP = functionSEXP;
+         if (isCurrent(function))
+         {
+            ::R_PreserveObject(functionSEXP);
+            functions_[name] = function;
+         }
+      }
+
+      return functionSEXP;
+   }
+
+private:
+   struct Function
+   {
+      SEXP symbolSEXP;
+      SEXP functionSEXP;
+   };
+   typedef std::map<std::string,Function> Functions;
+
+   static bool isCurrent(const Function& function)
+   {
+      SEXP envSEXP = CLOENV(function.functionSEXP);
+      return Rf_findVarInFrame(envSEXP, function.symbolSEXP) ==
+                                                   function.functionSEXP &&
+             Rf_findVarInFrame(R_GlobalEnv, function.symbolSEXP) ==
+                                                   R_UnboundValue;
+   }
+
+   void clear()
+   {
+      for (Functions::iterator it = functions_.begin();
+           it != functions_.end();
+           ++it)
+      {
+         ::R_ReleaseObject(it->second.functionSEXP);
+      }
+      functions_.clear();
+   }
+
+private:
+   int generation_;
+   Functions functions_;
+};
+
+ToolsFunctionCache& toolsFunctionCache()
+{
+   static ToolsFunctionCache instance;
+   return instance;
+}
    
 } // anonymous namespace
    
@@ -296,8 +389,11 @@ void RFunction::commonInit(const std::string& functionName)
       name = functionName_; 
    }
    
-   // lookup function
-   functionSEXP_ = sexp::findFunction(name, ns);
+   // lookup function (tools:rstudio functions are cached)
+   if (ns.empty() && boost::algorithm::starts_with(name, ".rs."))
+      functionSEXP_ = toolsFunctionCache().find(name);
+   else
+      functionSEXP_ = sexp::findFunction(name, ns);
    if (functionSEXP_ != R_UnboundValue)
       rProtect_.add(functionSEXP_);
 }
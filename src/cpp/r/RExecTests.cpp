@@ -0,0 +1,100 @@
+/*
+ * RExecTests.cpp
+ *
+ * Copyright (C) 2009-11 by RStudio, Inc.
+ *
+ * This program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#define R_INTERNAL_FUNCTIONS
+#include <r/RExec.hpp>
+
+#include <iostream>
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include <core/Error.hpp>
+#include <core/Log.hpp>
+
+#include <r/RSexp.hpp>
+
+using namespace core;
+
+namespace r {
+namespace exec {
+
+namespace {
+
+const char * const kBenchmarkFunction = ".rs.rFunctionBenchmark";
+
+void printCallsPerSecond(const std::string& name,
+                         int iterations,
+                         const boost::posix_time::ptime& start)
+{
+   using namespace boost::posix_time;
+   time_duration elapsed = microsec_clock::universal_time() - start;
+   double seconds = static_cast<double>(elapsed.total_microseconds()) / 1e6;
+   std::cout << name << ": " << (iterations / seconds) << " calls/s"
+             << std::endl;
+}
+
+Error callBenchmarkFunction(RFunction* pFunction)
+{
+   pFunction->addParam("name", std::string("column"));
+   pFunction->addParam("index", 1);
+   return pFunction->call();
+}
+
+} // anonymous namespace
+
+// Benchmark calling a tools:rstudio function with named parameters when
+// it is looked up for each call (as RFunction did before tools:rstudio
+// functions were cached) and when it is cached. Must be called from the
+// main thread with R initialized.
+void runRFunctionBenchmark(int iterations)
+{
+   using namespace boost::posix_time;
+
+   Error error = executeString(
+      ".rs.addFunction('rFunctionBenchmark', function(name, index) NULL)");
+   if (error)
+   {
+      LOG_ERROR(error);
+      return;
+   }
+
+   ptime start = microsec_clock::universal_time();
+   for (int i = 0; i < iterations; i++)
+   {
+      RFunction function(sexp::findFunction(kBenchmarkFunction,
+                                            std::string()));
+      error = callBenchmarkFunction(&function);
+      if (error)
+      {
+         LOG_ERROR(error);
+         return;
+      }
+   }
+   printCallsPerSecond("lookup per call", iterations, start);
+
+   start = microsec_clock::universal_time();
+   for (int i = 0; i < iterations; i++)
+   {
+      RFunction function(kBenchmarkFunction);
+      error = callBenchmarkFunction(&function);
+      if (error)
+      {
+         LOG_ERROR(error);
+         return;
+      }
+   }
+   printCallsPerSecond("cached", iterations, start);
+}
+
+} // namespace exec
+} // namespace r
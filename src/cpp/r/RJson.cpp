@@ -41,10 +41,25 @@
 
 5) There is as of yet no explicit support for arrays or matrixes so they
    will be returned as plain flattened vectors of primitive types
+
+6) Alternatively writeColumnarJson writes json directly (without building
+   json values) in a columnar form which preserves types:
+
+      vector      - {"type":"numeric","values":[1.5,null,"NaN","Inf"]}
+      factor      - {"type":"factor","levels":["a","b"],"values":[0,null]}
+      data frame  - {"rows":2,"columns":[{"name":"x","type":...}, ...]}
+
+   NA is null for all types, the other non-finite reals are strings,
+   complex values are [real, imaginary] pairs, and the class of vectors
+   with one (e.g. Date) is included. Named lists are objects whose fields
+   are written the same way and anything else is converted as above.
+   R json-rpc handlers opt in to this by marking results with .rs.columnar
  
 */
 
+#include <cstring>
 #include <iostream>
+#include <vector>
 
 #define R_INTERNAL_FUNCTIONS
 #include <r/RJson.hpp>
@@ -316,6 +331,320 @@ Error jsonObjectArrayFromDataFrame(SEXP listSEXP, core::json::Value* pValue)
    return Success();
 }
 
+// columnar json (see writeColumnarJson)
+
+void writeStringElement(SEXP stringSEXP, core::json::Writer* pWriter)
+{
+   if (stringSEXP == NA_STRING)
+   {
+      pWriter->writeNull();
+   }
+   else
+   {
+      const char* value = Rf_translateCharUTF8(stringSEXP);
+      pWriter->writeString(value, std::strlen(value));
+   }
+}
+
+void writeRealElement(double value, core::json::Writer* pWriter)
+{
+   // NA is null while the other non-finite values (which json can't
+   // represent) are written as strings
+   if (R_FINITE(value))
+      pWriter->writeReal(value);
+   else if (R_IsNA(value))
+      pWriter->writeNull();
+   else if (ISNAN(value))
+      pWriter->writeString("NaN");
+   else if (value > 0)
+      pWriter->writeString("Inf");
+   else
+      pWriter->writeString("-Inf");
+}
+
+void writeStringArray(SEXP stringsSEXP, core::json::Writer* pWriter)
+{
+   pWriter->writeRaw('[');
+   int length = Rf_length(stringsSEXP);
+   for (int i=0; i<length; i++)
+   {
+      if (i > 0)
+         pWriter->writeRaw(',');
+      writeStringElement(STRING_ELT(stringsSEXP, i), pWriter);
+   }
+   pWriter->writeRaw(']');
+}
+
+Error writeColumnValues(SEXP vectorSEXP,
+                        bool isFactor,
+                        core::json::Writer* pWriter)
+{
+   pWriter->writeRaw("\"values\":[");
+
+   int length = Rf_length(vectorSEXP);
+   switch(TYPEOF(vectorSEXP))
+   {
+      case LGLSXP:
+      {
+         int* values = LOGICAL(vectorSEXP);
+         for (int i=0; i<length; i++)
+         {
+            if (i > 0)
+               pWriter->writeRaw(',');
+            if (values[i] == NA_LOGICAL)
+               pWriter->writeNull();
+            else
+               pWriter->writeBool(values[i] == TRUE);
+         }
+         break;
+      }
+      case INTSXP:
+      {
+         // factor codes are written zero-based (as indexes into the levels)
+         int* values = INTEGER(vectorSEXP);
+         boost::int64_t offset = isFactor ? 1 : 0;
+         for (int i=0; i<length; i++)
+         {
+            if (i > 0)
+               pWriter->writeRaw(',');
+            if (values[i] == NA_INTEGER)
+               pWriter->writeNull();
+            else
+               pWriter->writeInteger(values[i] - offset);
+         }
+         break;
+      }
+      case REALSXP:
+      {
+         double* values = REAL(vectorSEXP);
+         for (int i=0; i<length; i++)
+         {
+            if (i > 0)
+               pWriter->writeRaw(',');
+            writeRealElement(values[i], pWriter);
+         }
+         break;
+      }
+      case STRSXP:
+      {
+         for (int i=0; i<length; i++)
+         {
+            if (i > 0)
+               pWriter->writeRaw(',');
+            writeStringElement(STRING_ELT(vectorSEXP, i), pWriter);
+         }
+         break;
+      }
+      case CPLXSXP:
+      {
+         // [real, imaginary] pairs (null if either part is NA)
+         Rcomplex* values = COMPLEX(vectorSEXP);
+         for (int i=0; i<length; i++)
+         {
+            if (i > 0)
+               pWriter->writeRaw(',');
+            if (R_IsNA(values[i].r) || R_IsNA(values[i].i))
+            {
+               pWriter->writeNull();
+            }
+            else
+            {
+               pWriter->writeRaw('[');
+               writeRealElement(values[i].r, pWriter);
+               pWriter->writeRaw(',');
+               writeRealElement(values[i].i, pWriter);
+               pWriter->writeRaw(']');
+            }
+         }
+         break;
+      }
+      case VECSXP:
+      {
+         // list columns are rare so each element is converted as usual
+         for (int i=0; i<length; i++)
+         {
+            if (i > 0)
+               pWriter->writeRaw(',');
+            core::json::Value value;
+            Error error = jsonValueFromObject(VECTOR_ELT(vectorSEXP, i),
+                                              &value);
+            if (error)
+               return error;
+            pWriter->write(value);
+         }
+         break;
+      }
+      default:
+      {
+         return Error(errc::UnexpectedDataTypeError, ERROR_LOCATION);
+      }
+   }
+
+   pWriter->writeRaw(']');
+   return Success();
+}
+
+const char* columnType(SEXP vectorSEXP, bool isFactor)
+{
+   if (isFactor)
+      return "factor";
+
+   switch(TYPEOF(vectorSEXP))
+   {
+      case LGLSXP:
+         return "logical";
+      case INTSXP:
+         return "integer";
+      case REALSXP:
+         return "numeric";
+      case STRSXP:
+         return "character";
+      case CPLXSXP:
+         return "complex";
+      default:
+         return "list";
+   }
+}
+
+// writes the fields of a column object (the caller writes the braces)
+Error writeColumnFields(SEXP vectorSEXP, core::json::Writer* pWriter)
+{
+   bool isFactor = Rf_isFactor(vectorSEXP);
+
+   pWriter->writeRaw("\"type\":");
+   pWriter->writeString(columnType(vectorSEXP, isFactor));
+
+   // classes other than factor (e.g. Date) so the client can interpret
+   // the values (our rs.columnar marker is omitted)
+   SEXP classSEXP = Rf_getAttrib(vectorSEXP, R_ClassSymbol);
+   if (TYPEOF(classSEXP) == STRSXP && !isFactor)
+   {
+      std::vector<SEXP> classes;
+      for (int i=0; i<Rf_length(classSEXP); i++)
+      {
+         SEXP nameSEXP = STRING_ELT(classSEXP, i);
+         if (std::strcmp(CHAR(nameSEXP), "rs.columnar") != 0)
+            classes.push_back(nameSEXP);
+      }
+
+      if (!classes.empty())
+      {
+         pWriter->writeRaw(",\"class\":[");
+         for (std::size_t i=0; i<classes.size(); i++)
+         {
+            if (i > 0)
+               pWriter->writeRaw(',');
+            writeStringElement(classes[i], pWriter);
+         }
+         pWriter->writeRaw(']');
+      }
+   }
+
+   if (isFactor)
+   {
+      pWriter->writeRaw(",\"levels\":");
+      writeStringArray(Rf_getAttrib(vectorSEXP, R_LevelsSymbol), pWriter);
+   }
+
+   pWriter->writeRaw(',');
+   return writeColumnValues(vectorSEXP, isFactor, pWriter);
+}
+
+//
+// NOTE: this function assumes that the list has a name (possibly empty)
+// for each of its elements
+//
+Error writeColumnarDataFrame(SEXP listSEXP, core::json::Writer* pWriter)
+{
+   SEXP namesSEXP = Rf_getAttrib(listSEXP, R_NamesSymbol);
+   int columns = Rf_length(listSEXP);
+   int rows = columns > 0 ? Rf_length(VECTOR_ELT(listSEXP, 0)) : 0;
+
+   pWriter->writeRaw("{\"rows\":");
+   pWriter->writeInteger(boost::int64_t(rows));
+   pWriter->writeRaw(",\"columns\":[");
+   for (int c=0; c<columns; c++)
+   {
+      if (c > 0)
+         pWriter->writeRaw(',');
+      pWriter->writeRaw("{\"name\":");
+      writeStringElement(STRING_ELT(namesSEXP, c), pWriter);
+      pWriter->writeRaw(',');
+      Error error = writeColumnFields(VECTOR_ELT(listSEXP, c), pWriter);
+      if (error)
+         return error;
+      pWriter->writeRaw('}');
+   }
+   pWriter->writeRaw("]}");
+
+   return Success();
+}
+
+Error writeColumnarObject(SEXP objectSEXP, core::json::Writer* pWriter)
+{
+   switch(TYPEOF(objectSEXP))
+   {
+      case NILSXP:
+      {
+         pWriter->writeNull();
+         return Success();
+      }
+      case LGLSXP:
+      case INTSXP:
+      case REALSXP:
+      case STRSXP:
+      case CPLXSXP:
+      {
+         pWriter->writeRaw('{');
+         Error error = writeColumnFields(objectSEXP, pWriter);
+         if (error)
+            return error;
+         pWriter->writeRaw('}');
+         return Success();
+      }
+      case VECSXP:
+      {
+         // (the columns of data frames can have empty names)
+         if (Rf_inherits(objectSEXP, "data.frame") &&
+             Rf_length(Rf_getAttrib(objectSEXP, R_NamesSymbol)) ==
+                                                   Rf_length(objectSEXP))
+         {
+            return writeColumnarDataFrame(objectSEXP, pWriter);
+         }
+
+         if (!isNamedList(objectSEXP))
+            break;
+
+         // named lists are objects whose fields are in turn columnar
+         SEXP namesSEXP = Rf_getAttrib(objectSEXP, R_NamesSymbol);
+         pWriter->writeRaw('{');
+         for (int i=0; i<Rf_length(objectSEXP); i++)
+         {
+            if (i > 0)
+               pWriter->writeRaw(',');
+            writeStringElement(STRING_ELT(namesSEXP, i), pWriter);
+            pWriter->writeRaw(':');
+            Error error = writeColumnarObject(VECTOR_ELT(objectSEXP, i),
+                                              pWriter);
+            if (error)
+               return error;
+         }
+         pWriter->writeRaw('}');
+         return Success();
+      }
+      default:
+         break;
+   }
+
+   // anything else is converted as usual
+   core::json::Value value;
+   Error error = jsonValueFromObject(objectSEXP, &value);
+   if (error)
+      return error;
+   pWriter->write(value);
+   return Success();
+}
+
 } // anonymous namespace
 
 Error jsonValueFromScalar(SEXP scalarSEXP, core::json::Value* pValue)
@@ -408,7 +737,13 @@ Error jsonValueFromObject(SEXP objectSEXP, core::json::Value* pValue)
          return jsonValueFromVector(objectSEXP, pValue);
       }
    }
-} 
+}
+
+Error writeColumnarJson(SEXP objectSEXP, std::string* pOutput)
+{
+   core::json::Writer writer(pOutput);
+   return writeColumnarObject(objectSEXP, &writer);
+}
    
 } // namespace json
 } // namesapce r
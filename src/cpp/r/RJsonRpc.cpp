@@ -33,6 +33,7 @@
       assigned to list elements
 
 - Outbound R objects are converted to json via rules described in RJson.cpp
+  (results marked with .rs.columnar are written as typed columns)
 
 - Json-rpc functions can signal errors by calling the stop function. note
   that these and any other errors which occur during json rpc calls are
@@ -64,6 +65,18 @@ namespace {
          
 Error setJsonResult(SEXP resultSEXP, core::json::JsonRpcResponse* pResponse)
 {   
+   // results marked as columnar are written directly
+   if (Rf_inherits(resultSEXP, "rs.columnar"))
+   {
+      std::string resultJson;
+      Error error = writeColumnarJson(resultSEXP, &resultJson);
+      if (error)
+         return error;
+
+      pResponse->setResultJson(resultJson);
+      return Success();
+   }
+
    // get the result
    core::json::Value resultValue ;
    Error error = jsonValueFromObject(resultSEXP, &resultValue);
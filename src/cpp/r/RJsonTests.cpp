@@ -0,0 +1,226 @@
+/*
+ * RJsonTests.cpp
+ *
+ * Copyright (C) 2009-11 by RStudio, Inc.
+ *
+ * This program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#define R_INTERNAL_FUNCTIONS
+#include <r/RJson.hpp>
+
+#include <iostream>
+
+#include <boost/assert.hpp>
+#include <boost/format.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include <core/Error.hpp>
+#include <core/Log.hpp>
+
+#include <r/RExec.hpp>
+#include <r/RSexp.hpp>
+
+using namespace core;
+
+namespace r {
+namespace json {
+
+namespace {
+
+void printElapsed(const std::string& name,
+                  std::size_t bytes,
+                  const boost::posix_time::ptime& start)
+{
+   using namespace boost::posix_time;
+   time_duration elapsed = microsec_clock::universal_time() - start;
+   std::cout << name << ": " << elapsed.total_milliseconds() << " ms ("
+             << bytes << " bytes)" << std::endl;
+}
+
+// evaluate R code and write the result as columnar json
+std::string columnarJson(const std::string& code)
+{
+   sexp::Protect rProtect;
+   SEXP objectSEXP;
+   Error error = r::exec::evaluateString(code, &objectSEXP, &rProtect);
+   BOOST_ASSERT(!error);
+
+   std::string output;
+   error = writeColumnarJson(objectSEXP, &output);
+   BOOST_ASSERT(!error);
+   return output;
+}
+
+void checkColumnarJson(const std::string& code, const std::string& expected)
+{
+   std::string output = columnarJson(code);
+   if (output != expected)
+   {
+      std::cerr << code << std::endl
+                << "   expected: " << expected << std::endl
+                << "   actual:   " << output << std::endl;
+   }
+   BOOST_ASSERT(output == expected);
+}
+
+// NOTE: reals are written as json_spirit does (with 16 significant digits)
+
+// NA is null for every type
+void testMissingValues()
+{
+   checkColumnarJson("c(TRUE, NA, FALSE)",
+                     "{\"type\":\"logical\",\"values\":[true,null,false]}");
+   checkColumnarJson("c(1L, NA, -3L)",
+                     "{\"type\":\"integer\",\"values\":[1,null,-3]}");
+   checkColumnarJson("c(1.5, NA)",
+                     "{\"type\":\"numeric\","
+                     "\"values\":[1.500000000000000,null]}");
+   checkColumnarJson("c('a', NA)",
+                     "{\"type\":\"character\",\"values\":[\"a\",null]}");
+   checkColumnarJson("NULL", "null");
+}
+
+// the other non-finite reals are strings (json can't represent them)
+void testNonFiniteValues()
+{
+   checkColumnarJson("c(NaN, Inf, -Inf, 0)",
+                     "{\"type\":\"numeric\","
+                     "\"values\":[\"NaN\",\"Inf\",\"-Inf\","
+                     "0.000000000000000]}");
+}
+
+// factors are zero-based codes into their levels
+void testFactors()
+{
+   checkColumnarJson("factor(c('b', NA, 'a', 'b'), levels = c('b', 'a'))",
+                     "{\"type\":\"factor\",\"levels\":[\"b\",\"a\"],"
+                     "\"values\":[0,null,1,0]}");
+   checkColumnarJson("factor(character())",
+                     "{\"type\":\"factor\",\"levels\":[],\"values\":[]}");
+}
+
+// classes (other than our marker) are passed along with the values
+void testClasses()
+{
+   checkColumnarJson("as.Date(c('1970-01-02', NA))",
+                     "{\"type\":\"numeric\",\"class\":[\"Date\"],"
+                     "\"values\":[1.000000000000000,null]}");
+   checkColumnarJson(".rs.columnar(as.Date('1970-01-11'))",
+                     "{\"type\":\"numeric\",\"class\":[\"Date\"],"
+                     "\"values\":[10.00000000000000]}");
+}
+
+// complex values are [real, imaginary] pairs (null if either is NA)
+void testComplexValues()
+{
+   checkColumnarJson("c(complex(real = 1, imaginary = -2), NA, "
+                     "complex(real = Inf, imaginary = NaN))",
+                     "{\"type\":\"complex\",\"values\":"
+                     "[[1.000000000000000,-2.000000000000000],null,"
+                     "[\"Inf\",\"NaN\"]]}");
+}
+
+void testDataFrames()
+{
+   checkColumnarJson("data.frame(x = c(1L, NA), y = c('a', 'b'), "
+                     "stringsAsFactors = FALSE)",
+                     "{\"rows\":2,\"columns\":["
+                     "{\"name\":\"x\",\"type\":\"integer\","
+                     "\"values\":[1,null]},"
+                     "{\"name\":\"y\",\"type\":\"character\","
+                     "\"values\":[\"a\",\"b\"]}]}");
+   checkColumnarJson("data.frame()", "{\"rows\":0,\"columns\":[]}");
+   checkColumnarJson("list(n = 1L, d = data.frame(f = factor('z')))",
+                     "{\"n\":{\"type\":\"integer\",\"values\":[1]},"
+                     "\"d\":{\"rows\":1,\"columns\":["
+                     "{\"name\":\"f\",\"type\":\"factor\","
+                     "\"levels\":[\"z\"],\"values\":[0]}]}}");
+}
+
+} // anonymous namespace
+
+// Tests of writeColumnarJson. Must be called from the main thread with R
+// initialized.
+void runColumnarJsonTests()
+{
+   testMissingValues();
+   testNonFiniteValues();
+   testFactors();
+   testClasses();
+   testComplexValues();
+   testDataFrames();
+}
+
+// Benchmark writing a data frame of the specified number of rows (with
+// numeric, integer, character, factor, logical, and Date columns) as row
+// objects (via json values) and as typed columns. Must be called from
+// the main thread with R initialized.
+void runColumnarJsonBenchmark(int rows, int iterations)
+{
+   using namespace boost::posix_time;
+
+   boost::format fmt(
+      "local({ n <- %1%; x <- data.frame("
+      "   value = runif(n),"
+      "   count = sample.int(100L, n, replace = TRUE),"
+      "   label = paste('observation', seq_len(n)),"
+      "   group = factor(sample(c('control', 'treatment'), n, TRUE)),"
+      "   flag = sample(c(TRUE, FALSE, NA), n, TRUE),"
+      "   date = as.Date('2011-01-01') + seq_len(n),"
+      "   stringsAsFactors = FALSE);"
+      " x$value[seq(1, n, by = 10)] <- NA; x })");
+
+   sexp::Protect rProtect;
+   SEXP dataFrameSEXP;
+   Error error = r::exec::evaluateString(boost::str(fmt % rows),
+                                         &dataFrameSEXP,
+                                         &rProtect);
+   if (error)
+   {
+      LOG_ERROR(error);
+      return;
+   }
+
+   std::cout << "data frame (" << rows << " rows, " << iterations
+             << " iterations)" << std::endl;
+
+   std::size_t bytes = 0;
+   ptime start = microsec_clock::universal_time();
+   for (int i = 0; i < iterations; i++)
+   {
+      core::json::Value value;
+      error = jsonValueFromObject(dataFrameSEXP, &value);
+      if (error)
+      {
+         LOG_ERROR(error);
+         return;
+      }
+      std::string output;
+      core::json::write(value, &output);
+      bytes = output.size();
+   }
+   printElapsed("   row objects", bytes, start);
+
+   start = microsec_clock::universal_time();
+   for (int i = 0; i < iterations; i++)
+   {
+      std::string output;
+      error = writeColumnarJson(dataFrameSEXP, &output);
+      if (error)
+      {
+         LOG_ERROR(error);
+         return;
+      }
+      bytes = output.size();
+   }
+   printElapsed("   columnar", bytes, start);
+}
+
+} // namespace json
+} // namespace r
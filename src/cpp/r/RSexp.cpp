@@ -107,6 +107,51 @@ void listEnvironment(SEXP env,
    }
 }
 
+namespace {
+
+void addFrameBindings(SEXP frame,
+                      bool includeAll,
+                      std::vector<Binding>* pBindings)
+{
+   for ( ; frame != R_NilValue; frame = CDR(frame))
+   {
+      SEXP valueSEXP = CAR(frame);
+      if (valueSEXP == R_UnboundValue)
+         continue;
+
+      SEXP symbolSEXP = TAG(frame);
+      if (!includeAll && CHAR(PRINTNAME(symbolSEXP))[0] == '.')
+         continue;
+
+      pBindings->push_back(std::make_pair(symbolSEXP, valueSEXP));
+   }
+}
+
+} // anonymous namespace
+
+void listEnvironmentBindings(SEXP env,
+                             bool includeAll,
+                             std::vector<Binding>* pBindings)
+{
+   // reset passed bindings (retains their capacity so that repeated calls
+   // with the same vector don't allocate)
+   pBindings->clear();
+
+   // hashed environments keep a chain of bindings in each bucket of their
+   // hash table, others keep a single chain
+   SEXP hashTableSEXP = HASHTAB(env);
+   if (hashTableSEXP != R_NilValue)
+   {
+      int buckets = Rf_length(hashTableSEXP);
+      for (int i = 0; i < buckets; i++)
+         addFrameBindings(VECTOR_ELT(hashTableSEXP, i), includeAll, pBindings);
+   }
+   else
+   {
+      addFrameBindings(FRAME(env), includeAll, pBindings);
+   }
+}
+
 SEXP findVar(const std::string& name, const std::string& ns)
 {
    if (name.empty())
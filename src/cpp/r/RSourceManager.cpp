@@ -110,6 +110,7 @@ Error SourceManager::source(const FilePath& filePath, bool local)
       
    // record that we sourced the file. 
    recordSourcedFile(filePath, local);
+   generation_++;
    
    // source the file
    return r::exec::executeString(rCode); 
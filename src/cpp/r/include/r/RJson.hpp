@@ -33,6 +33,9 @@ core::Error jsonValueFromScalar(SEXP scalarSEXP, core::json::Value* pValue);
 core::Error jsonValueFromVector(SEXP vectorSEXP, core::json::Value* pValue);
 core::Error jsonValueFromList(SEXP listSEXP, core::json::Value* pValue);
 core::Error jsonValueFromObject(SEXP objectSEXP, core::json::Value* pValue);
+
+// write typed columns (see RJson.cpp) directly to the output
+core::Error writeColumnarJson(SEXP objectSEXP, std::string* pOutput);
    
 } // namespace json
 } // namesapce r
@@ -49,6 +49,15 @@ void listEnvironment(SEXP env,
                      bool includeAll,
                      Protect* pProtect,
                      std::vector<Variable>* pVariables);
+
+// bindings (symbol and value) within an environment, read directly from
+// its frame so that nothing is allocated or evaluated (promises and active
+// bindings are returned as is). the order is that of the frame, which is
+// the same from call to call unless bindings are added or removed
+typedef std::pair<SEXP,SEXP> Binding;
+void listEnvironmentBindings(SEXP env,
+                             bool includeAll,
+                             std::vector<Binding>* pBindings);
       
 // object info
 SEXP findVar(const std::string& name,
@@ -37,7 +37,7 @@ SourceManager& sourceManager();
 class SourceManager : boost::noncopyable
 {
 private:
-   SourceManager() : autoReload_(false) {}
+   SourceManager() : autoReload_(false), generation_(0) {}
    friend SourceManager& sourceManager();
    // COPYING: boost::noncopyable
    
@@ -52,6 +52,9 @@ public:
    core::Error sourceLocal(const core::FilePath& filePath);
    
    void reloadIfNecessary();
+
+   // incremented each time R code is sourced
+   int generation() const { return generation_; }
    
 private:   
    // data types
@@ -76,6 +79,7 @@ private:
    
    // members
    bool autoReload_ ;
+   int generation_ ;
    SourcedFileMap sourcedFiles_ ;
    std::vector<core::FilePath> toolsFilePaths_;
 };
@@ -90,6 +90,13 @@ public:
    virtual core::Error savePlotAsMetafile(const core::FilePath& filePath,
                                           int widthPx,
                                           int heightPx) = 0;
+
+   // render the active plot as an image (images are cached so requests for
+   // a plot at a size it has already been rendered at don't invoke R)
+   virtual core::Error renderPlotImage(const std::string& format,
+                                       int widthPx,
+                                       int heightPx,
+                                       std::string* pImage) = 0;
       
    // display
    virtual bool hasOutput() const = 0 ;
@@ -49,6 +49,8 @@ struct ROptions
          serverMode(false),
          autoReloadSource(false),
          shellEscape(false),
+         plotImageCacheMemoryMb(0),
+         plotImageCacheDiskMb(0),
          restoreWorkspace(true),
          saveWorkspace(SA_SAVEASK)
    {
@@ -69,6 +71,8 @@ struct ROptions
    bool serverMode;
    bool autoReloadSource ;
    bool shellEscape;
+   int plotImageCacheMemoryMb;
+   int plotImageCacheDiskMb;
    bool restoreWorkspace;
    SA_TYPE saveWorkspace;
 };
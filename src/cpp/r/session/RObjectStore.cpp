@@ -0,0 +1,1577 @@
+/*
+ * RObjectStore.cpp
+ *
+ * Copyright (C) 2009-11 by RStudio, Inc.
+ *
+ * This program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include "RObjectStore.hpp"
+
+#include <map>
+#include <set>
+#include <deque>
+#include <string>
+#include <vector>
+#include <sstream>
+#include <iomanip>
+#include <iterator>
+#include <algorithm>
+
+#include <boost/bind.hpp>
+#include <boost/utility.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/foreach.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include <boost/iostreams/filtering_stream.hpp>
+#ifndef _WIN32
+#include <boost/iostreams/filter/zlib.hpp>
+#endif
+
+#include <core/Log.hpp>
+#include <core/Error.hpp>
+#include <core/FilePath.hpp>
+#include <core/FileSerializer.hpp>
+#include <core/Thread.hpp>
+#include <core/json/JsonRpc.hpp>
+
+#define R_INTERNAL_FUNCTIONS
+#include <r/RInternal.hpp>
+#include <r/RExec.hpp>
+#include <r/RSexp.hpp>
+#include <r/RRoutines.hpp>
+#include <r/RErrorCategory.hpp>
+
+using namespace core ;
+
+namespace r {
+namespace session {
+namespace object_store {
+
+namespace {
+
+const char * const kIndexFile = "INDEX";
+
+// object files contain a group of objects serialized as the bindings of an
+// environment (see serializeGroup) and start with a header line giving the
+// codec the group was written with
+const char * const kObjectFileHeader = "RSOBJECT";
+const char * const kCodecZlib = "zlib";
+const char * const kCodecNone = "none";
+
+// groups are streamed to the writer threads in chunks of this size as they
+// are serialized, and at most kMaxPendingChunks are waiting to be written
+// at any time (so the memory used to suspend doesn't depend on the size of
+// the objects being saved)
+const std::size_t kChunkSize = 1024 * 1024;
+const std::size_t kMaxPendingChunks = 8;
+
+// groups are compressed in parallel by up to this many threads
+const unsigned int kMaxWriterThreads = 4;
+
+// groups up to this size are hashed in full before they are compressed (so
+// those which are already in the store are neither compressed nor written)
+const std::size_t kMaxBufferedGroupSize = 8 * kChunkSize;
+
+// serialization format version (readable by all versions of R)
+const int kSerializeVersion = 2;
+
+// variable containing the hash of the group within the environment of
+// the promises created by .rs.restoreSuspendedObjects
+const char * const kHashVar = "hash";
+
+// descriptions of the objects within a group (by name)
+typedef std::map<std::string,std::vector<std::string> > Descriptions;
+
+// store the global environment was last saved to or restored from and the
+// descriptions of the objects within each of its groups (by hash)
+FilePath s_storePath;
+std::map<std::string,Descriptions> s_groups;
+
+// values of the objects within the lazily restored groups which have been
+// read from the store (by hash). the group environment is preserved so that
+// the values aren't collected (and their addresses reused) meanwhile
+struct RestoredGroup
+{
+   SEXP groupSEXP;
+   std::map<std::string,SEXP> values;
+};
+std::map<std::string,RestoredGroup> s_restoredGroups;
+
+FilePath indexFilePath(const FilePath& storePath)
+{
+   return storePath.complete(kIndexFile);
+}
+
+FilePath objectFilePath(const FilePath& storePath, const std::string& hash)
+{
+   return storePath.complete(hash);
+}
+
+Error objectFileError(const std::string& what, const FilePath& filePath)
+{
+   Error error = systemError(boost::system::errc::io_error, ERROR_LOCATION);
+   error.addProperty("what", what);
+   error.addProperty("path", filePath.absolutePath());
+   return error;
+}
+
+// FNV-1a (64 bit), computed incrementally as a group is written
+const boost::uint64_t kHashOffset = 14695981039346656037ULL;
+
+void updateHash(const std::string& data, boost::uint64_t* pHash)
+{
+   boost::uint64_t hash = *pHash;
+   for (std::string::const_iterator it = data.begin(); it != data.end(); ++it)
+   {
+      hash ^= static_cast<unsigned char>(*it);
+      hash *= 1099511628211ULL;
+   }
+   *pHash = hash;
+}
+
+std::string formatHash(boost::uint64_t hash, boost::uint64_t size)
+{
+   // qualify with the size (makes collisions less likely still)
+   std::ostringstream ostr;
+   ostr << std::hex << std::setw(16) << std::setfill('0') << hash
+        << std::dec << "-" << size;
+   return ostr.str();
+}
+
+// file a serialized group is written to. small groups are held until they
+// are complete and only compressed and written if they aren't already in
+// the store. larger groups are compressed to a temporary file as they are
+// written and moved into place once their hash is known
+class GroupFile : boost::noncopyable
+{
+public:
+   GroupFile(const FilePath& storePath, std::size_t group)
+      : storePath_(storePath),
+        tempFilePath_(storePath.complete(
+                  "group." + boost::lexical_cast<std::string>(group) + ".tmp")),
+        hash_(kHashOffset),
+        size_(0)
+   {
+   }
+
+   Error write(const std::string& data)
+   {
+      updateHash(data, &hash_);
+      size_ += data.size();
+
+      if (!pOfs_)
+      {
+         buffer_.append(data);
+         if (buffer_.size() < kMaxBufferedGroupSize)
+            return Success();
+         return writeBuffer();
+      }
+
+      return compress(data);
+   }
+
+   Error close(std::string* pHash)
+   {
+      // no need for another copy of a group which is already in the store
+      *pHash = formatHash(hash_, size_);
+      FilePath filePath = objectFilePath(storePath_, *pHash);
+      if (!pOfs_)
+      {
+         if (filePath.exists())
+            return Success();
+
+         Error error = writeBuffer();
+         if (error)
+            return error;
+      }
+
+      try
+      {
+#ifndef _WIN32
+         // NOTE: reset closes the compressor (writing any remaining output)
+         pCompressStream_->reset();
+#endif
+         pOfs_->flush();
+      }
+      catch(const std::exception& e)
+      {
+         return objectFileError(e.what(), tempFilePath_);
+      }
+      pOfs_.reset();
+
+      if (filePath.exists())
+         return tempFilePath_.remove();
+
+      // move into place (so an object file is never partially written).
+      // another thread may have just written a group with the same hash
+      Error error = tempFilePath_.move(filePath);
+      if (error && filePath.exists())
+         return tempFilePath_.remove();
+      return error;
+   }
+
+   void discard()
+   {
+      try
+      {
+         pCompressStream_.reset();
+      }
+      catch(const std::exception&)
+      {
+      }
+      pOfs_.reset();
+      buffer_.clear();
+
+      Error error = tempFilePath_.removeIfExists();
+      if (error)
+         LOG_ERROR(error);
+   }
+
+private:
+   Error open()
+   {
+      Error error = tempFilePath_.open_w(&pOfs_);
+      if (error)
+         return error;
+
+      try
+      {
+         pOfs_->exceptions(std::ostream::failbit | std::ostream::badbit);
+
+#ifndef _WIN32
+         // compress for speed rather than size (suspending is latency
+         // sensitive and serialized objects compress well regardless)
+         *pOfs_ << kObjectFileHeader << " " << kCodecZlib << "\n";
+         pCompressStream_.reset(new boost::iostreams::filtering_ostream());
+         pCompressStream_->exceptions(std::ostream::failbit |
+                                      std::ostream::badbit);
+         pCompressStream_->push(boost::iostreams::zlib_compressor(
+                                       boost::iostreams::zlib::best_speed));
+         pCompressStream_->push(*pOfs_);
+#else
+         *pOfs_ << kObjectFileHeader << " " << kCodecNone << "\n";
+#endif
+      }
+      catch(const std::exception& e)
+      {
+         return objectFileError(e.what(), tempFilePath_);
+      }
+
+      return Success();
+   }
+
+   Error compress(const std::string& data)
+   {
+      try
+      {
+#ifndef _WIN32
+         pCompressStream_->write(data.data(), data.size());
+#else
+         pOfs_->write(data.data(), data.size());
+#endif
+      }
+      catch(const std::exception& e)
+      {
+         return objectFileError(e.what(), tempFilePath_);
+      }
+
+      return Success();
+   }
+
+   // open the file and compress the group held so far into it
+   Error writeBuffer()
+   {
+      Error error = open();
+      if (error)
+         return error;
+
+      std::string buffer;
+      buffer.swap(buffer_);
+      return compress(buffer);
+   }
+
+private:
+   FilePath storePath_;
+   FilePath tempFilePath_;
+   boost::shared_ptr<std::ostream> pOfs_;
+   boost::scoped_ptr<boost::iostreams::filtering_ostream> pCompressStream_;
+   boost::uint64_t hash_;
+   boost::uint64_t size_;
+   std::string buffer_;
+};
+
+// chunk of a serialized group waiting to be written
+struct GroupChunk
+{
+   GroupChunk() : group(0), last(false), discard(false) {}
+   std::size_t group;
+   std::string data;
+   bool last;
+   bool discard;
+};
+
+// hashes, compresses, and writes serialized groups on a small pool of
+// background threads (each group is written by a single thread). R
+// serializes each group into write() (on the main thread) which passes it
+// to the thread writing the group in chunks, so groups are compressed in
+// parallel with each other and with serialization and a group is never
+// held in memory as a whole (other than small groups, see GroupFile)
+class GroupWriter : boost::noncopyable
+{
+public:
+   GroupWriter(const FilePath& storePath, std::size_t groups)
+      : storePath_(storePath),
+        hashes_(groups),
+        errors_(groups),
+        groupQueued_(false),
+        groupChunks_(groups),
+        pendingChunks_(0),
+        finished_(false)
+   {
+   }
+
+   virtual ~GroupWriter()
+   {
+      try
+      {
+         finish();
+      }
+      catch(...)
+      {
+      }
+   }
+
+   void start()
+   {
+      // a thread per core (less one for R) but no more than there are groups
+      unsigned int cores = boost::thread::hardware_concurrency();
+      std::size_t threads = std::max(1u, std::min(kMaxWriterThreads,
+                                                   cores > 1 ? cores - 1 : 1u));
+      threads = std::min(threads, hashes_.size());
+
+      for (std::size_t i = 0; i < threads; i++)
+      {
+         boost::shared_ptr<boost::thread> pThread(new boost::thread());
+         core::thread::safeLaunchThread(boost::bind(&GroupWriter::run, this),
+                                        pThread.get());
+         if (pThread->joinable())
+            threads_.push_back(pThread);
+      }
+   }
+
+   void beginGroup(std::size_t group)
+   {
+      chunk_.group = group;
+      chunk_.data.reserve(kChunkSize);
+      groupQueued_ = false;
+   }
+
+   // NOTE: called by R while serializing (so must not throw)
+   void write(const char* pData, std::size_t size)
+   {
+      try
+      {
+         chunk_.data.append(pData, size);
+         if (chunk_.data.size() >= kChunkSize)
+            enqueueChunk();
+      }
+      CATCH_UNEXPECTED_EXCEPTION
+   }
+
+   // finish the current group (discarding it if it wasn't serialized)
+   void endGroup(bool discard)
+   {
+      chunk_.last = true;
+      chunk_.discard = discard;
+      enqueueChunk();
+   }
+
+   // wait for all of the groups to be written
+   void finish()
+   {
+      if (threads_.empty())
+         return;
+
+      LOCK_MUTEX(mutex_)
+      {
+         finished_ = true;
+      }
+      END_LOCK_MUTEX
+      chunkQueued_.notify_all();
+
+      BOOST_FOREACH(const boost::shared_ptr<boost::thread>& pThread, threads_)
+      {
+         pThread->join();
+      }
+      threads_.clear();
+   }
+
+   const std::string& hash(std::size_t group) const
+   {
+      return hashes_.at(group);
+   }
+
+   const Error& error(std::size_t group) const
+   {
+      return errors_.at(group);
+   }
+
+private:
+   void enqueueChunk()
+   {
+      // write on this thread if the writer threads couldn't be started
+      if (threads_.empty())
+      {
+         writeChunk(chunk_, &pFile_);
+      }
+      else
+      {
+         boost::unique_lock<boost::mutex> lock(mutex_);
+         while (pendingChunks_ >= kMaxPendingChunks)
+            chunkWritten_.wait(lock);
+
+         std::deque<GroupChunk>& chunks = groupChunks_.at(chunk_.group);
+         chunks.push_back(GroupChunk());
+         GroupChunk& chunk = chunks.back();
+         chunk.group = chunk_.group;
+         chunk.data.swap(chunk_.data);
+         chunk.last = chunk_.last;
+         chunk.discard = chunk_.discard;
+         pendingChunks_++;
+
+         // the first chunk of a group makes it available to a writer thread
+         if (!groupQueued_)
+         {
+            queuedGroups_.push_back(chunk_.group);
+            groupQueued_ = true;
+         }
+
+         lock.unlock();
+         chunkQueued_.notify_all();
+      }
+
+      chunk_.data.clear();
+      chunk_.data.reserve(kChunkSize);
+      chunk_.last = false;
+      chunk_.discard = false;
+   }
+
+   void run()
+   {
+      try
+      {
+         while (true)
+         {
+            std::size_t group;
+
+            boost::unique_lock<boost::mutex> lock(mutex_);
+            while (queuedGroups_.empty() && !finished_)
+               chunkQueued_.wait(lock);
+            if (queuedGroups_.empty())
+               break;
+
+            group = queuedGroups_.front();
+            queuedGroups_.pop_front();
+
+            lock.unlock();
+
+            writeGroup(group);
+         }
+      }
+      catch(const boost::thread_resource_error& e)
+      {
+         Error error(boost::thread_error::ec_from_exception(e),
+                     ERROR_LOCATION);
+         LOG_ERROR(error);
+      }
+      CATCH_UNEXPECTED_EXCEPTION
+   }
+
+   // write each chunk of a group as it is queued. this never waits on a
+   // group other than the one being serialized (the chunks of the groups
+   // before it have all been queued) so the writer threads always make
+   // progress
+   void writeGroup(std::size_t group)
+   {
+      boost::scoped_ptr<GroupFile> pFile;
+      bool last = false;
+      while (!last)
+      {
+         GroupChunk chunk;
+
+         boost::unique_lock<boost::mutex> lock(mutex_);
+         std::deque<GroupChunk>& chunks = groupChunks_.at(group);
+         while (chunks.empty())
+            chunkQueued_.wait(lock);
+
+         chunk.group = chunks.front().group;
+         chunk.data.swap(chunks.front().data);
+         chunk.last = chunks.front().last;
+         chunk.discard = chunks.front().discard;
+         chunks.pop_front();
+         pendingChunks_--;
+
+         lock.unlock();
+         chunkWritten_.notify_one();
+
+         writeChunk(chunk, &pFile);
+         last = chunk.last;
+      }
+   }
+
+   void writeChunk(const GroupChunk& chunk,
+                   boost::scoped_ptr<GroupFile>* ppFile)
+   {
+      Error& error = errors_.at(chunk.group);
+      boost::scoped_ptr<GroupFile>& pFile = *ppFile;
+
+      // first chunk of a group
+      if (!pFile)
+         pFile.reset(new GroupFile(storePath_, chunk.group));
+
+      if (!error)
+         error = pFile->write(chunk.data);
+
+      if (chunk.last)
+      {
+         if (!error && !chunk.discard)
+            error = pFile->close(&hashes_.at(chunk.group));
+         else
+            pFile->discard();
+         pFile.reset();
+      }
+   }
+
+private:
+   FilePath storePath_;
+
+   // results by group (each is written only by the thread writing the
+   // group and read once the writers have finished)
+   std::vector<std::string> hashes_;
+   std::vector<Error> errors_;
+
+   // chunk being serialized into (main thread)
+   GroupChunk chunk_;
+   bool groupQueued_;
+
+   // group being written if the writer threads couldn't be started
+   boost::scoped_ptr<GroupFile> pFile_;
+
+   std::vector<boost::shared_ptr<boost::thread> > threads_;
+   boost::mutex mutex_;
+   boost::condition chunkQueued_;
+   boost::condition chunkWritten_;
+
+   // chunks waiting to be written (by group) and the groups which have yet
+   // to be taken by a writer thread
+   std::vector<std::deque<GroupChunk> > groupChunks_;
+   std::deque<std::size_t> queuedGroups_;
+   std::size_t pendingChunks_;
+   bool finished_;
+};
+
+void outBytes(R_outpstream_t stream, void* pBuffer, int length)
+{
+   GroupWriter* pWriter = static_cast<GroupWriter*>(stream->data);
+   pWriter->write(static_cast<const char*>(pBuffer), length);
+}
+
+void outChar(R_outpstream_t stream, int c)
+{
+   char ch = static_cast<char>(c);
+   outBytes(stream, &ch, 1);
+}
+
+// reads a serialized group from its object file, decompressing it as R
+// unserializes it
+class GroupReader : boost::noncopyable
+{
+public:
+   GroupReader() : pIn_(NULL) {}
+
+   Error open(const FilePath& filePath)
+   {
+      filePath_ = filePath;
+      Error error = filePath.open_r(&pIfs_);
+      if (error)
+         return error;
+
+      // read the header
+      std::string header;
+      if (!std::getline(*pIfs_, header))
+         return objectFileError("no header", filePath);
+      std::istringstream headerStream(header);
+      std::string magic, codec;
+      headerStream >> magic >> codec;
+      if (headerStream.fail() || magic != kObjectFileHeader)
+         return objectFileError("invalid header", filePath);
+
+      if (codec == kCodecNone)
+      {
+         pIn_ = pIfs_.get();
+      }
+#ifndef _WIN32
+      else if (codec == kCodecZlib)
+      {
+         pDecompressStream_.reset(new boost::iostreams::filtering_istream());
+         pDecompressStream_->push(boost::iostreams::zlib_decompressor());
+         pDecompressStream_->push(*pIfs_);
+         pIn_ = pDecompressStream_.get();
+      }
+#endif
+      else
+      {
+         return objectFileError("unsupported codec " + codec, filePath);
+      }
+
+      return Success();
+   }
+
+   // NOTE: called by R while unserializing (so must not throw)
+   bool read(char* pBuffer, std::size_t size)
+   {
+      try
+      {
+         pIn_->read(pBuffer, size);
+         return static_cast<std::size_t>(pIn_->gcount()) == size;
+      }
+      catch(const std::exception& e)
+      {
+         LOG_ERROR(objectFileError(e.what(), filePath_));
+         return false;
+      }
+   }
+
+private:
+   FilePath filePath_;
+   boost::shared_ptr<std::istream> pIfs_;
+   boost::scoped_ptr<boost::iostreams::filtering_istream> pDecompressStream_;
+   std::istream* pIn_;
+};
+
+void inBytes(R_inpstream_t stream, void* pBuffer, int length)
+{
+   GroupReader* pReader = static_cast<GroupReader*>(stream->data);
+   if (!pReader->read(static_cast<char*>(pBuffer), length))
+      Rf_error("Unexpected end of object from suspended session");
+}
+
+int inChar(R_inpstream_t stream)
+{
+   char ch;
+   inBytes(stream, &ch, 1);
+   return static_cast<unsigned char>(ch);
+}
+
+// object within the global environment (for active bindings the value is
+// the binding's function)
+struct GlobalObject
+{
+   GlobalObject(SEXP symbolSEXP, SEXP valueSEXP, bool active)
+      : symbolSEXP(symbolSEXP), valueSEXP(valueSEXP), active(active)
+   {
+   }
+
+   SEXP symbolSEXP;
+   SEXP valueSEXP;
+   bool active;
+};
+typedef std::vector<GlobalObject> ObjectGroup;
+
+// environments other than these are serialized by value (along with
+// their contents)
+bool isSerializedByValue(SEXP envSEXP)
+{
+   return envSEXP != R_GlobalEnv &&
+          envSEXP != R_BaseEnv &&
+          envSEXP != R_EmptyEnv &&
+          envSEXP != R_BaseNamespace &&
+          !R_IsPackageEnv(envSEXP) &&
+          !R_IsNamespaceEnv(envSEXP);
+}
+
+void pushNode(SEXP nodeSEXP, std::vector<SEXP>* pNodes)
+{
+   switch(TYPEOF(nodeSEXP))
+   {
+      // no environments within these
+      case NILSXP:
+      case SYMSXP:
+      case CHARSXP:
+      case SPECIALSXP:
+      case BUILTINSXP:
+      case BCODESXP:
+      case WEAKREFSXP:
+         return;
+
+      // (or these, other than within their attributes)
+      case LGLSXP:
+      case INTSXP:
+      case REALSXP:
+      case CPLXSXP:
+      case STRSXP:
+      case RAWSXP:
+         if (ATTRIB(nodeSEXP) == R_NilValue)
+            return;
+         break;
+
+      default:
+         break;
+   }
+
+   pNodes->push_back(nodeSEXP);
+}
+
+// find the environments which are serialized by value along with an object
+// (the object is walked iteratively since objects may be deeply nested)
+void findSerializedEnvironments(SEXP objectSEXP, std::set<SEXP>* pEnvironments)
+{
+   std::set<SEXP> visited;
+   std::vector<SEXP> nodes;
+   pushNode(objectSEXP, &nodes);
+   while (!nodes.empty())
+   {
+      SEXP nodeSEXP = nodes.back();
+      nodes.pop_back();
+      if (!visited.insert(nodeSEXP).second)
+         continue;
+
+      switch(TYPEOF(nodeSEXP))
+      {
+         case ENVSXP:
+            if (!isSerializedByValue(nodeSEXP))
+               continue;
+            pEnvironments->insert(nodeSEXP);
+            pushNode(FRAME(nodeSEXP), &nodes);
+            pushNode(HASHTAB(nodeSEXP), &nodes);
+            pushNode(ENCLOS(nodeSEXP), &nodes);
+            break;
+
+         case LISTSXP:
+         case LANGSXP:
+         case DOTSXP:
+            pushNode(CAR(nodeSEXP), &nodes);
+            pushNode(CDR(nodeSEXP), &nodes);
+            break;
+
+         case CLOSXP:
+            pushNode(FORMALS(nodeSEXP), &nodes);
+            pushNode(BODY(nodeSEXP), &nodes);
+            pushNode(CLOENV(nodeSEXP), &nodes);
+            break;
+
+         case PROMSXP:
+            pushNode(PRVALUE(nodeSEXP), &nodes);
+            pushNode(PRCODE(nodeSEXP), &nodes);
+            pushNode(PRENV(nodeSEXP), &nodes);
+            break;
+
+         case VECSXP:
+         case EXPRSXP:
+         {
+            int length = Rf_length(nodeSEXP);
+            for (int i = 0; i < length; i++)
+               pushNode(VECTOR_ELT(nodeSEXP, i), &nodes);
+            break;
+         }
+
+         case EXTPTRSXP:
+            pushNode(R_ExternalPtrProtected(nodeSEXP), &nodes);
+            pushNode(R_ExternalPtrTag(nodeSEXP), &nodes);
+            break;
+
+         default:
+            break;
+      }
+
+      pushNode(ATTRIB(nodeSEXP), &nodes);
+   }
+}
+
+std::size_t findGroupRoot(std::vector<std::size_t>* pParents, std::size_t i)
+{
+   std::vector<std::size_t>& parents = *pParents;
+   while (parents[i] != i)
+      i = parents[i] = parents[parents[i]];
+   return i;
+}
+
+// group objects which share environments. objects are serialized in groups
+// since serialization only preserves the identity of environments within a
+// single serialization (e.g. closures sharing an enclosure, reference class
+// objects, or the same environment bound to two names would otherwise be
+// restored as independent copies)
+void groupObjects(const std::vector<GlobalObject>& objects,
+                  std::vector<ObjectGroup>* pGroups)
+{
+   std::vector<std::size_t> parents;
+   for (std::size_t i = 0; i < objects.size(); i++)
+      parents.push_back(i);
+
+   std::map<SEXP,std::size_t> environmentObjects;
+   for (std::size_t i = 0; i < objects.size(); i++)
+   {
+      std::set<SEXP> environments;
+      findSerializedEnvironments(objects[i].valueSEXP, &environments);
+      BOOST_FOREACH(SEXP envSEXP, environments)
+      {
+         std::map<SEXP,std::size_t>::const_iterator it =
+                                          environmentObjects.find(envSEXP);
+         if (it == environmentObjects.end())
+            environmentObjects[envSEXP] = i;
+         else
+            parents[findGroupRoot(&parents, i)] =
+                                       findGroupRoot(&parents, it->second);
+      }
+   }
+
+   // (groups are in the order of their first object)
+   std::map<std::size_t,std::size_t> groupIndexes;
+   for (std::size_t i = 0; i < objects.size(); i++)
+   {
+      std::size_t root = findGroupRoot(&parents, i);
+      if (groupIndexes.find(root) == groupIndexes.end())
+      {
+         groupIndexes[root] = pGroups->size();
+         pGroups->push_back(ObjectGroup());
+      }
+      pGroups->at(groupIndexes[root]).push_back(objects[i]);
+   }
+}
+
+bool isUnforcedPromise(SEXP valueSEXP)
+{
+   return TYPEOF(valueSEXP) == PROMSXP && PRVALUE(valueSEXP) == R_UnboundValue;
+}
+
+SEXP objectValue(SEXP valueSEXP)
+{
+   if (TYPEOF(valueSEXP) == PROMSXP && PRVALUE(valueSEXP) != R_UnboundValue)
+      return PRVALUE(valueSEXP);
+   else
+      return valueSEXP;
+}
+
+// groups made up of values are restored lazily, others (those containing
+// active bindings or promises) are bound as they were when restored
+bool isLazyGroup(const ObjectGroup& group)
+{
+   BOOST_FOREACH(const GlobalObject& object, group)
+   {
+      if (object.active || isUnforcedPromise(object.valueSEXP))
+         return false;
+   }
+   return true;
+}
+
+// serialize a group as the bindings of an environment whose enclosure is
+// the global environment (so active bindings and promises are serialized
+// as such and the global environment is serialized as a reference).
+// NOTE: called within executeSafely
+void serializeGroup(const ObjectGroup* pGroup, GroupWriter* pWriter)
+{
+   SEXP groupSEXP = PROTECT(Rf_NewEnvironment(R_NilValue,
+                                              R_NilValue,
+                                              R_GlobalEnv));
+   for (std::size_t i = 0; i < pGroup->size(); i++)
+   {
+      const GlobalObject& object = (*pGroup)[i];
+      if (object.active)
+         R_MakeActiveBinding(object.symbolSEXP, object.valueSEXP, groupSEXP);
+      else
+         Rf_defineVar(object.symbolSEXP, object.valueSEXP, groupSEXP);
+   }
+
+   struct R_outpstream_st stream;
+   R_InitOutPStream(&stream,
+                    static_cast<R_pstream_data_t>(pWriter),
+                    R_pstream_xdr_format,
+                    kSerializeVersion,
+                    outChar,
+                    outBytes,
+                    NULL,
+                    R_NilValue);
+   R_Serialize(groupSEXP, &stream);
+
+   UNPROTECT(1);
+}
+
+// NOTE: called within executeSafely
+void unserializeGroup(GroupReader* pReader, SEXP resultSEXP)
+{
+   struct R_inpstream_st stream;
+   R_InitInPStream(&stream,
+                   static_cast<R_pstream_data_t>(pReader),
+                   R_pstream_any_format,
+                   inChar,
+                   inBytes,
+                   NULL,
+                   R_NilValue);
+   SET_VECTOR_ELT(resultSEXP, 0, R_Unserialize(&stream));
+}
+
+Error readGroup(const std::string& hash,
+                SEXP* pGroupSEXP,
+                r::sexp::Protect* pProtect)
+{
+   FilePath filePath = objectFilePath(s_storePath, hash);
+   GroupReader reader;
+   Error error = reader.open(filePath);
+   if (error)
+      return error;
+
+   // (the group is unserialized into a protected list since it would
+   // otherwise be unprotected as executeSafely returns)
+   SEXP resultSEXP;
+   pProtect->add(resultSEXP = Rf_allocVector(VECSXP, 1));
+   error = r::exec::executeSafely(boost::bind(unserializeGroup,
+                                              &reader,
+                                              resultSEXP));
+   if (error)
+      return error;
+
+   *pGroupSEXP = VECTOR_ELT(resultSEXP, 0);
+   if (TYPEOF(*pGroupSEXP) != ENVSXP)
+      return objectFileError("invalid object", filePath);
+
+   return Success();
+}
+
+// bind the objects within a group in the global environment as they were
+// bound when it was saved (other than objects which have since been bound)
+// NOTE: called within executeSafely
+void restoreFrameBindings(SEXP frameSEXP, SEXP groupSEXP)
+{
+   for ( ; frameSEXP != R_NilValue; frameSEXP = CDR(frameSEXP))
+   {
+      SEXP symbolSEXP = TAG(frameSEXP);
+      SEXP valueSEXP = CAR(frameSEXP);
+      if (valueSEXP == R_UnboundValue)
+         continue;
+
+      if (Rf_findVarInFrame3(R_GlobalEnv, symbolSEXP, FALSE) != R_UnboundValue &&
+          !R_BindingIsActive(symbolSEXP, R_GlobalEnv))
+      {
+         continue;
+      }
+
+      if (R_BindingIsActive(symbolSEXP, groupSEXP))
+         R_MakeActiveBinding(symbolSEXP, valueSEXP, R_GlobalEnv);
+      else
+         Rf_defineVar(symbolSEXP, valueSEXP, R_GlobalEnv);
+   }
+}
+
+void restoreGroupBindings(SEXP groupSEXP)
+{
+   SEXP hashTableSEXP = HASHTAB(groupSEXP);
+   if (hashTableSEXP != R_NilValue)
+   {
+      int buckets = Rf_length(hashTableSEXP);
+      for (int i = 0; i < buckets; i++)
+         restoreFrameBindings(VECTOR_ELT(hashTableSEXP, i), groupSEXP);
+   }
+   else
+   {
+      restoreFrameBindings(FRAME(groupSEXP), groupSEXP);
+   }
+}
+
+Error restoreGroup(const std::string& hash)
+{
+   r::sexp::Protect rProtect;
+   SEXP groupSEXP;
+   Error error = readGroup(hash, &groupSEXP, &rProtect);
+   if (error)
+      return error;
+
+   return r::exec::executeSafely(boost::bind(restoreGroupBindings,
+                                             groupSEXP));
+}
+
+// if the value is a promise created when the store was restored (which
+// hasn't yet been forced) then get the hash of the group it reads
+bool isUnloadedObject(SEXP valueSEXP, std::string* pHash)
+{
+   if (!isUnforcedPromise(valueSEXP))
+      return false;
+
+   SEXP envSEXP = PRENV(valueSEXP);
+   if (TYPEOF(envSEXP) != ENVSXP)
+      return false;
+
+   SEXP hashSEXP = Rf_findVarInFrame(envSEXP, Rf_install(kHashVar));
+   if (TYPEOF(hashSEXP) != STRSXP || Rf_length(hashSEXP) != 1)
+      return false;
+
+   *pHash = CHAR(STRING_ELT(hashSEXP, 0));
+   return s_groups.find(*pHash) != s_groups.end();
+}
+
+// objects which haven't been read since the store was restored can be
+// carried forward when the global environment is saved to it again
+bool canCarryForward(const FilePath& storePath, const std::string& hash)
+{
+   return !storePath.empty() &&
+          storePath == s_storePath &&
+          objectFilePath(storePath, hash).exists();
+}
+
+// record the values of a lazily restored group as it is read. the values
+// are marked as shared (so R copies rather than modifies them) hence an
+// object which is still bound to its value is unchanged. groups containing
+// environments aren't recorded since environments are modified in place
+void recordRestoredGroup(const std::string& hash,
+                         SEXP groupSEXP,
+                         const std::vector<r::sexp::Binding>& bindings)
+{
+   RestoredGroup group;
+   group.groupSEXP = groupSEXP;
+   BOOST_FOREACH(const r::sexp::Binding& binding, bindings)
+   {
+      if (TYPEOF(binding.second) == PROMSXP)
+         return;
+
+      std::set<SEXP> environments;
+      findSerializedEnvironments(binding.second, &environments);
+      if (!environments.empty())
+         return;
+
+      group.values[CHAR(PRINTNAME(binding.first))] = binding.second;
+   }
+
+   std::map<std::string,RestoredGroup>::iterator it =
+                                             s_restoredGroups.find(hash);
+   if (it != s_restoredGroups.end())
+   {
+      ::R_ReleaseObject(it->second.groupSEXP);
+      s_restoredGroups.erase(it);
+   }
+
+   for (std::map<std::string,SEXP>::const_iterator valueIt =
+                                                      group.values.begin();
+        valueIt != group.values.end();
+        ++valueIt)
+   {
+      SET_NAMED(valueIt->second, 2);
+   }
+   ::R_PreserveObject(groupSEXP);
+   s_restoredGroups[hash] = group;
+}
+
+// forget the restored groups other than those with the given hashes
+void releaseRestoredGroups(const std::set<std::string>& keepHashes)
+{
+   std::map<std::string,RestoredGroup>::iterator it = s_restoredGroups.begin();
+   while (it != s_restoredGroups.end())
+   {
+      if (keepHashes.find(it->first) == keepHashes.end())
+      {
+         ::R_ReleaseObject(it->second.groupSEXP);
+         s_restoredGroups.erase(it++);
+      }
+      else
+      {
+         ++it;
+      }
+   }
+}
+
+// if a group is made up of exactly the objects of a restored group, each
+// still bound to the value it was read as, then get the hash of that group
+// (so it needn't be serialized again)
+bool isRestoredGroup(const ObjectGroup& group,
+                     const std::map<SEXP,std::string>& restoredValues,
+                     std::string* pHash)
+{
+   if (group.empty())
+      return false;
+
+   std::map<SEXP,std::string>::const_iterator valueIt =
+            restoredValues.find(objectValue(group.front().valueSEXP));
+   if (valueIt == restoredValues.end())
+      return false;
+
+   const RestoredGroup& restored = s_restoredGroups[valueIt->second];
+   if (restored.values.size() != group.size())
+      return false;
+
+   BOOST_FOREACH(const GlobalObject& object, group)
+   {
+      if (object.active)
+         return false;
+
+      SEXP valueSEXP = objectValue(object.valueSEXP);
+      std::map<std::string,SEXP>::const_iterator it =
+                  restored.values.find(CHAR(PRINTNAME(object.symbolSEXP)));
+      if (it == restored.values.end() ||
+          it->second != valueSEXP ||
+          NAMED(valueSEXP) < 2)
+      {
+         return false;
+      }
+   }
+
+   *pHash = valueIt->second;
+   return true;
+}
+
+// load the objects which have yet to be read from the store (other than
+// those which can be carried forward to the store being saved to)
+Error loadObjects(const FilePath& storePath)
+{
+   if (s_groups.empty())
+      return Success();
+
+   std::vector<r::sexp::Binding> bindings;
+   r::sexp::listEnvironmentBindings(R_GlobalEnv, true, &bindings);
+
+   std::vector<std::string> names;
+   BOOST_FOREACH(const r::sexp::Binding& binding, bindings)
+   {
+      std::string hash;
+      if (isUnloadedObject(binding.second, &hash) &&
+          !canCarryForward(storePath, hash))
+      {
+         names.push_back(CHAR(PRINTNAME(binding.first)));
+      }
+   }
+
+   if (names.empty())
+      return Success();
+
+   return r::exec::RFunction(".rs.loadSuspendedObjects", names).call();
+}
+
+Error describeObject(SEXP valueSEXP, std::vector<std::string>* pDescription)
+{
+   r::sexp::Protect rProtect;
+   SEXP descriptionSEXP;
+   Error error = r::exec::RFunction(".rs.describeObject", valueSEXP)
+                                          .call(&descriptionSEXP, &rProtect);
+   if (error)
+      return error;
+
+   return r::sexp::extract(descriptionSEXP, pDescription);
+}
+
+json::Object indexEntry(const std::string& name,
+                        const std::string& hash,
+                        const std::vector<std::string>& description,
+                        bool lazy)
+{
+   json::Array descriptionJson;
+   std::transform(description.begin(),
+                  description.end(),
+                  std::back_inserter(descriptionJson),
+                  json::toJsonString);
+
+   json::Object entryJson;
+   entryJson["name"] = name;
+   entryJson["hash"] = hash;
+   entryJson["description"] = descriptionJson;
+   entryJson["lazy"] = lazy;
+   return entryJson;
+}
+
+Error writeIndex(const FilePath& storePath, const json::Array& indexJson)
+{
+   std::ostringstream ostr;
+   json::write(indexJson, ostr);
+
+   FilePath tempFilePath = storePath.complete(std::string(kIndexFile) + ".tmp");
+   Error error = writeStringToFile(tempFilePath, ostr.str());
+   if (error)
+      return error;
+
+   return tempFilePath.move(indexFilePath(storePath));
+}
+
+Error removeUnreferencedObjects(const FilePath& storePath,
+                                const std::set<std::string>& hashes)
+{
+   std::vector<FilePath> children;
+   Error error = storePath.children(&children);
+   if (error)
+      return error;
+
+   BOOST_FOREACH(const FilePath& child, children)
+   {
+      std::string filename = child.filename();
+      if (filename != kIndexFile && hashes.find(filename) == hashes.end())
+      {
+         Error error = child.remove();
+         if (error)
+            LOG_ERROR(error);
+      }
+   }
+
+   return Success();
+}
+
+SEXP rs_loadSuspendedObject(SEXP hashSEXP, SEXP nameSEXP)
+{
+   try
+   {
+      std::string hash = r::sexp::asString(hashSEXP);
+      std::string name = r::sexp::asString(nameSEXP);
+
+      r::sexp::Protect rProtect;
+      SEXP groupSEXP;
+      Error error = readGroup(hash, &groupSEXP, &rProtect);
+      if (error)
+      {
+         LOG_ERROR(error);
+         throw r::exec::RErrorException(
+                  "Unable to read object from suspended session: " +
+                  error.code().message());
+      }
+
+      // the other objects within the group share environments with this
+      // one so those which have yet to be read are bound to their values
+      // now too (reading them separately would create copies)
+      SEXP valueSEXP = R_UnboundValue;
+      std::vector<r::sexp::Binding> bindings;
+      r::sexp::listEnvironmentBindings(groupSEXP, true, &bindings);
+      BOOST_FOREACH(const r::sexp::Binding& binding, bindings)
+      {
+         SEXP objectSEXP = objectValue(binding.second);
+         if (CHAR(PRINTNAME(binding.first)) == name)
+         {
+            valueSEXP = objectSEXP;
+            continue;
+         }
+
+         std::string objectHash;
+         SEXP currentSEXP = Rf_findVarInFrame(R_GlobalEnv, binding.first);
+         if (isUnloadedObject(currentSEXP, &objectHash) &&
+             objectHash == hash &&
+             !R_BindingIsLocked(binding.first, R_GlobalEnv))
+         {
+            Rf_defineVar(binding.first, objectSEXP, R_GlobalEnv);
+         }
+      }
+
+      if (valueSEXP == R_UnboundValue)
+      {
+         throw r::exec::RErrorException(
+                  "Object " + name + " not found in suspended session");
+      }
+
+      recordRestoredGroup(hash, groupSEXP, bindings);
+
+      return valueSEXP;
+   }
+   catch(r::exec::RErrorException& e)
+   {
+      r::exec::error(e.message());
+   }
+   CATCH_UNEXPECTED_EXCEPTION
+
+   return R_NilValue;
+}
+
+SEXP rs_suspendedObjectDescriptions(SEXP namesSEXP)
+{
+   try
+   {
+      std::vector<std::string> names;
+      Error error = r::sexp::extract(namesSEXP, &names);
+      if (error)
+         throw r::exec::RErrorException(r::endUserErrorMessage(error));
+
+      // find the objects which have yet to be read from the store (from
+      // the bindings themselves so that active bindings aren't called)
+      std::map<std::string,std::string> unloadedObjects;
+      std::vector<r::sexp::Binding> bindings;
+      r::sexp::listEnvironmentBindings(R_GlobalEnv, true, &bindings);
+      BOOST_FOREACH(const r::sexp::Binding& binding, bindings)
+      {
+         std::string hash;
+         if (isUnloadedObject(binding.second, &hash))
+            unloadedObjects[CHAR(PRINTNAME(binding.first))] = hash;
+      }
+
+      // describe them (NULL for the others)
+      r::sexp::Protect rProtect;
+      SEXP descriptionsSEXP;
+      rProtect.add(descriptionsSEXP = Rf_allocVector(VECSXP, names.size()));
+      for (std::size_t i = 0; i < names.size(); i++)
+      {
+         std::map<std::string,std::string>::const_iterator it =
+                                             unloadedObjects.find(names[i]);
+         if (it != unloadedObjects.end())
+         {
+            SET_VECTOR_ELT(descriptionsSEXP,
+                           i,
+                           r::sexp::create(s_groups[it->second][names[i]],
+                                           &rProtect));
+         }
+      }
+      return descriptionsSEXP;
+   }
+   catch(r::exec::RErrorException& e)
+   {
+      r::exec::error(e.message());
+   }
+   CATCH_UNEXPECTED_EXCEPTION
+
+   return R_NilValue;
+}
+
+} // anonymous namespace
+
+
+void initialize()
+{
+   R_CallMethodDef loadSuspendedObjectMethodDef ;
+   loadSuspendedObjectMethodDef.name = "rs_loadSuspendedObject" ;
+   loadSuspendedObjectMethodDef.fun = (DL_FUNC) rs_loadSuspendedObject ;
+   loadSuspendedObjectMethodDef.numArgs = 2;
+   r::routines::addCallMethod(loadSuspendedObjectMethodDef);
+
+   R_CallMethodDef descriptionsMethodDef ;
+   descriptionsMethodDef.name = "rs_suspendedObjectDescriptions" ;
+   descriptionsMethodDef.fun = (DL_FUNC) rs_suspendedObjectDescriptions ;
+   descriptionsMethodDef.numArgs = 1;
+   r::routines::addCallMethod(descriptionsMethodDef);
+}
+
+Error save(const FilePath& storePath)
+{
+   Error error = storePath.ensureDirectory();
+   if (error)
+      return error;
+
+   // objects read from another store must be loaded before being saved
+   error = loadObjects(storePath);
+   if (error)
+      return error;
+
+   std::vector<r::sexp::Binding> bindings;
+   r::sexp::listEnvironmentBindings(R_GlobalEnv, true, &bindings);
+
+   json::Array indexJson;
+   std::map<std::string,Descriptions> groups;
+   std::set<std::string> hashes;
+
+   // objects which haven't been read since the store was restored are
+   // still within it (so needn't be serialized again)
+   std::vector<GlobalObject> objects;
+   BOOST_FOREACH(const r::sexp::Binding& binding, bindings)
+   {
+      std::string name(CHAR(PRINTNAME(binding.first)));
+      std::string hash;
+      if (isUnloadedObject(binding.second, &hash))
+      {
+         const std::vector<std::string>& description = s_groups[hash][name];
+         indexJson.push_back(indexEntry(name, hash, description, true));
+         groups[hash][name] = description;
+         hashes.insert(hash);
+      }
+      else
+      {
+         objects.push_back(GlobalObject(
+                              binding.first,
+                              binding.second,
+                              R_BindingIsActive(binding.first, R_GlobalEnv)));
+      }
+   }
+
+   std::vector<ObjectGroup> objectGroups;
+   groupObjects(objects, &objectGroups);
+
+   std::map<SEXP,std::string> restoredValues;
+   for (std::map<std::string,RestoredGroup>::const_iterator it =
+                                                   s_restoredGroups.begin();
+        it != s_restoredGroups.end();
+        ++it)
+   {
+      for (std::map<std::string,SEXP>::const_iterator valueIt =
+                                                   it->second.values.begin();
+           valueIt != it->second.values.end();
+           ++valueIt)
+      {
+         restoredValues[valueIt->second] = it->first;
+      }
+   }
+
+   // serialize each group (to the writer threads)
+   std::vector<Descriptions> groupDescriptions(objectGroups.size());
+   std::vector<std::string> restoredHashes(objectGroups.size());
+   GroupWriter writer(storePath, objectGroups.size());
+   writer.start();
+   for (std::size_t i = 0; i < objectGroups.size() && !error; i++)
+   {
+      // groups which are unchanged since they were read from the store
+      // are still within it
+      const ObjectGroup& group = objectGroups[i];
+      std::string hash;
+      if (isRestoredGroup(group, restoredValues, &hash) &&
+          canCarryForward(storePath, hash) &&
+          s_groups.find(hash) != s_groups.end())
+      {
+         BOOST_FOREACH(const GlobalObject& object, group)
+         {
+            std::string name(CHAR(PRINTNAME(object.symbolSEXP)));
+            groupDescriptions[i][name] = s_groups[hash][name];
+         }
+         restoredHashes[i] = hash;
+         continue;
+      }
+
+      // describe the objects in lazily restored groups (so that they can
+      // be listed without reading them)
+      bool lazy = isLazyGroup(group);
+      BOOST_FOREACH(const GlobalObject& object, group)
+      {
+         std::vector<std::string>& description =
+               groupDescriptions[i][CHAR(PRINTNAME(object.symbolSEXP))];
+         if (lazy && !error)
+            error = describeObject(objectValue(object.valueSEXP),
+                                   &description);
+      }
+      if (error)
+         break;
+
+      writer.beginGroup(i);
+      error = r::exec::executeSafely(boost::bind(serializeGroup,
+                                                 &group,
+                                                 &writer));
+      writer.endGroup(!!error);
+   }
+   writer.finish();
+
+   if (error)
+      return error;
+
+   for (std::size_t i = 0; i < objectGroups.size(); i++)
+   {
+      if (writer.error(i))
+         return writer.error(i);
+
+      const std::string& hash = restoredHashes[i].empty() ?
+                                          writer.hash(i) : restoredHashes[i];
+      bool lazy = isLazyGroup(objectGroups[i]);
+      BOOST_FOREACH(const Descriptions::value_type& description,
+                    groupDescriptions[i])
+      {
+         indexJson.push_back(indexEntry(description.first,
+                                        hash,
+                                        description.second,
+                                        lazy));
+         if (lazy)
+            groups[hash][description.first] = description.second;
+      }
+      hashes.insert(hash);
+   }
+
+   error = writeIndex(storePath, indexJson);
+   if (error)
+      return error;
+
+   s_storePath = storePath;
+   s_groups = groups;
+   releaseRestoredGroups(hashes);
+
+   // remove groups which are no longer in the global environment
+   return removeUnreferencedObjects(storePath, hashes);
+}
+
+Error restore(const FilePath& storePath)
+{
+   std::string contents;
+   Error error = readStringFromFile(indexFilePath(storePath), &contents);
+   if (error)
+      return error;
+
+   json::Value indexJson;
+   if (!json::parse(contents, &indexJson) ||
+       !json::isType<json::Array>(indexJson))
+   {
+      return objectFileError("invalid index", indexFilePath(storePath));
+   }
+
+   std::vector<std::string> names, hashes;
+   std::set<std::string> eagerHashes;
+   std::map<std::string,Descriptions> groups;
+   BOOST_FOREACH(const json::Value& entryJson, indexJson.get_array())
+   {
+      if (!json::isType<json::Object>(entryJson))
+         return objectFileError("invalid index", indexFilePath(storePath));
+
+      std::string name, hash;
+      json::Array descriptionJson;
+      bool lazy = true;
+      error = json::readObject(entryJson.get_obj(),
+                               "name", &name,
+                               "hash", &hash,
+                               "description", &descriptionJson);
+      if (!error)
+         error = json::readObject(entryJson.get_obj(), "lazy", &lazy);
+      if (error)
+         return error;
+
+      if (!lazy)
+      {
+         eagerHashes.insert(hash);
+         continue;
+      }
+
+      std::vector<std::string>& description = groups[hash][name];
+      description.clear();
+      BOOST_FOREACH(const json::Value& valueJson, descriptionJson)
+      {
+         if (json::isType<std::string>(valueJson))
+            description.push_back(valueJson.get_str());
+      }
+
+      names.push_back(name);
+      hashes.push_back(hash);
+   }
+
+   s_storePath = storePath;
+   s_groups = groups;
+   releaseRestoredGroups(std::set<std::string>());
+
+   // bind each object in a lazily restored group to a promise which reads
+   // its group
+   error = r::exec::RFunction(".rs.restoreSuspendedObjects",
+                              names,
+                              hashes).call();
+   if (error)
+      return error;
+
+   // restore the bindings of the other groups as they were
+   BOOST_FOREACH(const std::string& hash, eagerHashes)
+   {
+      Error error = restoreGroup(hash);
+      if (error)
+         return error;
+   }
+
+   return Success();
+}
+
+bool exists(const FilePath& storePath)
+{
+   return indexFilePath(storePath).exists();
+}
+
+Error loadAll()
+{
+   return loadObjects(FilePath());
+}
+
+} // namespace object_store
+} // namespace session
+} // namespace r
@@ -0,0 +1,65 @@
+/*
+ * RObjectStore.hpp
+ *
+ * Copyright (C) 2009-11 by RStudio, Inc.
+ *
+ * This program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef R_SESSION_OBJECT_STORE_HPP
+#define R_SESSION_OBJECT_STORE_HPP
+
+namespace core {
+   class Error;
+   class FilePath;
+}
+
+// Store for the objects in the global environment of a suspended session.
+//
+// Objects are serialized in groups (objects which share environments are
+// serialized together so that they remain shared once restored, others
+// are serialized alone). Each group is streamed from R's serializer to a
+// writer thread which compresses it and writes it to its own file named
+// for a hash of its contents (an index maps the object names to these).
+//
+// When the store is restored each object is bound to a promise which reads
+// its group the first time it is accessed. Objects which haven't been
+// accessed by the time the session is next suspended are carried forward
+// without being read (and a description saved along with each object
+// allows the workspace to be listed without reading them). Groups which
+// contain active bindings or promises are restored as they were saved
+// rather than lazily.
+
+namespace r {
+namespace session {
+namespace object_store {
+
+// register the routines used by the store (called before R routines
+// are registered)
+void initialize();
+
+// save the global environment to the store
+core::Error save(const core::FilePath& storePath);
+
+// restore the global environment from the store (objects are read lazily
+// so the store must remain until they have been loaded)
+core::Error restore(const core::FilePath& storePath);
+
+// is there a saved store at this path?
+bool exists(const core::FilePath& storePath);
+
+// load any objects which have yet to be read from the store (required before
+// the global environment is saved by any other means or the store removed)
+core::Error loadAll();
+
+} // namespace object_store
+} // namespace session
+} // namespace r
+
+#endif // R_SESSION_OBJECT_STORE_HPP
+
@@ -18,6 +18,7 @@
 //
 
 #include "RSearchPath.hpp"
+#include "RObjectStore.hpp"
 
 #include <string>
 #include <vector>
@@ -50,7 +51,10 @@ namespace search_path {
 
 namespace {   
 
+// NOTE: the global environment was previously saved as a whole to the
+// environment file (this is still restored for migration)
 const char * const kEnvironmentFile = "environment";
+const char * const kObjectStoreDir = "environment_objects";
 const char * const kSearchPathDir = "search_path";
    
 const char * const kSearchPathElementsDir = "search_path_elements";
@@ -75,15 +79,23 @@ void reportRestoreError(const std::string& context,
    REprintf(report.c_str());
 }   
    
-Error saveGlobalEnvironment(const FilePath& environmentFile)
+Error saveGlobalEnvironment(const FilePath& statePath)
 {
-   std::string envPath = environmentFile.absolutePath();
-   return executeSafely(boost::bind(R_SaveGlobalEnvToFile, envPath.c_str()));
+   Error error = object_store::save(statePath.complete(kObjectStoreDir));
+   if (error)
+      return error;
+
+   return statePath.complete(kEnvironmentFile).removeIfExists();
 }
    
-Error restoreGlobalEnvironment(const core::FilePath& environmentFile)
+Error restoreGlobalEnvironment(const core::FilePath& statePath)
 {
+   FilePath objectStorePath = statePath.complete(kObjectStoreDir);
+   if (object_store::exists(objectStorePath))
+      return object_store::restore(objectStorePath);
+
    // tolerate no environment saved
+   FilePath environmentFile = statePath.complete(kEnvironmentFile);
    if (!environmentFile.exists())
       return Success();
    
@@ -218,8 +230,7 @@ void attachEnvironmentData(const FilePath& dataFilePath,
 Error save(const FilePath& statePath)
 {
    // save the global environment
-   FilePath environmentFile = statePath.complete(kEnvironmentFile);
-   Error error = saveGlobalEnvironment(environmentFile);
+   Error error = saveGlobalEnvironment(statePath);
    if (error)
       return error;
    
@@ -286,8 +297,7 @@ Error save(const FilePath& statePath)
 Error restore(const FilePath& statePath)
 {
    // restore global environment
-   FilePath environmentFile = statePath.complete(kEnvironmentFile);
-   Error error = restoreGlobalEnvironment(environmentFile);
+   Error error = restoreGlobalEnvironment(statePath);
    if (error)
       return error;
    
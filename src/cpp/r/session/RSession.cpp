@@ -15,6 +15,7 @@
 #include <r/session/RSession.hpp>
 
 #include <iostream>
+#include <algorithm>
 
 #include <boost/regex.hpp>
 #include <boost/algorithm/string/predicate.hpp>
@@ -43,11 +44,13 @@
 
 #include "RClientMetrics.hpp"
 #include "RSessionState.hpp"
+#include "RObjectStore.hpp"
 #include "REmbedded.hpp"
 
 #include "graphics/RGraphicsUtils.hpp"
 #include "graphics/RGraphicsDevice.hpp"
 #include "graphics/RGraphicsPlotManager.hpp"
+#include "graphics/RGraphicsPlotImageCache.hpp"
 
 #include <Rembedded.h>
 #include <R_ext/Utils.h>
@@ -277,9 +280,15 @@ Error saveDefaultGlobalEnvironment()
 
    // suppress interrupts which occur during saving
    r::exec::IgnoreInterruptsScope ignoreInterrupts;
+
+   // objects restored from a suspended session are read lazily so load
+   // those which haven't yet been read (otherwise we'd save the promises)
+   Error error = r::session::object_store::loadAll();
+   if (error)
+      return error;
          
    // save global environment
-   Error error = r::exec::executeSafely(
+   error = r::exec::executeSafely(
                         boost::bind(R_SaveGlobalEnvToFile,
                                     globalEnvPath.absolutePath().c_str()));
    
@@ -402,6 +411,15 @@ Error initialize()
                                         s_callbacks.locator);
    if (error) 
       return error;
+
+   // initialize cache of rendered plot images
+   const std::size_t kMb = 1024 * 1024;
+   error = graphics::plotImageCache().initialize(
+                     graphicsPath.complete("cache"),
+                     std::max(s_options.plotImageCacheMemoryMb, 0) * kMb,
+                     std::max(s_options.plotImageCacheDiskMb, 0) * kMb);
+   if (error)
+      LOG_ERROR(error);
    
    // restore client state
    session::clientState().restore(s_clientStatePath,
@@ -1199,6 +1217,9 @@ Error run(const ROptions& options, const RCallbacks& callbacks)
    createUUIDMethodDef.numArgs = 0;
    r::routines::addCallMethod(createUUIDMethodDef);
 
+   // register routines used to lazily restore the global environment
+   r::session::object_store::initialize();
+
    // run R
    bool newSession = !s_suspendedSessionPath.exists();
    r::session::Callbacks cb;
@@ -26,6 +26,8 @@
 #include <r/RExec.hpp>
 #include <r/session/RGraphics.hpp>
 
+#include "RGraphicsPlotImageCache.hpp"
+
 using namespace core ;
 
 namespace r {
@@ -74,6 +76,18 @@ void Plot::invalidate()
    needsUpdate_ = true;
 }
 
+bool Plot::hasCurrentStorage() const
+{
+   return hasStorage() && !needsUpdate_;
+}
+
+bool Plot::hasCurrentImage() const
+{
+   return hasCurrentStorage() &&
+          (renderedSize() == graphicsDevice_.displaySize()) &&
+          imageFilePath(storageUuid_).exists();
+}
+
 bool Plot::hasManipulator() const
 {
    // check is a bit complicated because defer loading the manipulator
@@ -215,6 +229,9 @@ Error Plot::removeFiles()
    // bail if we don't have any storage
    if (storageUuid_.empty())
       return Success();
+
+   // remove images rendered from this storage
+   plotImageCache().remove(storageUuid_);
    
    Error snapshotError = snapshotFilePath(storageUuid_).removeIfExists();
    Error imageError = imageFilePath(storageUuid_).removeIfExists();
@@ -59,6 +59,12 @@ public:
    void saveManipulator() const;
    
    void invalidate();
+
+   // does our storage reflect the current contents of the plot?
+   bool hasCurrentStorage() const;
+
+   // is our image file current for the size of the display?
+   bool hasCurrentImage() const;
    
    core::Error renderFromDisplay();
    core::Error renderFromDisplaySnapshot(SEXP snapshot);
@@ -0,0 +1,287 @@
+/*
+ * RGraphicsPlotImageCache.cpp
+ *
+ * Copyright (C) 2009-11 by RStudio, Inc.
+ *
+ * This program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include "RGraphicsPlotImageCache.hpp"
+
+#include <vector>
+#include <algorithm>
+
+#include <boost/format.hpp>
+#include <boost/regex.hpp>
+#include <boost/foreach.hpp>
+
+#include <core/Log.hpp>
+#include <core/Error.hpp>
+#include <core/FileSerializer.hpp>
+
+using namespace core;
+
+namespace r {
+namespace session {
+namespace graphics {
+
+namespace {
+
+std::string keyString(const PlotImageKey& key)
+{
+   boost::format fmt("%1%_%2%x%3%.%4%");
+   return boost::str(fmt % key.storageUuid % key.width % key.height %
+                           key.format);
+}
+
+bool compareLastWriteTime(const FilePath& file1, const FilePath& file2)
+{
+   // most recently written first
+   return file1.lastWriteTime() > file2.lastWriteTime();
+}
+
+} // anonymous namespace
+
+PlotImageCache& plotImageCache()
+{
+   static PlotImageCache instance;
+   return instance;
+}
+
+PlotImageCache::PlotImageCache()
+   : memoryBudget_(0), diskBudget_(0), memoryUsed_(0), diskUsed_(0)
+{
+}
+
+Error PlotImageCache::initialize(const FilePath& cachePath,
+                                 std::size_t memoryBudget,
+                                 std::size_t diskBudget)
+{
+   cachePath_ = cachePath;
+   memoryBudget_ = memoryBudget;
+   diskBudget_ = diskBudget;
+
+   Error error = cachePath_.ensureDirectory();
+   if (error)
+      return error;
+
+   // index images written by a previous (suspended) session
+   std::vector<FilePath> files;
+   error = cachePath_.children(&files);
+   if (error)
+      return error;
+   std::sort(files.begin(), files.end(), compareLastWriteTime);
+
+   boost::regex keyRegex("([A-Za-z0-9\\-]+)_([0-9]+)x([0-9]+)\\.([a-z]+)");
+   BOOST_FOREACH(const FilePath& file, files)
+   {
+      boost::smatch matches;
+      std::string filename = file.filename();
+      if (diskBudget_ > 0 && boost::regex_match(filename, matches, keyRegex))
+      {
+         Entry entry;
+         entry.key = filename;
+         entry.storageUuid = matches[1];
+         entry.size = file.size();
+         entry.onDisk = true;
+         entries_.push_back(entry);
+         index_[entry.key] = --entries_.end();
+         diskUsed_ += entry.size;
+      }
+      else
+      {
+         Error error = file.remove();
+         if (error)
+            LOG_ERROR(error);
+      }
+   }
+
+   enforceBudgets();
+   return Success();
+}
+
+bool PlotImageCache::get(const PlotImageKey& key, std::string* pImage)
+{
+   std::map<std::string,Entries::iterator>::iterator it =
+                                                index_.find(keyString(key));
+   if (it == index_.end())
+      return false;
+
+   Entries::iterator entryIt = it->second;
+   if (!entryIt->pImage)
+   {
+      // read it from disk (and keep it in memory if it fits)
+      boost::shared_ptr<std::string> pDiskImage(new std::string());
+      Error error = readStringFromFile(imageFilePath(entryIt->key),
+                                       pDiskImage.get());
+      if (error)
+      {
+         // the file is gone (e.g. the graphics directory was removed)
+         entryIt->onDisk = false;
+         diskUsed_ -= entryIt->size;
+         erase(entryIt);
+         return false;
+      }
+
+      if (pDiskImage->size() <= memoryBudget_)
+      {
+         entryIt->pImage = pDiskImage;
+         memoryUsed_ += entryIt->size;
+      }
+      *pImage = *pDiskImage;
+   }
+   else
+   {
+      *pImage = *(entryIt->pImage);
+   }
+
+   // mark as most recently used
+   entries_.splice(entries_.begin(), entries_, entryIt);
+   enforceBudgets();
+
+   return true;
+}
+
+void PlotImageCache::put(const PlotImageKey& key, const std::string& image)
+{
+   if (!enabled())
+      return;
+
+   // replace any existing entry
+   std::string keyStr = keyString(key);
+   std::map<std::string,Entries::iterator>::iterator it = index_.find(keyStr);
+   if (it != index_.end())
+      erase(it->second);
+
+   Entry entry;
+   entry.key = keyStr;
+   entry.storageUuid = key.storageUuid;
+   entry.size = image.size();
+
+   if (entry.size <= diskBudget_)
+   {
+      // (the cache directory is removed along with the graphics directory
+      // when the device is closed)
+      Error error = cachePath_.ensureDirectory();
+      if (!error)
+         error = writeStringToFile(imageFilePath(keyStr), image);
+      if (!error)
+      {
+         entry.onDisk = true;
+         diskUsed_ += entry.size;
+      }
+      else
+      {
+         LOG_ERROR(error);
+      }
+   }
+
+   if (entry.size <= memoryBudget_)
+   {
+      entry.pImage.reset(new std::string(image));
+      memoryUsed_ += entry.size;
+   }
+
+   if (!entry.pImage && !entry.onDisk)
+      return;
+
+   entries_.push_front(entry);
+   index_[keyStr] = entries_.begin();
+
+   enforceBudgets();
+}
+
+void PlotImageCache::remove(const std::string& storageUuid)
+{
+   Entries::iterator it = entries_.begin();
+   while (it != entries_.end())
+   {
+      Entries::iterator next = it;
+      ++next;
+      if (it->storageUuid == storageUuid)
+         erase(it);
+      it = next;
+   }
+}
+
+void PlotImageCache::clear()
+{
+   while (!entries_.empty())
+      erase(entries_.begin());
+}
+
+FilePath PlotImageCache::imageFilePath(const std::string& key) const
+{
+   return cachePath_.complete(key);
+}
+
+void PlotImageCache::erase(Entries::iterator it)
+{
+   if (it->pImage)
+      memoryUsed_ -= it->size;
+
+   if (it->onDisk)
+   {
+      diskUsed_ -= it->size;
+      Error error = imageFilePath(it->key).removeIfExists();
+      if (error)
+         LOG_ERROR(error);
+   }
+
+   index_.erase(it->key);
+   entries_.erase(it);
+}
+
+void PlotImageCache::enforceBudgets()
+{
+   // release the least recently used images from memory and disk until
+   // each is within its budget
+   for (Entries::reverse_iterator it = entries_.rbegin();
+        it != entries_.rend() && memoryUsed_ > memoryBudget_;
+        ++it)
+   {
+      if (it->pImage)
+      {
+         it->pImage.reset();
+         memoryUsed_ -= it->size;
+      }
+   }
+
+   for (Entries::reverse_iterator it = entries_.rbegin();
+        it != entries_.rend() && diskUsed_ > diskBudget_;
+        ++it)
+   {
+      if (it->onDisk)
+      {
+         Error error = imageFilePath(it->key).removeIfExists();
+         if (error)
+            LOG_ERROR(error);
+         it->onDisk = false;
+         diskUsed_ -= it->size;
+      }
+   }
+
+   // remove entries which are no longer cached anywhere
+   Entries::iterator it = entries_.begin();
+   while (it != entries_.end())
+   {
+      if (!it->pImage && !it->onDisk)
+      {
+         index_.erase(it->key);
+         it = entries_.erase(it);
+      }
+      else
+      {
+         ++it;
+      }
+   }
+}
+
+} // namespace graphics
+} // namespace session
+} // namespace r
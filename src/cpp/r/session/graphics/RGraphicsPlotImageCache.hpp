@@ -0,0 +1,117 @@
+/*
+ * RGraphicsPlotImageCache.hpp
+ *
+ * Copyright (C) 2009-11 by RStudio, Inc.
+ *
+ * This program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef R_SESSION_GRAPHICS_PLOT_IMAGE_CACHE_HPP
+#define R_SESSION_GRAPHICS_PLOT_IMAGE_CACHE_HPP
+
+#include <map>
+#include <list>
+#include <string>
+
+#include <boost/utility.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <core/FilePath.hpp>
+
+namespace core {
+   class Error;
+}
+
+namespace r {
+namespace session {
+namespace graphics {
+
+// singleton
+class PlotImageCache;
+PlotImageCache& plotImageCache();
+
+// identifies a rendered image of a plot
+struct PlotImageKey
+{
+   PlotImageKey(const std::string& storageUuid,
+                const std::string& format,
+                int width,
+                int height)
+      : storageUuid(storageUuid), format(format), width(width), height(height)
+   {
+   }
+
+   std::string storageUuid;
+   std::string format;
+   int width;
+   int height;
+};
+
+// Images rendered from plots (e.g. for zooming and exporting), kept so that
+// subsequent requests for the same plot at the same size are served without
+// re-rendering. The most recently used images are held in memory and all
+// images are written to the cache directory, each up to a byte budget (the
+// least recently used images are evicted first). Images are stored in files
+// named for their key so the cache survives suspend and resume.
+class PlotImageCache : boost::noncopyable
+{
+private:
+   PlotImageCache();
+   friend PlotImageCache& plotImageCache();
+
+public:
+   core::Error initialize(const core::FilePath& cachePath,
+                          std::size_t memoryBudget,
+                          std::size_t diskBudget);
+
+   // get a cached image (returns false if there isn't one)
+   bool get(const PlotImageKey& key, std::string* pImage);
+
+   // add an image to the cache
+   void put(const PlotImageKey& key, const std::string& image);
+
+   // remove all images of a plot (called when its storage is removed)
+   void remove(const std::string& storageUuid);
+
+   // remove all images
+   void clear();
+
+private:
+   struct Entry
+   {
+      Entry() : size(0), onDisk(false) {}
+      std::string key;
+      std::string storageUuid;
+      std::size_t size;
+      boost::shared_ptr<std::string> pImage;
+      bool onDisk;
+   };
+   typedef std::list<Entry> Entries;
+
+   bool enabled() const { return memoryBudget_ > 0 || diskBudget_ > 0; }
+   core::FilePath imageFilePath(const std::string& key) const;
+   void erase(Entries::iterator it);
+   void enforceBudgets();
+
+private:
+   core::FilePath cachePath_;
+   std::size_t memoryBudget_;
+   std::size_t diskBudget_;
+   std::size_t memoryUsed_;
+   std::size_t diskUsed_;
+
+   // entries (most recently used first) and an index of them by key
+   Entries entries_;
+   std::map<std::string,Entries::iterator> index_;
+};
+
+} // namespace graphics
+} // namespace session
+} // namespace r
+
+#endif // R_SESSION_GRAPHICS_PLOT_IMAGE_CACHE_HPP
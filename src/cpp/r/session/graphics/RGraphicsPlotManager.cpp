@@ -24,6 +24,8 @@
 #include <core/Error.hpp>
 #include <core/FileSerializer.hpp>
 
+#include <core/system/System.hpp>
+
 #include <r/RExec.hpp>
 #include <r/RErrorCategory.hpp>
 #include <r/session/RSessionUtils.hpp>
@@ -32,6 +34,7 @@
 #include "RGraphicsDevice.hpp"
 #include "RGraphicsFileDevice.hpp"
 #include "RGraphicsPlotManipulatorManager.hpp"
+#include "RGraphicsPlotImageCache.hpp"
 
 using namespace core;
 
@@ -71,6 +74,7 @@ PlotManager& plotManager()
 PlotManager::PlotManager()
    :  displayHasChanges_(false), 
       suppressDeviceEvents_(false),
+      renderToDisplayDeferred_(false),
       activePlot_(-1),
       plotInfoRegex_("([A-Za-z0-9\\-]+):([0-9]+),([0-9]+)")
 {
@@ -153,8 +157,13 @@ Error PlotManager::setActivePlot(int index)
       // set index
       activePlot_ = index;
       
-      // render it
-      renderActivePlotToDisplay();
+      // render it (if its image is already current for the display then
+      // the client doesn't need the device so we defer this, which allows
+      // quickly moving back and forth through the plot history)
+      if (activePlot().hasCurrentImage())
+         renderToDisplayDeferred_ = true;
+      else
+         renderActivePlotToDisplay();
 
       // trip changes flag 
       displayHasChanges_ = true; 
@@ -227,6 +236,9 @@ Error PlotManager::savePlotAsFile(const boost::function<Error()>&
 {
    if (!hasPlot())
       return Error(errc::NoActivePlot, ERROR_LOCATION);
+
+   // make sure the device is displaying the active plot
+   renderDeferredActivePlotToDisplay();
    
    // restore previous device after invoking file device
    RestorePreviousGraphicsDeviceScope restoreScope;
@@ -393,6 +405,46 @@ Error PlotManager::savePlotAsMetafile(const core::FilePath& filePath,
 }
 
 
+Error PlotManager::renderPlotImage(const std::string& format,
+                                   int widthPx,
+                                   int heightPx,
+                                   std::string* pImage)
+{
+   if (!hasPlot())
+      return Error(errc::NoActivePlot, ERROR_LOCATION);
+
+   // check the cache (the plot's storage uuid identifies its contents
+   // unless there have been changes since it was last rendered)
+   bool cacheable = activePlot().hasCurrentStorage();
+   PlotImageKey key(activePlot().storageUuid(), format, widthPx, heightPx);
+   if (cacheable && plotImageCache().get(key, pImage))
+      return Success();
+
+   // render to a temporary file within the graphics path
+   Error error = graphicsPath_.ensureDirectory();
+   if (error)
+      return error;
+   FilePath imagePath = graphicsPath_.complete(
+                           "render-" + core::system::generateUuid() +
+                           "." + format);
+   error = savePlotAsImage(imagePath, format, widthPx, heightPx);
+   if (error)
+      return error;
+
+   // read the image then remove the file
+   error = readStringFromFile(imagePath, pImage);
+   Error removeError = imagePath.removeIfExists();
+   if (removeError)
+      LOG_ERROR(removeError);
+   if (error)
+      return Error(errc::PlotFileError, error, ERROR_LOCATION);
+
+   if (cacheable)
+      plotImageCache().put(key, *pImage);
+
+   return Success();
+}
+
 bool PlotManager::hasOutput() const   
 {
    return hasPlot();
@@ -423,6 +475,11 @@ void PlotManager::render(boost::function<void(DisplayState)> outputFunction)
 
    if (hasPlot()) // write image for active plot
    {
+      // if the active plot's image is no longer current (e.g. because the
+      // display has been resized) then it needs to be on the device
+      if (!activePlot().hasCurrentImage())
+         renderDeferredActivePlotToDisplay();
+
       // copy current contents of the display to the active plot files
       Error error = activePlot().renderFromDisplay();
       if (error)
@@ -510,17 +567,23 @@ boost::signal<void ()>& PlotManager::onShowManipulator()
 
 void PlotManager::setPlotManipulatorValues(const json::Object& values)
 {
+   renderDeferredActivePlotToDisplay();
    return plotManipulatorManager().setPlotManipulatorValues(values);
 }
 
 void PlotManager::manipulatorPlotClicked(int x, int y)
 {
+   // (click coordinates are converted using the device's current plot)
+   renderDeferredActivePlotToDisplay();
    plotManipulatorManager().manipulatorPlotClicked(x, y);
 }
 
 
 void PlotManager::onBeforeExecute()
 {
+   // executing code may draw on the device's current plot
+   renderDeferredActivePlotToDisplay();
+
    graphicsDevice_.onBeforeExecute();
 }
 
@@ -634,8 +697,10 @@ void PlotManager::onDeviceNewPage(SEXP previousPageSnapshot)
    if (suppressDeviceEvents_)
       return;
    
-   // if we have a plot with unrendered changes then save the previous snapshot
-   if (hasPlot() && hasChanges())
+   // if we have a plot with unrendered changes then save the previous
+   // snapshot (if rendering the active plot to the device was deferred
+   // then the previous page isn't the active plot)
+   if (hasPlot() && hasChanges() && !renderToDisplayDeferred_)
    {
       if (previousPageSnapshot != R_NilValue)
       {
@@ -692,6 +757,9 @@ void PlotManager::onDeviceNewPage(SEXP previousPageSnapshot)
 
    // once we render the new plot we always reset pending manipulator state
    plotManipulatorManager().clearPendingManipulatorState();
+
+   // the device now displays the active plot
+   renderToDisplayDeferred_ = false;
    
    // ensure updates
    invalidateActivePlot();
@@ -721,6 +789,8 @@ void PlotManager::onDeviceClosed()
    // clear plots
    activePlot_ = -1;
    plots_.clear();
+   renderToDisplayDeferred_ = false;
+   plotImageCache().clear();
    
    // trip changes flag to ensure repaint
    displayHasChanges_ = true;
@@ -762,6 +832,8 @@ void PlotManager::invalidateActivePlot()
 // render active plot to display (used in setActivePlot and onSessionResume)
 void PlotManager::renderActivePlotToDisplay()
 {   
+   renderToDisplayDeferred_ = false;
+
    suppressDeviceEvents_ = true;
    
    // attempt to render the active plot -- notify end user if there is an error
@@ -773,6 +845,16 @@ void PlotManager::renderActivePlotToDisplay()
    
 }
    
+
+void PlotManager::renderDeferredActivePlotToDisplay()
+{
+   if (renderToDisplayDeferred_)
+   {
+      renderToDisplayDeferred_ = false;
+      if (hasPlot())
+         renderActivePlotToDisplay();
+   }
+}
       
 Error PlotManager::plotIndexError(int index, const ErrorLocation& location)
                                                                         const
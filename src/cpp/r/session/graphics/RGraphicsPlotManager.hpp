@@ -86,6 +86,11 @@ public:
                                           int widthPx,
                                           int heightPx);
 
+   virtual core::Error renderPlotImage(const std::string& format,
+                                       int widthPx,
+                                       int heightPx,
+                                       std::string* pImage);
+
    // display
    virtual bool hasOutput() const;
    virtual bool hasChanges() const;
@@ -132,6 +137,10 @@ private:
 
    // render active plot to display (used in setActivePlot and onSessionResume)
    void renderActivePlotToDisplay();
+
+   // render active plot to display if this was deferred by setActivePlot
+   // (called before anything which depends on the contents of the device)
+   void renderDeferredActivePlotToDisplay();
    
    // render active plot file file
    core::Error savePlotAsFile(const boost::function<core::Error()>&
@@ -171,6 +180,7 @@ private:
    // state
    bool displayHasChanges_;
    bool suppressDeviceEvents_;
+   bool renderToDisplayDeferred_;
    
    int activePlot_;
    boost::circular_buffer<PtrPlot> plots_ ;
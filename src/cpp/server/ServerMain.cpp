@@ -26,6 +26,7 @@
 #include <core/http/URL.hpp>
 #include <core/http/AsyncUriHandler.hpp>
 #include <core/http/TcpIpAsyncServer.hpp>
+#include <core/json/Json.hpp>
 
 #include <core/gwt/GwtLogHandler.hpp>
 #include <core/gwt/GwtFileHandler.hpp>
@@ -60,8 +61,47 @@ namespace {
 bool mainPageFilter(const core::http::Request& request,
                     core::http::Response* pResponse)
 {
-   return server::browser::supportedBrowserFilter(request, pResponse) &&
-          auth::handler::mainPageFilter(request, pResponse);
+   if (!server::browser::supportedBrowserFilter(request, pResponse) ||
+       !auth::handler::mainPageFilter(request, pResponse))
+   {
+      return false;
+   }
+
+   // launch the user's session while the client is loading (rather than
+   // waiting for its first request)
+   if (server::options().rsessionPrelaunch())
+   {
+      std::string username = auth::handler::userIdentifierToLocalUsername(
+                           auth::handler::getUserIdentifier(request));
+      if (!username.empty())
+         sessionManager().prelaunchSession(username);
+   }
+
+   return true;
+}
+
+void handleLaunchStatsRequest(const std::string&,
+                              const http::Request&,
+                              http::Response* pResponse)
+{
+   SessionManager::LaunchStats stats = sessionManager().launchStats();
+
+   json::Object statsJson;
+   statsJson["launches"] = stats.launches;
+   statsJson["prelaunches"] = stats.prelaunches;
+   statsJson["failures"] = stats.failures;
+   statsJson["mean_latency_ms"] = stats.launches > 0 ?
+      stats.totalLatency.total_milliseconds() / stats.launches : 0;
+   statsJson["max_latency_ms"] = stats.maxLatency.total_milliseconds();
+   statsJson["last_latency_ms"] = stats.lastLatency.total_milliseconds();
+
+   std::string body;
+   json::write(statsJson, &body);
+   pResponse->setNoCacheHeaders();
+   pResponse->setContentType("application/json");
+   Error error = pResponse->setBody(body);
+   if (error)
+      LOG_ERROR(error);
 }
 
 
@@ -112,10 +152,11 @@ Error httpServerInit()
    s_pHttpServer.reset(new http::TcpIpAsyncServer("RStudio"));
 
    // set server options
+   Options& options = server::options();
    s_pHttpServer->setAbortOnResourceError(true);
+   s_pHttpServer->setIoServicePerThread(options.wwwIoServicePerThread());
 
    // initialize the http server
-   Options& options = server::options();
    return s_pHttpServer->init(options.wwwAddress(), options.wwwPort());
 }
 
@@ -148,6 +189,10 @@ void httpServerAddHandlers()
    // establish logging handler
    uri_handlers::addBlocking("/log", secureJsonRpcHandler(gwt::handleLogRequest));
 
+   // session launch latency
+   uri_handlers::addBlocking("/launch_stats",
+                             secureHttpHandler(handleLaunchStatsRequest));
+
    // establish progress handler
    FilePath wwwLocalPath(server::options().wwwLocalPath());
    FilePath progressPagePath = wwwLocalPath.complete("progress.htm");
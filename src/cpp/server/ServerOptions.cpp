@@ -103,7 +103,10 @@ ProgramStatus Options::read(int argc, char * const argv[])
          "www files path")
       ("www-thread-pool-size",
          value<int>(&wwwThreadPoolSize_)->default_value(2),
-         "thread pool size");
+         "thread pool size")
+      ("www-io-service-per-thread",
+         value<bool>(&wwwIoServicePerThread_)->default_value(false),
+         "give each thread in the pool its own io service");
 
    // rsession
    options_description rsession("rsession");
@@ -131,7 +134,10 @@ ProgramStatus Options::read(int argc, char * const argv[])
          "rsession stack limit (mb)")
       ("rsession-process-limit",
          value<int>(&rsessionUserProcessLimit_)->default_value(0),
-         "rsession user process limit");
+         "rsession user process limit")
+      ("rsession-prelaunch",
+         value<bool>(&rsessionPrelaunch_)->default_value(false),
+         "launch sessions as soon as the main page is requested");
    
    // still read depracated options (so we don't break config files)
    bool deprecatedAuthPamRequiresPriv;
@@ -16,6 +16,7 @@
 #include <sys/wait.h>
 
 #include <vector>
+#include <algorithm>
 
 #include <boost/foreach.hpp>
 #include <boost/format.hpp>
@@ -26,6 +27,7 @@
 #include <core/system/PosixUser.hpp>
 
 #include <session/SessionConstants.hpp>
+#include <session/SessionLocalStreams.hpp>
 
 #include <server/ServerOptions.hpp>
 
@@ -47,6 +49,12 @@ SessionManager& sessionManager()
 }
 
 Error SessionManager::launchSession(const std::string& username)
+{
+   return launchSession(username, false);
+}
+
+Error SessionManager::launchSession(const std::string& username,
+                                    bool prelaunch)
 {
    using namespace boost::posix_time;
 
@@ -57,7 +65,7 @@ Error SessionManager::launchSession(const std::string& username)
       if (pos != pendingLaunches_.end())
       {
          // if the launch is less than one minute old then return success
-         if ( (pos->second + boost::posix_time::minutes(1))
+         if ( (pos->second.time + boost::posix_time::minutes(1))
                > microsec_clock::universal_time() )
          {
             return Success();
@@ -75,7 +83,10 @@ Error SessionManager::launchSession(const std::string& username)
       }
 
       // record the launch
-      pendingLaunches_[username] =  microsec_clock::universal_time();
+      PendingLaunch launch;
+      launch.time = microsec_clock::universal_time();
+      launch.prelaunch = prelaunch;
+      pendingLaunches_[username] = launch;
    }
    END_LOCK_MUTEX
 
@@ -84,6 +95,12 @@ Error SessionManager::launchSession(const std::string& username)
    Error error = server::launchSession(username, &pid);
    if (error)
    {
+      LOCK_MUTEX(launchesMutex_)
+      {
+         launchStats_.failures++;
+      }
+      END_LOCK_MUTEX
+
       removePendingLaunch(username);
       return error;
    }
@@ -106,6 +123,60 @@ void SessionManager::removePendingLaunch(const std::string& username)
    END_LOCK_MUTEX
 }
 
+void SessionManager::prelaunchSession(const std::string& username)
+{
+   // a running session has a local stream (if the stream is stale then
+   // the session will be launched by the first request's retry instead)
+   if (session::local_streams::streamPath(username).exists())
+      return;
+
+   Error error = launchSession(username, true);
+   if (error)
+      LOG_ERROR(error);
+}
+
+void SessionManager::notifySessionResponded(const std::string& username)
+{
+   using namespace boost::posix_time;
+
+   LOCK_MUTEX(launchesMutex_)
+   {
+      LaunchMap::iterator pos = pendingLaunches_.find(username);
+      if (pos == pendingLaunches_.end())
+         return;
+
+      // a prelaunched session's first request is only made once the
+      // client has loaded (so its latency isn't the session's)
+      PendingLaunch launch = pos->second;
+      pendingLaunches_.erase(pos);
+      if (launch.prelaunch)
+      {
+         launchStats_.prelaunches++;
+         return;
+      }
+
+      time_duration latency = microsec_clock::universal_time() - launch.time;
+
+      launchStats_.launches++;
+      launchStats_.totalLatency += latency;
+      launchStats_.maxLatency = std::max(launchStats_.maxLatency, latency);
+      launchStats_.lastLatency = latency;
+   }
+   END_LOCK_MUTEX
+}
+
+SessionManager::LaunchStats SessionManager::launchStats()
+{
+   LOCK_MUTEX(launchesMutex_)
+   {
+      return launchStats_;
+   }
+   END_LOCK_MUTEX
+
+   // keep compiler happy
+   return LaunchStats();
+}
+
 namespace {
 
 // wraper for waitPid which tries again for EINTR
@@ -19,6 +19,7 @@
 #include <map>
 
 #include <boost/signals.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
 
 #include <core/Thread.hpp>
 
@@ -37,7 +38,10 @@ SessionManager& sessionManager();
 // Session manager for launching managed sessions. This includes
 // automatically waiting for other pending launches (rather than
 // attempting to launch the same session twice) as well as reaping
-// of session child processes
+// of session child processes. The time between launching a session and
+// its first response is recorded so that launch latency can be monitored
+// (other than for prelaunched sessions, whose first request waits for the
+// client to load)
 class SessionManager
 {
 private:
@@ -45,24 +49,55 @@ private:
    SessionManager() {}
    friend SessionManager& sessionManager();
 
+public:
+   struct LaunchStats
+   {
+      LaunchStats() : launches(0), prelaunches(0), failures(0) {}
+      int launches;
+      int prelaunches;
+      int failures;
+      boost::posix_time::time_duration totalLatency;
+      boost::posix_time::time_duration maxLatency;
+      boost::posix_time::time_duration lastLatency;
+   };
+
 public:
    // launching
    core::Error launchSession(const std::string& username);
    void removePendingLaunch(const std::string& username);
 
+   // launch a session in advance of its first request (does nothing if
+   // the session is already running or being launched)
+   void prelaunchSession(const std::string& username);
+
+   // notification that a session responded to a request (completes any
+   // pending launch and records its latency)
+   void notifySessionResponded(const std::string& username);
+
+   LaunchStats launchStats();
+
    // notificatio that a SIGCHLD was received
    void notifySIGCHLD();
 
 private:
+   core::Error launchSession(const std::string& username, bool prelaunch);
+
    void addActivePid(PidType pid);
    void removeActivePid(PidType pid);
    std::vector<PidType> activePids();
 
 private:
    // pending launches
+   struct PendingLaunch
+   {
+      PendingLaunch() : prelaunch(false) {}
+      boost::posix_time::ptime time;
+      bool prelaunch;
+   };
    boost::mutex launchesMutex_;
-   typedef std::map<std::string,boost::posix_time::ptime> LaunchMap;
+   typedef std::map<std::string,PendingLaunch> LaunchMap;
    LaunchMap pendingLaunches_;
+   LaunchStats launchStats_;
 
    // pids we have launched
    boost::mutex pidsMutex_;
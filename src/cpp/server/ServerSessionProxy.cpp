@@ -60,6 +60,10 @@ namespace session_proxy {
    
 namespace {
 
+// keep-alive connections to sessions (avoids connecting to the session's
+// local stream for every request)
+http::LocalStreamConnectionPool s_sessionConnectionPool;
+
 void launchSessionRecovery(const std::string& username)
 {
    Error error = sessionManager().launchSession(username);
@@ -79,19 +83,6 @@ http::ConnectionRetryProfile sessionRetryProfile(const std::string& username)
 }
 
 
-void handleProxyResponse(
-      boost::shared_ptr<core::http::AsyncConnection> ptrConnection,
-      std::string username,
-      const http::Response& response)
-{
-   // if there was a launch pending then remove it
-   sessionManager().removePendingLaunch(username);
-
-   // write the response
-   ptrConnection->writeResponse(response);
-}
-
-
 void logIfNotConnectionTerminated(const Error& error,
                                   const http::Request& request)
 {
@@ -182,6 +173,52 @@ void handleEventsError(
    ptrConnection->writeResponse();
 }
 
+void handleStreamWrite(
+      boost::shared_ptr<core::http::AsyncConnection> ptrConnection,
+      const http::ReadNextBlockFunction& readNextBlock,
+      const Error& error)
+{
+   // read the next block once the last one has been written (if the write
+   // failed then the connection has been closed and the client is
+   // discarded along with the read function)
+   if (!error)
+      readNextBlock();
+}
+
+void handleStreamHeaders(
+      boost::shared_ptr<core::http::AsyncConnection> ptrConnection,
+      const http::Response& response,
+      const http::ReadNextBlockFunction& readNextBlock)
+{
+   ptrConnection->response().assign(response);
+   ptrConnection->writeResponseHeaders(
+         boost::bind(handleStreamWrite, ptrConnection, readNextBlock, _1));
+}
+
+void handleStreamBlock(
+      boost::shared_ptr<core::http::AsyncConnection> ptrConnection,
+      const std::string& block,
+      const http::ReadNextBlockFunction& readNextBlock)
+{
+   ptrConnection->writeResponseBlock(
+         block,
+         boost::bind(handleStreamWrite, ptrConnection, readNextBlock, _1));
+}
+
+void handleProxyHeaders(
+      boost::shared_ptr<core::http::AsyncConnection> ptrConnection,
+      std::string username,
+      const http::Response& response,
+      const http::ReadNextBlockFunction& readNextBlock)
+{
+   // if there was a launch pending then it is complete
+   sessionManager().notifySessionResponded(username);
+
+   handleStreamHeaders(ptrConnection, response, readNextBlock);
+}
+
+// responses are passed on to the client as they are read (so that large
+// responses, e.g. files, aren't held in memory) over pooled connections
 void proxyRequest(
       const std::string& username,
       boost::shared_ptr<core::http::AsyncConnection> ptrConnection,
@@ -194,7 +231,9 @@ void proxyRequest(
 
    // create async client
    boost::shared_ptr<http::LocalStreamAsyncClient> pClient(
-    new http::LocalStreamAsyncClient(ptrConnection->ioService(), streamPath));
+    new http::LocalStreamAsyncClient(ptrConnection->ioService(),
+                                     streamPath,
+                                     &s_sessionConnectionPool));
 
    // setup retry context
    if (!connectionRetryProfile.empty())
@@ -204,8 +243,29 @@ void proxyRequest(
    pClient->request().assign(ptrConnection->request());
 
    // execute
-   pClient->execute(
-         boost::bind(handleProxyResponse, ptrConnection, username, _1),
+   pClient->executeStreaming(
+         boost::bind(handleProxyHeaders, ptrConnection, username, _1, _2),
+         boost::bind(handleStreamBlock, ptrConnection, _1, _2),
+         errorHandler);
+}
+
+// streamed event responses don't use pooled connections since the session
+// closes the connection at the end of the response
+void proxyStreamRequest(
+      const std::string& username,
+      boost::shared_ptr<core::http::AsyncConnection> ptrConnection,
+      const http::ErrorHandler& errorHandler)
+{
+   FilePath streamPath = session::local_streams::streamPath(username);
+
+   boost::shared_ptr<http::LocalStreamAsyncClient> pClient(
+    new http::LocalStreamAsyncClient(ptrConnection->ioService(), streamPath));
+
+   pClient->request().assign(ptrConnection->request());
+
+   pClient->executeStreaming(
+         boost::bind(handleStreamHeaders, ptrConnection, _1, _2),
+         boost::bind(handleStreamBlock, ptrConnection, _1, _2),
          errorHandler);
 }
 
@@ -302,9 +362,19 @@ void proxyEventsRequest(
    if (!validateUser(ptrConnection, username))
       return;
 
-   proxyRequest(username,
-                ptrConnection,
-                boost::bind(handleEventsError, ptrConnection, _1));
+   if (boost::algorithm::ends_with(ptrConnection->request().uri(),
+                                   "stream_events"))
+   {
+      proxyStreamRequest(username,
+                         ptrConnection,
+                         boost::bind(handleEventsError, ptrConnection, _1));
+   }
+   else
+   {
+      proxyRequest(username,
+                   ptrConnection,
+                   boost::bind(handleEventsError, ptrConnection, _1));
+   }
 }
 
 } // namespace session_proxy
@@ -86,6 +86,11 @@ public:
       return wwwThreadPoolSize_;
    }
 
+   bool wwwIoServicePerThread() const
+   {
+      return wwwIoServicePerThread_;
+   }
+
    // auth
    bool authValidateUsers()
    {
@@ -143,6 +148,11 @@ public:
       return rsessionUserProcessLimit_;
    }
 
+   bool rsessionPrelaunch() const
+   {
+      return rsessionPrelaunch_;
+   }
+
 private:
    bool verifyInstallation_;
    std::string serverWorkingDir_;
@@ -154,6 +164,7 @@ private:
    std::string wwwPort_ ;
    std::string wwwLocalPath_ ;
    int wwwThreadPoolSize_;
+   bool wwwIoServicePerThread_;
    bool authValidateUsers_;
    std::string authRequiredUserGroup_;
    std::string authPamHelperPath_;
@@ -165,6 +176,7 @@ private:
    int rsessionMemoryLimitMb_;
    int rsessionStackLimitMb_;
    int rsessionUserProcessLimit_;
+   bool rsessionPrelaunch_;
 };
       
 } // namespace server
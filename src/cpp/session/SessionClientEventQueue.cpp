@@ -13,7 +13,10 @@
 
 #include "SessionClientEventQueue.hpp"
 
+#include <algorithm>
+
 #include <boost/foreach.hpp>
+#include <boost/format.hpp>
 
 
 #include <core/BoostThread.hpp>
@@ -28,6 +31,14 @@ namespace session {
  
 namespace {
 ClientEventQueue* s_pClientEventQueue = NULL;
+
+// size of the chunks console output is appended to
+const std::size_t kConsoleOutputChunkSize = 16 * 1024;
+
+// maximum console output held between flushes (when it is exceeded output
+// is dropped down to 3/4 of the maximum so that runaway output isn't
+// trimmed on every write)
+const std::size_t kMaxPendingConsoleOutput = 1024 * 1024;
 }
 
 void initializeClientEventQueue()
@@ -44,6 +55,8 @@ ClientEventQueue& clientEventQueue()
 ClientEventQueue::ClientEventQueue()
    :  pMutex_(new boost::mutex()),
       pWaitForEventCondition_(new boost::condition()),
+      pendingConsoleOutputBytes_(0),
+      droppedConsoleLines_(0),
       lastEventAddTime_(boost::posix_time::not_a_date_time)
 {
 }
@@ -56,7 +69,7 @@ void ClientEventQueue::add(const ClientEvent& event)
       if (event.type() == client_events::kConsoleWriteOutput)
       {
          if (event.data().type() == json::StringType)
-            pendingConsoleOutput_ += event.data().get_str();
+            addConsoleOutput(event.data().get_str());
       }
       else
       {
@@ -80,7 +93,7 @@ bool ClientEventQueue::hasEvents()
 {
    LOCK_MUTEX(*pMutex_)
    {
-      return pendingEvents_.size() > 0 || pendingConsoleOutput_.length() > 0;
+      return pendingEvents_.size() > 0 || pendingConsoleOutput_.size() > 0;
    }
    END_LOCK_MUTEX
    
@@ -95,13 +108,18 @@ void ClientEventQueue::remove(std::vector<ClientEvent>* pEvents)
       // flush any pending output
       flushPendingConsoleOutput();
       
-      // copy the events to the caller
-      pEvents->insert(pEvents->begin(), 
-                      pendingEvents_.begin(), 
-                      pendingEvents_.end());
-   
-      // clear pending events
-      pendingEvents_.clear();
+      // give the events to the caller (ahead of any it already has)
+      if (pEvents->empty())
+      {
+         pEvents->swap(pendingEvents_);
+      }
+      else
+      {
+         pEvents->insert(pEvents->begin(),
+                         pendingEvents_.begin(),
+                         pendingEvents_.end());
+         pendingEvents_.clear();
+      }
    } 
    END_LOCK_MUTEX
 }
@@ -111,6 +129,8 @@ void ClientEventQueue::clear()
    LOCK_MUTEX(*pMutex_)
    {
       pendingConsoleOutput_.clear();
+      pendingConsoleOutputBytes_ = 0;
+      droppedConsoleLines_ = 0;
       pendingEvents_.clear();
    }
    END_LOCK_MUTEX
@@ -153,38 +173,130 @@ bool ClientEventQueue::eventAddedSince(const boost::posix_time::ptime& time)
 }
    
 
+void ClientEventQueue::addConsoleOutput(const std::string& output)
+{
+   // NOTE: private helper so no lock required (mutex is not recursive)
+
+   if (output.empty())
+      return;
+
+   // append to the last chunk (start a new one if it is full)
+   if (pendingConsoleOutput_.empty() ||
+       pendingConsoleOutput_.back().size() >= kConsoleOutputChunkSize)
+   {
+      pendingConsoleOutput_.push_back(std::string());
+      pendingConsoleOutput_.back().reserve(
+                           std::max(kConsoleOutputChunkSize, output.size()));
+   }
+   pendingConsoleOutput_.back().append(output);
+   pendingConsoleOutputBytes_ += output.size();
+
+   if (pendingConsoleOutputBytes_ > kMaxPendingConsoleOutput)
+   {
+      dropConsoleOutput(pendingConsoleOutputBytes_ -
+                        (kMaxPendingConsoleOutput / 4 * 3));
+   }
+}
+
+void ClientEventQueue::dropConsoleOutput(std::size_t bytes)
+{
+   // NOTE: private helper so no lock required (mutex is not recursive)
+
+   std::size_t droppedBytes = 0;
+   char lastDropped = '\n';
+
+   // drop chunks which are entirely within the bytes to drop
+   while (!pendingConsoleOutput_.empty() &&
+          pendingConsoleOutput_.front().size() <= bytes)
+   {
+      const std::string& chunk = pendingConsoleOutput_.front();
+      droppedConsoleLines_ += std::count(chunk.begin(), chunk.end(), '\n');
+      pendingConsoleOutputBytes_ -= chunk.size();
+      bytes -= chunk.size();
+      droppedBytes += chunk.size();
+      if (!chunk.empty())
+         lastDropped = chunk[chunk.size() - 1];
+      pendingConsoleOutput_.pop_front();
+   }
+
+   // then drop the remaining bytes from the next chunk, through the end of
+   // the line which was cut if it ends within the chunk (so the output
+   // which remains starts at the beginning of a line). if it doesn't then
+   // only the requested bytes are dropped (output without newlines would
+   // otherwise be dropped entirely)
+   if (!pendingConsoleOutput_.empty() && (bytes > 0 || lastDropped != '\n'))
+   {
+      std::string& chunk = pendingConsoleOutput_.front();
+      std::size_t pos = chunk.find('\n', bytes);
+      std::size_t dropBytes = (pos != std::string::npos) ? pos + 1 : bytes;
+      if (dropBytes > 0)
+      {
+         droppedConsoleLines_ += std::count(chunk.begin(),
+                                            chunk.begin() + dropBytes,
+                                            '\n');
+         pendingConsoleOutputBytes_ -= dropBytes;
+         droppedBytes += dropBytes;
+         lastDropped = chunk[dropBytes - 1];
+         chunk.erase(0, dropBytes);
+      }
+   }
+
+   // count the partial line which was cut (so that the omitted output is
+   // always noted)
+   if (droppedBytes > 0 && lastDropped != '\n')
+      droppedConsoleLines_++;
+}
+
 void ClientEventQueue::flushPendingConsoleOutput()
 {
    // NOTE: private helper so no lock required (mutex is not recursive) 
    
    if ( !pendingConsoleOutput_.empty() )
    {
+      std::string output;
+      output.reserve(pendingConsoleOutputBytes_);
+      BOOST_FOREACH(const std::string& chunk, pendingConsoleOutput_)
+      {
+         output.append(chunk);
+      }
+      pendingConsoleOutput_.clear();
+      pendingConsoleOutputBytes_ = 0;
+
       // If there's more console output than the client can even show, then
       // truncate it to the amount that the client can show. Too much output
       // can overwhelm the client, causing it to become unresponsive.
       int limit = r::session::consoleActions().capacity() + 1;
-      if (pendingConsoleOutput_.length() > static_cast<unsigned int>(limit*2))
+      if (output.length() > static_cast<unsigned int>(limit*2))
       {
          int lineCount = 0;
-         std::string::const_iterator begin = pendingConsoleOutput_.begin();
-         std::string::iterator pos = pendingConsoleOutput_.end();
-         while (--pos >= begin)
+         std::size_t pos = output.length();
+         while (pos > 0)
          {
-            if (*pos == '\n')
+            pos = output.rfind('\n', pos - 1);
+            if (pos == std::string::npos)
+               break;
+
+            if (++lineCount > limit)
             {
-               if (++lineCount > limit)
-               {
-                  pendingConsoleOutput_.erase(pendingConsoleOutput_.begin(),
-                                              pos);
-                  break;
-               }
+               droppedConsoleLines_ += std::count(output.begin(),
+                                                  output.begin() + pos + 1,
+                                                  '\n');
+               output.erase(0, pos + 1);
+               break;
             }
          }
       }
 
+      // let the user know about output which was dropped
+      if (droppedConsoleLines_ > 0)
+      {
+         boost::format fmt("[ %1% lines of output omitted ]\n");
+         output.insert(0, boost::str(fmt % droppedConsoleLines_));
+         droppedConsoleLines_ = 0;
+      }
+
       pendingEvents_.push_back(ClientEvent(client_events::kConsoleWriteOutput, 
-                                           pendingConsoleOutput_)); 
-      pendingConsoleOutput_.clear() ;
+                                           output));
    }
 }
 
@@ -16,6 +16,7 @@
 
 #include <string>
 #include <vector>
+#include <deque>
 
 #include <boost/function.hpp>
 #include <boost/utility.hpp>
@@ -62,6 +63,8 @@ public:
    bool eventAddedSince(const boost::posix_time::ptime& time);
       
 private:   
+   void addConsoleOutput(const std::string& output);
+   void dropConsoleOutput(std::size_t bytes);
    void flushPendingConsoleOutput();
  
 private:
@@ -73,8 +76,12 @@ private:
    boost::mutex* pMutex_ ;
    boost::condition* pWaitForEventCondition_ ;
 
-   // instance data
-   std::string pendingConsoleOutput_ ;
+   // instance data. console output is appended to fixed size chunks (so
+   // output already written is never reallocated) and limited to a fixed
+   // number of bytes, beyond which the oldest lines are dropped
+   std::deque<std::string> pendingConsoleOutput_ ;
+   std::size_t pendingConsoleOutputBytes_ ;
+   std::size_t droppedConsoleLines_ ;
    std::vector<ClientEvent> pendingEvents_ ; 
    boost::posix_time::ptime lastEventAddTime_;
    
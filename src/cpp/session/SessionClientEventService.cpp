@@ -13,9 +13,11 @@
 
 #include "SessionClientEventService.hpp"
 
+#include <sstream>
 #include <algorithm>
 
 #include <boost/function.hpp>
+#include <boost/algorithm/string/predicate.hpp>
 
 #include <core/BoostThread.hpp>
 #include <core/Log.hpp>
@@ -26,6 +28,7 @@
 
 
 #include <core/http/Request.hpp>
+#include <core/http/Response.hpp>
 
 #include <session/SessionOptions.hpp>
 #include <session/SessionHttpConnectionListener.hpp>
@@ -40,13 +43,68 @@ namespace {
 
 const int kLastChanceWaitSeconds = 4;
 
+// event streams are ended (so that the client reconnects, acknowledging
+// the events it has received) once this many events are awaiting
+// acknowledgement or the stream has been open for this long
+const std::size_t kMaxUnacknowledgedEvents = 1000;
+const int kMaxStreamMinutes = 5;
+
 bool hasEventIdLessThanOrEqualTo(const json::Value& event, int targetId)
 {
    const json::Object& eventJSON = event.get_obj();
    int eventId = eventJSON.find("id")->second.get_int();
    return eventId <= targetId;
 }
-         
+
+// wait for additional events that occur in rapid succession (but don't
+// wait for more than the specified maximum total delay)
+void waitForEventBatch(ClientEventQueue& clientEventQueue,
+                       const boost::posix_time::time_duration& batchDelay,
+                       const boost::posix_time::time_duration& maxTotalDelay)
+{
+   boost::system_time maxBatchDelayTime =
+                              boost::get_system_time() + maxTotalDelay;
+
+   while ( clientEventQueue.waitForEvent(batchDelay) &&
+           (boost::get_system_time() < maxBatchDelayTime) )
+   {
+   }
+}
+
+bool isEventsConnectionWaiting()
+{
+   return !httpConnectionListener().eventsConnectionQueue()
+                                          .peekNextConnectionUri().empty();
+}
+
+// report an error in an events request. streaming clients only read
+// newline terminated lines so the error is written as a line (as events
+// are) so that they see it and fall back to get_events
+void sendEventsError(boost::shared_ptr<HttpConnection> ptrConnection,
+                     const Error& error)
+{
+   if (!boost::algorithm::ends_with(ptrConnection->request().uri(),
+                                    "events/stream_events"))
+   {
+      ptrConnection->sendJsonRpcError(error);
+      return;
+   }
+
+   json::JsonRpcResponse jsonRpcResponse;
+   jsonRpcResponse.setError(error);
+   std::string body;
+   jsonRpcResponse.write(&body);
+   body.push_back('\n');
+
+   http::Response response;
+   response.setContentType("application/json");
+   response.setNoCacheHeaders();
+   Error bodyError = response.setBody(body);
+   if (bodyError)
+      LOG_ERROR(bodyError);
+   ptrConnection->sendResponse(response);
+}
+
 } // anonymous namespace
 
 ClientEventService& clientEventService()
@@ -180,6 +238,138 @@ void ClientEventService::setClientEventResult(
    END_LOCK_MUTEX
 }
 
+void ClientEventService::getClientEvents(json::Array* pEvents)
+{
+   LOCK_MUTEX(mutex_)
+   {
+      *pEvents = clientEvents_;
+   }
+   END_LOCK_MUTEX
+}
+
+std::size_t ClientEventService::unacknowledgedEventCount()
+{
+   LOCK_MUTEX(mutex_)
+   {
+      return clientEvents_.size();
+   }
+   END_LOCK_MUTEX
+
+   // keep compiler happy
+   return 0;
+}
+
+void ClientEventService::dequeClientEvents(int* pNextEventId,
+                                           json::Array* pEvents)
+{
+   // deque the events
+   std::vector<ClientEvent> events;
+   clientEventQueue().remove(&events);
+
+   // convert to json and add event id
+   for (std::vector<ClientEvent>::const_iterator
+        it = events.begin(); it != events.end(); ++it)
+   {
+      json::Object event ;
+      it->asJsonObject((*pNextEventId)++, &event);
+      addClientEvent(event);
+      if (pEvents != NULL)
+         pEvents->push_back(event);
+   }
+}
+
+// streamed events are written as newline delimited json-rpc responses
+// (one per batch of events). events remain in clientEvents_ until the
+// client acknowledges them by passing the last event id it has seen when
+// it next connects (so any which are lost along with the connection are
+// sent again)
+void ClientEventService::streamEvents(
+                  boost::shared_ptr<HttpConnection> ptrConnection,
+                  const std::string& clientId,
+                  const boost::posix_time::time_duration& batchDelay,
+                  const boost::posix_time::time_duration& maxTotalBatchDelay,
+                  int* pNextEventId,
+                  bool* pStopServer)
+{
+   using namespace boost::posix_time;
+   ClientEventQueue& clientEventQueue = session::clientEventQueue();
+
+   http::Response response;
+   response.setContentType("application/json");
+   response.setNoCacheHeaders();
+   Error error = ptrConnection->beginStreamingResponse(response);
+   if (error)
+   {
+      ptrConnection->close();
+      return;
+   }
+
+   // start by re-sending any events the client hasn't acknowledged. this
+   // first batch is sent even if it is empty (so that the client knows the
+   // stream was established)
+   json::Array events;
+   getClientEvents(&events);
+   bool firstBatch = true;
+
+   ptime streamEndTime = microsec_clock::universal_time() +
+                         minutes(kMaxStreamMinutes);
+   while (true)
+   {
+      // send the events (if there are any)
+      if (!events.empty() || firstBatch)
+      {
+         firstBatch = false;
+
+         json::JsonRpcResponse jsonRpcResponse;
+         jsonRpcResponse.setResult(events);
+         jsonRpcResponse.setField(kEventsPending, "false");
+
+         std::string chunk;
+         jsonRpcResponse.write(&chunk);
+         chunk.push_back('\n');
+         if (ptrConnection->writeStreamingChunk(chunk))
+            break;
+         events.clear();
+      }
+
+      // end the stream if we are stopping, the client is no longer current,
+      // there is another events request waiting (e.g. because the client
+      // restarted its listener), or the client needs to acknowledge events
+      if (*pStopServer ||
+          clientId != this->clientId() ||
+          isEventsConnectionWaiting() ||
+          unacknowledgedEventCount() >= kMaxUnacknowledgedEvents ||
+          microsec_clock::universal_time() > streamEndTime)
+      {
+         break;
+      }
+
+      // wait for the next batch of events (checking on the state of
+      // the stream every second)
+      try
+      {
+         if (clientEventQueue.hasEvents() ||
+             clientEventQueue.waitForEvent(seconds(1)))
+         {
+            waitForEventBatch(clientEventQueue,
+                              batchDelay,
+                              maxTotalBatchDelay);
+         }
+      }
+      catch(const boost::thread_interrupted& e)
+      {
+         // set flag so we end the stream after sending any remaining
+         // events (e.g. the quit event)
+         *pStopServer = true;
+      }
+
+      if (clientId == this->clientId())
+         dequeClientEvents(pNextEventId, &events);
+   }
+
+   ptrConnection->endStreamingResponse();
+}
+
 
 void ClientEventService::run()
 {
@@ -248,7 +438,7 @@ void ClientEventService::run()
                                                  &request);
          if (error)
          {
-            ptrConnection->sendJsonRpcError(error);
+            sendEventsError(ptrConnection, error);
             continue;
          }
 
@@ -257,7 +447,7 @@ void ClientEventService::run()
          {
             Error error = Error(json::errc::InvalidClientId,
                                              ERROR_LOCATION);
-            ptrConnection->sendJsonRpcError(error);
+            sendEventsError(ptrConnection, error);
             continue;
          }
 
@@ -268,7 +458,7 @@ void ClientEventService::run()
                                             &lastClientEventIdSeen);
          if (paramError)
          {
-            ptrConnection->sendJsonRpcError(paramError);
+            sendEventsError(ptrConnection, paramError);
             continue;
          }
            
@@ -281,6 +471,19 @@ void ClientEventService::run()
          // would never see any events!)
          nextEventId = std::max(nextEventId, lastClientEventIdSeen + 1);
 
+         // streaming clients are sent each batch of events as it occurs
+         // (the stream ends when the client needs to reconnect)
+         if (request.method == "stream_events")
+         {
+            streamEvents(ptrConnection,
+                         request.clientId,
+                         batchDelay,
+                         maxTotalBatchDelay,
+                         &nextEventId,
+                         &stopServer);
+            continue;
+         }
+
          // check for events (and wait a specified internal if there are none)
          try
          {
@@ -292,13 +495,9 @@ void ClientEventService::run()
                
                // wait for additional events that occur in rapid succession 
                // but don't wait for more than the specified maximum seconds
-               boost::system_time maxBatchDelayTime = 
-                              boost::get_system_time() + maxTotalBatchDelay;
-               
-               while ( clientEventQueue.waitForEvent(batchDelay) &&
-                       (boost::get_system_time() < maxBatchDelayTime) )
-               {
-               }
+               waitForEventBatch(clientEventQueue,
+                                 batchDelay,
+                                 maxTotalBatchDelay);
            }
          }
          catch(const boost::thread_interrupted& e)
@@ -318,17 +517,7 @@ void ClientEventService::run()
          if (request.clientId == clientId())
          {
             // deque the events
-            std::vector<ClientEvent> events;
-            clientEventQueue.remove(&events);
-            
-            // convert to json and add event id
-            for (std::vector<ClientEvent>::const_iterator 
-                 it = events.begin(); it != events.end(); ++it)
-            {
-               json::Object event ;
-               it->asJsonObject(nextEventId++, &event);
-               addClientEvent(event);
-            }
+            dequeClientEvents(&nextEventId, NULL);
 
             // send them (pass false for kEventsPending b/c responses from the
             // event service shouldn't interact with automatic event service
@@ -17,6 +17,8 @@
 #include <string>
 
 #include <boost/utility.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
 
 #include <core/BoostThread.hpp>
 
@@ -29,6 +31,8 @@ namespace core {
 
 namespace session {
 
+class HttpConnection;
+
 // singleton
 class ClientEventService;
 ClientEventService& clientEventService();
@@ -53,9 +57,20 @@ private:
 
    void run();
 
+   void streamEvents(
+            boost::shared_ptr<HttpConnection> ptrConnection,
+            const std::string& clientId,
+            const boost::posix_time::time_duration& batchDelay,
+            const boost::posix_time::time_duration& maxTotalBatchDelay,
+            int* pNextEventId,
+            bool* pStopServer);
+
    void erasePreviouslyDeliveredEvents(int lastClientEventIdSeen);
    bool havePendingClientEvents();
+   std::size_t unacknowledgedEventCount();
    void addClientEvent(const core::json::Object& eventObject);
+   void dequeClientEvents(int* pNextEventId, core::json::Array* pEvents);
+   void getClientEvents(core::json::Array* pEvents);
    void setClientEventResult(core::json::JsonRpcResponse* pResponse);
 
   
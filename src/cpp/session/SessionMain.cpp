@@ -49,6 +49,7 @@
 #include <core/gwt/GwtLogHandler.hpp>
 #include <core/gwt/GwtFileHandler.hpp>
 #include <core/system/Process.hpp>
+#include <core/system/FileMonitor.hpp>
 #include <core/system/ParentProcessMonitor.hpp>
 #include <core/text/TemplateFilter.hpp>
 
@@ -118,6 +119,18 @@ http::UriHandlerFunction s_defaultUriHandler;
 
 // json rpc methods
 core::json::JsonRpcMethods s_jsonRpcMethods;
+
+// rpc methods and uri handlers which don't use R (these are looked up by
+// the worker threads of the connection listener so are guarded by a mutex).
+// uri handlers which do use R are included with empty functions so that
+// a uri resolves to the same handler here as in s_uriHandlers
+boost::mutex s_rFreeHandlersMutex;
+core::json::JsonRpcMethods s_rFreeRpcMethods;
+http::UriHandlers s_rFreeUriHandlers;
+
+// active client id (requests handled by worker threads are validated
+// against this rather than reading persistent state)
+core::thread::ThreadsafeValue<std::string> s_activeClientId("");
    
 // R browseUrl handlers
 std::vector<module_context::RBrowseUrlHandler> s_rBrowseUrlHandlers;
@@ -294,6 +307,7 @@ void handleClientInit(const boost::function<void()>& initFunction,
    
    // calculate initialization parameters
    std::string clientId = session::persistentState().newActiveClientId();
+   s_activeClientId.set(clientId);
    bool resumed = s_rSessionResumed || s_sessionInitialized;
 
    // if we are resuming then we don't need to worry about events queued up
@@ -529,7 +543,7 @@ bool parseAndValidateJsonRpcConnection(
    }
 
    // check for invalid client id
-   if (pJsonRpcRequest->clientId != session::persistentState().activeClientId())
+   if (pJsonRpcRequest->clientId != s_activeClientId.get())
    {
       Error error(json::errc::InvalidClientId, ERROR_LOCATION);
       ptrConnection->sendJsonRpcError(error);
@@ -636,6 +650,118 @@ void handleConnection(boost::shared_ptr<HttpConnection> ptrConnection,
    }
 }
 
+void addRFreeUriHandler(const std::string& prefix,
+                        const http::UriHandlerFunction& handlerFunction)
+{
+   LOCK_MUTEX(s_rFreeHandlersMutex)
+   {
+      s_rFreeUriHandlers.add(http::UriHandler(prefix, handlerFunction));
+   }
+   END_LOCK_MUTEX
+}
+
+json::JsonRpcFunction rFreeRpcMethod(const std::string& method)
+{
+   LOCK_MUTEX(s_rFreeHandlersMutex)
+   {
+      json::JsonRpcMethods::const_iterator it = s_rFreeRpcMethods.find(method);
+      if (it != s_rFreeRpcMethods.end())
+         return it->second;
+   }
+   END_LOCK_MUTEX
+
+   return json::JsonRpcFunction();
+}
+
+http::UriHandlerFunction rFreeUriHandler(const std::string& uri)
+{
+   LOCK_MUTEX(s_rFreeHandlersMutex)
+   {
+      return s_rFreeUriHandlers.handlerFor(uri);
+   }
+   END_LOCK_MUTEX
+
+   return http::UriHandlerFunction();
+}
+
+std::string rpcMethodFromUri(const std::string& uri)
+{
+   std::string prefix("/rpc/");
+   return uri.substr(prefix.length());
+}
+
+// called by the connection listener (on its own thread) to determine
+// whether a connection can be handled by a worker thread
+bool isRFreeConnection(boost::shared_ptr<HttpConnection> ptrConnection)
+{
+   if (isJsonRpcRequest(ptrConnection))
+   {
+      std::string uri = ptrConnection->request().uri();
+      return !rFreeRpcMethod(rpcMethodFromUri(uri)).empty();
+   }
+   else
+   {
+      return !rFreeUriHandler(ptrConnection->request().uri()).empty();
+   }
+}
+
+// handle a connection on a worker thread (see isRFreeConnection). this
+// is equivalent to handleConnection save for not detecting changes
+// (which requires R)
+void handleRFreeConnection(boost::shared_ptr<HttpConnection> ptrConnection)
+{
+   const http::Request& request = ptrConnection->request();
+   if (isJsonRpcRequest(ptrConnection))
+   {
+      json::JsonRpcRequest jsonRpcRequest;
+      if (!parseAndValidateJsonRpcConnection(ptrConnection, &jsonRpcRequest))
+         return;
+
+      json::JsonRpcFunction handlerFunction =
+                                    rFreeRpcMethod(jsonRpcRequest.method);
+      if (!handlerFunction)
+      {
+         Error error(json::errc::MethodNotFound, ERROR_LOCATION);
+         error.addProperty("method", jsonRpcRequest.method);
+         ptrConnection->sendJsonRpcError(error);
+         return;
+      }
+
+      using namespace boost::posix_time;
+      ptime executeStartTime = microsec_clock::universal_time();
+
+      json::JsonRpcResponse jsonRpcResponse;
+      Error error = handlerFunction(jsonRpcRequest, &jsonRpcResponse);
+      if (error)
+      {
+         ptrConnection->sendJsonRpcError(error);
+         return;
+      }
+
+      if ( !clientEventQueue().eventAddedSince(executeStartTime) &&
+           !jsonRpcResponse.hasAfterResponse() )
+      {
+         jsonRpcResponse.setField(kEventsPending, "false");
+      }
+
+      ptrConnection->sendJsonRpcResponse(jsonRpcResponse);
+
+      if (jsonRpcResponse.hasAfterResponse())
+         jsonRpcResponse.runAfterResponse();
+   }
+   else
+   {
+      http::UriHandlerFunction uriHandler = rFreeUriHandler(request.uri());
+      http::Response response;
+      if (uriHandler)
+         uriHandler(request, &response);
+      else
+         response.setError(http::status::NotFound,
+                           request.uri() + " not found");
+      ptrConnection->sendResponse(response);
+   }
+}
+
 // fork state
 boost::thread::id s_mainThreadId;
 bool s_wasForked = false;
@@ -1051,12 +1177,18 @@ Error bufferConsoleInput(const core::json::JsonRpcRequest& request,
 Error startHttpConnectionListener()
 {
    initializeHttpConnectionListener();
+   httpConnectionListener().setWorkerConnectionHandler(
+                                          session::options().rpcThreads(),
+                                          isRFreeConnection,
+                                          handleRFreeConnection);
    return httpConnectionListener().start();
 }
 
 Error startClientEventService()
 {
-   return clientEventService().start(session::persistentState().activeClientId());
+   std::string clientId = session::persistentState().activeClientId();
+   s_activeClientId.set(clientId);
+   return clientEventService().start(clientId);
 }
 
 void registerGwtHandlers()
@@ -1626,6 +1758,12 @@ void rCleanup(bool terminatedNormally)
       // fire shutdown event to modules
       module_context::events().onShutdown(terminatedNormally);
 
+      // stop background tasks (their results are no longer needed)
+      module_context::backgroundTaskScheduler().stop();
+
+      // stop the file monitoring service (unregisters all monitors)
+      core::system::file_monitor::stop();
+
       // cause graceful exit of clientEventService (ensures delivery
       // of any pending events prior to process termination). wait a
       // very brief interval first to allow the quit or other termination
@@ -1899,6 +2037,7 @@ Error registerUriHandler(const std::string& name,
    
    s_uriHandlers.add(http::UriHandler(name,
                                       handlerFunction));
+   addRFreeUriHandler(name, http::UriHandlerFunction());
    return Success();
 }
    
@@ -1908,6 +2047,8 @@ Error registerLocalUriHandler(const std::string& name,
 {
    s_uriHandlers.add(http::UriHandler(kLocalUriLocationPrefix + name,
                                       handlerFunction));
+   addRFreeUriHandler(kLocalUriLocationPrefix + name,
+                      http::UriHandlerFunction());
    return Success();
 }
    
@@ -1919,6 +2060,29 @@ Error registerRpcMethod(const std::string& name,
    return Success();
 }
 
+Error registerRFreeRpcMethod(const std::string& name,
+                             const core::json::JsonRpcFunction& function)
+{
+   // (also handled on the main thread if there are no worker threads)
+   if (s_jsonRpcMethods.insert(std::make_pair(name, function)).second)
+   {
+      LOCK_MUTEX(s_rFreeHandlersMutex)
+      {
+         s_rFreeRpcMethods.insert(std::make_pair(name, function));
+      }
+      END_LOCK_MUTEX
+   }
+   return Success();
+}
+
+Error registerRFreeUriHandler(const std::string& name,
+                              const http::UriHandlerFunction& handlerFunction)
+{
+   s_uriHandlers.add(http::UriHandler(name, handlerFunction));
+   addRFreeUriHandler(name, handlerFunction);
+   return Success();
+}
+
 namespace {
 
 bool continueChildProcess()
@@ -2220,6 +2384,8 @@ int main (int argc, char * const argv[])
       rOptions.serverMode = serverMode;
       rOptions.autoReloadSource = options.autoReloadSource();
       rOptions.shellEscape = options.rShellEscape();
+      rOptions.plotImageCacheMemoryMb = options.rPlotImageCacheMemoryMb();
+      rOptions.plotImageCacheDiskMb = options.rPlotImageCacheDiskMb();
       rOptions.restoreWorkspace = restoreWorkspaceOption();
       rOptions.saveWorkspace = saveWorkspaceOption();
       
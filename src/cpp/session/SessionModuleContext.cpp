@@ -14,6 +14,7 @@
 #include "SessionModuleContextInternal.hpp"
 
 #include <vector>
+#include <algorithm>
 
 #include <boost/utility.hpp>
 #include <boost/signal.hpp>
@@ -33,6 +34,7 @@
 
 #include <core/system/Process.hpp>
 #include <core/system/FileChangeEvent.hpp>
+#include <core/system/FileMonitor.hpp>
 
 #include <r/RSexp.hpp>
 #include <r/RUtil.hpp>
@@ -297,6 +299,10 @@ Error initialize()
    if (error)
       return error;
 
+   // start the file monitoring service (modules register monitors during
+   // their own initialization and receive callbacks via checkForChanges)
+   core::system::file_monitor::initialize();
+
    // source the ModuleTools.R file
    FilePath modulesPath = session::options().modulesRSourcePath();
    return r::sourceManager().sourceTools(modulesPath.complete("ModuleTools.R"));
@@ -448,6 +454,12 @@ void onBackgroundProcessing(bool isIdle)
    // allow process supervisor to poll for events
    processSupervisor().poll();
 
+   // check for file monitor changes (callbacks are delivered on this thread)
+   core::system::file_monitor::checkForChanges();
+
+   // apply the results of completed background tasks
+   backgroundTaskScheduler().processCompletions();
+
    // fire event
    events().onBackgroundProcessing(isIdle);
 
@@ -713,6 +725,27 @@ core::system::ProcessSupervisor& processSupervisor()
    static core::system::ProcessSupervisor instance;
    return instance;
 }
+
+namespace {
+
+std::size_t backgroundThreads()
+{
+   int threads = session::options().backgroundThreads();
+   if (threads > 0)
+      return threads;
+
+   // by default use a thread per core (less one for R) up to 4 threads
+   unsigned int cores = boost::thread::hardware_concurrency();
+   return std::max(1u, std::min(4u, cores > 1 ? cores - 1 : 1u));
+}
+
+} // anonymous namespace
+
+core::thread::BackgroundTaskScheduler& backgroundTaskScheduler()
+{
+   static core::thread::BackgroundTaskScheduler instance(backgroundThreads());
+   return instance;
+}
    
 namespace {
 void beginRpcHandler(json::JsonRpcFunction function,
@@ -120,7 +120,13 @@ core::ProgramStatus Options::read(int argc, char * const argv[])
          "session preflight script")
       ("session-create-public-folder",
          value<bool>(&createPublicFolder_)->default_value(false),
-         "automatically create public folder");
+         "automatically create public folder")
+      ("session-rpc-threads",
+         value<int>(&rpcThreads_)->default_value(2),
+         "threads for requests which don't use R (0 to disable)")
+      ("session-background-threads",
+         value<int>(&backgroundThreads_)->default_value(0),
+         "threads for background tasks (0 to use one per core)");
 
    // r options
    options_description r("r") ;
@@ -152,6 +158,12 @@ core::ProgramStatus Options::read(int argc, char * const argv[])
       ("r-shell-escape",
          value<bool>(&rShellEscape_)->default_value(false),
          "Support shell escape")
+      ("r-plot-image-cache-memory-mb",
+         value<int>(&rPlotImageCacheMemoryMb_)->default_value(16),
+         "Memory used for caching rendered plot images")
+      ("r-plot-image-cache-disk-mb",
+         value<int>(&rPlotImageCacheDiskMb_)->default_value(64),
+         "Disk space used for caching rendered plot images")
       ("r-home-dir-override",
          value<std::string>(&rHomeDirOverride_)->default_value(""),
          "Override for R_HOME (used for debug configurations)")
@@ -15,9 +15,13 @@
 
 #include <string>
 #include <vector>
+#include <map>
+#include <sstream>
 #include <algorithm>
 
 #include <boost/bind.hpp>
+#include <boost/utility.hpp>
+#include <boost/cstdint.hpp>
 #include <boost/foreach.hpp>
 #include <boost/regex.hpp>
 #include <boost/date_time/posix_time/posix_time.hpp>
@@ -56,103 +60,705 @@ namespace source_database {
 
 namespace {
 
-struct PropertiesDatabase
+// The source database is stored in a single append-only log within the
+// source_database directory. Each record is a header line followed by a
+// json payload of the length given in the header:
+//
+//   <type> <key> <length> <crc32>
+//   <payload>
+//
+// The record types are:
+//
+//   put          full json for the document with id <key>
+//   edit         json for the document with id <key> (without contents)
+//                along with an edit to apply to its previous contents
+//   remove       the document with id <key> was removed (empty payload)
+//   properties   durable properties for the (url escaped) path <key>
+//
+// The log is read sequentially once at startup into an in-memory index of
+// documents and properties, after which reads are served from memory and
+// writes append a record. When most of the log is made up of records which
+// have since been superseded it is compacted (rewritten with one record
+// for each document and path).
+
+const char * const kLogFile = "LOG";
+const char * const kCompactedLogFile = "LOG.tmp";
+const char * const kPropertiesDir = "properties";
+
+const char * const kPutRecord = "put";
+const char * const kEditRecord = "edit";
+const char * const kRemoveRecord = "remove";
+const char * const kPropertiesRecord = "properties";
+
+// don't compact logs smaller than this
+const boost::uintmax_t kMinCompactionSize = 1024 * 1024;
+
+// don't record edits to documents smaller than this (the full contents
+// are cheap enough to write)
+const std::size_t kMinEditContentsSize = 4096;
+
+std::string recordChecksum(const std::string& payload)
+{
+   // crc32 of an empty string is (reasonably) formatted as an empty string
+   std::string checksum = hash::crc32Hash(payload);
+   return !checksum.empty() ? checksum : "0";
+}
+
+std::string formatRecord(const std::string& type,
+                         const std::string& key,
+                         const std::string& payload)
+{
+   std::ostringstream ostr;
+   ostr << type << " " << key << " " << payload.size() << " "
+        << recordChecksum(payload) << "\n" << payload << "\n";
+   return ostr.str();
+}
+
+std::string formatRecord(const std::string& type,
+                         const std::string& key,
+                         const json::Object& payload)
+{
+   std::ostringstream ostr;
+   json::write(payload, ostr);
+   return formatRecord(type, key, ostr.str());
+}
+
+// is the byte at offset within utf8 contents a continuation byte (i.e.
+// not the start of a character)
+bool isContinuationByte(const std::string& contents, std::size_t offset)
 {
-   FilePath path;
-   FilePath indexFile;
-   std::map<std::string,std::string> index;
+   return offset < contents.size() &&
+          (static_cast<unsigned char>(contents[offset]) & 0xC0) == 0x80;
+}
+
+} // anonymous namespace
+
+// NOTE: applyEdit and computeEdit aren't static so that they can be
+// exercised by SessionSourceDatabaseTests.cpp
+
+// apply an edit (replace length bytes at offset with text) to contents
+bool applyEdit(std::size_t offset,
+               std::size_t length,
+               const std::string& text,
+               std::string* pContents)
+{
+   if (offset > pContents->size() || length > pContents->size() - offset)
+      return false;
+   pContents->replace(offset, length, text);
+   return true;
+}
+
+// compute the edit which turns previous into contents (the edit replaces
+// length bytes at offset with text). the edit is aligned to utf8 character
+// boundaries within contents; returns false if no such edit reproduces
+// contents (in which case the full contents should be recorded)
+bool computeEdit(const std::string& previous,
+                 const std::string& contents,
+                 std::size_t* pOffset,
+                 std::size_t* pLength,
+                 std::string* pText)
+{
+   std::size_t maxCommon = std::min(previous.size(), contents.size());
+
+   // common prefix, moved back to the start of a character
+   std::size_t prefix = 0;
+   while (prefix < maxCommon && previous[prefix] == contents[prefix])
+      prefix++;
+   while (prefix > 0 && isContinuationByte(contents, prefix))
+      prefix--;
+
+   // common suffix, moved forward to the start of a character (moving it
+   // back would take in bytes which were never compared)
+   std::size_t suffix = 0;
+   while (suffix < (maxCommon - prefix) &&
+          previous[previous.size() - suffix - 1] ==
+                                    contents[contents.size() - suffix - 1])
+   {
+      suffix++;
+   }
+   while (suffix > 0 &&
+          isContinuationByte(contents, contents.size() - suffix))
+   {
+      suffix--;
+   }
+
+   *pOffset = prefix;
+   *pLength = previous.size() - prefix - suffix;
+   *pText = contents.substr(prefix, contents.size() - prefix - suffix);
+
+   // verify that the edit reproduces contents
+   std::string edited = previous;
+   return applyEdit(*pOffset, *pLength, *pText, &edited) &&
+          edited == contents;
+}
+
+namespace {
+
+// estimate the size of a full record for a document after an edit
+std::size_t editedRecordSize(std::size_t previousSize,
+                             std::size_t previousContentsSize,
+                             std::size_t contentsSize)
+{
+   boost::int64_t size = static_cast<boost::int64_t>(previousSize) +
+                         static_cast<boost::int64_t>(contentsSize) -
+                         static_cast<boost::int64_t>(previousContentsSize);
+   return static_cast<std::size_t>(std::max(size, boost::int64_t(0)));
+}
+
+bool isSourceDocumentFile(const FilePath& filePath);
+
+class SourceDatabaseLog : boost::noncopyable
+{
+private:
+   SourceDatabaseLog() : logSize_(0), liveSize_(0) {}
+   friend SourceDatabaseLog& sourceDatabaseLog();
+
+public:
+   Error initialize();
+
+   bool getDocument(const std::string& id, json::Object* pDocJson) const;
+   void listDocuments(std::vector<json::Object>* pDocsJson) const;
+   Error putDocument(const json::Object& docJson);
+   Error removeDocument(const std::string& id);
+   Error removeAllDocuments();
+
+   void getProperties(const std::string& path, json::Object* pProperties) const;
+   Error putProperties(const std::string& path, const json::Object& properties);
+
+private:
+   struct Entry
+   {
+      Entry() : size(0) {}
+      json::Object value;
+
+      // size of a full record for this entry (used to decide when the
+      // log is worth compacting)
+      std::size_t size;
+   };
+   typedef std::map<std::string,Entry> Entries;
+
+   FilePath logFilePath() const { return path().complete(kLogFile); }
+
+   Error readLog(bool* pCompact);
+   bool applyRecord(const std::string& type,
+                    const std::string& key,
+                    const std::string& payload,
+                    std::size_t recordSize);
+   Error migrateDocumentFiles();
+   Error append(const std::string& record);
+   Error compactIfNecessary();
+   Error compact();
+
+private:
+   Entries documents_;
+   Entries properties_;
+   boost::uintmax_t logSize_;
+   boost::uintmax_t liveSize_;
 };
 
-Error getPropertiesDatabase(PropertiesDatabase* pDatabase)
+SourceDatabaseLog& sourceDatabaseLog()
 {
-   pDatabase->path = path().complete("properties");
-   Error error = pDatabase->path.ensureDirectory();
+   static SourceDatabaseLog instance;
+   return instance;
+}
+
+Error SourceDatabaseLog::initialize()
+{
+   documents_.clear();
+   properties_.clear();
+   logSize_ = 0;
+   liveSize_ = 0;
+
+   // finish an interrupted compaction
+   FilePath logPath = logFilePath();
+   FilePath compactedLogPath = path().complete(kCompactedLogFile);
+   if (compactedLogPath.exists())
+   {
+      Error error = logPath.exists() ? compactedLogPath.remove()
+                                     : compactedLogPath.move(logPath);
+      if (error)
+         return error;
+   }
+
+   // no log yet: create it from the document files written by previous
+   // versions (if there are any)
+   if (!logPath.exists())
+      return migrateDocumentFiles();
+
+   bool compact = false;
+   Error error = readLog(&compact);
+   if (error)
+      return error;
+
+   if (compact)
+      return this->compact();
+   else
+      return compactIfNecessary();
+}
+
+Error SourceDatabaseLog::readLog(bool* pCompact)
+{
+   *pCompact = false;
+
+   std::string log;
+   Error error = readStringFromFile(logFilePath(), &log);
    if (error)
       return error;
 
-   pDatabase->indexFile = pDatabase->path.complete("INDEX");
+   std::size_t pos = 0;
+   while (pos < log.size())
+   {
+      // read the header
+      std::size_t headerEnd = log.find('\n', pos);
+      if (headerEnd == std::string::npos)
+         break;
+      std::istringstream header(log.substr(pos, headerEnd - pos));
+      std::string type, key, checksum;
+      std::size_t length = 0;
+      header >> type >> key >> length >> checksum;
+      if (header.fail())
+         break;
+
+      // read the payload (a record which is truncated or doesn't match
+      // its checksum was only partially written, in which case it and
+      // anything after it are discarded)
+      std::size_t payloadStart = headerEnd + 1;
+      if (length > log.size() - payloadStart ||
+          log.size() - payloadStart - length < 1 ||
+          log[payloadStart + length] != '\n')
+      {
+         break;
+      }
+      std::string payload = log.substr(payloadStart, length);
+      if (recordChecksum(payload) != checksum)
+         break;
 
-   if (pDatabase->indexFile.exists())
-      return readStringMapFromFile(pDatabase->indexFile, &(pDatabase->index));
+      std::size_t recordEnd = payloadStart + length + 1;
+      if (!applyRecord(type, key, payload, recordEnd - pos))
+      {
+         Error error = systemError(boost::system::errc::bad_message,
+                                   ERROR_LOCATION);
+         error.addProperty("record", type + " " + key);
+         LOG_ERROR(error);
+      }
+
+      pos = recordEnd;
+   }
+
+   logSize_ = pos;
+
+   // rewrite the log without the discarded records
+   if (pos < log.size())
+   {
+      Error error = systemError(boost::system::errc::bad_message,
+                                ERROR_LOCATION);
+      error.addProperty("path", logFilePath().absolutePath());
+      error.addProperty("discarded", static_cast<int>(log.size() - pos));
+      LOG_ERROR(error);
+      *pCompact = true;
+   }
+
+   return Success();
+}
+
+bool SourceDatabaseLog::applyRecord(const std::string& type,
+                                    const std::string& key,
+                                    const std::string& payload,
+                                    std::size_t recordSize)
+{
+   if (type == kRemoveRecord)
+   {
+      Entries::iterator it = documents_.find(key);
+      if (it != documents_.end())
+      {
+         liveSize_ -= it->second.size;
+         documents_.erase(it);
+      }
+      return true;
+   }
+
+   // an edit requires the document it applies to
+   if (type == kEditRecord && documents_.find(key) == documents_.end())
+      return false;
+
+   json::Value value;
+   if (!json::parse(payload, &value) || !json::isType<json::Object>(value))
+      return false;
+   json::Object object = value.get_obj();
+
+   Entries* pEntries = (type == kPropertiesRecord) ? &properties_
+                                                   : &documents_;
+   Entry& entry = (*pEntries)[key];
+   std::size_t previousSize = entry.size;
+
+   if (type == kPutRecord || type == kPropertiesRecord)
+   {
+      entry.value = object;
+      entry.size = recordSize;
+   }
+   else if (type == kEditRecord)
+   {
+      // apply the edit to the previous contents
+      json::Value editJson = object["edit"];
+      json::Value contentsJson = entry.value["contents"];
+      if (!json::isType<json::Object>(editJson) ||
+          !json::isType<std::string>(contentsJson))
+      {
+         return false;
+      }
+      json::Object edit = editJson.get_obj();
+      if (!json::isType<int>(edit["offset"]) ||
+          !json::isType<int>(edit["length"]) ||
+          !json::isType<std::string>(edit["text"]))
+      {
+         return false;
+      }
+
+      std::string contents = contentsJson.get_str();
+      std::size_t previousContentsSize = contents.size();
+      if (!applyEdit(edit["offset"].get_int(),
+                     edit["length"].get_int(),
+                     edit["text"].get_str(),
+                     &contents))
+      {
+         return false;
+      }
+
+      object.erase("edit");
+      object["contents"] = contents;
+      entry.value = object;
+      entry.size = editedRecordSize(previousSize,
+                                    previousContentsSize,
+                                    contents.size());
+   }
    else
+   {
+      return false;
+   }
+
+   liveSize_ = liveSize_ - previousSize + entry.size;
+   return true;
+}
+
+Error SourceDatabaseLog::migrateDocumentFiles()
+{
+   // documents (one json file per document id)
+   std::vector<FilePath> files;
+   Error error = path().children(&files);
+   if (error)
+      return error;
+   std::vector<FilePath> migratedFiles;
+   BOOST_FOREACH(const FilePath& filePath, files)
+   {
+      if (!isSourceDocumentFile(filePath))
+         continue;
+
+      migratedFiles.push_back(filePath);
+
+      std::string contents;
+      json::Value value;
+      Error error = readStringFromFile(filePath, &contents);
+      if (!error && (!json::parse(contents, &value) ||
+                     !json::isType<json::Object>(value)))
+      {
+         error = systemError(boost::system::errc::bad_message,
+                             ERROR_LOCATION);
+         error.addProperty("path", filePath.absolutePath());
+      }
+      if (error)
+      {
+         LOG_ERROR(error);
+         continue;
+      }
+
+      Entry& entry = documents_[filePath.filename()];
+      entry.value = value.get_obj();
+   }
+
+   // properties (an index of escaped paths to properties files)
+   FilePath propertiesPath = path().complete(kPropertiesDir);
+   FilePath indexFile = propertiesPath.complete("INDEX");
+   if (indexFile.exists())
+   {
+      std::map<std::string,std::string> index;
+      Error error = readStringMapFromFile(indexFile, &index);
+      if (error)
+         LOG_ERROR(error);
+
+      typedef std::map<std::string,std::string>::value_type IndexEntry;
+      BOOST_FOREACH(const IndexEntry& indexEntry, index)
+      {
+         std::string contents;
+         json::Value value;
+         Error error = readStringFromFile(
+                                 propertiesPath.complete(indexEntry.second),
+                                 &contents);
+         if (error)
+            LOG_ERROR(error);
+         else if (json::parse(contents, &value) &&
+                  json::isType<json::Object>(value))
+            properties_[indexEntry.first].value = value.get_obj();
+      }
+   }
+
+   // write the log then remove the files it replaces
+   error = compact();
+   if (error)
+      return error;
+
+   BOOST_FOREACH(const FilePath& filePath, migratedFiles)
+   {
+      Error error = filePath.removeIfExists();
+      if (error)
+         LOG_ERROR(error);
+   }
+
+   error = propertiesPath.removeIfExists();
+   if (error)
+      LOG_ERROR(error);
+
+   return Success();
+}
+
+bool SourceDatabaseLog::getDocument(const std::string& id,
+                                    json::Object* pDocJson) const
+{
+   Entries::const_iterator it = documents_.find(id);
+   if (it == documents_.end())
+      return false;
+
+   *pDocJson = it->second.value;
+   return true;
+}
+
+void SourceDatabaseLog::listDocuments(
+                              std::vector<json::Object>* pDocsJson) const
+{
+   for (Entries::const_iterator it = documents_.begin();
+        it != documents_.end();
+        ++it)
+   {
+      pDocsJson->push_back(it->second.value);
+   }
+}
+
+Error SourceDatabaseLog::putDocument(const json::Object& docJson)
+{
+   json::Object::const_iterator idIt = docJson.find("id");
+   json::Object::const_iterator contentsIt = docJson.find("contents");
+   if (idIt == docJson.end() || contentsIt == docJson.end())
+      return systemError(boost::system::errc::invalid_argument,
+                         ERROR_LOCATION);
+   std::string id = idIt->second.get_str();
+   const std::string& contents = contentsIt->second.get_str();
+
+   // nothing to do if the document hasn't changed
+   Entries::iterator it = documents_.find(id);
+   if (it != documents_.end() && it->second.value == docJson)
       return Success();
+
+   // if this is a small edit to a large document then record just the
+   // edit rather than all of the contents
+   std::string record;
+   std::size_t previousContentsSize = 0;
+   if (it != documents_.end() &&
+       contents.size() >= kMinEditContentsSize &&
+       json::isType<std::string>(it->second.value["contents"]))
+   {
+      const std::string& previous = it->second.value["contents"].get_str();
+      previousContentsSize = previous.size();
+
+      std::size_t offset, length;
+      std::string text;
+      if (computeEdit(previous, contents, &offset, &length, &text) &&
+          text.size() < (contents.size() / 4))
+      {
+         json::Object edit;
+         edit["offset"] = static_cast<int>(offset);
+         edit["length"] = static_cast<int>(length);
+         edit["text"] = text;
+
+         json::Object editJson = docJson;
+         editJson.erase("contents");
+         editJson["edit"] = edit;
+         record = formatRecord(kEditRecord, id, editJson);
+      }
+   }
+
+   bool isEdit = !record.empty();
+   if (!isEdit)
+      record = formatRecord(kPutRecord, id, docJson);
+
+   Error error = append(record);
+   if (error)
+      return error;
+
+   // update the index
+   Entry& entry = documents_[id];
+   std::size_t previousSize = entry.size;
+   entry.value = docJson;
+   entry.size = isEdit ? editedRecordSize(previousSize,
+                                          previousContentsSize,
+                                          contents.size())
+                       : record.size();
+   liveSize_ = liveSize_ - previousSize + entry.size;
+
+   return compactIfNecessary();
 }
 
-Error putProperties(const std::string& path, const json::Object& properties)
+Error SourceDatabaseLog::removeDocument(const std::string& id)
 {
-   // url escape path (so we can use key=value persistence)
-   std::string escapedPath = http::util::urlEncode(path);
+   Entries::iterator it = documents_.find(id);
+   if (it == documents_.end())
+      return Success();
 
-   // get properties database
-   PropertiesDatabase propertiesDB;
-   Error error = getPropertiesDatabase(&propertiesDB);
+   Error error = append(formatRecord(kRemoveRecord, id, std::string()));
    if (error)
       return error;
 
-   // use existing properties file if it exists, otherwise create new
-   bool updateIndex = false;
-   std::string propertiesFile = propertiesDB.index[escapedPath];
-   if (propertiesFile.empty())
+   liveSize_ -= it->second.size;
+   documents_.erase(it);
+
+   return compactIfNecessary();
+}
+
+Error SourceDatabaseLog::removeAllDocuments()
+{
+   if (documents_.empty())
+      return Success();
+
+   std::string records;
+   for (Entries::const_iterator it = documents_.begin();
+        it != documents_.end();
+        ++it)
    {
-      propertiesFile = core::system::generateUuid(false);
-      propertiesDB.index[escapedPath] = propertiesFile;
-      updateIndex = true;
+      records.append(formatRecord(kRemoveRecord, it->first, std::string()));
+      liveSize_ -= it->second.size;
    }
 
-   // write the file
-   std::ostringstream ostr ;
-   json::writeFormatted(properties, ostr);
-   FilePath propertiesFilePath = propertiesDB.path.complete(propertiesFile);
-   error = writeStringToFile(propertiesFilePath, ostr.str());
+   Error error = append(records);
    if (error)
       return error;
 
-   // update the index if necessary
-   if (updateIndex)
-      return writeStringMapToFile(propertiesDB.indexFile, propertiesDB.index);
+   documents_.clear();
+
+   return compactIfNecessary();
+}
+
+void SourceDatabaseLog::getProperties(const std::string& path,
+                                      json::Object* pProperties) const
+{
+   // url escape path (so it can be used as a record key)
+   std::string escapedPath = http::util::urlEncode(path);
+
+   Entries::const_iterator it = properties_.find(escapedPath);
+   if (it != properties_.end())
+      *pProperties = it->second.value;
    else
-      return Success();
+      *pProperties = json::Object();
 }
 
-Error getProperties(const std::string& path, json::Object* pProperties)
+Error SourceDatabaseLog::putProperties(const std::string& path,
+                                      const json::Object& properties)
 {
-   // url escape path (so we can use key=value persistence)
+   // url escape path (so it can be used as a record key)
    std::string escapedPath = http::util::urlEncode(path);
 
-   // get properties database
-   PropertiesDatabase propertiesDB;
-   Error error = getPropertiesDatabase(&propertiesDB);
+   // nothing to do if the properties haven't changed
+   Entries::iterator it = properties_.find(escapedPath);
+   if (it != properties_.end() && it->second.value == properties)
+      return Success();
+
+   std::string record = formatRecord(kPropertiesRecord,
+                                     escapedPath,
+                                     properties);
+   Error error = append(record);
    if (error)
       return error;
 
-   // check for properties file
-   std::string propertiesFile = propertiesDB.index[escapedPath];
-   if (propertiesFile.empty())
-   {
-      // return empty object if there is none
-      *pProperties = json::Object();
+   Entry& entry = properties_[escapedPath];
+   liveSize_ = liveSize_ - entry.size + record.size();
+   entry.value = properties;
+   entry.size = record.size();
+
+   return compactIfNecessary();
+}
+
+Error SourceDatabaseLog::append(const std::string& record)
+{
+   Error error = appendToFile(logFilePath(), record);
+   if (error)
+      return error;
+
+   logSize_ += record.size();
+   return Success();
+}
+
+Error SourceDatabaseLog::compactIfNecessary()
+{
+   if (logSize_ >= kMinCompactionSize && logSize_ > (2 * liveSize_))
+      return compact();
+   else
       return Success();
+}
+
+Error SourceDatabaseLog::compact()
+{
+   // write a full record for each document and path
+   std::string log;
+   liveSize_ = 0;
+   for (Entries::iterator it = documents_.begin();
+        it != documents_.end();
+        ++it)
+   {
+      std::string record = formatRecord(kPutRecord, it->first,
+                                        it->second.value);
+      it->second.size = record.size();
+      liveSize_ += record.size();
+      log.append(record);
+   }
+   for (Entries::iterator it = properties_.begin();
+        it != properties_.end();
+        ++it)
+   {
+      std::string record = formatRecord(kPropertiesRecord, it->first,
+                                        it->second.value);
+      it->second.size = record.size();
+      liveSize_ += record.size();
+      log.append(record);
    }
 
-   // read the properties file
-   std::string contents ;
-   FilePath propertiesFilePath = propertiesDB.path.complete(propertiesFile);
-   error = readStringFromFile(propertiesFilePath, &contents,
-                              options().sourceLineEnding());
+   // write it alongside the existing log then move it into place (if we
+   // are interrupted before the move completes then it is finished by
+   // initialize on the next startup)
+   FilePath logPath = logFilePath();
+   FilePath compactedLogPath = path().complete(kCompactedLogFile);
+   Error error = writeStringToFile(compactedLogPath, log);
    if (error)
       return error;
 
-   // parse the json
-   json::Value value;
-   if ( !json::parse(contents, &value) )
-      return systemError(boost::system::errc::bad_message, ERROR_LOCATION);
+   error = logPath.removeIfExists();
+   if (error)
+      return error;
 
-   // return it
-   if (json::isType<json::Object>(value))
-      *pProperties = value.get_obj();
+   error = compactedLogPath.move(logPath);
+   if (error)
+      return error;
+
+   logSize_ = log.size();
    return Success();
 }
 
+bool isSourceDocumentFile(const FilePath& filePath)
+{
+   if (filePath.isDirectory())
+      return false;
+   else if (filePath.filename() == ".DS_Store")
+      return false;
+   else
+      return true;
+}
+
 }  // anonymous namespace
 
 SourceDocument::SourceDocument(const std::string& type)
@@ -369,26 +975,9 @@ FilePath path()
    
 Error get(const std::string& id, boost::shared_ptr<SourceDocument> pDoc)
 {
-   FilePath filePath = source_database::path().complete(id);
-   if (filePath.exists())
+   json::Object jsonDoc;
+   if (sourceDatabaseLog().getDocument(id, &jsonDoc))
    {
-      // read the contents of the file
-      std::string contents ;
-      Error error = readStringFromFile(filePath, &contents,
-                                       options().sourceLineEnding());
-      if (error)
-         return error;
-   
-      // parse the json
-      json::Value value;
-      if ( !json::parse(contents, &value) )
-      {
-         return systemError(boost::system::errc::invalid_argument,
-                            ERROR_LOCATION);
-      }
-      
-      // initialize doc from json
-      json::Object jsonDoc = value.get_obj();
       return pDoc->readFromJson(&jsonDoc);
    }
    else
@@ -400,40 +989,25 @@ Error get(const std::string& id, boost::shared_ptr<SourceDocument> pDoc)
 
 Error getDurableProperties(const std::string& path, json::Object* pProperties)
 {
-   return getProperties(path, pProperties);
-}
-
-bool isSourceDocument(const FilePath& filePath)
-{
-   if (filePath.isDirectory())
-      return false;
-   else if (filePath.filename() == ".DS_Store")
-      return false;
-   else
-      return true;
+   sourceDatabaseLog().getProperties(path, pProperties);
+   return Success();
 }
 
 Error list(std::vector<boost::shared_ptr<SourceDocument> >* pDocs)
 {
-   std::vector<FilePath> files ;
-   Error error = source_database::path().children(&files);
-   if (error)
-      return error ;
-   
-   BOOST_FOREACH( FilePath& filePath, files )
+   std::vector<json::Object> docsJson;
+   sourceDatabaseLog().listDocuments(&docsJson);
+
+   BOOST_FOREACH(json::Object& jsonDoc, docsJson)
    {
-      if (isSourceDocument(filePath))
-      {
-         // get the source doc
-         boost::shared_ptr<SourceDocument> pDoc(new SourceDocument()) ;
-         Error error = source_database::get(filePath.filename(), pDoc);
-         if (!error)
-            pDocs->push_back(pDoc);
-         else
-            LOG_ERROR(error);
-      }
+      boost::shared_ptr<SourceDocument> pDoc(new SourceDocument()) ;
+      Error error = pDoc->readFromJson(&jsonDoc);
+      if (!error)
+         pDocs->push_back(pDoc);
+      else
+         LOG_ERROR(error);
    }
-   
+
    return Success();
 }
    
@@ -442,17 +1016,15 @@ Error put(boost::shared_ptr<SourceDocument> pDoc)
    // get json representation
    json::Object jsonDoc ;
    pDoc->writeToJson(&jsonDoc);
-   std::ostringstream ostr ;
-   json::writeFormatted(jsonDoc, ostr);
-   
-   // write to file
-   FilePath filePath = source_database::path().complete(pDoc->id());
-   Error error = writeStringToFile(filePath, ostr.str());
+
+   // write to the log
+   Error error = sourceDatabaseLog().putDocument(jsonDoc);
    if (error)
       return error ;
 
    // write properties to durable storage
-   error = putProperties(pDoc->path(), pDoc->properties());
+   error = sourceDatabaseLog().putProperties(pDoc->path(),
+                                             pDoc->properties());
    if (error)
       LOG_ERROR(error);
 
@@ -461,30 +1033,23 @@ Error put(boost::shared_ptr<SourceDocument> pDoc)
    
 Error remove(const std::string& id)
 {
-   return source_database::path().complete(id).removeIfExists();
+   return sourceDatabaseLog().removeDocument(id);
 }
    
 Error removeAll()
 {
-   std::vector<FilePath> files ;
-   Error error = source_database::path().children(&files);
-   if (error)
-      return error ;
-   
-   BOOST_FOREACH( FilePath& filePath, files )
-   {
-      Error error = filePath.remove();
-      if (error)
-         return error ;
-   }
-   
-   return Success();
+   return sourceDatabaseLog().removeAllDocuments();
 }
 
 Error initialize()
 {
    // make sure the source database exists
-   return source_database::path().ensureDirectory();
+   Error error = source_database::path().ensureDirectory();
+   if (error)
+      return error;
+
+   // read it
+   return sourceDatabaseLog().initialize();
 }
 
 } // namespace source_database
@@ -0,0 +1,115 @@
+/*
+ * SessionSourceDatabaseTests.cpp
+ *
+ * Copyright (C) 2009-11 by RStudio, Inc.
+ *
+ * This program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <string>
+
+#include <boost/assert.hpp>
+
+namespace session {
+namespace source_database {
+
+// defined in SessionSourceDatabase.cpp
+bool applyEdit(std::size_t offset,
+               std::size_t length,
+               const std::string& text,
+               std::string* pContents);
+bool computeEdit(const std::string& previous,
+                 const std::string& contents,
+                 std::size_t* pOffset,
+                 std::size_t* pLength,
+                 std::string* pText);
+
+namespace {
+
+bool isCharacterStart(const std::string& contents, std::size_t offset)
+{
+   return offset >= contents.size() ||
+          (static_cast<unsigned char>(contents[offset]) & 0xC0) != 0x80;
+}
+
+// the edit computed from previous to contents reproduces contents and
+// starts and ends on character boundaries
+void checkEdit(const std::string& previous, const std::string& contents)
+{
+   std::size_t offset, length;
+   std::string text;
+   BOOST_ASSERT(computeEdit(previous, contents, &offset, &length, &text));
+
+   BOOST_ASSERT(isCharacterStart(contents, offset));
+   BOOST_ASSERT(isCharacterStart(contents, offset + text.size()));
+
+   std::string edited = previous;
+   BOOST_ASSERT(applyEdit(offset, length, text, &edited));
+   BOOST_ASSERT(edited == contents);
+}
+
+void testAsciiEdits()
+{
+   checkEdit("", "");
+   checkEdit("", "x <- 1");
+   checkEdit("x <- 1", "");
+   checkEdit("x <- 1", "x <- 1");
+   checkEdit("x <- 1", "x <- 12");
+   checkEdit("x <- 1", "y <- 1");
+   checkEdit("x <- 1\ny <- 2", "x <- 1\nz <- 2");
+   checkEdit("aaaa", "aa");
+   checkEdit("aa", "aaaa");
+
+   std::size_t offset, length;
+   std::string text;
+   computeEdit("x <- 1\ny <- 2", "x <- 1\nz <- 2", &offset, &length, &text);
+   BOOST_ASSERT(offset == 7 && length == 1 && text == "z");
+}
+
+// characters which differ only in their leading byte share their trailing
+// continuation bytes (which must not be treated as a common suffix)
+void testSharedContinuationBytes()
+{
+   // é (C3 A9) -> © (C2 A9)
+   checkEdit("caf\xC3\xA9", "caf\xC2\xA9");
+   checkEdit("caf\xC3\xA9 au lait", "caf\xC2\xA9 au lait");
+
+   // 中 (E4 B8 AD) -> 渭 (E6 B8 AD)
+   checkEdit("\xE4\xB8\xAD", "\xE6\xB8\xAD");
+   checkEdit("x <- '\xE4\xB8\xAD'", "x <- '\xE6\xB8\xAD'");
+
+   // shared leading bytes (a common prefix within a character)
+   checkEdit("\xE4\xB8\xAD", "\xE4\xB8\xAE");
+   checkEdit("\xC3\xA9t\xC3\xA9", "\xC3\xA8t\xC3\xA9");
+
+   std::size_t offset, length;
+   std::string text;
+   computeEdit("caf\xC3\xA9", "caf\xC2\xA9", &offset, &length, &text);
+   BOOST_ASSERT(offset == 3 && length == 2 && text == "\xC2\xA9");
+}
+
+void testApplyEdit()
+{
+   std::string contents = "abc";
+   BOOST_ASSERT(!applyEdit(4, 0, "", &contents));
+   BOOST_ASSERT(!applyEdit(2, 2, "", &contents));
+   BOOST_ASSERT(applyEdit(3, 0, "d", &contents) && contents == "abcd");
+   BOOST_ASSERT(applyEdit(0, 4, "", &contents) && contents.empty());
+}
+
+} // anonymous namespace
+
+void runSourceDatabaseTests()
+{
+   testAsciiEdits();
+   testSharedContinuationBytes();
+   testApplyEdit();
+}
+
+} // namespace source_database
+} // namespace session
@@ -15,6 +15,8 @@
 #define SESSION_HTTP_CONNECTION_IMPL_HPP
 
 
+#include <vector>
+
 #include <boost/array.hpp>
 
 #include <boost/utility.hpp>
@@ -22,6 +24,12 @@
 #include <boost/asio/write.hpp>
 #include <boost/asio/placeholders.hpp>
 #include <boost/enable_shared_from_this.hpp>
+#include <boost/algorithm/string/predicate.hpp>
+
+#ifndef _WIN32
+#include <errno.h>
+#include <unistd.h>
+#endif
 
 #include <core/Error.hpp>
 #include <core/Log.hpp>
@@ -29,6 +37,7 @@
 
 #include <core/http/Request.hpp>
 #include <core/http/Response.hpp>
+#include <core/http/StreamBody.hpp>
 #include <core/http/RequestParser.hpp>
 #include <core/http/SocketUtils.hpp>
 
@@ -54,7 +63,7 @@ public:
 public:
    HttpConnectionImpl(boost::asio::io_service& ioService,
                       const Handler& handler)
-      : socket_(ioService), handler_(handler)
+      : socket_(ioService), handler_(handler), streamingChunked_(false)
    {
    }
 
@@ -80,17 +89,38 @@ public:
       // set log entry type depending upon what happens (default to success)
       HttpLog::EntryType logEntryType = HttpLog::ConnectionResponded;
 
+      // determine whether we can keep the connection open
+      bool keepAlive = isKeepAlive(response);
+
+      core::Error error;
       try
       {
          // write the response
          boost::asio::write(socket_,
-                            response.toBuffers(
-                                  core::http::Header::connectionClose()));
+                            response.toBuffers(keepAlive ?
+                               core::http::Header("Connection", "keep-alive") :
+                               core::http::Header::connectionClose()));
+
+         // write streamed bodies (we always close the connection after
+         // responses with bodies of unknown length so this marks the end
+         // of the body -- this also means that they can be read by the
+         // server's proxy, which doesn't understand chunked encoding)
+         if (response.streamBody())
+         {
+            error = core::http::writeStreamBody(socket_,
+                                                response.streamBody(),
+                                                false);
+         }
       }
       catch(const boost::system::system_error& e)
+      {
+         error = core::Error(e.code(), ERROR_LOCATION);
+      }
+      CATCH_UNEXPECTED_EXCEPTION
+
+      if (error)
       {
          // establish error
-         core::Error error = core::Error(e.code(), ERROR_LOCATION);
          error.addProperty("request-uri", request_.uri());
 
          // log the error if it wasn't connection terminated
@@ -104,16 +134,18 @@ public:
             logEntryType = HttpLog::ConnectionError;
          }
       }
-      CATCH_UNEXPECTED_EXCEPTION
 
-      // always log and close connection
+      // always log and close (or continue) the connection
       try
       {
          // log it
          httpLog().addEntry(logEntryType, requestId_);
 
-         // close
-         close();
+         // read the next request or close
+         if (keepAlive && !error)
+            readNextRequest();
+         else
+            close();
       }
       CATCH_UNEXPECTED_EXCEPTION
    }
@@ -148,6 +180,87 @@ public:
       sendResponse(response);
    }
 
+   virtual core::Error beginStreamingResponse(
+                                 const core::http::Response& response)
+   {
+      // HTTP/1.0 clients read until the connection is closed
+      streamingChunked_ = !request_.isHttp10();
+
+      core::http::Response streamingResponse;
+      streamingResponse.assign(response);
+      streamingResponse.removeHeader("Content-Length");
+      if (streamingChunked_)
+         streamingResponse.setHeader("Transfer-Encoding", "chunked");
+
+      try
+      {
+         boost::asio::write(socket_,
+                            streamingResponse.toBuffers(
+                                  core::http::Header::connectionClose()));
+         return core::Success();
+      }
+      catch(const boost::system::system_error& e)
+      {
+         return streamingError(e);
+      }
+   }
+
+   virtual core::Error writeStreamingChunk(const std::string& chunk)
+   {
+      if (chunk.empty())
+         return core::Success();
+
+      try
+      {
+         std::vector<boost::asio::const_buffer> buffers;
+         std::string header;
+         if (streamingChunked_)
+         {
+            header = core::http::chunkHeader(chunk.size());
+            buffers.push_back(boost::asio::buffer(header));
+         }
+         buffers.push_back(boost::asio::buffer(chunk));
+         if (streamingChunked_)
+            buffers.push_back(boost::asio::buffer(core::http::kChunkTrailer));
+         boost::asio::write(socket_, buffers);
+         return core::Success();
+      }
+      catch(const boost::system::system_error& e)
+      {
+         return streamingError(e);
+      }
+   }
+
+   virtual void endStreamingResponse()
+   {
+      // set log entry type depending upon what happens (default to success)
+      HttpLog::EntryType logEntryType = HttpLog::ConnectionResponded;
+
+      if (streamingChunked_)
+      {
+         try
+         {
+            boost::asio::write(socket_,
+                               boost::asio::buffer(core::http::kLastChunk));
+         }
+         catch(const boost::system::system_error& e)
+         {
+            core::Error error = streamingError(e);
+            if (core::http::isConnectionTerminatedError(error))
+               logEntryType = HttpLog::ConnectionTerminated;
+            else
+               logEntryType = HttpLog::ConnectionError;
+         }
+      }
+
+      try
+      {
+         httpLog().addEntry(logEntryType, requestId_);
+         close();
+      }
+      CATCH_UNEXPECTED_EXCEPTION
+   }
+
    // close (occurs automatically after writeResponse, here in case it
    // need to be closed in other circumstances
    virtual void close()
@@ -174,6 +287,79 @@ public:
 
 private:
 
+   // keep the connection open after the response if the client asked us
+   // to and the end of the response can be determined without closing
+   bool isKeepAlive(const core::http::Response& response)
+   {
+#ifndef _WIN32
+      if (!boost::algorithm::iequals(request_.headerValue("Connection"),
+                                     "keep-alive"))
+      {
+         return false;
+      }
+
+      if (response.streamBody())
+         return response.streamBody()->length() >= 0;
+      else
+         return response.containsHeader("Content-Length");
+#else
+      return false;
+#endif
+   }
+
+   core::Error streamingError(const boost::system::system_error& e)
+   {
+      core::Error error(e.code(), ERROR_LOCATION);
+      error.addProperty("request-uri", request_.uri());
+      if (!core::http::isConnectionTerminatedError(error))
+         LOG_ERROR(error);
+      return error;
+   }
+
+   // continue reading requests from the connection. this is done using a
+   // new connection object (which takes over the socket) since handlers
+   // may still hold a reference to this one
+   void readNextRequest()
+   {
+#ifndef _WIN32
+      boost::shared_ptr<HttpConnectionImpl<ProtocolType> > pNext(
+            new HttpConnectionImpl<ProtocolType>(socket_.get_io_service(),
+                                                 handler_));
+
+      boost::system::error_code ec;
+      typename ProtocolType::endpoint endpoint = socket_.local_endpoint(ec);
+      int fd = -1;
+      if (!ec)
+      {
+         fd = ::dup(socket_.native());
+         if (fd == -1)
+         {
+            ec = boost::system::error_code(
+                                 errno,
+                                 boost::system::get_system_category());
+         }
+      }
+      if (!ec)
+      {
+         pNext->socket().assign(endpoint.protocol(), fd, ec);
+         if (ec)
+            ::close(fd);
+      }
+
+      if (ec)
+      {
+         LOG_ERROR(core::Error(ec, ERROR_LOCATION));
+         close();
+         return;
+      }
+
+      // release our descriptor (without shutting down the connection)
+      socket_.close(ec);
+
+      pNext->startReading();
+#endif
+   }
+
    // async request reading interface
    void readSome()
    {
@@ -264,6 +450,7 @@ private:
    core::http::Request request_;
    std::string requestId_;
    Handler handler_;
+   bool streamingChunked_;
 };
 
 } // namespace session
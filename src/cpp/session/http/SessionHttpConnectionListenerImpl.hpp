@@ -15,10 +15,13 @@
 #define SESSION_HTTP_CONNECTION_LISTENER_IMPL_HPP
 
 #include <queue>
+#include <vector>
 
 #include <boost/shared_ptr.hpp>
+#include <boost/scoped_ptr.hpp>
 
 #include <boost/utility.hpp>
+#include <boost/foreach.hpp>
 #include <boost/asio/placeholders.hpp>
 #include <boost/algorithm/string/predicate.hpp>
 
@@ -70,7 +73,7 @@ class HttpConnectionListenerImpl : public HttpConnectionListener,
                                    boost::noncopyable
 {  
 protected:
-   HttpConnectionListenerImpl() : started_(false) {}
+   HttpConnectionListenerImpl() : workerThreadCount_(0), started_(false) {}
 
    // COPYING: boost::noncopyable
    
@@ -105,6 +108,21 @@ public:
                                            &(acceptorService_.ioService())));
          listenerThread_ = listenerThread.move();
 
+         // launch the worker threads
+         if (workerFilter_ && workerThreadCount_ > 0)
+         {
+            workerService_.reset();
+            pWorkerServiceWork_.reset(
+                     new boost::asio::io_service::work(workerService_));
+            for (int i=0; i<workerThreadCount_; i++)
+            {
+               boost::shared_ptr<boost::thread> pWorkerThread(
+                  new boost::thread(bind(&boost::asio::io_service::run,
+                                         &workerService_)));
+               workerThreads_.push_back(pWorkerThread);
+            }
+         }
+
          // set started flag
          started_ = true;
 
@@ -148,6 +166,22 @@ public:
          listenerThread_.detach();
       }
 
+      // stop the worker threads (connections they have yet to start
+      // handling are abandoned)
+      pWorkerServiceWork_.reset();
+      workerService_.stop();
+      BOOST_FOREACH(boost::shared_ptr<boost::thread> pWorkerThread,
+                    workerThreads_)
+      {
+         if (!pWorkerThread->timed_join(boost::posix_time::seconds(3)))
+         {
+            LOG_WARNING_MESSAGE(
+                  "HttpConnectionListener worker didn't stop within 3 sec");
+            pWorkerThread->detach();
+         }
+      }
+      workerThreads_.clear();
+
       // allow subclass specific cleanup
       core::Error error = cleanup();
       if (error)
@@ -165,6 +199,16 @@ public:
       return eventsConnectionQueue_;
    }
 
+   virtual void setWorkerConnectionHandler(
+                              int threads,
+                              const WorkerConnectionFilter& filter,
+                              const WorkerConnectionHandler& handler)
+   {
+      workerThreadCount_ = threads;
+      workerFilter_ = filter;
+      workerHandler_ = handler;
+   }
+
 protected:
 
    virtual bool authenticate(boost::shared_ptr<HttpConnection>)
@@ -273,13 +317,42 @@ private:
       if (checkForHttpLog(ptrHttpConnection))
          return;
 
-      // place the connection on the correct queue
-      if (isGetEvents(ptrHttpConnection))
+      // place the connection on the correct queue (or hand it to
+      // a worker thread if it doesn't need the main thread)
+      if (isEventsRequest(ptrHttpConnection))
          eventsConnectionQueue_.enqueConnection(ptrHttpConnection);
+      else if (isWorkerConnection(ptrHttpConnection))
+         workerService_.post(boost::bind(
+               &HttpConnectionListenerImpl<ProtocolType>::handleWorkerConnection,
+               this,
+               ptrHttpConnection));
       else
          mainConnectionQueue_.enqueConnection(ptrHttpConnection);
    }
 
+   bool isWorkerConnection(boost::shared_ptr<HttpConnection> ptrConnection)
+   {
+      if (!pWorkerServiceWork_)
+         return false;
+
+      try
+      {
+         return workerFilter_(ptrConnection);
+      }
+      CATCH_UNEXPECTED_EXCEPTION
+
+      return false;
+   }
+
+   void handleWorkerConnection(boost::shared_ptr<HttpConnection> ptrConnection)
+   {
+      try
+      {
+         workerHandler_(ptrConnection);
+      }
+      CATCH_UNEXPECTED_EXCEPTION
+   }
+
    static bool isMethod(boost::shared_ptr<HttpConnection> ptrConnection,
                         const std::string& method)
    {
@@ -287,10 +360,12 @@ private:
                                          "rpc/" + method);
    }
 
-   static bool isGetEvents(boost::shared_ptr<HttpConnection> ptrConnection)
+   static bool isEventsRequest(
+                        boost::shared_ptr<HttpConnection> ptrConnection)
    {
-      return boost::algorithm::ends_with(ptrConnection->request().uri(),
-                                         "events/get_events");
+      const std::string& uri = ptrConnection->request().uri();
+      return boost::algorithm::ends_with(uri, "events/get_events") ||
+             boost::algorithm::ends_with(uri, "events/stream_events");
    }
 
    bool checkForAbort(
@@ -369,6 +444,14 @@ private:
    // listener thread
    boost::thread listenerThread_ ;
 
+   // worker threads (and the connections they handle)
+   int workerThreadCount_;
+   WorkerConnectionFilter workerFilter_;
+   WorkerConnectionHandler workerHandler_;
+   boost::asio::io_service workerService_;
+   boost::scoped_ptr<boost::asio::io_service::work> pWorkerServiceWork_;
+   std::vector<boost::shared_ptr<boost::thread> > workerThreads_;
+
    // flag indicating we've started
    bool started_;
 };
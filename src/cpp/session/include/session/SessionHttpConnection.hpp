@@ -61,6 +61,14 @@ public:
    virtual void sendJsonRpcResponse(
                   const core::json::JsonRpcResponse& jsonRpcResponse) = 0;
 
+   // streamed responses: write the response headers and then each chunk
+   // of the body as it becomes available (using chunked encoding for
+   // HTTP/1.1 clients). the connection is closed by endStreamingResponse
+   virtual core::Error beginStreamingResponse(
+                  const core::http::Response& response) = 0;
+   virtual core::Error writeStreamingChunk(const std::string& chunk) = 0;
+   virtual void endStreamingResponse() = 0;
+
 
    // close (occurs automatically after writeResponse, here in case it
    // need to be closed in other circumstances
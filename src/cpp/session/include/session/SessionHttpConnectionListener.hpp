@@ -37,6 +37,12 @@
  may (optionally) do so. Note that these request handlers should NEVER
  execute R code since it must all be called from the main thread.
 
+ Requests which are known not to require R at all (those for which the
+ worker connection filter returns true) skip the queue entirely and are
+ handled by a pool of worker threads as soon as they are read. This keeps
+ the client responsive even when R is blocked in code which never reaches
+ R_PolledEvents.
+
  Note that since R_PolledEvents can occur during the processing of R code
  it is possible that requests which execute R code can execute in a nested fashion
  This is analogous to what occurs when GUIs pump events (during R_PolledEvents)
@@ -66,6 +72,9 @@
 
 */
 
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+
 #include "SessionHttpConnectionQueue.hpp"
 
 namespace core {
@@ -94,6 +103,19 @@ public:
    // connection queues
 	virtual HttpConnectionQueue& mainConnectionQueue() = 0;
 	virtual HttpConnectionQueue& eventsConnectionQueue() = 0;
+
+   // connections accepted by the filter are passed to the handler on one
+   // of the specified number of worker threads rather than being queued
+   // (both are called from background threads so must be threadsafe).
+   // must be called prior to start
+   typedef boost::function<bool(boost::shared_ptr<HttpConnection>)>
+                                                   WorkerConnectionFilter;
+   typedef boost::function<void(boost::shared_ptr<HttpConnection>)>
+                                                   WorkerConnectionHandler;
+   virtual void setWorkerConnectionHandler(
+                              int threads,
+                              const WorkerConnectionFilter& filter,
+                              const WorkerConnectionHandler& handler) = 0;
 };
 
 } // namespace session
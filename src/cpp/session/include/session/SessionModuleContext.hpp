@@ -26,6 +26,7 @@
 #include <core/http/UriHandler.hpp>
 #include <core/json/JsonRpc.hpp>
 #include <core/Thread.hpp>
+#include <core/BackgroundTaskScheduler.hpp>
 
 #include <session/SessionOptions.hpp>
 #include <session/SessionClientEvent.hpp>
@@ -93,6 +94,18 @@ core::Error registerPostbackHandler(
 core::Error registerRpcMethod(const std::string& name,
                               const core::json::JsonRpcFunction& function);
 
+// register an rpc method or uri handler which never uses R. these are
+// executed on a worker thread as soon as the request arrives rather than
+// waiting for the main thread (so they remain available while R is busy).
+// they must be threadsafe and can't depend on any state which is only
+// accessed from the main thread (note that they also don't trigger a
+// check for changes after they execute)
+core::Error registerRFreeRpcMethod(const std::string& name,
+                                   const core::json::JsonRpcFunction& function);
+core::Error registerRFreeUriHandler(
+                        const std::string& name,
+                        const core::http::UriHandlerFunction& handlerFunction);
+
 
 core::Error executeAsync(const core::json::JsonRpcFunction& function,
                          const core::json::JsonRpcRequest& request,
@@ -171,6 +184,12 @@ core::Error executeInterruptableChild(const std::string& path,
 // ProcessSupervisor
 core::system::ProcessSupervisor& processSupervisor();
 
+// BackgroundTaskScheduler. tasks run on a pool of worker threads so they
+// can't use R or any state which is only accessed from the main thread.
+// completion handlers are called back on the main thread (during
+// background processing) and are where the results of tasks are applied
+core::thread::BackgroundTaskScheduler& backgroundTaskScheduler();
+
 // schedule incremental work. execute will be called back periodically
 // (up to every 25ms if the process is completely idle). if execute
 // returns true then it will be called back again, if it returns false
@@ -110,6 +110,10 @@ public:
 
    bool createPublicFolder() const { return createPublicFolder_; }
 
+   int rpcThreads() const { return rpcThreads_; }
+
+   int backgroundThreads() const { return backgroundThreads_; }
+
    unsigned int minimumUserId() const { return 100; }
    
    core::FilePath coreRSourcePath() const 
@@ -152,6 +156,16 @@ public:
       return rShellEscape_;
    }
 
+   int rPlotImageCacheMemoryMb() const
+   {
+      return rPlotImageCacheMemoryMb_;
+   }
+
+   int rPlotImageCacheDiskMb() const
+   {
+      return rPlotImageCacheDiskMb_;
+   }
+
    std::string rHomeDirOverride()
    {
       return std::string(rHomeDirOverride_.c_str());
@@ -268,6 +282,8 @@ private:
    std::string preflightScript_;
    int timeoutMinutes_;
    bool createPublicFolder_;
+   int rpcThreads_;
+   int backgroundThreads_;
 
    // r
    std::string coreRSourcePath_;
@@ -279,6 +295,8 @@ private:
    int rCompatibleGraphicsEngineVersion_;
    std::string rHelpCssFilePath_;
    bool rShellEscape_;
+   int rPlotImageCacheMemoryMb_;
+   int rPlotImageCacheDiskMb_;
    std::string rHomeDirOverride_;
    std::string rDocDirOverride_;
    
@@ -16,19 +16,28 @@
 #include <iostream>
 #include <vector>
 #include <set>
+#include <map>
 
 #include <boost/bind.hpp>
 #include <boost/shared_ptr.hpp>
 #include <boost/foreach.hpp>
 #include <boost/algorithm/string/predicate.hpp>
+#include <boost/algorithm/string/split.hpp>
+#include <boost/algorithm/string/classification.hpp>
 
 #include <core/Error.hpp>
 #include <core/Exec.hpp>
 #include <core/FilePath.hpp>
+#include <core/FileInfo.hpp>
 #include <core/FileSerializer.hpp>
 #include <core/SafeConvert.hpp>
+#include <core/Thread.hpp>
 
 #include <core/r_util/RSourceIndex.hpp>
+#include <core/r_util/RSymbolIndex.hpp>
+
+#include <core/system/FileMonitor.hpp>
+#include <core/system/FileChangeEvent.hpp>
 
 #include <R_ext/rlocale.h>
 
@@ -38,8 +47,11 @@
 #include <session/projects/SessionProjects.hpp>
 
 #include "SessionSource.hpp"
+#include "SessionSourceControl.hpp"
 
 using namespace core ;
+using core::system::FileChangeEvent;
+using core::thread::BackgroundTaskScheduler;
 
 namespace session {  
 namespace modules {
@@ -47,94 +59,457 @@ namespace code_search {
 
 namespace {
 
-std::vector<boost::shared_ptr<core::r_util::RSourceIndex> > s_sourceIndexes;
-
-class SourceFileIndexer : boost::noncopyable
+// maintains an index of the R source files within the project. the index
+// is kept up to date using a file monitor (so only changed files are
+// re-indexed) and is persisted to the project scratch path so that
+// subsequent sessions can search immediately rather than re-indexing.
+// files are read and tokenized by background tasks (in parallel) and
+// their indexes are added on the main thread as each task completes. the
+// index is searched from worker threads so changes to the symbol index
+// are serialized with searches
+class SourceFileIndex : boost::noncopyable
 {
 public:
-   SourceFileIndexer()
-      : encoding_(projects::projectContext().defaultEncoding()),
-        projectRootDir_(projects::projectContext().directory()),
-        dirIter_(projectRootDir_)
+   SourceFileIndex()
+      : cacheDirty_(false)
    {
    }
 
-   virtual ~SourceFileIndexer()
+   virtual ~SourceFileIndex()
    {
    }
 
+   // COPYING: boost::noncopyable
+
+   struct Entry
+   {
+      FileInfo fileInfo;
+      boost::shared_ptr<r_util::RSourceIndex> pIndex;
+   };
+
+   typedef std::map<std::string,Entry> Entries;
+
 public:
-   bool indexNextFile()
+
+   void initialize(const FilePath& projectRootDir,
+                   const FilePath& cacheFilePath,
+                   const std::string& encoding)
+   {
+      projectRootDir_ = projectRootDir;
+      cacheFilePath_ = cacheFilePath;
+      encoding_ = encoding;
+   }
+
+   const Entries& entries() const { return entries_; }
+
+   void search(const std::string& term,
+               bool prefixOnly,
+               bool caseSensitive,
+               const std::set<std::string>& excludeContexts,
+               std::size_t maxResults,
+               std::vector<r_util::RSourceItem>* pItems) const
+   {
+      LOCK_MUTEX(mutex_)
+      {
+         symbolIndex_.search(term,
+                             prefixOnly,
+                             caseSensitive,
+                             excludeContexts,
+                             maxResults,
+                             pItems);
+      }
+      END_LOCK_MUTEX
+   }
+
+   Error readCache()
    {
-      // see if we are finished
-      if (dirIter_.finished())
-         return false;
+      if (!cacheFilePath_.exists())
+         return Success();
 
-      // get next file
-      FilePath filePath;
-      Error error = dirIter_.next(&filePath);
+      boost::shared_ptr<std::istream> pIfs;
+      Error error = cacheFilePath_.open_r(&pIfs);
       if (error)
+         return error;
+
+      // validate the version (silently discard caches in other formats)
+      std::string line;
+      std::getline(*pIfs, line);
+      if (line != kCacheVersion)
+         return Success();
+
+      Entries entries;
+      std::string path;
+      FileInfo fileInfo;
+      std::vector<r_util::RSourceItem> items;
+      while (std::getline(*pIfs, line))
       {
-         LOG_ERROR(error);
-         return false;
+         std::vector<std::string> fields;
+         boost::algorithm::split(fields, line, boost::algorithm::is_any_of("\t"));
+
+         // file record: F <mtime> <size> <project relative path>
+         if (fields.size() == 4 && fields[0] == "F")
+         {
+            addCacheEntry(path, fileInfo, items, &entries);
+            path = fields[3];
+            fileInfo = FileInfo(
+               projectRootDir_.complete(path).absolutePath(),
+               false,
+               safe_convert::stringTo<uintmax_t>(fields[2], 0),
+               safe_convert::stringTo<std::time_t>(fields[1], 0));
+            items.clear();
+         }
+         // item record: I <type> <line> <column> <name>
+         else if (fields.size() == 5 && fields[0] == "I" && !path.empty())
+         {
+            items.push_back(r_util::RSourceItem(
+               safe_convert::stringTo<int>(fields[1], 0),
+               fields[4],
+               safe_convert::stringTo<std::size_t>(fields[2], 0),
+               safe_convert::stringTo<std::size_t>(fields[3], 0)));
+         }
+      }
+      addCacheEntry(path, fileInfo, items, &entries);
+
+      entries_.swap(entries);
+
+      // rebuild the symbol index from the cached entries
+      LOCK_MUTEX(mutex_)
+      {
+         symbolIndex_.clear();
+         BOOST_FOREACH(const Entries::value_type& entry, entries_)
+         {
+            symbolIndex_.add(entry.second.pIndex);
+         }
+      }
+      END_LOCK_MUTEX
+
+      return Success();
+   }
+
+   Error writeCache()
+   {
+      if (!cacheDirty_)
+         return Success();
+
+      boost::shared_ptr<std::ostream> pOfs;
+      Error error = cacheFilePath_.open_w(&pOfs);
+      if (error)
+         return error;
+
+      *pOfs << kCacheVersion << "\n";
+      BOOST_FOREACH(const Entries::value_type& entry, entries_)
+      {
+         const FileInfo& fileInfo = entry.second.fileInfo;
+         *pOfs << "F\t" << fileInfo.lastWriteTime()
+               << "\t" << fileInfo.size()
+               << "\t" << entry.second.pIndex->context() << "\n";
+
+         BOOST_FOREACH(const r_util::RSourceItem& item,
+                       entry.second.pIndex->items())
+         {
+            // skip names which can't be represented in the cache
+            if (item.name().find_first_of("\t\n") != std::string::npos)
+               continue;
+
+            *pOfs << "I\t" << item.type()
+                  << "\t" << item.line()
+                  << "\t" << item.column()
+                  << "\t" << item.name() << "\n";
+         }
+      }
+
+      pOfs->flush();
+      if (pOfs->fail())
+      {
+         error = systemError(boost::system::errc::io_error, ERROR_LOCATION);
+         error.addProperty("path", cacheFilePath_.absolutePath());
+         return error;
+      }
+
+      cacheDirty_ = false;
+      return Success();
+   }
+
+   void enqueFiles(const tree<FileInfo>& fileTree)
+   {
+      // discard indexing which is in progress (files which still need to
+      // be indexed are scheduled again below)
+      while (!indexTasks_.empty())
+         cancelIndexing(indexTasks_.begin()->first);
+
+      // remove entries which are no longer part of the project
+      std::set<std::string> projectFiles;
+      for (tree<FileInfo>::iterator it = fileTree.begin();
+           it != fileTree.end();
+           ++it)
+      {
+         if (isRSourceFile(*it))
+            projectFiles.insert(it->absolutePath());
+      }
+      for (Entries::iterator it = entries_.begin(); it != entries_.end(); )
+      {
+         if (projectFiles.find(it->first) == projectFiles.end())
+         {
+            removeSymbols(it->second.pIndex->context());
+            entries_.erase(it++);
+            cacheDirty_ = true;
+         }
+         else
+         {
+            ++it;
+         }
       }
 
-      // index
-      indexProjectFile(filePath);
+      // index files which aren't already indexed (or whose cached
+      // index is out of date)
+      for (tree<FileInfo>::iterator it = fileTree.begin();
+           it != fileTree.end();
+           ++it)
+      {
+         if (isRSourceFile(*it) && !isIndexed(*it))
+            scheduleIndexing(*it, BackgroundTaskScheduler::PriorityLow);
+      }
 
-      // return status
-      return !dirIter_.finished();
+      writeCacheIfIndexed();
+   }
+
+   void enqueFileChanges(const std::vector<FileChangeEvent>& events)
+   {
+      BOOST_FOREACH(const FileChangeEvent& event, events)
+      {
+         if (isRSourceFile(event.fileInfo()))
+            processFileChange(event);
+      }
+
+      writeCacheIfIndexed();
    }
 
 private:
 
-   void indexProjectFile(const FilePath& filePath)
+   static const char * const kCacheVersion;
+
+   void addCacheEntry(const std::string& path,
+                      const FileInfo& fileInfo,
+                      const std::vector<r_util::RSourceItem>& items,
+                      Entries* pEntries)
+   {
+      if (path.empty())
+         return;
+
+      Entry entry;
+      entry.fileInfo = fileInfo;
+      entry.pIndex.reset(new r_util::RSourceIndex(path, items));
+      (*pEntries)[fileInfo.absolutePath()] = entry;
+   }
+
+   void scheduleIndexing(const FileInfo& fileInfo,
+                         BackgroundTaskScheduler::Priority priority)
+   {
+      // a file which changes again while it is being indexed is re-read
+      cancelIndexing(fileInfo.absolutePath());
+
+      boost::shared_ptr<Entry> pEntry(new Entry());
+      pEntry->fileInfo = fileInfo;
+      indexTasks_[fileInfo.absolutePath()] =
+         module_context::backgroundTaskScheduler().schedule(
+            boost::bind(&SourceFileIndex::indexProjectFile,
+                        projectRootDir_, encoding_, pEntry),
+            priority,
+            boost::bind(&SourceFileIndex::onProjectFileIndexed, this, pEntry));
+   }
+
+   void cancelIndexing(const std::string& path)
+   {
+      std::map<std::string,BackgroundTaskScheduler::TaskId>::iterator it =
+                                                      indexTasks_.find(path);
+      if (it != indexTasks_.end())
+      {
+         module_context::backgroundTaskScheduler().cancel(it->second);
+         indexTasks_.erase(it);
+      }
+   }
+
+   // persist the index once there are no files left to index
+   void writeCacheIfIndexed()
    {
-      if (isRSourceFile(filePath))
+      if (!indexTasks_.empty())
+         return;
+
+      Error error = writeCache();
+      if (error)
+         LOG_ERROR(error);
+   }
+
+   void processFileChange(const FileChangeEvent& event)
+   {
+      const FileInfo& fileInfo = event.fileInfo();
+      switch(event.type())
+      {
+      case FileChangeEvent::FileAdded:
+      case FileChangeEvent::FileModified:
+         if (!isIndexed(fileInfo))
+            scheduleIndexing(fileInfo, BackgroundTaskScheduler::PriorityNormal);
+         break;
+
+      case FileChangeEvent::FileRemoved:
       {
-         // read the file
-         std::string code;
-         Error error = module_context::readAndDecodeFile(filePath,
-                                                         encoding_,
-                                                         true,
-                                                         &code);
-         if (error)
+         cancelIndexing(fileInfo.absolutePath());
+         Entries::iterator it = entries_.find(fileInfo.absolutePath());
+         if (it != entries_.end())
          {
-            error.addProperty("src-file", filePath.absolutePath());
-            LOG_ERROR(error);
-            return;
+            removeSymbols(it->second.pIndex->context());
+            entries_.erase(it);
+            cacheDirty_ = true;
          }
+         break;
+      }
+
+      case FileChangeEvent::None:
+      default:
+         break;
+      }
+   }
 
-         // compute project relative directory (used for context)
-         std::string context = filePath.relativePath(projectRootDir_);
+   bool isIndexed(const FileInfo& fileInfo) const
+   {
+      Entries::const_iterator it = entries_.find(fileInfo.absolutePath());
+      return it != entries_.end() &&
+             it->second.fileInfo.lastWriteTime() == fileInfo.lastWriteTime() &&
+             it->second.fileInfo.size() == fileInfo.size();
+   }
 
-         // index the source
-         s_sourceIndexes.push_back(boost::shared_ptr<r_util::RSourceIndex>(
-                                       new r_util::RSourceIndex(context, code)));
+   // runs on a background thread (so only touches the passed entry)
+   static void indexProjectFile(const FilePath& projectRootDir,
+                                const std::string& encoding,
+                                boost::shared_ptr<Entry> pEntry)
+   {
+      // read the file
+      FilePath filePath(pEntry->fileInfo.absolutePath());
+      std::string code;
+      Error error = module_context::readAndDecodeFile(filePath,
+                                                      encoding,
+                                                      true,
+                                                      &code);
+      if (error)
+      {
+         error.addProperty("src-file", filePath.absolutePath());
+         LOG_ERROR(error);
+         return;
+      }
+
+      // compute project relative directory (used for context)
+      std::string context = filePath.relativePath(projectRootDir);
+
+      // index the source
+      pEntry->pIndex.reset(new r_util::RSourceIndex(context, code));
+   }
+
+   void onProjectFileIndexed(boost::shared_ptr<Entry> pEntry)
+   {
+      indexTasks_.erase(pEntry->fileInfo.absolutePath());
+
+      if (pEntry->pIndex)
+      {
+         entries_[pEntry->fileInfo.absolutePath()] = *pEntry;
+         LOCK_MUTEX(mutex_)
+         {
+            symbolIndex_.add(pEntry->pIndex);
+         }
+         END_LOCK_MUTEX
+         cacheDirty_ = true;
+      }
+
+      writeCacheIfIndexed();
+   }
+
+   void removeSymbols(const std::string& context)
+   {
+      LOCK_MUTEX(mutex_)
+      {
+         symbolIndex_.remove(context);
       }
+      END_LOCK_MUTEX
    }
 
-   static bool isRSourceFile(const FilePath& filePath)
+   static bool isRSourceFile(const FileInfo& fileInfo)
    {
-      return !filePath.isDirectory() && (filePath.extensionLowerCase() == ".r");
+      return !fileInfo.isDirectory() &&
+             (FilePath(fileInfo.absolutePath()).extensionLowerCase() == ".r");
    }
 
 private:
    std::string encoding_;
    FilePath projectRootDir_;
-   RecursiveDirectoryIterator dirIter_;
+   FilePath cacheFilePath_;
+   Entries entries_;
+   mutable boost::mutex mutex_;
+   r_util::RSymbolIndex symbolIndex_;
+   std::map<std::string,BackgroundTaskScheduler::TaskId> indexTasks_;
+   bool cacheDirty_;
 };
 
+const char * const SourceFileIndex::kCacheVersion = "rs-source-index-1";
+
+SourceFileIndex s_projectIndex;
+
+void onFileMonitorRegistered(core::system::file_monitor::Handle handle,
+                             const tree<FileInfo>& files)
+{
+   s_projectIndex.enqueFiles(files);
+   source_control::onProjectMonitorRegistered();
+}
+
+void onFileMonitorRegistrationError(const Error& error)
+{
+   LOG_ERROR(error);
+   source_control::onProjectMonitorError();
+}
+
+void onFileMonitorError(const Error& error)
+{
+   LOG_ERROR(error);
+   source_control::onProjectMonitorError();
+}
+
+void onFilesChanged(const std::vector<FileChangeEvent>& events)
+{
+   s_projectIndex.enqueFileChanges(events);
+   source_control::onProjectFilesChanged(events);
+}
+
 void indexProjectFiles()
 {
-   // create indexer
-   boost::shared_ptr<SourceFileIndexer> pIndexer(new SourceFileIndexer());
-
-   // schedule indexing to occur up front + at idle time
-   module_context::scheduleIncrementalWork(
-         boost::posix_time::milliseconds(200),
-         boost::posix_time::milliseconds(20),
-         boost::bind(&SourceFileIndexer::indexNextFile, pIndexer));
+   // initialize the index and read any previously persisted state
+   const projects::ProjectContext& context = projects::projectContext();
+   s_projectIndex.initialize(context.directory(),
+                             context.scratchPath().complete("source_index"),
+                             context.defaultEncoding());
+   Error error = s_projectIndex.readCache();
+   if (error)
+      LOG_ERROR(error);
+
+   // monitor the project directory (the initial listing is used to
+   // reconcile the cached index with the files currently on disk)
+   core::system::file_monitor::Callbacks cb;
+   cb.onRegistered = onFileMonitorRegistered;
+   cb.onRegistrationError = onFileMonitorRegistrationError;
+   cb.onMonitoringError = onFileMonitorError;
+   cb.onFilesChanged = onFilesChanged;
+   core::system::file_monitor::registerMonitor(
+                           context.directory(),
+                           true,
+                           core::system::file_monitor::excludeHiddenFilter(),
+                           cb);
+}
+
+void onShutdown(bool terminatedNormally)
+{
+   if (code_search::enabled())
+   {
+      Error error = s_projectIndex.writeCache();
+      if (error)
+         LOG_ERROR(error);
+   }
 }
 
 
@@ -186,26 +561,12 @@ void searchProject(const std::string& term,
                    const std::set<std::string>& excludeContexts,
                    std::vector<r_util::RSourceItem>* pItems)
 {
-   BOOST_FOREACH(const boost::shared_ptr<core::r_util::RSourceIndex>& pIndex,
-                 s_sourceIndexes)
-   {
-      // bail if this is an exluded context
-      if (excludeContexts.find(pIndex->context()) != excludeContexts.end())
-         continue;
-
-      // scan the next index
-      pIndex->search(term,
-                     prefixOnly,
-                     false,
-                     std::back_inserter(*pItems));
-
-      // return if we are past maxResults
-      if (pItems->size() >= maxResults)
-      {
-         pItems->resize(maxResults);
-         return;
-      }
-   }
+   s_projectIndex.search(term,
+                         prefixOnly,
+                         false,
+                         excludeContexts,
+                         maxResults,
+                         pItems);
 }
 
 void searchSource(const std::string& term,
@@ -432,15 +793,16 @@ bool enabled()
    
 Error initialize()
 {
-   // sign up for deferred init
+   // sign up for deferred init and shutdown
    module_context::events().onDeferredInit.connect(onDeferredInit);
+   module_context::events().onShutdown.connect(onShutdown);
 
 
    using boost::bind;
    using namespace module_context;
    ExecBlock initBlock ;
    initBlock.addFunctions()
-      (bind(registerRpcMethod, "search_code", searchCode));
+      (bind(registerRFreeRpcMethod, "search_code", searchCode));
    ;
 
    return initBlock.execute();
@@ -208,7 +208,7 @@ Error initialize()
    using namespace session::module_context;
    ExecBlock initBlock ;
    initBlock.addFunctions()
-      (bind(registerUriHandler, "/content", handleContentRequest))
+      (bind(registerRFreeUriHandler, "/content", handleContentRequest))
       (bind(registerRpcMethod, "remove_content_url", removeContentUrl));
    return initBlock.execute();
 }
@@ -15,10 +15,17 @@
 
 #include <string>
 #include <vector>
+#include <map>
+#include <deque>
+#include <limits>
+#include <cstring>
 #include <sstream>
 
 #include <boost/bind.hpp>
 #include <boost/format.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/algorithm/string/trim.hpp>
 
 #include <core/Log.hpp>
 #include <core/Error.hpp>
@@ -26,6 +33,12 @@
 #include <core/FileSerializer.hpp>
 #include <core/StringUtils.hpp>
 
+#include <core/http/Request.hpp>
+#include <core/http/Response.hpp>
+#include <core/json/JsonRpc.hpp>
+
+#include <core/system/System.hpp>
+
 #define R_INTERNAL_FUNCTIONS
 #include <r/RInternal.hpp>
 #include <r/RSexp.hpp>
@@ -67,31 +80,455 @@ SEXP dataEntryHook(SEXP call, SEXP op, SEXP args, SEXP rho)
    return R_NilValue;
 }
 
-void appendTag(std::string* pHTML,
-               const std::string& text,
-               const std::string& tag,
-               const std::string& className = std::string())
+// uri for requesting windows of viewed data
+const char * const kGridData = "/grid_data";
+
+// maximum number of data frames to hold references to (views beyond this
+// number release the data of the least recently opened view)
+const std::size_t kMaxViewedData = 10;
+
+// maximum size of a window of data
+const int kMaxWindowRows = 1000;
+const int kMaxWindowColumns = 100;
+
+// A data frame which is being viewed. We hold a reference to the data so
+// that the viewer can request windows of rows and columns on demand (only
+// the cells within a window are ever formatted). Sorting and filtering
+// are done here against the underlying REAL and STR vectors and yield the
+// list of row indexes which are visible (in display order).
+struct ViewedData : boost::noncopyable
 {
-   std::string classAttrib;
-   if (!className.empty())
-      classAttrib = " class=\"" + className + "\"";
-
-   boost::format fmt("<%1%%2%>%3%</%1%>");
-   pHTML->append(boost::str(fmt % tag %
-                                  classAttrib %
-                                  string_utils::textToHtml(text)));
+   ViewedData(SEXP dataSEXP,
+              const std::vector<std::string>& columnNames,
+              int rowCount)
+      : data(dataSEXP),
+        columnNames(columnNames),
+        rowCount(rowCount),
+        sortColumn(-1),
+        sortDescending(false),
+        filterColumn(-1)
+   {
+   }
+
+   r::sexp::PreservedSEXP data;
+   std::vector<std::string> columnNames;
+   int rowCount;
+
+   // current sort and filter (and the resulting visible rows -- an empty
+   // list along with no sort or filter indicates the natural order)
+   int sortColumn;
+   bool sortDescending;
+   int filterColumn;
+   std::string filter;
+   std::vector<int> rows;
+};
+
+typedef std::map<std::string, boost::shared_ptr<ViewedData> > ViewedDataMap;
+ViewedDataMap s_viewedData;
+std::deque<std::string> s_viewedDataOrder;
+
+std::string addViewedData(boost::shared_ptr<ViewedData> pData)
+{
+   std::string id = core::system::generateUuid(false);
+   s_viewedData[id] = pData;
+   s_viewedDataOrder.push_back(id);
+
+   // release the data of the oldest views if we are over the limit
+   while (s_viewedDataOrder.size() > kMaxViewedData)
+   {
+      s_viewedData.erase(s_viewedDataOrder.front());
+      s_viewedDataOrder.pop_front();
+   }
+
+   return id;
 }
 
-void appendTD(std::string* pHTML,
-              const std::string& text,
-              const std::string& className = std::string())
+// NA (or rows beyond the end of a short column) sort last irrespective of
+// the sort direction
+class RealLess
+{
+public:
+   RealLess(SEXP columnSEXP, bool descending)
+      : values_(REAL(columnSEXP)),
+        length_(Rf_length(columnSEXP)),
+        descending_(descending)
+   {
+   }
+
+   bool operator()(int lhs, int rhs) const
+   {
+      bool lhsNA = lhs >= length_ || ISNAN(values_[lhs]);
+      bool rhsNA = rhs >= length_ || ISNAN(values_[rhs]);
+      if (lhsNA || rhsNA)
+         return !lhsNA && rhsNA;
+      else if (descending_)
+         return values_[rhs] < values_[lhs];
+      else
+         return values_[lhs] < values_[rhs];
+   }
+
+private:
+   const double* values_;
+   int length_;
+   bool descending_;
+};
+
+class StringLess
+{
+public:
+   StringLess(SEXP columnSEXP, bool descending)
+      : columnSEXP_(columnSEXP),
+        length_(Rf_length(columnSEXP)),
+        descending_(descending)
+   {
+   }
+
+   bool operator()(int lhs, int rhs) const
+   {
+      SEXP lhsSEXP = lhs < length_ ? STRING_ELT(columnSEXP_, lhs) : NA_STRING;
+      SEXP rhsSEXP = rhs < length_ ? STRING_ELT(columnSEXP_, rhs) : NA_STRING;
+      bool lhsNA = lhsSEXP == NA_STRING;
+      bool rhsNA = rhsSEXP == NA_STRING;
+      if (lhsNA || rhsNA)
+         return !lhsNA && rhsNA;
+      else if (descending_)
+         return std::strcmp(CHAR(rhsSEXP), CHAR(lhsSEXP)) < 0;
+      else
+         return std::strcmp(CHAR(lhsSEXP), CHAR(rhsSEXP)) < 0;
+   }
+
+private:
+   SEXP columnSEXP_;
+   int length_;
+   bool descending_;
+};
+
+// filter rows of a column. strings are matched by substring (case
+// sensitive) and numbers either by value or by an inclusive range
+// specified as "min..max" (either bound may be omitted)
+Error filterRows(SEXP columnSEXP,
+                 const std::string& filter,
+                 std::vector<int>* pRows)
 {
-   appendTag(pHTML, text, "td", className);
+   int length = Rf_length(columnSEXP);
+
+   if (TYPEOF(columnSEXP) == STRSXP)
+   {
+      for (int i=0; i<length; i++)
+      {
+         SEXP stringSEXP = STRING_ELT(columnSEXP, i);
+         if (stringSEXP != NA_STRING &&
+             std::strstr(CHAR(stringSEXP), filter.c_str()) != NULL)
+         {
+            pRows->push_back(i);
+         }
+      }
+   }
+   else
+   {
+      double minValue = -std::numeric_limits<double>::infinity();
+      double maxValue = std::numeric_limits<double>::infinity();
+      std::string::size_type rangePos = filter.find("..");
+      try
+      {
+         if (rangePos != std::string::npos)
+         {
+            std::string min = boost::algorithm::trim_copy(
+                                          filter.substr(0, rangePos));
+            std::string max = boost::algorithm::trim_copy(
+                                          filter.substr(rangePos + 2));
+            if (!min.empty())
+               minValue = boost::lexical_cast<double>(min);
+            if (!max.empty())
+               maxValue = boost::lexical_cast<double>(max);
+         }
+         else
+         {
+            minValue = maxValue = boost::lexical_cast<double>(
+                                       boost::algorithm::trim_copy(filter));
+         }
+      }
+      catch(boost::bad_lexical_cast&)
+      {
+         return Error(json::errc::ParamInvalid, ERROR_LOCATION);
+      }
+
+      const double* values = REAL(columnSEXP);
+      for (int i=0; i<length; i++)
+      {
+         if (!ISNAN(values[i]) &&
+             values[i] >= minValue &&
+             values[i] <= maxValue)
+         {
+            pRows->push_back(i);
+         }
+      }
+   }
+
+   return Success();
 }
 
-void appendTH(std::string* pHTML, const std::string& text)
+// update the visible rows for a sort and filter (only recomputed when the
+// sort or filter actually changes so paging is cheap)
+Error updateRows(ViewedData* pData,
+                 int sortColumn,
+                 bool sortDescending,
+                 int filterColumn,
+                 const std::string& filter)
 {
-   appendTag(pHTML, text, "th");
+   int columnCount = pData->columnNames.size();
+   if (sortColumn < -1 || sortColumn >= columnCount ||
+       filterColumn < -1 || filterColumn >= columnCount)
+   {
+      return Error(json::errc::ParamInvalid, ERROR_LOCATION);
+   }
+
+   // no filter means no filter column
+   if (filter.empty())
+      filterColumn = -1;
+
+   // no sort means no sort direction
+   if (sortColumn == -1)
+      sortDescending = false;
+
+   // bail if nothing has changed
+   if (sortColumn == pData->sortColumn &&
+       sortDescending == pData->sortDescending &&
+       filterColumn == pData->filterColumn &&
+       (filterColumn == -1 || filter == pData->filter))
+   {
+      return Success();
+   }
+
+   // filter (or take all rows if we are only sorting)
+   std::vector<int> rows;
+   if (filterColumn != -1)
+   {
+      SEXP columnSEXP = VECTOR_ELT(pData->data.get(), filterColumn);
+      Error error = filterRows(columnSEXP, filter, &rows);
+      if (error)
+         return error;
+   }
+   else if (sortColumn != -1)
+   {
+      rows.reserve(pData->rowCount);
+      for (int i=0; i<pData->rowCount; i++)
+         rows.push_back(i);
+   }
+
+   // sort
+   if (sortColumn != -1)
+   {
+      SEXP columnSEXP = VECTOR_ELT(pData->data.get(), sortColumn);
+      if (TYPEOF(columnSEXP) == REALSXP)
+      {
+         std::stable_sort(rows.begin(),
+                          rows.end(),
+                          RealLess(columnSEXP, sortDescending));
+      }
+      else
+      {
+         std::stable_sort(rows.begin(),
+                          rows.end(),
+                          StringLess(columnSEXP, sortDescending));
+      }
+   }
+
+   pData->sortColumn = sortColumn;
+   pData->sortDescending = sortDescending;
+   pData->filterColumn = filterColumn;
+   pData->filter = filter;
+   pData->rows.swap(rows);
+   return Success();
+}
+
+int visibleRowCount(const ViewedData& data)
+{
+   if (data.sortColumn == -1 && data.filterColumn == -1)
+      return data.rowCount;
+   else
+      return data.rows.size();
+}
+
+int rowIndex(const ViewedData& data, int visibleRow)
+{
+   if (data.sortColumn == -1 && data.filterColumn == -1)
+      return visibleRow;
+   else
+      return data.rows[visibleRow];
+}
+
+// format a window of a column (NA values and rows beyond the end of the
+// column are NA)
+Error formatColumnWindow(const ViewedData& data,
+                         int column,
+                         int firstRow,
+                         int rowCount,
+                         SEXP* pFormattedSEXP,
+                         r::sexp::Protect* pProtect)
+{
+   r::sexp::Protect rProtect;
+   SEXP columnSEXP = VECTOR_ELT(data.data.get(), column);
+   int columnLength = Rf_length(columnSEXP);
+   bool isReal = TYPEOF(columnSEXP) == REALSXP;
+
+   // extract the window of the column
+   SEXP windowSEXP = Rf_allocVector(TYPEOF(columnSEXP), rowCount);
+   rProtect.add(windowSEXP);
+   std::vector<bool> na(rowCount, false);
+   for (int i=0; i<rowCount; i++)
+   {
+      int row = rowIndex(data, firstRow + i);
+      if (isReal)
+      {
+         double value = row < columnLength ? REAL(columnSEXP)[row] : NA_REAL;
+         REAL(windowSEXP)[i] = value;
+         na[i] = ISNA(value);
+      }
+      else
+      {
+         SEXP value = row < columnLength ? STRING_ELT(columnSEXP, row) :
+                                           NA_STRING;
+         SET_STRING_ELT(windowSEXP, i, value);
+         na[i] = value == NA_STRING;
+      }
+   }
+
+   // format it
+   SEXP formattedSEXP;
+   r::exec::RFunction formatFx(".rs.formatDataColumn");
+   formatFx.addParam(windowSEXP);
+   formatFx.addParam(rowCount);
+   Error error = formatFx.call(&formattedSEXP, &rProtect);
+   if (error)
+      return error;
+
+   // (format writes NA as "NA")
+   SEXP valuesSEXP = Rf_allocVector(STRSXP, rowCount);
+   pProtect->add(valuesSEXP);
+   for (int i=0; i<rowCount; i++)
+   {
+      if (na[i] || i >= Rf_length(formattedSEXP))
+         SET_STRING_ELT(valuesSEXP, i, NA_STRING);
+      else
+         SET_STRING_ELT(valuesSEXP, i, STRING_ELT(formattedSEXP, i));
+   }
+
+   *pFormattedSEXP = valuesSEXP;
+   return Success();
+}
+
+// the window is written as json directly, with its row numbers and its
+// formatted columns (a data frame) in columnar form:
+//
+//   {"totalRows":...,"totalColumns":...,"firstRow":...,"firstColumn":...,
+//    "rowNumbers":{"type":"integer","values":[...]},
+//    "data":{"rows":...,"columns":[{"name":...,"values":[...]}, ...]}}
+//
+Error dataWindow(const http::Request& request, std::string* pWindowJson)
+{
+   // lookup the data
+   std::string id = request.queryParamValue("id");
+   ViewedDataMap::iterator it = s_viewedData.find(id);
+   if (it == s_viewedData.end())
+      return Error(json::errc::ParamInvalid, ERROR_LOCATION);
+   ViewedData& data = *(it->second);
+
+   // apply sort and filter
+   int sortColumn = request.queryParamValue<int>("sort", -1);
+   bool sortDescending = request.queryParamValue("dir") == "desc";
+   int filterColumn = request.queryParamValue<int>("filter_col", -1);
+   std::string filter = request.queryParamValue("filter");
+   Error error = updateRows(&data,
+                            sortColumn,
+                            sortDescending,
+                            filterColumn,
+                            filter);
+   if (error)
+      return error;
+
+   // determine the window (clipped to the data)
+   int totalRows = visibleRowCount(data);
+   int totalColumns = data.columnNames.size();
+   int firstRow = std::max(request.queryParamValue<int>("row", 0), 0);
+   int rowCount = request.queryParamValue<int>("rows", kMaxWindowRows);
+   firstRow = std::min(firstRow, totalRows);
+   rowCount = std::max(std::min(std::min(rowCount, kMaxWindowRows),
+                                totalRows - firstRow), 0);
+   int firstColumn = std::max(request.queryParamValue<int>("col", 0), 0);
+   int columnCount = request.queryParamValue<int>("cols", kMaxWindowColumns);
+   firstColumn = std::min(firstColumn, totalColumns);
+   columnCount = std::max(std::min(std::min(columnCount, kMaxWindowColumns),
+                                   totalColumns - firstColumn), 0);
+
+   // row numbers (in terms of the original data)
+   r::sexp::Protect rProtect;
+   SEXP rowNumbersSEXP = Rf_allocVector(INTSXP, rowCount);
+   rProtect.add(rowNumbersSEXP);
+   for (int i=0; i<rowCount; i++)
+      INTEGER(rowNumbersSEXP)[i] = rowIndex(data, firstRow + i) + 1;
+
+   // formatted values (as a data frame of the window's columns)
+   SEXP windowSEXP = Rf_allocVector(VECSXP, columnCount);
+   rProtect.add(windowSEXP);
+   SEXP namesSEXP = Rf_allocVector(STRSXP, columnCount);
+   rProtect.add(namesSEXP);
+   for (int i=0; i<columnCount; i++)
+   {
+      const std::string& name = data.columnNames[firstColumn + i];
+      SET_STRING_ELT(namesSEXP, i, Rf_mkChar(name.c_str()));
+
+      SEXP valuesSEXP;
+      error = formatColumnWindow(data,
+                                 firstColumn + i,
+                                 firstRow,
+                                 rowCount,
+                                 &valuesSEXP,
+                                 &rProtect);
+      if (error)
+         return error;
+      SET_VECTOR_ELT(windowSEXP, i, valuesSEXP);
+   }
+   Rf_setAttrib(windowSEXP, R_NamesSymbol, namesSEXP);
+   Rf_setAttrib(windowSEXP, R_ClassSymbol, Rf_mkString("data.frame"));
+
+   std::string& windowJson = *pWindowJson;
+   json::Writer writer(&windowJson);
+   writer.writeRaw("{\"totalRows\":");
+   writer.writeInteger(boost::int64_t(totalRows));
+   writer.writeRaw(",\"totalColumns\":");
+   writer.writeInteger(boost::int64_t(totalColumns));
+   writer.writeRaw(",\"firstRow\":");
+   writer.writeInteger(boost::int64_t(firstRow));
+   writer.writeRaw(",\"firstColumn\":");
+   writer.writeInteger(boost::int64_t(firstColumn));
+   writer.writeRaw(",\"rowNumbers\":");
+   error = r::json::writeColumnarJson(rowNumbersSEXP, &windowJson);
+   if (error)
+      return error;
+   writer.writeRaw(",\"data\":");
+   error = r::json::writeColumnarJson(windowSEXP, &windowJson);
+   if (error)
+      return error;
+   writer.writeRaw('}');
+   return Success();
+}
+
+void handleGridDataRequest(const http::Request& request,
+                           http::Response* pResponse)
+{
+   std::string windowJson;
+   Error error = dataWindow(request, &windowJson);
+   if (error)
+   {
+      json::setJsonRpcError(error, pResponse);
+   }
+   else
+   {
+      json::JsonRpcResponse jsonRpcResponse;
+      jsonRpcResponse.setResultJson(windowJson);
+      json::setJsonRpcResponse(jsonRpcResponse, pResponse);
+   }
 }
 
 SEXP dataViewerHook(SEXP call, SEXP op, SEXP args, SEXP rho)
@@ -124,10 +561,6 @@ SEXP dataViewerHook(SEXP call, SEXP op, SEXP args, SEXP rho)
       // get column count
       int columnCount = r::sexp::length(dataSEXP);
 
-      // calculate columns to display
-      const int kMaxColumns = 100;
-      int displayedColumns = std::min(columnCount, kMaxColumns);
-
       // extract title and column names
       std::string title = r::sexp::asString(titleSEXP);
       std::vector<std::string> columnNames;
@@ -136,21 +569,15 @@ SEXP dataViewerHook(SEXP call, SEXP op, SEXP args, SEXP rho)
          throw r::exec::RErrorException("invalid names: " +
                                         error.code().message());
 
-      // truncate columns names to displayedColumns
-      columnNames.resize(displayedColumns);
-
-      // get column lenghts and then calculate # of rows based on the maximum #
-      // of elements in single column (technically R can pass columns which have
-      // a disparate # of rows to this method)
+      // calculate # of rows based on the maximum # of elements in single
+      // column (technically R can pass columns which have a disparate # of
+      // rows to this method)
       int rowCount = 0;
-      std::vector<int> columnLengths;
-      for (int i=0; i<displayedColumns; i++)
+      for (int i=0; i<columnCount; i++)
       {
-          // get the column and record its length (updating rowCount)
+          // get the column and update rowCount
           SEXP columnSEXP = VECTOR_ELT(dataSEXP, i);
-          int columnLength = r::sexp::length(columnSEXP);
-          columnLengths.push_back(columnLength);
-          rowCount = std::max(columnLength, rowCount);
+          rowCount = std::max(r::sexp::length(columnSEXP), rowCount);
 
           // validate data type (R converts all inbound vectors to REAL or STR)
           if (TYPEOF(columnSEXP) != REALSXP && TYPEOF(columnSEXP) != STRSXP)
@@ -160,98 +587,37 @@ SEXP dataViewerHook(SEXP call, SEXP op, SEXP args, SEXP rho)
           }
       }
 
-      // calculate rows to display
-      const int kMaxRows = 1000;
-      int displayedRows = std::min(rowCount, kMaxRows);
+      // hold a reference to the data for serving windows of it
+      boost::shared_ptr<ViewedData> pData(
+                           new ViewedData(dataSEXP, columnNames, rowCount));
+      std::string id = addViewedData(pData);
 
-      // format the data for presentation
-      r::sexp::Protect rProtect;
-      SEXP formattedDataSEXP = Rf_allocVector(VECSXP, displayedColumns);
-      rProtect.add(formattedDataSEXP);
-      for (int i=0; i<displayedColumns; i++)
-      {
-         SEXP columnSEXP = VECTOR_ELT(dataSEXP, i);
-         SEXP formattedColumnSEXP;
-         r::exec::RFunction formatFx(".rs.formatDataColumn");
-         formatFx.addParam(columnSEXP);
-         formatFx.addParam(displayedRows);
-         Error error = formatFx.call(&formattedColumnSEXP, &rProtect);
-         if (error)
-            throw r::exec::RErrorException(error.summary());
-         SET_VECTOR_ELT(formattedDataSEXP, i, formattedColumnSEXP);
-       }
-
-      // write html header
-      boost::format headerFmt(
+      // write html (the rows are requested by the viewer as it scrolls)
+      boost::format htmlFmt(
          "<html>\n"
          "  <head>\n"
          "     <title>%1%</title>\n"
          "     <meta charset=\"utf-8\"/>\n"
          "     <link rel=\"stylesheet\" type=\"text/css\" href=\"../css/data.css\"/>\n"
+         "     <script type=\"text/javascript\" src=\"../js/dataviewer.js\"></script>\n"
          "  </head>\n"
-         "  <body>\n");
-      std::string html = boost::str(headerFmt % title);
-
-      // output begin table & header
-      html += "<table>\n";
-      html += "<thead><tr>\n";
-      html += "<td id=\"origin\">&nbsp;</td>"; // above row numbers
-      std::for_each(columnNames.begin(),
-                    columnNames.end(),
-                    boost::bind(appendTH, &html, _1));
-      html += "\n</tr></thead>\n";
-
-      html += "<tbody>\n";
-      // output rows
-      for (int row=0; row<displayedRows; row++)
-      {
-         html += "<tr>\n";
-
-         // row number
-         appendTD(&html, boost::lexical_cast<std::string>(row+1), "rn");
-
-         // output a data element from each column where this row is available
-         for (int col=0; col<Rf_length(formattedDataSEXP); col++)
-         {
-            if (columnLengths[col] > row)
-            {
-               SEXP columnSEXP = VECTOR_ELT(formattedDataSEXP, col);
-               SEXP stringSEXP = STRING_ELT(columnSEXP, row);
-               if (stringSEXP != NULL &&
-                   stringSEXP != NA_STRING &&
-                   r::sexp::length(stringSEXP) > 0)
-               {
-                  std::string text(Rf_translateChar(stringSEXP));
-                  appendTD(&html, text);
-               }
-               else
-               {
-                  html += "<td>&nbsp;</td>";
-               }
-            }
-            else
-            {
-               html += "<td>&nbsp;</td>";
-            }
-         }
-
-         html += "\n</tr>\n";
-      }
-      html += "</tbody>\n";
-
-      // append table footer
-      html += "\n</table>\n";
-
-      // append document footer
-      html += "</body></html>\n";
+         "  <body onload=\"dataViewer.init('%2%', '%3%', %4%, %5%)\">\n"
+         "  </body>\n"
+         "</html>\n");
+      std::string html = boost::str(htmlFmt %
+                                    string_utils::textToHtml(title) %
+                                    &kGridData[1] %
+                                    id %
+                                    rowCount %
+                                    columnCount);
 
       // fire show data event
       json::Object dataItem;
       dataItem["title"] = title;
       dataItem["totalObservations"] = rowCount;
-      dataItem["displayedObservations"] = displayedRows;
+      dataItem["displayedObservations"] = rowCount;
       dataItem["variables"] = columnCount;
-      dataItem["displayedVariables"] = displayedColumns;
+      dataItem["displayedVariables"] = columnCount;
       dataItem["contentUrl"] = content_urls::provision(title, html, ".htm");
       ClientEvent event(client_events::kShowData, dataItem);
       module_context::enqueClientEvent(event);
@@ -281,6 +647,7 @@ Error initialize()
    initBlock.addFunctions()
       (bind(registerReplaceHook, "dataentry", dataEntryHook, (CCODE*)NULL))
       (bind(registerReplaceHook, "dataviewer", dataViewerHook,(CCODE*)NULL))
+      (bind(registerUriHandler, kGridData, handleGridDataRequest))
       (bind(sourceModuleRFile, "SessionData.R"));
    
    return initBlock.execute();
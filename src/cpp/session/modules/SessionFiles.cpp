@@ -32,8 +32,10 @@
 #include <core/Settings.hpp>
 #include <core/Exec.hpp>
 #include <core/DateTime.hpp>
+#include <core/StringUtils.hpp>
 
 #include <core/system/DirectoryMonitor.hpp>
+#include <core/system/FileScanner.hpp>
 
 #include <core/http/Util.hpp>
 #include <core/http/Request.hpp>
@@ -103,6 +105,12 @@ bool isVisible(const FilePath& file)
    }
 }
 
+bool compareFileInfoPathNoCase(const FileInfo& file1, const FileInfo& file2)
+{
+   return string_utils::toLower(file1.absolutePath()) <
+          string_utils::toLower(file2.absolutePath());
+}
+
 // directory monitor instance. the DirectoryMonitor is started when a 
 // call to list_files includes monitor=true or when a session which was
 // previously monitoring files is resumed
@@ -240,10 +248,10 @@ core::Error listFiles(const json::JsonRpcRequest& request,
    if (error)
       return error ;
    
-   // retreive list of files
+   // retreive list of files (stat'ing each only once)
    FilePath targetPath = module_context::resolveAliasedPath(path) ;
-   std::vector<FilePath> files ;
-   error = targetPath.children(&files) ;
+   std::vector<FileInfo> files ;
+   error = core::system::listDirectoryCached(targetPath, true, &files) ;
    if (error)
       return error ;
 
@@ -253,18 +261,18 @@ core::Error listFiles(const json::JsonRpcRequest& request,
       return error;
 
    // sort the files by name
-   std::sort(files.begin(), files.end(), compareAbsolutePathNoCase);
+   std::sort(files.begin(), files.end(), compareFileInfoPathNoCase);
    
    // produce json listing
    json::Array jsonFiles ;
-   BOOST_FOREACH( FilePath& filePath, files )
+   BOOST_FOREACH( const FileInfo& fileInfo, files )
    {
-      // files which may have been deleted after the listing or which
-      // are not end-user visible
-      if (filePath.exists() && isVisible(filePath))
+      // files which are not end-user visible
+      FilePath filePath(fileInfo.absolutePath());
+      if (isVisible(filePath))
       {
          source_control::VCSStatus status = vcsStatus.getStatus(filePath);
-         json::Object fileObject = module_context::createFileSystemItem(filePath);
+         json::Object fileObject = module_context::createFileSystemItem(fileInfo);
          fileObject["vcs_status"] = status.status();
          jsonFiles.push_back(fileObject) ;
       }
@@ -966,14 +974,14 @@ Error initialize()
    using boost::bind;
    ExecBlock initBlock ;
    initBlock.addFunctions()
-      (bind(registerRpcMethod, "stat", stat))
+      (bind(registerRFreeRpcMethod, "stat", stat))
       (bind(registerRpcMethod, "list_files", listFiles))
       (bind(registerRpcMethod, "create_folder", createFolder))
       (bind(registerRpcMethod, "delete_files", deleteFiles))
       (bind(registerRpcMethod, "copy_file", copyFile))
       (bind(registerRpcMethod, "move_files", moveFiles))
       (bind(registerRpcMethod, "rename_file", renameFile))
-      (bind(registerUriHandler, "/files", handleFilesRequest))
+      (bind(registerRFreeUriHandler, "/files", handleFilesRequest))
       (bind(registerUriHandler, "/upload", handleFileUploadRequest))
       (bind(registerUriHandler, "/export", handleFileExportRequest))
       (bind(registerRpcMethod, "complete_upload", completeUpload))
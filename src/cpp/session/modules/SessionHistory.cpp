@@ -12,6 +12,7 @@
  */
 
 #include "SessionHistory.hpp"
+#include "SessionHistoryArchive.hpp"
 
 #include <iostream>
 #include <sstream>
@@ -45,18 +46,6 @@ namespace history {
 
 namespace {   
 
-struct HistoryEntry
-{
-   HistoryEntry() : index(0), timestamp(0) {}
-   HistoryEntry(int index, double timestamp, const std::string& command)
-      : index(index), timestamp(timestamp), command(command)
-   {
-   }
-   int index;
-   double timestamp;
-   std::string command;
-};
-
 void historyEntriesAsJson(const std::vector<HistoryEntry>& entries,
                           json::Object* pEntriesJson)
 {
@@ -79,179 +68,6 @@ void historyEntriesAsJson(const std::vector<HistoryEntry>& entries,
 }
    
 
-// simple reader for parsing lines of history file
-class HistoryEntryReader
-{
-public:
-   HistoryEntryReader() : nextIndex_(0) {}
-   
-   ReadCollectionAction operator()(const std::string& line, 
-                                   HistoryEntry* pEntry)
-   {
-      // if the line doesn't have a ':' then ignore it
-      if (line.find(':') == std::string::npos)
-         return ReadCollectionIgnoreLine;
-
-      pEntry->index = nextIndex_++; 
-      std::istringstream istr(line);
-      istr >> pEntry->timestamp ;
-      istr.ignore(1, ':');
-      std::getline(istr, pEntry->command);
-      
-      // if we had a read failure log it and return ignore state
-      if (!istr.fail())
-      {
-         return ReadCollectionAddLine;
-      }
-      else
-      {
-         LOG_ERROR_MESSAGE("unexpected io error reading history line: " + 
-                           line);
-         return ReadCollectionIgnoreLine;  
-      }
-   }
-private:
-   int nextIndex_;
-};
-   
-   
-class History : boost::noncopyable
-{
-private:
-   History() : entryCacheValid_(false) {}
-   friend History& historyArchive();
-   
-public:
-   
-   Error add(const std::string& command)
-   {
-      // invalidiate the entry cache -- obviously we could maintain the entry 
-      // cache in memory however the OS will do this as well so better to free 
-      // it on the assumption that an add operation means the user has resumed
-      // their work and isn't going to actively query the history again 
-      // for a while
-      entries_.clear();
-      entryCacheValid_ = false;
-            
-      // write the entry to the file
-      std::ostringstream ostrEntry ;
-      double currentTime = core::date_time::millisecondsSinceEpoch();
-      writeEntry(currentTime, command, &ostrEntry);
-      ostrEntry << std::endl;
-      return appendToFile(historyDatabaseFilePath(), ostrEntry.str());
-   }
-   
-   std::vector<HistoryEntry>::const_iterator begin() const
-   {
-      return entries().begin();
-   }
-   
-   std::vector<HistoryEntry>::const_iterator end() const
-   {
-      return entries().end();
-   }
-   
-   std::vector<HistoryEntry>::const_reverse_iterator rbegin() const
-   {
-      return entries().rbegin();
-   }
-   
-   std::vector<HistoryEntry>::const_reverse_iterator rend() const
-   {
-      return entries().rend();
-   }
-   
-   int size() const 
-   {
-      return entries().size();
-   }
-   
-   static void migrateRhistoryIfNecessary()
-   {
-      // if the history database doesn't exist see if we can migrate the 
-      // old .Rhistory file
-      FilePath historyDBPath = historyDatabaseFilePath();
-      if (!historyDBPath.exists())
-         attemptRhistoryMigration() ;
-   }
-   
-
-private:
-   
-   const std::vector<HistoryEntry>& entries() const
-   {
-      if (!entryCacheValid_)
-      {
-         // read history file if it exists
-         FilePath historyDBPath = historyDatabaseFilePath();
-         if (historyDBPath.exists())
-         {
-            Error error = readCollectionFromFile<std::vector<HistoryEntry> >(
-                                                         historyDBPath,
-                                                         &entries_,
-                                                         HistoryEntryReader());
-            if (error)
-            {
-               LOG_ERROR(error);
-            }
-            else
-            {
-               entryCacheValid_ = true;
-            }
-         }
-         else
-         {
-            entryCacheValid_ = true; // doesn't exist so empty cache is valid
-         }
-      }
-      
-      return entries_;
-   }
-   
-   static void writeEntry(double timestamp, 
-                          const std::string& command, 
-                          std::ostream* pOS) 
-   {
-      *pOS << std::fixed << std::setprecision(0) 
-           << timestamp << ":" << command;
-   }
-   
-   static std::string migratedHistoryEntry(const std::string& command)
-   {
-      std::ostringstream ostr ;
-      writeEntry(0, command, &ostr);
-      return ostr.str();
-   }
-   
-   static void attemptRhistoryMigration() 
-   {
-      Error error = writeCollectionToFile<r::session::ConsoleHistory>(
-                                                   historyDatabaseFilePath(),
-                                                   r::session::consoleHistory(),
-                                                   migratedHistoryEntry);  
-      
-      // log any error which occurs
-      if (error)
-         LOG_ERROR(error);
-   }
-   
-   static FilePath historyDatabaseFilePath()
-   {
-      return module_context::userScratchPath().complete("history_database");
-   }
-   
-   
-private:
-   mutable bool entryCacheValid_;
-   mutable std::vector<HistoryEntry> entries_;
-};
-   
-History& historyArchive()
-{
-   static History instance;
-   return instance;
-}
-
 Error setJsonResultFromHistory(int startIndex,
                                int endIndex,
                                json::JsonRpcResponse* pResponse)
@@ -268,33 +84,13 @@ Error setJsonResultFromHistory(int startIndex,
    
    // return the entries
    std::vector<HistoryEntry> entries;
-   const History& hist = historyArchive();
-   std::copy(hist.begin() + startIndex,
-             hist.begin() + endIndex,
-             std::back_inserter(entries));
+   historyArchive().subset(startIndex, endIndex, &entries);
    json::Object entriesJson;
    historyEntriesAsJson(entries, &entriesJson);
    pResponse->setResult(entriesJson);
    return Success();
 }
    
-bool matches(const HistoryEntry& entry,
-             const std::vector<std::string>& searchTerms)
-{   
-   // look for each search term in the input
-   for (std::vector<std::string>::const_iterator it = searchTerms.begin();
-        it != searchTerms.end();
-        ++it)
-   {
-      if (!boost::algorithm::contains(entry.command, *it))
-         return false;
-   }
-   
-   // had all of the search terms, return true
-   return true;
-}
-
-
 void historyRangeAsJson(int startIndex,
                         int endIndex,
                         json::Object* pHistoryJson)
@@ -447,25 +243,9 @@ Error searchHistoryArchive(const json::JsonRpcRequest& request,
    boost::tokenizer<boost::char_separator<char> > tok(query, sep);
    std::copy(tok.begin(), tok.end(), std::back_inserter(searchTerms));
    
-   // examine the items in the history for matches
+   // find the most recent items which match
    std::vector<HistoryEntry> matchingEntries;
-   const History& hist = historyArchive();
-   for (std::vector<HistoryEntry>::const_reverse_iterator 
-            it = hist.rbegin();
-            it != hist.rend();
-            ++it)
-   {
-      // check limit
-      if (matchingEntries.size() >= static_cast<std::size_t>(maxEntries))
-         break;
-
-      // look for match
-      if (matches(*it, searchTerms))
-      {
-         // add entry
-         matchingEntries.push_back(*it);
-      }
-   }
+   historyArchive().search(searchTerms, maxEntries, &matchingEntries);
 
    // return json
    json::Object entriesJson;
@@ -487,23 +267,10 @@ Error searchHistoryArchiveByPrefix(const json::JsonRpcRequest& request,
    // trim the prefix
    boost::algorithm::trim(prefix);
    
-   // examine the items in the history for matches
+   // find the most recent items which match
    std::vector<HistoryEntry> matchingEntries;
-   const History& hist = historyArchive();
-   for (std::vector<HistoryEntry>::const_reverse_iterator 
-        it = hist.rbegin();
-        it != hist.rend();
-        ++it)
-   {
-      // check limit
-      if (matchingEntries.size() >= static_cast<std::size_t>(maxEntries))
-         break;
-      
-      // look for match
-      if (boost::algorithm::starts_with(it->command, prefix))
-         matchingEntries.push_back(*it);
-   }
-   
+   historyArchive().searchByPrefix(prefix, maxEntries, &matchingEntries);
+
    // return json
    json::Object entriesJson;
    historyEntriesAsJson(matchingEntries, &entriesJson);
@@ -528,16 +295,26 @@ void onHistoryAdd(const std::string& command)
    module_context::enqueClientEvent(event);
 }
 
+void onShutdown(bool terminatedNormally)
+{
+   Error error = historyArchive().writeIndex();
+   if (error)
+      LOG_ERROR(error);
+}
+
 } // anonymous namespace
    
    
 Error initialize()
 {
    // migrate .Rhistory if necessary
-   History::migrateRhistoryIfNecessary();
+   HistoryArchive::migrateRhistoryIfNecessary();
    
    // connect to console history add event
    r::session::consoleHistory().connectOnAdd(onHistoryAdd);   
+
+   // persist the archive's search index
+   module_context::events().onShutdown.connect(onShutdown);
    
    // install handlers
    using boost::bind;
@@ -548,9 +325,9 @@ Error initialize()
       (bind(registerRpcMethod, "get_history_items", getHistoryItems))
       (bind(registerRpcMethod, "remove_history_items", removeHistoryItems))
       (bind(registerRpcMethod, "clear_history", clearHistory))
-      (bind(registerRpcMethod, "get_history_archive_items", getHistoryArchiveItems))
-      (bind(registerRpcMethod, "search_history_archive", searchHistoryArchive))
-      (bind(registerRpcMethod, "search_history_archive_by_prefix", searchHistoryArchiveByPrefix));
+      (bind(registerRFreeRpcMethod, "get_history_archive_items", getHistoryArchiveItems))
+      (bind(registerRFreeRpcMethod, "search_history_archive", searchHistoryArchive))
+      (bind(registerRFreeRpcMethod, "search_history_archive_by_prefix", searchHistoryArchiveByPrefix));
    return initBlock.execute();
 }
 
@@ -0,0 +1,651 @@
+/*
+ * SessionHistoryArchive.cpp
+ *
+ * Copyright (C) 2009-11 by RStudio, Inc.
+ *
+ * This program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include "SessionHistoryArchive.hpp"
+
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+#include <algorithm>
+#include <functional>
+
+#include <boost/foreach.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/algorithm/string/predicate.hpp>
+
+#include <core/Error.hpp>
+#include <core/Log.hpp>
+#include <core/FilePath.hpp>
+#include <core/FileSerializer.hpp>
+#include <core/DateTime.hpp>
+#include <core/Thread.hpp>
+
+#include <r/session/RConsoleHistory.hpp>
+
+#include <session/SessionModuleContext.hpp>
+
+using namespace core;
+
+namespace session {
+namespace modules {
+namespace history {
+
+namespace {
+
+const char * const kIndexFormat = "rs-history-index-1\n";
+
+// number of entries added since the sorted index was last merged before
+// they are merged into it
+const std::size_t kMaxRecentEntries = 1024;
+
+void writeEntry(double timestamp, const std::string& command, std::ostream* pOS)
+{
+   *pOS << std::fixed << std::setprecision(0)
+        << timestamp << ":" << command;
+}
+
+std::string migratedHistoryEntry(const std::string& command)
+{
+   std::ostringstream ostr ;
+   writeEntry(0, command, &ostr);
+   return ostr.str();
+}
+
+bool parseEntry(const std::string& line, HistoryEntry* pEntry)
+{
+   // if the line doesn't have a ':' then ignore it
+   if (line.find(':') == std::string::npos)
+      return false;
+
+   std::istringstream istr(line);
+   istr >> pEntry->timestamp ;
+   istr.ignore(1, ':');
+   std::getline(istr, pEntry->command);
+
+   // if we had a read failure log it and ignore the line
+   if (istr.fail())
+   {
+      LOG_ERROR_MESSAGE("unexpected io error reading history line: " + line);
+      return false;
+   }
+
+   return true;
+}
+
+bool matches(const HistoryEntry& entry,
+             const std::vector<std::string>& searchTerms)
+{
+   // look for each search term in the input
+   for (std::vector<std::string>::const_iterator it = searchTerms.begin();
+        it != searchTerms.end();
+        ++it)
+   {
+      if (!boost::algorithm::contains(entry.command, *it))
+         return false;
+   }
+
+   // had all of the search terms, return true
+   return true;
+}
+
+// distinct trigrams within a string (in ascending order)
+void trigrams(const std::string& str, std::vector<boost::uint32_t>* pTrigrams)
+{
+   pTrigrams->clear();
+   for (std::size_t i = 0; i + 3 <= str.size(); i++)
+   {
+      const unsigned char* p =
+            reinterpret_cast<const unsigned char*>(str.data() + i);
+      pTrigrams->push_back((p[0] << 16) | (p[1] << 8) | p[2]);
+   }
+   std::sort(pTrigrams->begin(), pTrigrams->end());
+   pTrigrams->erase(std::unique(pTrigrams->begin(), pTrigrams->end()),
+                    pTrigrams->end());
+}
+
+// orders entry indexes by command (then by index)
+class CommandLess
+{
+public:
+   explicit CommandLess(const std::vector<HistoryEntry>& entries)
+      : entries_(entries)
+   {
+   }
+
+   bool operator()(int a, int b) const
+   {
+      int result = entries_[a].command.compare(entries_[b].command);
+      return result < 0 || (result == 0 && a < b);
+   }
+
+   bool operator()(int a, const std::string& command) const
+   {
+      return entries_[a].command < command;
+   }
+
+private:
+   const std::vector<HistoryEntry>& entries_;
+};
+
+bool sizeLess(const std::vector<int>* pA, const std::vector<int>* pB)
+{
+   return pA->size() < pB->size();
+}
+
+// variable length encoding for the index file
+void writeVarint(boost::uint64_t value, std::string* pOutput)
+{
+   while (value >= 0x80)
+   {
+      pOutput->push_back(static_cast<char>((value & 0x7F) | 0x80));
+      value >>= 7;
+   }
+   pOutput->push_back(static_cast<char>(value));
+}
+
+bool readVarint(const std::string& input,
+                std::size_t* pPos,
+                boost::uint64_t* pValue)
+{
+   *pValue = 0;
+   for (int shift = 0; shift < 64; shift += 7)
+   {
+      if (*pPos >= input.size())
+         return false;
+
+      unsigned char byte = static_cast<unsigned char>(input[(*pPos)++]);
+      *pValue |= static_cast<boost::uint64_t>(byte & 0x7F) << shift;
+      if ((byte & 0x80) == 0)
+         return true;
+   }
+   return false;
+}
+
+// read a list of ascending indexes less than maxIndex (delta encoded)
+bool readIndexes(const std::string& input,
+                 std::size_t* pPos,
+                 boost::uint64_t maxIndex,
+                 bool deltaEncoded,
+                 std::vector<int>* pIndexes)
+{
+   boost::uint64_t count;
+   if (!readVarint(input, pPos, &count) || count > maxIndex)
+      return false;
+
+   pIndexes->reserve(count);
+   boost::uint64_t index = 0;
+   for (boost::uint64_t i = 0; i < count; i++)
+   {
+      boost::uint64_t value;
+      if (!readVarint(input, pPos, &value))
+         return false;
+
+      index = deltaEncoded ? index + value : value;
+      if (index >= maxIndex)
+         return false;
+
+      pIndexes->push_back(static_cast<int>(index));
+   }
+   return true;
+}
+
+void writeIndexes(const std::vector<int>& indexes,
+                  bool deltaEncoded,
+                  std::string* pOutput)
+{
+   writeVarint(indexes.size(), pOutput);
+   int previous = 0;
+   BOOST_FOREACH(int index, indexes)
+   {
+      writeVarint(deltaEncoded ? index - previous : index, pOutput);
+      previous = index;
+   }
+}
+
+} // anonymous namespace
+
+HistoryArchive::HistoryArchive()
+   : loaded_(false), indexDirty_(false), archiveSize_(0)
+{
+}
+
+Error HistoryArchive::add(const std::string& command)
+{
+   // write the entry to the file (it is read back and indexed incrementally
+   // when the archive is next accessed)
+   std::ostringstream ostrEntry ;
+   double currentTime = core::date_time::millisecondsSinceEpoch();
+   writeEntry(currentTime, command, &ostrEntry);
+   ostrEntry << std::endl;
+
+   LOCK_MUTEX(mutex_)
+   {
+      return appendToFile(historyDatabaseFilePath(), ostrEntry.str());
+   }
+   END_LOCK_MUTEX
+
+   // keep compiler happy
+   return Success();
+}
+
+int HistoryArchive::size() const
+{
+   LOCK_MUTEX(mutex_)
+   {
+      return entries().size();
+   }
+   END_LOCK_MUTEX
+
+   // keep compiler happy
+   return 0;
+}
+
+void HistoryArchive::subset(int startIndex,
+                            int endIndex,
+                            std::vector<HistoryEntry>* pEntries) const
+{
+   LOCK_MUTEX(mutex_)
+   {
+      const std::vector<HistoryEntry>& allEntries = entries();
+      int size = allEntries.size();
+      startIndex = std::max(0, std::min(startIndex, size));
+      endIndex = std::max(startIndex, std::min(endIndex, size));
+      std::copy(allEntries.begin() + startIndex,
+                allEntries.begin() + endIndex,
+                std::back_inserter(*pEntries));
+   }
+   END_LOCK_MUTEX
+}
+
+const std::vector<HistoryEntry>& HistoryArchive::entries() const
+{
+   FilePath historyDBPath = historyDatabaseFilePath();
+   boost::uint64_t archiveSize = historyDBPath.exists() ? historyDBPath.size()
+                                                        : 0;
+
+   // read the whole archive the first time and if it has been rewritten,
+   // otherwise just read anything which has been appended to it
+   if (!loaded_ || archiveSize < archiveSize_)
+      readArchive();
+   else if (archiveSize > archiveSize_)
+      readAppendedEntries(archiveSize);
+
+   return entries_;
+}
+
+void HistoryArchive::search(const std::vector<std::string>& searchTerms,
+                            std::size_t maxEntries,
+                            std::vector<HistoryEntry>* pMatches) const
+{
+   LOCK_MUTEX(mutex_)
+   {
+      const std::vector<HistoryEntry>& allEntries = entries();
+
+      // candidate entries must contain all of the trigrams of the search terms
+      std::vector<const std::vector<int>*> postings;
+      std::vector<Trigram> termTrigrams;
+      BOOST_FOREACH(const std::string& term, searchTerms)
+      {
+         trigrams(term, &termTrigrams);
+         BOOST_FOREACH(Trigram trigram, termTrigrams)
+         {
+            std::map<Trigram, std::vector<int> >::const_iterator it =
+                                                trigramIndex_.find(trigram);
+            if (it == trigramIndex_.end())
+               return;
+            postings.push_back(&(it->second));
+         }
+      }
+
+      // no search terms long enough to be indexed, examine all entries
+      if (postings.empty())
+      {
+         for (std::vector<HistoryEntry>::const_reverse_iterator
+                  it = allEntries.rbegin();
+                  it != allEntries.rend() && pMatches->size() < maxEntries;
+                  ++it)
+         {
+            if (matches(*it, searchTerms))
+               pMatches->push_back(*it);
+         }
+         return;
+      }
+
+      // walk the shortest posting list backwards (most recent first) checking
+      // that each entry is in the others and then that it really matches
+      std::sort(postings.begin(), postings.end(), sizeLess);
+      const std::vector<int>& candidates = *postings.front();
+      for (std::vector<int>::const_reverse_iterator it = candidates.rbegin();
+           it != candidates.rend() && pMatches->size() < maxEntries;
+           ++it)
+      {
+         bool candidate = true;
+         for (std::size_t i = 1; i < postings.size() && candidate; i++)
+            candidate = std::binary_search(postings[i]->begin(),
+                                           postings[i]->end(),
+                                           *it);
+
+         if (candidate && matches(allEntries[*it], searchTerms))
+            pMatches->push_back(allEntries[*it]);
+      }
+   }
+   END_LOCK_MUTEX
+}
+
+void HistoryArchive::searchByPrefix(const std::string& prefix,
+                                    std::size_t maxEntries,
+                                    std::vector<HistoryEntry>* pMatches) const
+{
+   LOCK_MUTEX(mutex_)
+   {
+      const std::vector<HistoryEntry>& allEntries = entries();
+
+      // everything matches an empty prefix
+      if (prefix.empty())
+      {
+         for (std::vector<HistoryEntry>::const_reverse_iterator
+                  it = allEntries.rbegin();
+                  it != allEntries.rend() && pMatches->size() < maxEntries;
+                  ++it)
+         {
+            pMatches->push_back(*it);
+         }
+         return;
+      }
+
+      // commands starting with the prefix are contiguous in the sorted index
+      CommandLess commandLess(allEntries);
+      std::vector<int> found;
+      for (std::vector<int>::const_iterator it =
+               std::lower_bound(sortedEntries_.begin(),
+                                sortedEntries_.end(),
+                                prefix,
+                                commandLess);
+           it != sortedEntries_.end() &&
+           boost::algorithm::starts_with(allEntries[*it].command, prefix);
+           ++it)
+      {
+         found.push_back(*it);
+      }
+      BOOST_FOREACH(int index, recentEntries_)
+      {
+         if (boost::algorithm::starts_with(allEntries[index].command, prefix))
+            found.push_back(index);
+      }
+
+      // most recent first
+      std::size_t count = std::min(maxEntries, found.size());
+      std::partial_sort(found.begin(),
+                        found.begin() + count,
+                        found.end(),
+                        std::greater<int>());
+      for (std::size_t i = 0; i < count; i++)
+         pMatches->push_back(allEntries[found[i]]);
+   }
+   END_LOCK_MUTEX
+}
+
+Error HistoryArchive::writeIndex() const
+{
+   LOCK_MUTEX(mutex_)
+   {
+      if (!loaded_ || !indexDirty_)
+         return Success();
+
+      sortRecentEntries();
+
+      std::string index(kIndexFormat);
+      writeVarint(archiveSize_, &index);
+      writeVarint(entries_.size(), &index);
+      writeVarint(trigramIndex_.size(), &index);
+      typedef std::map<Trigram, std::vector<int> >::value_type Posting;
+      BOOST_FOREACH(const Posting& posting, trigramIndex_)
+      {
+         writeVarint(posting.first, &index);
+         writeIndexes(posting.second, true, &index);
+      }
+      writeIndexes(sortedEntries_, false, &index);
+
+      Error error = writeStringToFile(historyIndexFilePath(), index);
+      if (error)
+         return error;
+
+      indexDirty_ = false;
+      return Success();
+   }
+   END_LOCK_MUTEX
+
+   // keep compiler happy
+   return Success();
+}
+
+void HistoryArchive::migrateRhistoryIfNecessary()
+{
+   // if the history database doesn't exist see if we can migrate the
+   // old .Rhistory file
+   FilePath historyDBPath = historyDatabaseFilePath();
+   if (!historyDBPath.exists())
+   {
+      Error error = writeCollectionToFile<r::session::ConsoleHistory>(
+                                                   historyDBPath,
+                                                   r::session::consoleHistory(),
+                                                   migratedHistoryEntry);
+
+      // log any error which occurs
+      if (error)
+         LOG_ERROR(error);
+   }
+}
+
+void HistoryArchive::readArchive() const
+{
+   clear();
+
+   // doesn't exist so empty history is valid
+   loaded_ = true;
+   FilePath historyDBPath = historyDatabaseFilePath();
+   if (!historyDBPath.exists())
+      return;
+
+   std::string data;
+   Error error = readStringFromFile(historyDBPath, &data);
+   if (error)
+   {
+      LOG_ERROR(error);
+      return;
+   }
+
+   std::vector<boost::uint64_t> endOffsets;
+   archiveSize_ = parseEntries(data, &endOffsets);
+
+   // use the persisted index for the entries it covers (if it is for
+   // this archive) and index any entries appended since
+   std::size_t indexedEntries = 0;
+   if (readIndex(endOffsets))
+   {
+      indexedEntries = sortedEntries_.size();
+      indexDirty_ = false;
+   }
+   else
+   {
+      trigramIndex_.clear();
+      sortedEntries_.clear();
+   }
+
+   for (std::size_t i = indexedEntries; i < entries_.size(); i++)
+      indexEntry(i);
+}
+
+void HistoryArchive::readAppendedEntries(boost::uint64_t archiveSize) const
+{
+   boost::shared_ptr<std::istream> pIfs;
+   Error error = historyDatabaseFilePath().open_r(&pIfs);
+   if (error)
+   {
+      LOG_ERROR(error);
+      return;
+   }
+
+   std::string data(archiveSize - archiveSize_, '\0');
+   pIfs->seekg(archiveSize_);
+   pIfs->read(&data[0], data.size());
+   data.resize(pIfs->gcount());
+
+   std::size_t firstNewEntry = entries_.size();
+   archiveSize_ += parseEntries(data, NULL);
+   for (std::size_t i = firstNewEntry; i < entries_.size(); i++)
+      indexEntry(i);
+}
+
+// parse the complete lines of the data into entries (returning the number
+// of bytes consumed) and optionally note the offset after each entry
+std::size_t HistoryArchive::parseEntries(
+                           const std::string& data,
+                           std::vector<boost::uint64_t>* pEndOffsets) const
+{
+   std::size_t pos = 0;
+   while (true)
+   {
+      std::size_t end = data.find('\n', pos);
+      if (end == std::string::npos)
+         break;
+
+      std::string line = data.substr(pos, end - pos);
+      if (!line.empty() && line[line.length() - 1] == '\r')
+         line.resize(line.length() - 1);
+      pos = end + 1;
+
+      HistoryEntry entry;
+      if (parseEntry(line, &entry))
+      {
+         entry.index = entries_.size();
+         entries_.push_back(entry);
+         if (pEndOffsets)
+            pEndOffsets->push_back(archiveSize_ + pos);
+      }
+   }
+   return pos;
+}
+
+// read the persisted index (returns false if it doesn't exist, is invalid,
+// or is for a different version of the archive)
+bool HistoryArchive::readIndex(
+                     const std::vector<boost::uint64_t>& endOffsets) const
+{
+   FilePath indexPath = historyIndexFilePath();
+   if (!indexPath.exists())
+      return false;
+
+   std::string index;
+   Error error = readStringFromFile(indexPath, &index);
+   if (error)
+   {
+      LOG_ERROR(error);
+      return false;
+   }
+
+   if (!boost::algorithm::starts_with(index, kIndexFormat))
+      return false;
+   std::size_t pos = ::strlen(kIndexFormat);
+
+   // the entries indexed must be a prefix of those in the archive
+   boost::uint64_t archiveSize, entryCount, trigramCount;
+   if (!readVarint(index, &pos, &archiveSize) ||
+       !readVarint(index, &pos, &entryCount) ||
+       !readVarint(index, &pos, &trigramCount))
+   {
+      return false;
+   }
+   if (entryCount > endOffsets.size())
+      return false;
+   if (archiveSize != (entryCount > 0 ? endOffsets[entryCount - 1] : 0))
+      return false;
+
+   for (boost::uint64_t i = 0; i < trigramCount; i++)
+   {
+      boost::uint64_t trigram;
+      if (!readVarint(index, &pos, &trigram))
+         return false;
+      std::vector<int>& posting =
+                     trigramIndex_[static_cast<Trigram>(trigram)];
+      if (!readIndexes(index, &pos, entryCount, true, &posting))
+         return false;
+   }
+
+   return readIndexes(index, &pos, entryCount, false, &sortedEntries_) &&
+          sortedEntries_.size() == entryCount;
+}
+
+void HistoryArchive::indexEntry(int index) const
+{
+   std::vector<Trigram> entryTrigrams;
+   trigrams(entries_[index].command, &entryTrigrams);
+   BOOST_FOREACH(Trigram trigram, entryTrigrams)
+   {
+      trigramIndex_[trigram].push_back(index);
+   }
+
+   recentEntries_.push_back(index);
+   if (recentEntries_.size() > kMaxRecentEntries)
+      sortRecentEntries();
+
+   indexDirty_ = true;
+}
+
+void HistoryArchive::sortRecentEntries() const
+{
+   if (recentEntries_.empty())
+      return;
+
+   CommandLess commandLess(entries_);
+   std::sort(recentEntries_.begin(), recentEntries_.end(), commandLess);
+   std::vector<int> merged;
+   merged.reserve(sortedEntries_.size() + recentEntries_.size());
+   std::merge(sortedEntries_.begin(), sortedEntries_.end(),
+              recentEntries_.begin(), recentEntries_.end(),
+              std::back_inserter(merged),
+              commandLess);
+   sortedEntries_.swap(merged);
+   recentEntries_.clear();
+}
+
+void HistoryArchive::clear() const
+{
+   loaded_ = false;
+   entries_.clear();
+   archiveSize_ = 0;
+   trigramIndex_.clear();
+   sortedEntries_.clear();
+   recentEntries_.clear();
+   indexDirty_ = true;
+}
+
+FilePath HistoryArchive::historyDatabaseFilePath()
+{
+   return module_context::userScratchPath().complete("history_database");
+}
+
+FilePath HistoryArchive::historyIndexFilePath()
+{
+   return module_context::userScratchPath().complete("history_index");
+}
+
+HistoryArchive& historyArchive()
+{
+   static HistoryArchive instance;
+   return instance;
+}
+
+} // namespace history
+} // namespace modules
+} // namesapce session
@@ -0,0 +1,131 @@
+/*
+ * SessionHistoryArchive.hpp
+ *
+ * Copyright (C) 2009-11 by RStudio, Inc.
+ *
+ * This program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef SESSION_HISTORY_ARCHIVE_HPP
+#define SESSION_HISTORY_ARCHIVE_HPP
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <boost/utility.hpp>
+#include <boost/cstdint.hpp>
+
+#include <core/BoostThread.hpp>
+
+namespace core {
+   class Error;
+   class FilePath;
+}
+
+namespace session {
+namespace modules {
+namespace history {
+
+struct HistoryEntry
+{
+   HistoryEntry() : index(0), timestamp(0) {}
+   HistoryEntry(int index, double timestamp, const std::string& command)
+      : index(index), timestamp(timestamp), command(command)
+   {
+   }
+   int index;
+   double timestamp;
+   std::string command;
+};
+
+// Archive of all of the commands entered by the user (in all sessions),
+// stored in an append-only file within the user scratch path.
+//
+// Entries are read once and kept in memory along with two indexes: an
+// inverted index of the trigrams within each command (for multi-term
+// substring search) and the entries in command order (for prefix search).
+// Commands appended to the file (by this or any other session) are read
+// and indexed incrementally. The indexes are persisted alongside the
+// archive so that they needn't be rebuilt when it is next read.
+//
+// The archive is searched from worker threads as well as the main thread
+// so access to it is serialized.
+class HistoryArchive : boost::noncopyable
+{
+private:
+   HistoryArchive();
+   friend HistoryArchive& historyArchive();
+
+public:
+   core::Error add(const std::string& command);
+
+   int size() const;
+
+   // entries from startIndex (inclusive) to endIndex (exclusive)
+   void subset(int startIndex,
+               int endIndex,
+               std::vector<HistoryEntry>* pEntries) const;
+
+   // entries containing all of the search terms (most recent first)
+   void search(const std::vector<std::string>& searchTerms,
+               std::size_t maxEntries,
+               std::vector<HistoryEntry>* pMatches) const;
+
+   // entries starting with the prefix (most recent first)
+   void searchByPrefix(const std::string& prefix,
+                       std::size_t maxEntries,
+                       std::vector<HistoryEntry>* pMatches) const;
+
+   // persist the indexes (if they have changed since they were read)
+   core::Error writeIndex() const;
+
+   static void migrateRhistoryIfNecessary();
+
+private:
+   typedef boost::uint32_t Trigram;
+
+   const std::vector<HistoryEntry>& entries() const;
+   void readArchive() const;
+   void readAppendedEntries(boost::uint64_t archiveSize) const;
+   std::size_t parseEntries(const std::string& data,
+                            std::vector<boost::uint64_t>* pEndOffsets) const;
+   bool readIndex(const std::vector<boost::uint64_t>& endOffsets) const;
+   void indexEntry(int index) const;
+   void sortRecentEntries() const;
+   void clear() const;
+
+   static core::FilePath historyDatabaseFilePath();
+   static core::FilePath historyIndexFilePath();
+
+private:
+   mutable boost::mutex mutex_;
+   mutable bool loaded_;
+   mutable bool indexDirty_;
+
+   // entries and the number of bytes of the archive they were read from
+   mutable std::vector<HistoryEntry> entries_;
+   mutable boost::uint64_t archiveSize_;
+
+   // for each trigram, the (ascending) indexes of entries containing it
+   mutable std::map<Trigram, std::vector<int> > trigramIndex_;
+
+   // indexes of entries in command order (entries added since the last
+   // sort are kept separately in recentEntries_ until there are enough of
+   // them to be worth merging)
+   mutable std::vector<int> sortedEntries_;
+   mutable std::vector<int> recentEntries_;
+};
+
+HistoryArchive& historyArchive();
+
+} // namespace history
+} // namespace modules
+} // namesapce session
+
+#endif // SESSION_HISTORY_ARCHIVE_HPP
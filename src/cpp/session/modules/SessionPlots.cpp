@@ -391,20 +391,20 @@ void setImageFileResponse(const FilePath& imageFilePath,
    }
 }
 
-void setTemporaryFileResponse(const FilePath& filePath, 
-                              const http::Request& request, 
-                              http::Response* pResponse)
+void setPngResponse(const std::string& image,
+                    const http::Request& request,
+                    http::Response* pResponse)
 {
-   // no cache (dynamic content)
-   pResponse->setNoCacheHeaders();
-   
-   // return the file
-   pResponse->setFile(filePath, request);
-   
-   // delete the file
-   Error error = filePath.remove();
+   pResponse->setContentType("image/png");
+   if (request.acceptsEncoding(http::kGzipEncoding))
+      pResponse->setContentEncoding(http::kGzipEncoding);
+   Error error = pResponse->setBody(image);
    if (error)
+   {
       LOG_ERROR(error);
+      pResponse->setError(http::status::InternalServerError,
+                          error.code().message());
+   }
 }
 
 void handleZoomRequest(const http::Request& request, http::Response* pResponse)
@@ -470,27 +470,22 @@ void handleZoomPngRequest(const http::Request& request,
    if (!extractSizeParams(request, 100, 3000, &width, &height, pResponse))
      return ;
 
-   // generate the file
+   // render the image (or get it from the cache)
    using namespace r::session::graphics;
-   FilePath imagePath = module_context::tempFile("plot", "png");
-   Error saveError = graphics::display().savePlotAsImage(imagePath,
-                                                         kPngFormat,
-                                                         width,
-                                                         height);
-   if (saveError)
+   std::string image;
+   Error renderError = graphics::display().renderPlotImage(kPngFormat,
+                                                           width,
+                                                           height,
+                                                           &image);
+   if (renderError)
    {
       pResponse->setError(http::status::InternalServerError, 
-                          saveError.code().message());
+                          renderError.code().message());
       return;
    }
    
    // send it back
-   setImageFileResponse(imagePath, request, pResponse);
-   
-   // delete the temp file
-   Error error = imagePath.remove();
-   if (error)
-      LOG_ERROR(error);
+   setPngResponse(image, request, pResponse);
 }
 
 void handlePngRequest(const http::Request& request, 
@@ -501,13 +496,13 @@ void handlePngRequest(const http::Request& request,
    if (!extractSizeParams(request, 100, 2000, &width, &height, pResponse))
       return ;
 
-   // generate the image
+   // render the image (or get it from the cache)
    using namespace r::session;
-   FilePath imagePath = module_context::tempFile("plot", "png");
-   Error error = graphics::display().savePlotAsImage(imagePath,
-                                                      graphics::kPngFormat,
+   std::string image;
+   Error error = graphics::display().renderPlotImage(graphics::kPngFormat,
                                                       width,
-                                                      height);
+                                                      height,
+                                                      &image);
    if (error)
    {
       pResponse->setError(http::status::InternalServerError,
@@ -520,12 +515,12 @@ void handlePngRequest(const http::Request& request,
    if (attachment)
    {
       pResponse->setHeader("Content-Disposition",
-                           "attachment; filename=rstudio-plot" +
-                           imagePath.extension());
+                           "attachment; filename=rstudio-plot.png");
    }
 
-   // return it
-   setTemporaryFileResponse(imagePath, request, pResponse);
+   // return it (no cache since this is dynamic content)
+   pResponse->setNoCacheHeaders();
+   setPngResponse(image, request, pResponse);
 }
 
 
@@ -31,6 +31,7 @@
 #include <core/FileInfo.hpp>
 #include <core/FileSerializer.hpp>
 #include <core/StringUtils.hpp>
+#include <core/Thread.hpp>
 
 #include <core/json/JsonRpc.hpp>
 
@@ -85,32 +86,51 @@ public:
                  new r_util::RSourceIndex(pDoc->path(), pDoc->contents()));
 
       // insert it
-      indexes_[pDoc->id()] = pIndex;
+      LOCK_MUTEX(mutex_)
+      {
+         indexes_[pDoc->id()] = pIndex;
+      }
+      END_LOCK_MUTEX
    }
 
    void remove(const std::string& id)
    {
-      indexes_.erase(id);
+      LOCK_MUTEX(mutex_)
+      {
+         indexes_.erase(id);
+      }
+      END_LOCK_MUTEX
    }
 
    void removeAll()
    {
-      indexes_.clear();
+      LOCK_MUTEX(mutex_)
+      {
+         indexes_.clear();
+      }
+      END_LOCK_MUTEX
    }
 
+   // (called from code search on worker threads, the indexes themselves
+   // are never modified once created)
    std::vector<boost::shared_ptr<r_util::RSourceIndex> > indexes()
    {
       std::vector<boost::shared_ptr<r_util::RSourceIndex> > indexes;
-      BOOST_FOREACH(const IndexMap::value_type& index, indexes_)
+      LOCK_MUTEX(mutex_)
       {
-         indexes.push_back(index.second);
+         BOOST_FOREACH(const IndexMap::value_type& index, indexes_)
+         {
+            indexes.push_back(index.second);
+         }
       }
+      END_LOCK_MUTEX
       return indexes;
    }
 
 private:
    typedef std::map<std::string, boost::shared_ptr<r_util::RSourceIndex> >
                                                                     IndexMap;
+   boost::mutex mutex_;
    IndexMap indexes_;
 };
 
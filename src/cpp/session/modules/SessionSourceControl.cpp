@@ -11,20 +11,30 @@
  *
  */
 #include "SessionSourceControl.hpp"
+#include "SessionCodeSearch.hpp"
+
+#include <set>
+#include <ctime>
+
+#include <sys/stat.h>
 
 #include <boost/algorithm/string.hpp>
 #include <boost/algorithm/string/trim.hpp>
 #include <boost/algorithm/string/split.hpp>
 #include <boost/algorithm/string/predicate.hpp>
+#include <boost/bind.hpp>
+#include <boost/cstdint.hpp>
 #include <boost/foreach.hpp>
 #include <boost/function.hpp>
 #include <boost/lexical_cast.hpp>
 #include <boost/optional.hpp>
 #include <boost/regex.hpp>
+#include <boost/shared_ptr.hpp>
 
 #include <core/json/JsonRpc.hpp>
 #include <core/system/System.hpp>
 #include <core/system/Process.hpp>
+#include <core/system/FileMonitor.hpp>
 #include <core/Exec.hpp>
 #include <core/FileSerializer.hpp>
 #include <core/Scope.hpp>
@@ -150,9 +160,9 @@ public:
       return Success();
    }
 
-   core::Error runCommand(const std::string& command,
-                          const std::vector<std::string>& args,
-                          std::string* pOutput)
+   // command line which runs the command from the root directory
+   std::string shellCommand(const std::string& command,
+                            const std::vector<std::string>& args)
    {
       std::string cmd("cd ");
       cmd.append(string_utils::bash_escape(root_));
@@ -165,9 +175,16 @@ public:
          cmd.append(" ");
          cmd.append(string_utils::bash_escape(*it));
       }
+      return cmd;
+   }
 
+   core::Error runCommand(const std::string& command,
+                          const std::vector<std::string>& args,
+                          std::string* pOutput)
+   {
       core::system::ProcessResult result;
-      Error error = core::system::runCommand(cmd, &result);
+      Error error = core::system::runCommand(shellCommand(command, args),
+                                             &result);
       if (error)
          return error;
 
@@ -237,24 +254,20 @@ public:
    VCS id() { return VCSGit; }
    std::string name() { return "Git"; }
 
-   core::Error status(const FilePath& dir, StatusResult* pStatusResult)
+   static std::vector<std::string> statusArgs(const FilePath& dir)
    {
-      using namespace boost;
-
-      std::vector<FileWithStatus> files;
-
       std::vector<std::string> args;
       args.push_back("status");
       args.push_back("--porcelain");
       args.push_back("--");
       args.push_back(string_utils::utf8ToSystem(dir.absolutePath()));
+      return args;
+   }
 
-      std::vector<std::string> lines;
-      Error error = runCommand("git", args, &lines);
-      if (error)
-         return error;
-
-      for (std::vector<std::string>::iterator it = lines.begin();
+   void parseStatus(const std::vector<std::string>& lines,
+                    std::vector<FileWithStatus>* pFiles)
+   {
+      for (std::vector<std::string>::const_iterator it = lines.begin();
            it != lines.end();
            it++)
       {
@@ -270,9 +283,19 @@ public:
             filePath = filePath.substr(0, filePath.size() - 1);
          file.path = root_.childPath(string_utils::systemToUtf8(filePath));
 
-         files.push_back(file);
+         pFiles->push_back(file);
       }
+   }
+
+   core::Error status(const FilePath& dir, StatusResult* pStatusResult)
+   {
+      std::vector<std::string> lines;
+      Error error = runCommand("git", statusArgs(dir), &lines);
+      if (error)
+         return error;
 
+      std::vector<FileWithStatus> files;
+      parseStatus(lines, &files);
       *pStatusResult = StatusResult(files);
 
       return Success();
@@ -698,6 +721,705 @@ public:
    }
 };
 
+boost::uint32_t readIndexUInt32(const std::string& data, std::size_t offset)
+{
+   const unsigned char* p =
+         reinterpret_cast<const unsigned char*>(data.data() + offset);
+   return (static_cast<boost::uint32_t>(p[0]) << 24) |
+          (static_cast<boost::uint32_t>(p[1]) << 16) |
+          (static_cast<boost::uint32_t>(p[2]) << 8) |
+          static_cast<boost::uint32_t>(p[3]);
+}
+
+boost::uint16_t readIndexUInt16(const std::string& data, std::size_t offset)
+{
+   const unsigned char* p =
+         reinterpret_cast<const unsigned char*>(data.data() + offset);
+   return static_cast<boost::uint16_t>((p[0] << 8) | p[1]);
+}
+
+// Stat data recorded for each of the entries of the git index (see
+// Documentation/technical/index-format.txt in the git sources). This is
+// enough to tell whether a working tree file has changed since it was
+// staged without running git. Versions 2 through 4 of the index are
+// supported (version 4 prefix compresses the paths of its entries)
+class GitIndex
+{
+public:
+   struct Entry
+   {
+      Entry()
+         : ctime(0), mtime(0), ino(0), mode(0), size(0), unmerged(false)
+      {
+      }
+
+      // read the stat data of a working tree file (false if it doesn't
+      // exist). the mode is normalized as git records it
+      static bool readStat(const FilePath& filePath, Entry* pEntry)
+      {
+         std::string path = string_utils::utf8ToSystem(
+                                                filePath.absolutePath());
+#ifndef _WIN32
+         struct ::stat st;
+         if (::lstat(path.c_str(), &st) != 0)
+            return false;
+         if (S_ISLNK(st.st_mode))
+            pEntry->mode = 0120000;
+         else
+            pEntry->mode = (st.st_mode & S_IXUSR) ? 0100755 : 0100644;
+#else
+         struct ::stat st;
+         if (::stat(path.c_str(), &st) != 0)
+            return false;
+         pEntry->mode = 0100644;
+#endif
+         pEntry->ctime = static_cast<boost::uint32_t>(st.st_ctime);
+         pEntry->mtime = static_cast<boost::uint32_t>(st.st_mtime);
+         pEntry->ino = static_cast<boost::uint32_t>(st.st_ino);
+         pEntry->size = static_cast<boost::uint32_t>(st.st_size);
+         return true;
+      }
+
+      // compare stat data the way git does (inodes and the executable bit
+      // aren't meaningful on windows)
+      bool statMatches(const Entry& other) const
+      {
+#ifndef _WIN32
+         if (ino != other.ino || mode != other.mode)
+            return false;
+#else
+         if ((mode & 0170000) != (other.mode & 0170000))
+            return false;
+#endif
+         return ctime == other.ctime &&
+                mtime == other.mtime &&
+                size == other.size;
+      }
+
+      boost::uint32_t ctime;  // seconds since epoch
+      boost::uint32_t mtime;  // seconds since epoch
+      boost::uint32_t ino;    // truncated to 32 bits
+      boost::uint32_t mode;
+      boost::uint32_t size;   // truncated to 32 bits
+      bool unmerged;
+   };
+
+public:
+   GitIndex() : lastWriteTime_(0) {}
+
+   // the write time of the index is recorded even if it can't be parsed
+   // (so that changes to it can still be detected)
+   Error read(const FilePath& indexFile)
+   {
+      entries_.clear();
+      lastWriteTime_ = 0;
+
+      // a repository has no index until something is first staged
+      if (!indexFile.exists())
+         return Success();
+
+      lastWriteTime_ = indexFile.lastWriteTime();
+      std::string data;
+      Error error = readStringFromFile(indexFile, &data);
+      if (error)
+         return error;
+
+      error = parse(data);
+      if (error)
+      {
+         entries_.clear();
+         error.addProperty("path", indexFile.absolutePath());
+         return error;
+      }
+
+      return Success();
+   }
+
+   // find the entry for a path relative to the root of the repository
+   const Entry* find(const std::string& path) const
+   {
+      std::map<std::string, Entry>::const_iterator it = entries_.find(path);
+      if (it != entries_.end())
+         return &(it->second);
+      else
+         return NULL;
+   }
+
+   std::time_t lastWriteTime() const { return lastWriteTime_; }
+
+private:
+   Error parse(const std::string& data)
+   {
+      if (data.size() < 12 || data.compare(0, 4, "DIRC") != 0)
+         return formatError();
+
+      boost::uint32_t version = readIndexUInt32(data, 4);
+      if (version < 2 || version > 4)
+         return formatError();
+
+      // each entry is: ctime, mtime, dev, ino, mode, uid, gid, size, sha1,
+      // flags, (extended flags,) and its path. before version 4 the path
+      // is nul terminated and padded so that the entry is a multiple of 8
+      // bytes. version 4 entries aren't padded and their path is the
+      // previous entry's path less a (variable width) number of trailing
+      // bytes followed by a nul terminated suffix
+      const std::size_t kFlagsOffset = 60;
+      boost::uint32_t count = readIndexUInt32(data, 8);
+      std::size_t offset = 12;
+      std::string path;
+      for (boost::uint32_t i = 0; i < count; i++)
+      {
+         if (offset + kFlagsOffset + 2 > data.size())
+            return formatError();
+
+         Entry entry;
+         entry.ctime = readIndexUInt32(data, offset);
+         entry.mtime = readIndexUInt32(data, offset + 8);
+         entry.ino = readIndexUInt32(data, offset + 20);
+         entry.mode = readIndexUInt32(data, offset + 24);
+         entry.size = readIndexUInt32(data, offset + 36);
+         boost::uint16_t flags = readIndexUInt16(data, offset + kFlagsOffset);
+         entry.unmerged = (flags & 0x3000) != 0;
+
+         std::size_t pathOffset = offset + kFlagsOffset + 2;
+         if (flags & 0x4000)
+            pathOffset += 2;
+
+         if (version == 4)
+         {
+            std::size_t strip;
+            if (!readIndexVarint(data, &pathOffset, &strip) ||
+                strip > path.size())
+            {
+               return formatError();
+            }
+            path.erase(path.size() - strip);
+         }
+         else
+         {
+            path.clear();
+         }
+
+         std::size_t pathEnd = data.find('\0', pathOffset);
+         if (pathEnd == std::string::npos)
+            return formatError();
+         path.append(data, pathOffset, pathEnd - pathOffset);
+
+         // unmerged paths have an entry for each stage
+         Entry& existing = entries_[path];
+         entry.unmerged = entry.unmerged || existing.unmerged;
+         existing = entry;
+
+         if (version == 4)
+            offset = pathEnd + 1;
+         else
+            offset += (pathEnd - offset + 8) & ~static_cast<std::size_t>(7);
+      }
+
+      return Success();
+   }
+
+   // git's offset encoding: 7 bits per byte, most significant first, with
+   // each continued byte adding one (so encodings are unique)
+   static bool readIndexVarint(const std::string& data,
+                               std::size_t* pOffset,
+                               std::size_t* pValue)
+   {
+      if (*pOffset >= data.size())
+         return false;
+
+      unsigned char c = static_cast<unsigned char>(data[(*pOffset)++]);
+      std::size_t value = c & 0x7F;
+      while (c & 0x80)
+      {
+         if (*pOffset >= data.size() || value > (data.size() >> 7))
+            return false;
+         c = static_cast<unsigned char>(data[(*pOffset)++]);
+         value = ((value + 1) << 7) | (c & 0x7F);
+      }
+
+      *pValue = value;
+      return true;
+   }
+
+   static Error formatError()
+   {
+      return systemError(boost::system::errc::protocol_error,
+                         ERROR_LOCATION);
+   }
+
+private:
+   std::map<std::string, Entry> entries_;
+   std::time_t lastWriteTime_;
+};
+
+// Status of the files in the repository, cached so that listing files and
+// vcs_full_status don't need to run the vcs command line tool.
+//
+// For git the status of the whole repository is read once and then kept up
+// to date from file monitor events: the working tree status of a changed
+// file is recomputed by comparing it with its stat data in .git/index.
+// Changes this can't account for (a rewritten index, new files which might
+// be ignored, changes to directories) mark the status stale, in which case
+// git status is run in the background and the current status is served
+// until it completes (its output is parsed and the index re-read by a
+// background task). If the index can't be parsed changed files can't be
+// resolved natively, so any change marks the status stale and it is
+// refreshed at most every few seconds.
+//
+// Subversion reports status a directory at a time so its results are
+// cached per directory and discarded when a file within the directory
+// changes.
+class StatusCache : boost::noncopyable
+{
+public:
+   StatusCache()
+      : enabled_(false), valid_(false), stale_(false), refreshing_(false),
+        generation_(0), nativeStatus_(true), lastRefreshTime_(0),
+        ignoreWriteTime_(0)
+   {
+   }
+
+   // caching is only enabled once the repository is being monitored
+   void setEnabled(bool enabled)
+   {
+      enabled_ = enabled;
+      nativeStatus_ = true;
+      invalidate();
+   }
+
+   // discard the cached status (the next request reads it synchronously)
+   void invalidate()
+   {
+      valid_ = false;
+      stale_ = false;
+      refreshing_ = false;
+      generation_++;
+      files_.clear();
+      directories_.clear();
+   }
+
+   Error status(const FilePath& dir, StatusResult* pStatusResult)
+   {
+      if (!enabled_)
+         return s_pVcsImpl_->status(dir, pStatusResult);
+
+      if (gitImpl() == NULL)
+         return directoryStatus(dir, pStatusResult);
+
+      FilePath root = s_pVcsImpl_->root();
+      if (!dir.isWithin(root))
+      {
+         *pStatusResult = StatusResult();
+         return Success();
+      }
+
+      Error error = ensureStatus();
+      if (error)
+         return error;
+
+      // entries within the directory are contiguous in the map
+      std::vector<FileWithStatus> files;
+      std::string prefix = dir.absolutePath();
+      if (dir.absolutePath() != root.absolutePath())
+         prefix.append("/");
+      std::map<std::string, VCSStatus>::const_iterator it =
+                                                   files_.lower_bound(prefix);
+      for (; it != files_.end() &&
+             boost::algorithm::starts_with(it->first, prefix); ++it)
+      {
+         FileWithStatus file;
+         file.status = it->second;
+         file.path = FilePath(it->first);
+         files.push_back(file);
+      }
+
+      *pStatusResult = StatusResult(files);
+      return Success();
+   }
+
+   void onFilesChanged(const std::vector<core::system::FileChangeEvent>& events)
+   {
+      if (!enabled_ || !valid_)
+         return;
+
+      BOOST_FOREACH(const core::system::FileChangeEvent& event, events)
+      {
+         if (gitImpl() != NULL)
+            updateFileStatus(event.fileInfo());
+         else
+            discardDirectoryStatus(event.fileInfo());
+      }
+   }
+
+   // start a refresh if the index or .gitignore has been rewritten or
+   // status is stale
+   void checkForChanges()
+   {
+      if (!enabled_ || !valid_ || gitImpl() == NULL)
+         return;
+
+      if (indexFile().lastWriteTime() != index_.lastWriteTime() ||
+          ignoreFile().lastWriteTime() != ignoreWriteTime_)
+      {
+         stale_ = true;
+      }
+
+      if (!stale_ || refreshing_)
+         return;
+
+      if (nativeStatus_ ||
+          std::time(NULL) - lastRefreshTime_ >= kRefreshIntervalSeconds)
+      {
+         refreshInBackground();
+      }
+   }
+
+private:
+   static GitVCSImpl* gitImpl()
+   {
+      return dynamic_cast<GitVCSImpl*>(s_pVcsImpl_.get());
+   }
+
+   static FilePath indexFile()
+   {
+      return s_pVcsImpl_->root().childPath(".git/index");
+   }
+
+   static FilePath ignoreFile()
+   {
+      return s_pVcsImpl_->root().childPath(".gitignore");
+   }
+
+   Error ensureStatus()
+   {
+      if (valid_)
+      {
+         checkForChanges();
+         return Success();
+      }
+
+      lastRefreshTime_ = std::time(NULL);
+      ignoreWriteTime_ = ignoreFile().lastWriteTime();
+
+      StatusResult statusResult;
+      Error error = s_pVcsImpl_->status(s_pVcsImpl_->root(), &statusResult);
+      if (error)
+         return error;
+
+      // read the index after status (git status may refresh it)
+      GitIndex index;
+      Error indexError = index.read(indexFile());
+      setStatus(statusResult.files(), index, indexError);
+      valid_ = true;
+      return Success();
+   }
+
+   void setStatus(const std::vector<FileWithStatus>& files,
+                  const GitIndex& index,
+                  const Error& indexError)
+   {
+      files_.clear();
+      BOOST_FOREACH(const FileWithStatus& file, files)
+      {
+         files_[file.path.absolutePath()] = file.status;
+      }
+
+      // if the index can't be read (e.g. a newer format) changed files are
+      // no longer resolved natively (only reported once)
+      if (indexError && nativeStatus_)
+      {
+         LOG_ERROR(indexError);
+         nativeStatus_ = false;
+      }
+
+      index_ = index;
+   }
+
+   void refreshInBackground()
+   {
+      GitVCSImpl* pGit = gitImpl();
+      std::string command = pGit->shellCommand(
+                     "git", GitVCSImpl::statusArgs(s_pVcsImpl_->root()));
+
+      Error error = module_context::processSupervisor().runCommand(
+                     command,
+                     boost::bind(&StatusCache::onRefreshCompleted,
+                                 this, generation_, _1));
+      if (error)
+      {
+         LOG_ERROR(error);
+         invalidate();
+         return;
+      }
+
+      stale_ = false;
+      refreshing_ = true;
+      lastRefreshTime_ = std::time(NULL);
+      ignoreWriteTime_ = ignoreFile().lastWriteTime();
+   }
+
+   struct RefreshResult
+   {
+      std::vector<FileWithStatus> files;
+      GitIndex index;
+      Error indexError;
+   };
+
+   void onRefreshCompleted(int generation,
+                           const core::system::ProcessResult& result)
+   {
+      // the cache was invalidated while git was running
+      if (generation != generation_)
+         return;
+
+      if (result.exitStatus != 0)
+      {
+         invalidate();
+         return;
+      }
+
+      // parse the status and read the index in the background (we are
+      // still refreshing until the results are applied)
+      boost::shared_ptr<RefreshResult> pResult(new RefreshResult());
+      module_context::backgroundTaskScheduler().schedule(
+               boost::bind(&StatusCache::readRefreshResult,
+                           gitImpl(), indexFile(), result.stdOut, pResult),
+               core::thread::BackgroundTaskScheduler::PriorityHigh,
+               boost::bind(&StatusCache::onRefreshRead,
+                           this, generation, pResult));
+   }
+
+   // runs on a background thread (so only touches the passed result)
+   static void readRefreshResult(GitVCSImpl* pGit,
+                                 const FilePath& indexFile,
+                                 const std::string& output,
+                                 boost::shared_ptr<RefreshResult> pResult)
+   {
+      std::vector<std::string> lines;
+      boost::algorithm::split(lines, output,
+                              boost::algorithm::is_any_of("\r\n"));
+      pGit->parseStatus(lines, &(pResult->files));
+
+      pResult->indexError = pResult->index.read(indexFile);
+   }
+
+   void onRefreshRead(int generation, boost::shared_ptr<RefreshResult> pResult)
+   {
+      // the cache was invalidated while the results were being read
+      if (generation != generation_)
+         return;
+
+      refreshing_ = false;
+
+      std::map<std::string, VCSStatus> previous;
+      previous.swap(files_);
+      setStatus(pResult->files, pResult->index, pResult->indexError);
+
+      // notify the client of files whose status has changed
+      std::set<std::string> changed;
+      typedef std::map<std::string, VCSStatus>::value_type Status;
+      BOOST_FOREACH(const Status& status, previous)
+      {
+         if (currentStatus(status.first) != status.second.status())
+            changed.insert(status.first);
+      }
+      BOOST_FOREACH(const Status& status, files_)
+      {
+         if (previous.find(status.first) == previous.end())
+            changed.insert(status.first);
+      }
+
+      if (changed.empty())
+         return;
+
+      BOOST_FOREACH(const std::string& path, changed)
+      {
+         FilePath filePath(path);
+         if (!filePath.exists())
+            continue;
+
+         using core::system::FileChangeEvent;
+         module_context::enqueFileChangedEvent(
+                  FileChangeEvent(FileChangeEvent::FileModified,
+                                  FileInfo(filePath)),
+                  currentStatus(path));
+      }
+      module_context::enqueClientEvent(ClientEvent(client_events::kVcsRefresh));
+   }
+
+   std::string currentStatus(const std::string& path) const
+   {
+      std::map<std::string, VCSStatus>::const_iterator it = files_.find(path);
+      if (it != files_.end())
+         return it->second.status();
+      else
+         return std::string();
+   }
+
+   bool withinUntrackedDirectory(const FilePath& filePath) const
+   {
+      FilePath root = s_pVcsImpl_->root();
+      for (FilePath dir = filePath.parent();
+           dir.isWithin(root) && dir.absolutePath() != root.absolutePath();
+           dir = dir.parent())
+      {
+         if (currentStatus(dir.absolutePath()) == "??")
+            return true;
+      }
+      return false;
+   }
+
+   void updateFileStatus(const FileInfo& fileInfo)
+   {
+      FilePath filePath(fileInfo.absolutePath());
+      FilePath root = s_pVcsImpl_->root();
+      if (!filePath.isWithin(root))
+         return;
+
+      // results which arrive from a refresh may predate this change
+      if (refreshing_ || fileInfo.isDirectory() || !nativeStatus_)
+      {
+         stale_ = true;
+         return;
+      }
+
+      // changes within untracked directories don't affect their status
+      if (withinUntrackedDirectory(filePath))
+         return;
+
+      std::string path = filePath.absolutePath();
+      std::string current = currentStatus(path);
+      GitIndex::Entry stat;
+      bool exists = GitIndex::Entry::readStat(filePath, &stat);
+
+      const GitIndex::Entry* pEntry =
+                        index_.find(filePath.relativePath(root));
+      if (pEntry == NULL)
+      {
+         // untracked files which are still untracked or have been removed
+         // are known -- otherwise only git knows whether a file is ignored
+         if (current == "??" && exists)
+            return;
+         else if ((current.empty() || current == "??") && !exists)
+            files_.erase(path);
+         else
+            stale_ = true;
+         return;
+      }
+
+      if (pEntry->unmerged)
+      {
+         stale_ = true;
+         return;
+      }
+
+      char worktreeStatus = 'D';
+      if (exists)
+      {
+         // files written in the same second as the index may have changed
+         // without their stat data changing (git compares their contents)
+         if (stat.mtime >= static_cast<boost::uint32_t>(index_.lastWriteTime()))
+         {
+            stale_ = true;
+            return;
+         }
+
+         worktreeStatus = stat.statMatches(*pEntry) ? ' ' : 'M';
+      }
+
+      std::string status;
+      status.push_back(current.size() == 2 ? current[0] : ' ');
+      status.push_back(worktreeStatus);
+      if (status == "  ")
+         files_.erase(path);
+      else
+         files_[path] = VCSStatus(status);
+   }
+
+   Error directoryStatus(const FilePath& dir, StatusResult* pStatusResult)
+   {
+      std::map<std::string, StatusResult>::const_iterator it =
+                                    directories_.find(dir.absolutePath());
+      if (it != directories_.end())
+      {
+         *pStatusResult = it->second;
+         return Success();
+      }
+
+      Error error = s_pVcsImpl_->status(dir, pStatusResult);
+      if (error)
+         return error;
+
+      directories_[dir.absolutePath()] = *pStatusResult;
+      valid_ = true;
+      return Success();
+   }
+
+   void discardDirectoryStatus(const FileInfo& fileInfo)
+   {
+      FilePath filePath(fileInfo.absolutePath());
+      directories_.erase(filePath.parent().absolutePath());
+      if (fileInfo.isDirectory())
+         directories_.erase(filePath.absolutePath());
+   }
+
+private:
+   bool enabled_;
+   bool valid_;
+   bool stale_;
+   bool refreshing_;
+   int generation_;
+
+   // git
+   static const int kRefreshIntervalSeconds = 3;
+   std::map<std::string, VCSStatus> files_;
+   GitIndex index_;
+   bool nativeStatus_;
+   std::time_t lastRefreshTime_;
+   std::time_t ignoreWriteTime_;
+
+   // other vcs (by directory)
+   std::map<std::string, StatusResult> directories_;
+};
+
+StatusCache s_statusCache;
+
+// is the repository monitored by the project's file monitor (rather than
+// one of its own)
+bool s_usesProjectMonitor = false;
+
+bool statusMonitorFilter(const FileInfo& fileInfo)
+{
+   // hidden files are excluded (e.g. .git and .Rproj.user) other than
+   // .gitignore (which determines which files are reported as untracked)
+   FilePath filePath(fileInfo.absolutePath());
+   return !filePath.isHidden() || filePath.filename() == ".gitignore";
+}
+
+void onStatusMonitorRegistered(core::system::file_monitor::Handle,
+                               const tree<FileInfo>&)
+{
+   s_statusCache.setEnabled(true);
+}
+
+void onStatusMonitorError(const Error& error)
+{
+   LOG_ERROR(error);
+   s_statusCache.setEnabled(false);
+}
+
+void onStatusFilesChanged(
+                  const std::vector<core::system::FileChangeEvent>& events)
+{
+   s_statusCache.onFilesChanged(events);
+}
+
+void onDetectChanges(module_context::ChangeSource source)
+{
+   s_statusCache.checkForChanges();
+}
+
 std::vector<FilePath> resolveAliasedPaths(json::Array paths)
 {
    std::vector<FilePath> parsedPaths;
@@ -737,7 +1459,26 @@ VCSStatus StatusResult::getStatus(const FilePath& fileOrDirectory) const
 
 core::Error status(const FilePath& dir, StatusResult* pStatusResult)
 {
-   return s_pVcsImpl_->status(dir, pStatusResult);
+   return s_statusCache.status(dir, pStatusResult);
+}
+
+void onProjectMonitorRegistered()
+{
+   if (s_usesProjectMonitor)
+      s_statusCache.setEnabled(true);
+}
+
+void onProjectMonitorError()
+{
+   if (s_usesProjectMonitor)
+      s_statusCache.setEnabled(false);
+}
+
+void onProjectFilesChanged(
+                  const std::vector<core::system::FileChangeEvent>& events)
+{
+   if (s_usesProjectMonitor)
+      s_statusCache.onFilesChanged(events);
 }
 
 Error fileStatus(const FilePath& filePath, VCSStatus* pStatus)
@@ -758,6 +1499,7 @@ struct RefreshOnExit : public boost::noncopyable
 {
    ~RefreshOnExit()
    {
+      s_statusCache.invalidate();
       module_context::enqueClientEvent(ClientEvent(client_events::kVcsRefresh));
    }
 };
@@ -889,7 +1631,7 @@ Error vcsFullStatus(const json::JsonRpcRequest&,
                     json::JsonRpcResponse* pResponse)
 {
    StatusResult statusResult;
-   Error error = s_pVcsImpl_->status(s_pVcsImpl_->root(), &statusResult);
+   Error error = s_statusCache.status(s_pVcsImpl_->root(), &statusResult);
    if (error)
       return error;
 
@@ -1104,9 +1846,34 @@ core::Error initialize()
    else
       s_pVcsImpl_.reset(new VCSImpl(workingDir));
 
+   // monitor the repository so that cached status can be kept up to date
+   // (a repository rooted at the project directory is already monitored
+   // recursively for code search so its events are shared)
+   FilePath projectDir = projects::projectContext().directory();
+   if (s_pVcsImpl_->id() != VCSNone &&
+       code_search::enabled() &&
+       s_pVcsImpl_->root().absolutePath() == projectDir.absolutePath())
+   {
+      s_usesProjectMonitor = true;
+   }
+   else if (s_pVcsImpl_->id() != VCSNone)
+   {
+      core::system::file_monitor::Callbacks cb;
+      cb.onRegistered = onStatusMonitorRegistered;
+      cb.onRegistrationError = onStatusMonitorError;
+      cb.onMonitoringError = onStatusMonitorError;
+      cb.onFilesChanged = onStatusFilesChanged;
+      core::system::file_monitor::registerMonitor(s_pVcsImpl_->root(),
+                                                  true,
+                                                  statusMonitorFilter,
+                                                  cb);
+   }
+
    // install rpc methods
    using boost::bind;
    using namespace module_context;
+   events().onDetectChanges.connect(bind(onDetectChanges, _1));
+
    ExecBlock initBlock ;
    initBlock.addFunctions()
       (bind(registerRpcMethod, "vcs_add", vcsAdd))
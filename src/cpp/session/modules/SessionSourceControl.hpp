@@ -19,6 +19,9 @@
 
 namespace core {
    class Error;
+   namespace system {
+      class FileChangeEvent;
+   }
 }
 
 namespace session {
@@ -79,6 +82,13 @@ VCS activeVCS();
 std::string activeVCSName();
 core::Error status(const core::FilePath& dir, StatusResult* pStatusResult);
 core::Error fileStatus(const core::FilePath& filePath, VCSStatus* pStatus);
+
+// notifications from the project's file monitor (which keeps the cached
+// status of a repository rooted at the project directory up to date)
+void onProjectMonitorRegistered();
+void onProjectMonitorError();
+void onProjectFilesChanged(
+                  const std::vector<core::system::FileChangeEvent>& events);
 core::Error initialize();
 
 } // namespace source_control
@@ -18,6 +18,8 @@
 #include <boost/bind.hpp>
 #include <boost/format.hpp>
 #include <boost/utility.hpp>
+#include <boost/foreach.hpp>
+#include <boost/unordered_map.hpp>
 
 #include <core/Error.hpp>
 #include <core/Log.hpp>
@@ -147,16 +149,16 @@ void enqueRefreshEvent()
    module_context::enqueClientEvent(refreshEvent);
 }
 
-void enqueRemovedEvent(const r::sexp::Variable& variable)   
+void enqueRemovedEvent(const std::string& name)
 {
-   ClientEvent removedEvent(client_events::kWorkspaceRemove, variable.first);
+   ClientEvent removedEvent(client_events::kWorkspaceRemove, name);
    module_context::enqueClientEvent(removedEvent);
 }
 
-void enqueAssignedEvent(const r::sexp::Variable& variable)
+void enqueAssignedEvent(const std::string& name)
 {   
    // get object info
-   json::Value objInfo = jsonValueForGlobalVar(variable.first);
+   json::Value objInfo = jsonValueForGlobalVar(name);
    
    // enque event
    ClientEvent assignedEvent(client_events::kWorkspaceAssign, objInfo);
@@ -215,9 +217,13 @@ void onResume(const Settings& settings)
 }
 
 
-// detect changes in the environment by inspecting the list of variable
-// names as well as the SEXP pointers (a new pointer implies a mutation of
-// an object)
+// detect changes in the environment by inspecting its bindings (a new
+// value pointer implies a mutation of an object). the bindings are read
+// directly from the environment's frame and compared with those from the
+// last check, so in the common case of no changes nothing is allocated or
+// evaluated. when there are changes they are found using an index of the
+// bindings by symbol and only the changed bindings are described to the
+// client
 class GlobalEnvironmentMonitor : boost::noncopyable
 {
 public:
@@ -229,15 +235,27 @@ public:
    void reset()
    {
       initialized_ = false;
+      lastBindings_.clear();
       lastEnv_.clear();
    }
    
    void checkForChanges()
    {
-      // get the current environment
-      std::vector<r::sexp::Variable> currentEnv ;
-      listEnvironment(&currentEnv);
-      
+      // get the current bindings
+      r::sexp::listEnvironmentBindings(R_GlobalEnv, false, &bindings_);
+
+      // if they are identical to the last ones (same symbols with the
+      // same values in the same order) then there are no changes
+      if (initialized_ && bindings_ == lastBindings_)
+         return;
+
+      // index the current bindings by symbol (symbols are unique by name)
+      Environment currentEnv;
+      BOOST_FOREACH(const r::sexp::Binding& binding, bindings_)
+      {
+         currentEnv[binding.first] = binding.second;
+      }
+
       // force refresh event the first time
       if (!initialized_)
       {
@@ -245,73 +263,73 @@ public:
          initialized_ = true;
       }
       
-      // if there are changes
-      else if (currentEnv != lastEnv_)
-      {      
-         // optimize for empty currentEnv (user reset workspace) or empty 
-         // lastEnv_ (startup) by just sending a single WorkspaceRefresh event
-         if (currentEnv.empty() || lastEnv_.empty())
+      // optimize for empty currentEnv (user reset workspace) or empty 
+      // lastEnv_ (startup) by just sending a single WorkspaceRefresh event
+      else if (currentEnv.empty() || lastEnv_.empty())
+      {
+         enqueRefreshEvent();
+      }
+
+      else
+      {
+         // find deletes (all symbols in the previous environment but NOT
+         // in the current environment)
+         std::vector<std::string> removedVars;
+         for (Environment::const_iterator it = lastEnv_.begin();
+              it != lastEnv_.end();
+              ++it)
          {
-            enqueRefreshEvent();
+            if (currentEnv.find(it->first) == currentEnv.end())
+               removedVars.push_back(symbolName(it->first));
          }
-         else
+
+         // find adds & assigns (all symbols in the current environment
+         // which weren't in the previous environment or had another value)
+         std::vector<std::string> assignedVars;
+         for (Environment::const_iterator it = currentEnv.begin();
+              it != currentEnv.end();
+              ++it)
          {
-            // find deletes (all variable names in the previous environment but
-            // NOT in the current environment)
-            std::vector<Variable> removedVars ;
-            std::set_difference(lastEnv_.begin(), lastEnv_.end(),
-                                currentEnv.begin(), currentEnv.end(),
-                                std::back_inserter(removedVars),
-                                boost::bind(
-                                  &GlobalEnvironmentMonitor::compareVarName,
-                                  this, _1, _2));
-                                
-            // fire removed event for deletes
-            std::for_each(removedVars.begin(), 
-                          removedVars.end(), 
-                          enqueRemovedEvent);
-            
-            // find adds & assigns (all variable name/value combinations in the 
-            // current environment but NOT in the previous environment)
-            std::vector<Variable> addedVars ;
-            std::set_difference(currentEnv.begin(), currentEnv.end(),
-                                lastEnv_.begin(), lastEnv_.end(),
-                                std::back_inserter(addedVars));
-                                
-            // fire assigned event for adds & assigns
-            std::for_each(addedVars.begin(), 
-                          addedVars.end(), 
-                          enqueAssignedEvent);
+            Environment::const_iterator lastIt = lastEnv_.find(it->first);
+            if (lastIt == lastEnv_.end() || lastIt->second != it->second)
+               assignedVars.push_back(symbolName(it->first));
          }
+
+         // fire events (in name order)
+         std::sort(removedVars.begin(), removedVars.end());
+         std::for_each(removedVars.begin(),
+                       removedVars.end(),
+                       enqueRemovedEvent);
+
+         std::sort(assignedVars.begin(), assignedVars.end());
+         std::for_each(assignedVars.begin(),
+                       assignedVars.end(),
+                       enqueAssignedEvent);
       }
       
-      // set the "last environment" list to the current env
-      // note that the SEXP values within the currentEnv are not protected
-      // beyond the scope of this call. this is OK because we only reference
-      // the pointer values not the underlying R objects. if we want to be
+      // set the "last environment" to the current one
+      // note that the SEXP values within it are not protected beyond the
+      // scope of this call. this is OK because we only reference the
+      // pointer values not the underlying R objects. if we want to be
       // able to manipulate the SEXPs directly we'll need a static protection
       // context so the objects are guaranteed to survive until the next call
-      lastEnv_ = currentEnv;
+      lastEnv_.swap(currentEnv);
+      lastBindings_.swap(bindings_);
    }
    
 private:
-   
-   void listEnvironment(std::vector<r::sexp::Variable>* pEnvironment)
-   {
-      // get the variables currently in the global environment (note this list
-      // is guaranteed to be sorted based on the behavior of R_lsInternal)
-      r::sexp::Protect rProtect;
-      r::sexp::listEnvironment(R_GlobalEnv, false, &rProtect, pEnvironment);   
-   }
-   
-   // helper to deterine whether two variables have the same name
-   bool compareVarName(const Variable& var1, const Variable& var2)
+   typedef boost::unordered_map<SEXP,SEXP> Environment;
+
+   static std::string symbolName(SEXP symbolSEXP)
    {
-      return var1.first < var2.first ;
+      return std::string(CHAR(PRINTNAME(symbolSEXP)));
    }
    
 private:
-   std::vector<r::sexp::Variable> lastEnv_; 
+   // current and last bindings (both retain their capacity between checks)
+   std::vector<r::sexp::Binding> bindings_;
+   std::vector<r::sexp::Binding> lastBindings_;
+   Environment lastEnv_;
    bool initialized_ ;
 };
 
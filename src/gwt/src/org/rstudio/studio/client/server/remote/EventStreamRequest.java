@@ -0,0 +1,202 @@
+/*
+ * EventStreamRequest.java
+ *
+ * Copyright (C) 2009-11 by RStudio, Inc.
+ *
+ * This program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+package org.rstudio.studio.client.server.remote;
+
+import com.google.gwt.core.client.JavaScriptObject;
+import com.google.gwt.json.client.JSONArray;
+import com.google.gwt.json.client.JSONNumber;
+import com.google.gwt.json.client.JSONObject;
+import com.google.gwt.json.client.JSONString;
+import com.google.gwt.user.client.Random;
+import org.rstudio.core.client.jsonrpc.RpcResponse;
+
+// Request for the stream_events endpoint. The server keeps the request
+// open and writes a json-rpc response (one per line) for each batch of
+// events as it occurs. We read these from the XMLHttpRequest as they
+// arrive (rather than waiting for the request to complete)
+class EventStreamRequest
+{
+   interface Callback
+   {
+      // called for each response read from the stream
+      void onResponse(RpcResponse response);
+
+      // called when the server ends the stream
+      void onEnd();
+
+      // called if the request fails (the status is 0 if the connection
+      // couldn't be established or was terminated)
+      void onError(int status);
+   }
+
+   public EventStreamRequest(String url,
+                             int lastEventId,
+                             String clientId,
+                             double clientVersion)
+   {
+      url_ = url;
+
+      JSONArray params = new JSONArray();
+      params.set(0, new JSONNumber(lastEventId));
+
+      JSONObject request = new JSONObject();
+      request.put("method", new JSONString("stream_events"));
+      request.put("params", params);
+      if (clientId != null)
+         request.put("clientId", new JSONString(clientId));
+      request.put("version", new JSONNumber(clientVersion));
+      body_ = request.toString();
+   }
+
+   public void send(Callback callback)
+   {
+      callback_ = callback;
+      xhr_ = sendNative(url_, body_, Integer.toString(Random.nextInt()));
+   }
+
+   public void cancel()
+   {
+      callback_ = null;
+      if (xhr_ != null)
+      {
+         abortNative(xhr_);
+         xhr_ = null;
+      }
+   }
+
+   private native JavaScriptObject sendNative(String url,
+                                              String body,
+                                              String requestId) /*-{
+      var self = this;
+      var xhr = new XMLHttpRequest();
+
+      xhr.onreadystatechange = $entry(function() {
+         if (xhr.readyState == 3 || xhr.readyState == 4) {
+            var text = xhr.status == 200 ? xhr.responseText : null;
+            self.@org.rstudio.studio.client.server.remote.EventStreamRequest::onReadyStateChange(IILjava/lang/String;)(xhr.readyState, xhr.status, text);
+         }
+      });
+
+      xhr.open("POST", url, true);
+      xhr.setRequestHeader("Content-Type", "application/json");
+      xhr.setRequestHeader("Accept", "application/json");
+      xhr.setRequestHeader("X-RS-RID", requestId);
+      xhr.send(body);
+      return xhr;
+   }-*/;
+
+   private native void abortNative(JavaScriptObject xhr) /*-{
+      xhr.onreadystatechange = function() {};
+      xhr.abort();
+   }-*/;
+
+   // package visible so the stream handling can be tested without a server
+   void setCallback(Callback callback)
+   {
+      callback_ = callback;
+   }
+
+   void onReadyStateChange(int readyState, int status, String text)
+   {
+      if (readyState == 3)
+      {
+         if (status == 200)
+            readLines(text, false);
+      }
+      else if (readyState == 4)
+      {
+         xhr_ = null;
+         if (status != 200)
+         {
+            onError(status);
+            return;
+         }
+
+         readLines(text, true);
+
+         // a stream always starts with a line (the server sends its first
+         // batch of events even if it is empty) so if we didn't read any
+         // the server didn't stream to us and we shouldn't reconnect
+         if (linesRead_ == 0)
+            onError(status);
+         else
+            onEnd();
+      }
+   }
+
+   // pass on each complete line that has arrived since we last looked. once
+   // the request is complete any unterminated remainder is also a line
+   private void readLines(String text, boolean complete)
+   {
+      if (text == null)
+         return;
+
+      int end;
+      while (callback_ != null && (end = text.indexOf('\n', offset_)) != -1)
+      {
+         String line = text.substring(offset_, end);
+         offset_ = end + 1;
+         if (line.length() > 0)
+            onLine(line);
+      }
+
+      if (complete && callback_ != null && offset_ < text.length())
+      {
+         String line = text.substring(offset_);
+         offset_ = text.length();
+         if (line.trim().length() > 0)
+            onLine(line);
+      }
+   }
+
+   private void onLine(String line)
+   {
+      if (callback_ == null)
+         return;
+
+      linesRead_++;
+      RpcResponse response = RpcResponse.parse(line);
+      if (response != null)
+         callback_.onResponse(response);
+      else
+         onError(0);
+   }
+
+   private void onEnd()
+   {
+      xhr_ = null;
+      if (callback_ != null)
+         callback_.onEnd();
+   }
+
+   private void onError(int status)
+   {
+      if (xhr_ != null)
+      {
+         abortNative(xhr_);
+         xhr_ = null;
+      }
+
+      Callback callback = callback_;
+      callback_ = null;
+      if (callback != null)
+         callback.onError(status);
+   }
+
+   private final String url_;
+   private final String body_;
+   private Callback callback_ = null;
+   private JavaScriptObject xhr_ = null;
+   private int offset_ = 0;
+   private int linesRead_ = 0;
+}
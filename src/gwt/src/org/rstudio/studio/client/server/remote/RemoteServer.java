@@ -1311,6 +1311,18 @@ public class RemoteServer implements Server
                          retryHandler);
    }
    
+   EventStreamRequest streamEvents(int lastEventId,
+                                   EventStreamRequest.Callback callback)
+   {
+      EventStreamRequest request = new EventStreamRequest(
+                        getApplicationURL(EVENTS_SCOPE) + "/stream_events",
+                        lastEventId,
+                        clientId_,
+                        clientVersion_);
+      request.send(callback);
+      return request;
+   }
+   
    void handleUnauthorizedError()
    {
       // disconnect
@@ -237,6 +237,11 @@ class RemoteServerEventListener
          activeRequest_.cancel();
          activeRequest_ = null;
       }
+      if (activeStream_ != null)
+      {
+         activeStream_.cancel();
+         activeStream_ = null;
+      }
    }
    
    // ensure that we are actively listening for events (used to make 
@@ -344,6 +349,13 @@ class RemoteServerEventListener
       // abort if we are no longer running
       if (!isListening_)
          return;
+
+      // use an event stream unless that has failed
+      if (!streamingDisabled_)
+      {
+         doListenStream();
+         return;
+      }
           
       // setup request callback (save reference for cancellation)
       activeRequestCallback_ = new ServerRequestCallback<JsArray<ClientEvent>>() 
@@ -354,36 +366,10 @@ class RemoteServerEventListener
             // keep watchdog appraised of successful receipt of events
             watchdog_.notifyResponseReceived();
             
-            try
-            {
-               // only processs events if we are still listening
-               if (isListening_ && (events != null))
-               {
-                  for (int i=0; i<events.length(); i++)
-                  {
-                     // we can stop listening in the middle of dispatching
-                     // events (e.g. if we dispatch a Suicide event) so we 
-                     // need to check the listening_ flag before each event
-                     // is dispatched
-                     if (!isListening_)
-                        return;
-                     
-                     // disppatch event
-                     ClientEvent event = events.get(i);
-                     enqueueEventForDispatch(event);
-                     lastEventId_ = event.getId();
-                  }   
-               }
-            }
-            // catch all here to make sure that in all cases we call
-            // listen() again after processing
-            catch(Throwable e)
-            {
-               GWT.log("ERROR: Processing client events", e);
-            }
-            
-            // listen for more events
-            listen();
+            // only listen again if we are still listening after
+            // processing the events
+            if (processEvents(events))
+               listen();
          }
          
          @Override
@@ -453,6 +439,103 @@ class RemoteServerEventListener
                                          retryHandler);                             
    }
 
+   // the server writes each batch of events to the stream as it occurs
+   // and ends the stream when we need to reconnect (we then acknowledge
+   // the events we have received by passing the last event id). if the
+   // stream can't be established then we go back to using get_events
+   // (which also deals with any errors reported by the server)
+   private void doListenStream()
+   {
+      activeStream_ = server_.streamEvents(lastEventId_,
+                                           new EventStreamRequest.Callback()
+      {
+         public void onResponse(RpcResponse response)
+         {
+            // keep watchdog appraised of successful receipt of events
+            watchdog_.notifyResponseReceived();
+
+            if (response.getError() != null)
+            {
+               disableStreaming();
+               return;
+            }
+
+            streamResponseReceived_ = true;
+            JsArray<ClientEvent> events = response.getResult();
+            processEvents(events);
+         }
+
+         public void onEnd()
+         {
+            activeStream_ = null;
+            if (isListening_)
+               listen();
+         }
+
+         public void onError(int status)
+         {
+            activeStream_ = null;
+            if (!isListening_)
+               return;
+
+            // if the stream previously worked and the connection was
+            // dropped then just reconnect (any other failure means the
+            // server isn't streaming to us so we use get_events instead)
+            if (streamResponseReceived_ && status == 0)
+               listen();
+            else
+               disableStreaming();
+         }
+      });
+   }
+
+   private void disableStreaming()
+   {
+      if (activeStream_ != null)
+      {
+         activeStream_.cancel();
+         activeStream_ = null;
+      }
+
+      streamingDisabled_ = true;
+      if (isListening_)
+         listen();
+   }
+
+   // dispatch events. returns false if we stopped listening as a result
+   private boolean processEvents(JsArray<ClientEvent> events)
+   {
+      try
+      {
+         // only processs events if we are still listening
+         if (isListening_ && (events != null))
+         {
+            for (int i=0; i<events.length(); i++)
+            {
+               // we can stop listening in the middle of dispatching
+               // events (e.g. if we dispatch a Suicide event) so we 
+               // need to check the listening_ flag before each event
+               // is dispatched
+               if (!isListening_)
+                  return false;
+               
+               // disppatch event
+               ClientEvent event = events.get(i);
+               enqueueEventForDispatch(event);
+               lastEventId_ = event.getId();
+            }   
+         }
+      }
+      // catch all here to make sure that in all cases we listen
+      // again after processing
+      catch(Throwable e)
+      {
+         GWT.log("ERROR: Processing client events", e);
+      }
+
+      return true;
+   }
+
    private void enqueueEventForDispatch(ClientEvent event)
    {
       pendingEvents_.add(event);
@@ -802,6 +885,10 @@ class RemoteServerEventListener
    private RpcRequest activeRequest_ ;
    private ServerRequestCallback<JsArray<ClientEvent>> activeRequestCallback_;
 
+   private EventStreamRequest activeStream_ ;
+   private boolean streamResponseReceived_ = false;
+   private boolean streamingDisabled_ = false;
+
    private final ArrayList<ClientEvent> pendingEvents_ = new ArrayList<ClientEvent>();
    
    private Watchdog watchdog_ = new Watchdog();
@@ -0,0 +1,106 @@
+/*
+ * EventStreamRequestTests.java
+ *
+ * Copyright (C) 2009-11 by RStudio, Inc.
+ *
+ * This program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+package org.rstudio.studio.client.server.remote;
+
+import junit.framework.Assert ;
+
+import com.google.gwt.junit.client.GWTTestCase ;
+import org.rstudio.core.client.jsonrpc.RpcError;
+import org.rstudio.core.client.jsonrpc.RpcResponse;
+
+public class EventStreamRequestTests extends GWTTestCase
+{
+   @Override
+   public String getModuleName()
+   {
+      return "org.rstudio.studio.RStudio" ;
+   }
+
+   // a stale client (e.g. another tab took over the client id) is sent an
+   // unterminated json-rpc error. this must reach onResponse (which makes
+   // the listener fall back to get_events) rather than ending the stream
+   // (which would make the listener reconnect over and over)
+   public void testStaleClientError()
+   {
+      Recorder recorder = new Recorder() ;
+      EventStreamRequest request = createRequest(recorder) ;
+      String body = "{\"error\":{\"code\":4,\"message\":\"Invalid client id\"}}" ;
+      request.onReadyStateChange(3, 200, body) ;
+      Assert.assertEquals(0, recorder.responses) ;
+      request.onReadyStateChange(4, 200, body) ;
+
+      Assert.assertEquals(1, recorder.responses) ;
+      Assert.assertNotNull(recorder.lastError) ;
+      Assert.assertEquals(RpcError.INVALID_CLIENT_ID,
+                          recorder.lastError.getCode()) ;
+      Assert.assertEquals(0, recorder.ends) ;
+   }
+
+   public void testEmptyStream()
+   {
+      Recorder recorder = new Recorder() ;
+      EventStreamRequest request = createRequest(recorder) ;
+      request.onReadyStateChange(4, 200, "") ;
+
+      Assert.assertEquals(0, recorder.responses) ;
+      Assert.assertEquals(0, recorder.ends) ;
+      Assert.assertEquals(200, recorder.errorStatus) ;
+   }
+
+   public void testStream()
+   {
+      Recorder recorder = new Recorder() ;
+      EventStreamRequest request = createRequest(recorder) ;
+      String text = "{\"result\":[]}\n{\"res" ;
+      request.onReadyStateChange(3, 200, text) ;
+      Assert.assertEquals(1, recorder.responses) ;
+      text += "ult\":[]}\n" ;
+      request.onReadyStateChange(4, 200, text) ;
+
+      Assert.assertEquals(2, recorder.responses) ;
+      Assert.assertNull(recorder.lastError) ;
+      Assert.assertEquals(1, recorder.ends) ;
+      Assert.assertEquals(-1, recorder.errorStatus) ;
+   }
+
+   private EventStreamRequest createRequest(Recorder recorder)
+   {
+      EventStreamRequest request = new EventStreamRequest("", 0, "", 1.0) ;
+      request.setCallback(recorder) ;
+      return request ;
+   }
+
+   private class Recorder implements EventStreamRequest.Callback
+   {
+      public void onResponse(RpcResponse response)
+      {
+         responses++ ;
+         lastError = response.getError() ;
+      }
+
+      public void onEnd()
+      {
+         ends++ ;
+      }
+
+      public void onError(int status)
+      {
+         errorStatus = status ;
+      }
+
+      int responses = 0 ;
+      int ends = 0 ;
+      int errorStatus = -1 ;
+      RpcError lastError = null ;
+   }
+}
@@ -0,0 +1,315 @@
+/*
+ * dataviewer.js
+ *
+ * Copyright (C) 2009-11 by RStudio, Inc.
+ *
+ * This program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+// Virtualized viewer for data frames. Only the visible window of rows and
+// columns is requested from the session (which formats, sorts, and filters
+// the data on the server side).
+var dataViewer = (function() {
+
+   var ROW_HEIGHT = 20;
+   // browsers limit the height of elements (to as little as ~1.5M pixels)
+   // so for large data sets the scroll position maps to rows proportionally
+   var MAX_SPACER_HEIGHT = 1000000;
+   var PAGE_COLUMNS = 50;
+   var PREFETCH_ROWS = 50;
+
+   var url_, id_;
+   var totalRows_, totalColumns_;
+   var firstColumn_ = 0;
+   var sortColumn_ = -1, sortDescending_ = false;
+   var filterColumn_ = -1, filter_ = "";
+   var window_ = null;
+   var requestId_ = 0;
+   var scrollTimer_ = null;
+
+   var viewport_, spacer_, table_, status_, filterColumnSelect_, filterInput_;
+
+   function el(tag, className, text) {
+      var e = document.createElement(tag);
+      if (className)
+         e.className = className;
+      if (text !== undefined && text !== null)
+         e.appendChild(document.createTextNode(text));
+      return e;
+   }
+
+   function setStatus(text) {
+      status_.innerHTML = "";
+      status_.appendChild(document.createTextNode(text));
+   }
+
+   function visibleRows() {
+      return Math.ceil(viewport_.clientHeight / ROW_HEIGHT);
+   }
+
+   function isScaled() {
+      return (totalRows_ + 1) * ROW_HEIGHT > MAX_SPACER_HEIGHT;
+   }
+
+   function setSpacerHeight() {
+      var height = Math.min((totalRows_ + 1) * ROW_HEIGHT, MAX_SPACER_HEIGHT);
+      spacer_.style.height = height + "px";
+   }
+
+   // the row displayed at the top of the viewport
+   function firstVisibleRow() {
+      if (!isScaled())
+         return Math.floor(viewport_.scrollTop / ROW_HEIGHT);
+
+      var scrollRange = MAX_SPACER_HEIGHT - viewport_.clientHeight;
+      var rowRange = Math.max(totalRows_ + 1 - visibleRows(), 0);
+      if (scrollRange <= 0)
+         return 0;
+      var fraction = Math.min(viewport_.scrollTop / scrollRange, 1);
+      return Math.floor(fraction * rowRange);
+   }
+
+   function queryString(params) {
+      var parts = [];
+      for (var name in params)
+         parts.push(name + "=" + encodeURIComponent(params[name]));
+      return parts.join("&");
+   }
+
+   // the row numbers and formatted columns of a window are sent as typed
+   // columns (see dataWindow in SessionData.cpp)
+   function unpackWindow(result) {
+      var w = {
+         totalRows: result.totalRows,
+         totalColumns: result.totalColumns,
+         firstRow: result.firstRow,
+         firstColumn: result.firstColumn,
+         rowNumbers: result.rowNumbers.values,
+         columnNames: [],
+         columns: []
+      };
+      var columns = result.data.columns;
+      for (var c = 0; c < columns.length; c++) {
+         w.columnNames.push(columns[c].name);
+         w.columns.push(columns[c].values);
+      }
+      return w;
+   }
+
+   function requestWindow() {
+      var firstRow = firstVisibleRow();
+      var first = Math.max(firstRow - PREFETCH_ROWS, 0);
+
+      // nothing to do if the current window already covers the view
+      if (window_ !== null &&
+          window_.firstColumn === firstColumn_ &&
+          first >= window_.firstRow &&
+          firstRow + visibleRows() <=
+                  window_.firstRow + window_.rowNumbers.length) {
+         render(firstRow);
+         return;
+      }
+
+      var params = {
+         id: id_,
+         row: first,
+         rows: visibleRows() + 2 * PREFETCH_ROWS,
+         col: firstColumn_,
+         cols: PAGE_COLUMNS,
+         sort: sortColumn_,
+         dir: sortDescending_ ? "desc" : "asc",
+         filter_col: filterColumn_,
+         filter: filter_
+      };
+
+      var requestId = ++requestId_;
+      var xhr = new XMLHttpRequest();
+      xhr.open("GET", url_ + "?" + queryString(params), true);
+      xhr.onreadystatechange = function() {
+         if (xhr.readyState !== 4 || requestId !== requestId_)
+            return;
+
+         var response = null;
+         try {
+            response = JSON.parse(xhr.responseText);
+         }
+         catch(e) {
+         }
+
+         if (xhr.status !== 200 || response === null || response.error) {
+            setStatus("The data is no longer available (use View to " +
+                      "display it again) or the filter is invalid");
+            return;
+         }
+
+         window_ = unpackWindow(response.result);
+         totalRows_ = window_.totalRows;
+         setSpacerHeight();
+         render(firstVisibleRow());
+      };
+      xhr.send(null);
+   }
+
+   function onHeaderClick(column) {
+      return function() {
+         if (sortColumn_ === column)
+            sortDescending_ = !sortDescending_;
+         else {
+            sortColumn_ = column;
+            sortDescending_ = false;
+         }
+         window_ = null;
+         requestWindow();
+      };
+   }
+
+   function render(firstRow) {
+      var w = window_;
+      var offset = Math.max(firstRow - w.firstRow, 0);
+      var count = Math.min(visibleRows(), w.rowNumbers.length - offset);
+
+      var table = el("table");
+      var thead = el("thead");
+      var tr = el("tr");
+      var origin = el("td", null, "\u00A0");
+      origin.id = "origin";
+      tr.appendChild(origin);
+      for (var c = 0; c < w.columnNames.length; c++) {
+         var column = w.firstColumn + c;
+         var name = w.columnNames[c];
+         if (column === sortColumn_)
+            name += sortDescending_ ? " \u25BC" : " \u25B2";
+         var th = el("th", null, name);
+         th.onclick = onHeaderClick(column);
+         tr.appendChild(th);
+      }
+      thead.appendChild(tr);
+      table.appendChild(thead);
+
+      var tbody = el("tbody");
+      for (var r = offset; r < offset + count; r++) {
+         tr = el("tr");
+         tr.appendChild(el("td", "rn", String(w.rowNumbers[r])));
+         for (c = 0; c < w.columns.length; c++) {
+            var value = w.columns[c][r];
+            tr.appendChild(el("td", null, value === null ? "\u00A0" : value));
+         }
+         tbody.appendChild(tr);
+      }
+      table.appendChild(tbody);
+
+      // (when scaled the rows are positioned within the viewport)
+      if (isScaled())
+         table.style.top = viewport_.scrollTop + "px";
+      else
+         table.style.top = (firstRow * ROW_HEIGHT) + "px";
+      updateFilterColumns(w);
+      spacer_.replaceChild(table, table_);
+      table_ = table;
+
+      var lastColumn = Math.min(firstColumn_ + PAGE_COLUMNS, totalColumns_);
+      setStatus(totalRows_ + " rows, columns " + (firstColumn_ + 1) +
+                " to " + lastColumn + " of " + totalColumns_);
+   }
+
+   function onScroll() {
+      if (scrollTimer_ !== null)
+         clearTimeout(scrollTimer_);
+      scrollTimer_ = setTimeout(function() {
+         scrollTimer_ = null;
+         requestWindow();
+      }, 50);
+   }
+
+   function pageColumns(delta) {
+      return function() {
+         var first = firstColumn_ + delta;
+         if (first < 0 || first >= totalColumns_)
+            return;
+         firstColumn_ = first;
+         window_ = null;
+         requestWindow();
+      };
+   }
+
+   function applyFilter() {
+      filterColumn_ = parseInt(filterColumnSelect_.value, 10);
+      filter_ = filterInput_.value;
+      window_ = null;
+      viewport_.scrollTop = 0;
+      requestWindow();
+   }
+
+   // the filter can be applied to any of the columns currently displayed
+   function updateFilterColumns(w) {
+      if (filterColumnSelect_.firstColumn === w.firstColumn)
+         return;
+      filterColumnSelect_.firstColumn = w.firstColumn;
+
+      filterColumnSelect_.innerHTML = "";
+      for (var c = 0; c < w.columnNames.length; c++) {
+         var option = el("option", null, w.columnNames[c]);
+         option.value = String(w.firstColumn + c);
+         option.selected = (w.firstColumn + c) === filterColumn_;
+         filterColumnSelect_.appendChild(option);
+      }
+   }
+
+   function createToolbar() {
+      var toolbar = el("div", "toolbar");
+
+      var prev = el("button", null, "\u25C0");
+      prev.onclick = pageColumns(-PAGE_COLUMNS);
+      var next = el("button", null, "\u25B6");
+      next.onclick = pageColumns(PAGE_COLUMNS);
+      toolbar.appendChild(prev);
+      toolbar.appendChild(next);
+
+      toolbar.appendChild(el("span", "label", "Filter:"));
+      filterColumnSelect_ = el("select");
+      toolbar.appendChild(filterColumnSelect_);
+
+      filterInput_ = el("input");
+      filterInput_.type = "text";
+      filterInput_.title = "Text contained in the value (or for numbers " +
+                           "either a value or a range such as 10..20)";
+      filterInput_.onkeyup = function(e) {
+         e = e || window.event;
+         if (e.keyCode === 13)
+            applyFilter();
+      };
+      toolbar.appendChild(filterInput_);
+
+      status_ = el("span", "status");
+      toolbar.appendChild(status_);
+      return toolbar;
+   }
+
+   return {
+      init: function(url, id, totalRows, totalColumns) {
+         url_ = url;
+         id_ = id;
+         totalRows_ = totalRows;
+         totalColumns_ = totalColumns;
+
+         viewport_ = el("div", "viewport");
+         spacer_ = el("div", "spacer");
+         table_ = el("table");
+         spacer_.appendChild(table_);
+         setSpacerHeight();
+         viewport_.appendChild(spacer_);
+         viewport_.onscroll = onScroll;
+         window.onresize = onScroll;
+
+         document.body.appendChild(createToolbar());
+         document.body.appendChild(viewport_);
+
+         requestWindow();
+      }
+   };
+})();